@@ -34,7 +34,7 @@ size_t
 array_brackets_calculate_size_from_index (struct datatype* dtype, struct array_brackets* brackets, int index)
 {
     struct vector* array_vec = array_brackets_node_vector(brackets);
-    size_t size = dtype->size;
+    size_t size = datatype_element_size (dtype);
     if (index >= vector_count(array_vec))
     {
         /* char* abc;
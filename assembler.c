@@ -0,0 +1,2535 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <ctype.h>
+#include <elf.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Assembles the subset of NASM codegen prints straight into an ELF
+   relocatable object.  Lines are encoded as they arrive, jumps are
+   kept aside as fragments until every label is known so the close
+   ones can use the two byte form.  References to symbols go through
+   the fixup system and become relocations when they point outside
+   of their section.  After `bits 64` the code is x86-64, symbols in
+   memory operands are relative to rip and the object is ELF64.  */
+
+#define ASSEMBLER_MAX_OPERANDS 3
+#define ASSEMBLER_MAX_NAME 256
+
+enum
+{
+    ASSEMBLER_OPERAND_REGISTER,
+    ASSEMBLER_OPERAND_MEMORY,
+    ASSEMBLER_OPERAND_IMMEDIATE
+};
+
+struct assembler_operand
+{
+    int type;
+    /* In bytes, 0 when the operand does not say.  */
+    int size;
+    /* The register, or the base of a memory operand, -1 for none.  */
+    int reg;
+    /* The index register of a memory operand, -1 for none, and what
+       it is multiplied by.  */
+    int index;
+    int scale;
+    /* spl, bpl, sil and dil, which only exist with a REX prefix.  */
+    bool needs_rex;
+    long long value;
+    /* Empty when no symbol is involved.  */
+    char symbol[ASSEMBLER_MAX_NAME];
+    /* The symbol of `symbol - base`, a label of the current section,
+       empty when nothing is subtracted.  */
+    char base[ASSEMBLER_MAX_NAME];
+};
+
+struct assembler_register
+{
+    const char* name;
+    /* 8 to 15 are r8 to r15, only on x86-64.  */
+    int number;
+    int size;
+    bool needs_rex;
+};
+
+static const struct assembler_register assembler_registers[] = {
+    {"eax", 0, 4}, {"ecx", 1, 4}, {"edx", 2, 4}, {"ebx", 3, 4},
+    {"esp", 4, 4}, {"ebp", 5, 4}, {"esi", 6, 4}, {"edi", 7, 4},
+    {"ax", 0, 2}, {"cx", 1, 2}, {"dx", 2, 2}, {"bx", 3, 2},
+    {"sp", 4, 2}, {"bp", 5, 2}, {"si", 6, 2}, {"di", 7, 2},
+    {"al", 0, 1}, {"cl", 1, 1}, {"dl", 2, 1}, {"bl", 3, 1},
+    {"ah", 4, 1}, {"ch", 5, 1}, {"dh", 6, 1}, {"bh", 7, 1},
+    {"rax", 0, 8}, {"rcx", 1, 8}, {"rdx", 2, 8}, {"rbx", 3, 8},
+    {"rsp", 4, 8}, {"rbp", 5, 8}, {"rsi", 6, 8}, {"rdi", 7, 8},
+    {"spl", 4, 1, true}, {"bpl", 5, 1, true}, {"sil", 6, 1, true},
+    {"dil", 7, 1, true},
+    {"r8", 8, 8}, {"r9", 9, 8}, {"r10", 10, 8}, {"r11", 11, 8},
+    {"r12", 12, 8}, {"r13", 13, 8}, {"r14", 14, 8}, {"r15", 15, 8},
+    {"r8d", 8, 4}, {"r9d", 9, 4}, {"r10d", 10, 4}, {"r11d", 11, 4},
+    {"r12d", 12, 4}, {"r13d", 13, 4}, {"r14d", 14, 4}, {"r15d", 15, 4},
+    {"r8w", 8, 2}, {"r9w", 9, 2}, {"r10w", 10, 2}, {"r11w", 11, 2},
+    {"r12w", 12, 2}, {"r13w", 13, 2}, {"r14w", 14, 2}, {"r15w", 15, 2},
+    {"r8b", 8, 1}, {"r9b", 9, 1}, {"r10b", 10, 1}, {"r11b", 11, 1},
+    {"r12b", 12, 1}, {"r13b", 13, 1}, {"r14b", 14, 1}, {"r15b", 15, 1},
+    {NULL, 0, 0}
+};
+
+struct assembler_condition
+{
+    const char* name;
+    int code;
+};
+
+static const struct assembler_condition assembler_conditions[] = {
+    {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3},
+    {"nb", 3}, {"nc", 3}, {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5},
+    {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7}, {"s", 8}, {"ns", 9},
+    {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11}, {"l", 12}, {"nge", 12},
+    {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+    {NULL, 0}
+};
+
+typedef void (*ASSEMBLER_ENCODE) (struct assembler* assembler, int code,
+                                  struct assembler_operand* operands,
+                                  int total_operands);
+
+struct assembler_mnemonic
+{
+    const char* name;
+    ASSEMBLER_ENCODE encode;
+    /* Opcode, `/digit` extension or condition code of the mnemonic.  */
+    int code;
+};
+
+static void
+assembler_fail (struct assembler* assembler, const char* message, const char* what)
+{
+    compiler_error (assembler->process, "assembler: %s \"%s\"", message, what);
+}
+
+static struct assembler_section*
+assembler_section_new (struct assembler* assembler, const char* name)
+{
+    struct assembler_section* section = \
+                    calloc (1, sizeof (struct assembler_section));
+    section->name = strdup (name);
+    if (!S_EQ (name, ".bss"))
+    {
+        section->bytes = buffer_create ();
+    }
+    section->fragments = vector_create (sizeof (struct assembler_fragment));
+    section->relocations = vector_create (sizeof (struct assembler_relocation));
+    section->alignment = S_EQ (name, ".text") ? 16 : 1;
+    vector_push (assembler->sections, &section);
+    return section;
+}
+
+struct assembler*
+assembler_new (struct compile_process* process)
+{
+    struct assembler* assembler = calloc (1, sizeof (struct assembler));
+    assembler->process = process;
+    assembler->sections = vector_create (sizeof (struct assembler_section*));
+    assembler->symbols = vector_create (sizeof (struct assembler_symbol*));
+    assembler->total_buckets = ASSEMBLER_INITIAL_BUCKETS;
+    assembler->buckets = calloc (ASSEMBLER_INITIAL_BUCKETS,
+                                 sizeof (struct assembler_symbol*));
+    assembler->fixups = fixup_sys_new ();
+    assembler->bits = 32;
+    assembler->section = assembler_section_new (assembler, ".text");
+    return assembler;
+}
+
+void
+assembler_free (struct assembler* assembler)
+{
+    fixup_sys_free (assembler->fixups);
+    for (int i = 0; i < vector_count (assembler->sections); i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        for (int j = 0; j < vector_count (section->fragments); j++)
+        {
+            struct assembler_fragment* fragment = \
+                            vector_at (section->fragments, j);
+            free (fragment->target);
+        }
+
+        if (section->bytes)
+        {
+            buffer_free (section->bytes);
+        }
+        vector_free (section->fragments);
+        vector_free (section->relocations);
+        free (section->image);
+        free (section->name);
+        free (section);
+    }
+
+    for (int i = 0; i < vector_count (assembler->symbols); i++)
+    {
+        struct assembler_symbol* symbol = \
+                        vector_peek_ptr_at (assembler->symbols, i);
+        free (symbol->name);
+        free (symbol->alias);
+        free (symbol);
+    }
+
+    vector_free (assembler->sections);
+    vector_free (assembler->symbols);
+    free (assembler->buckets);
+    free (assembler->scope);
+    free (assembler);
+}
+
+static void
+assembler_symbols_grow (struct assembler* assembler)
+{
+    size_t new_total = assembler->total_buckets * 2;
+    struct assembler_symbol** new_buckets = \
+                    calloc (new_total, sizeof (struct assembler_symbol*));
+    for (int i = 0; i < vector_count (assembler->symbols); i++)
+    {
+        struct assembler_symbol* symbol = \
+                        vector_peek_ptr_at (assembler->symbols, i);
+        size_t index = hash_string (symbol->name, NULL) & (new_total - 1);
+        symbol->next = new_buckets[index];
+        new_buckets[index] = symbol;
+    }
+
+    free (assembler->buckets);
+    assembler->buckets = new_buckets;
+    assembler->total_buckets = new_total;
+}
+
+/* Finds the symbol called `name`, creating it when `create` is set.  */
+static struct assembler_symbol*
+assembler_symbol (struct assembler* assembler, const char* name, bool create)
+{
+    size_t index = hash_string (name, NULL) & (assembler->total_buckets - 1);
+    for (struct assembler_symbol* symbol = assembler->buckets[index]; symbol;
+         symbol = symbol->next)
+    {
+        if (S_EQ (symbol->name, name))
+        {
+            return symbol;
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    if ((size_t) vector_count (assembler->symbols) >= assembler->total_buckets)
+    {
+        assembler_symbols_grow (assembler);
+        index = hash_string (name, NULL) & (assembler->total_buckets - 1);
+    }
+
+    struct assembler_symbol* symbol = calloc (1, sizeof (struct assembler_symbol));
+    symbol->name = strdup (name);
+    symbol->next = assembler->buckets[index];
+    assembler->buckets[index] = symbol;
+    vector_push (assembler->symbols, &symbol);
+    return symbol;
+}
+
+/* Writes the full name of `name` to `out`, labels starting with
+   a dot belong to the last label that did not.  A leading `$` only
+   says that what follows is a name, as in `$eax`.  */
+static void
+assembler_symbol_name (struct assembler* assembler, const char* name,
+                       size_t len, char* out)
+{
+    if (name[0] == '$' && len > 1)
+    {
+        name++;
+        len--;
+    }
+
+    if (name[0] == '.' && assembler->scope)
+    {
+        snprintf (out, ASSEMBLER_MAX_NAME, "%s%.*s",
+                  assembler->scope, (int) len, name);
+        return;
+    }
+
+    snprintf (out, ASSEMBLER_MAX_NAME, "%.*s", (int) len, name);
+}
+
+/* Follows `equ` aliases to the symbol that is defined, the offsets
+   on the way are added to `addend`.  */
+static struct assembler_symbol*
+assembler_symbol_resolve (struct assembler* assembler,
+                          struct assembler_symbol* symbol, long long* addend)
+{
+    int depth = 0;
+    while (symbol && symbol->alias)
+    {
+        if (++depth > 64)
+        {
+            assembler_fail (assembler, "recursive equ for", symbol->name);
+        }
+        *addend += (long long) symbol->offset;
+        symbol = assembler_symbol (assembler, symbol->alias, false);
+    }
+
+    return symbol;
+}
+
+static size_t
+assembler_symbol_address (struct assembler_symbol* symbol)
+{
+    struct assembler_fragment* fragment = \
+                    vector_at (symbol->section->fragments, symbol->fragment);
+    return fragment->address + symbol->offset;
+}
+
+/* Returns the fragment new bytes are added to.  */
+static struct assembler_fragment*
+assembler_bytes_fragment (struct assembler* assembler)
+{
+    struct assembler_section* section = assembler->section;
+    struct assembler_fragment* fragment = vector_back_or_null (section->fragments);
+    if (fragment && fragment->type == ASSEMBLER_FRAGMENT_BYTES)
+    {
+        return fragment;
+    }
+
+    struct assembler_fragment new_fragment = {
+        .type = ASSEMBLER_FRAGMENT_BYTES,
+        .start = section->bytes ? section->bytes->len : 0
+    };
+    vector_push (section->fragments, &new_fragment);
+    return vector_back (section->fragments);
+}
+
+static void
+assembler_byte (struct assembler* assembler, int byte)
+{
+    struct assembler_fragment* fragment = assembler_bytes_fragment (assembler);
+    if (!assembler->section->bytes)
+    {
+        if (byte)
+        {
+            assembler_fail (assembler, "initialised data in",
+                            assembler->section->name);
+        }
+        fragment->length++;
+        return;
+    }
+
+    buffer_write (assembler->section->bytes, (char) byte);
+    fragment->length++;
+}
+
+static void
+assembler_value (struct assembler* assembler, long long value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        assembler_byte (assembler, (int) ((value >> (i * 8)) & 0xff));
+    }
+}
+
+static void
+assembler_reserve (struct assembler* assembler, size_t size)
+{
+    if (assembler->section->bytes)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            assembler_byte (assembler, 0);
+        }
+        return;
+    }
+
+    assembler_bytes_fragment (assembler)->length += size;
+}
+
+static bool
+assembler_fixup_fix (struct fixup* fixup);
+static bool
+assembler_fixup_end (struct fixup* fixup);
+
+/* Records that the four bytes at `offset` of `fragment` hold
+   the address of `symbol`, or the distance to it.  */
+static struct assembler_reference*
+assembler_reference_at (struct assembler* assembler,
+                        struct assembler_section* section, int fragment,
+                        size_t offset, const char* symbol, long long addend,
+                        bool relative)
+{
+    struct assembler_reference* reference = \
+                    calloc (1, sizeof (struct assembler_reference));
+    reference->assembler = assembler;
+    reference->section = section;
+    reference->fragment = fragment;
+    reference->offset = offset;
+    reference->size = 4;
+    reference->symbol = strdup (symbol);
+    reference->addend = addend;
+    reference->relative = relative;
+    assembler_symbol (assembler, symbol, true)->referenced = true;
+    fixup_register (assembler->fixups, &(struct fixup_config) {
+        .fix = assembler_fixup_fix,
+        .end = assembler_fixup_end,
+        .private = reference
+    });
+    return reference;
+}
+
+/* Emits `size` bytes the fixup of `symbol` fills in later.  */
+static struct assembler_reference*
+assembler_reference (struct assembler* assembler, const char* symbol,
+                     long long addend, bool relative, int size)
+{
+    struct assembler_section* section = assembler->section;
+    struct assembler_fragment* fragment = assembler_bytes_fragment (assembler);
+    struct assembler_reference* reference = \
+            assembler_reference_at (assembler, section,
+                                    vector_count (section->fragments) - 1,
+                                    fragment->length, symbol, addend, relative);
+    reference->size = size;
+    assembler_value (assembler, 0, size);
+    return reference;
+}
+
+static const struct assembler_register*
+assembler_register (const char* name, size_t len)
+{
+    for (int i = 0; assembler_registers[i].name; i++)
+    {
+        if (strlen (assembler_registers[i].name) == len && \
+            strncmp (assembler_registers[i].name, name, len) == 0)
+        {
+            return &assembler_registers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int
+assembler_condition (const char* name)
+{
+    for (int i = 0; assembler_conditions[i].name; i++)
+    {
+        if (S_EQ (assembler_conditions[i].name, name))
+        {
+            return assembler_conditions[i].code;
+        }
+    }
+
+    return -1;
+}
+
+static bool
+assembler_is_name_char (char c)
+{
+    return isalnum ((unsigned char) c) || c == '_' || c == '.' || \
+           c == '$' || c == '@' || c == '?';
+}
+
+static const char*
+assembler_skip_spaces (const char* ptr)
+{
+    while (*ptr == ' ' || *ptr == '\t')
+    {
+        ptr++;
+    }
+
+    return ptr;
+}
+
+/* Parses a number or a quoted character, returns NULL if there is
+   neither at `ptr`.  */
+static const char*
+assembler_parse_number (const char* ptr, long long* value)
+{
+    if (*ptr == '\'' || *ptr == '"')
+    {
+        if (!ptr[1] || ptr[2] != ptr[0])
+        {
+            return NULL;
+        }
+        *value = (unsigned char) ptr[1];
+        return ptr + 3;
+    }
+
+    if (!isdigit ((unsigned char) *ptr))
+    {
+        return NULL;
+    }
+
+    char* end = NULL;
+    if (ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))
+    {
+        *value = (long long) strtoull (ptr, &end, 16);
+    }
+    else
+    {
+        *value = (long long) strtoull (ptr, &end, 10);
+    }
+    return end;
+}
+
+/* Parses `term (+|- term)*` where a term is a number, a register
+   or a symbol, at most one of each of the latter two.  A second
+   symbol may follow the first one after a minus.  */
+static void
+assembler_parse_expression (struct assembler* assembler, const char* text,
+                            const char* end, struct assembler_operand* operand)
+{
+    const char* ptr = assembler_skip_spaces (text);
+    int sign = 1;
+    if (*ptr == '-')
+    {
+        sign = -1;
+        ptr = assembler_skip_spaces (ptr + 1);
+    }
+
+    while (ptr < end)
+    {
+        long long value = 0;
+        const char* after = assembler_parse_number (ptr, &value);
+        if (after)
+        {
+            operand->value += sign * value;
+            ptr = after;
+        }
+        else
+        {
+            const char* start = ptr;
+            while (ptr < end && assembler_is_name_char (*ptr))
+            {
+                ptr++;
+            }
+
+            const struct assembler_register* reg = \
+                            assembler_register (start, ptr - start);
+            long long scale = 1;
+            const char* after_name = assembler_skip_spaces (ptr);
+            if (reg && after_name < end && *after_name == '*')
+            {
+                ptr = assembler_parse_number (assembler_skip_spaces (after_name + 1),
+                                              &scale);
+                if (!ptr || (scale != 1 && scale != 2 && scale != 4 && scale != 8))
+                {
+                    assembler_fail (assembler, "cannot encode operand", text);
+                }
+            }
+
+            /* `reg*n` or a second register is the index.  */
+            bool is_index = reg && (scale != 1 || operand->reg != -1);
+            bool is_base = !reg && sign < 0 && operand->symbol[0] && \
+                           !operand->base[0];
+            if (ptr == start || (sign < 0 && !is_base) || \
+                (!reg && !is_base && operand->symbol[0]) || \
+                (is_index && operand->index != -1) || \
+                (reg && !is_index && operand->reg != -1))
+            {
+                assembler_fail (assembler, "cannot encode operand", text);
+            }
+
+            if (is_base)
+            {
+                assembler_symbol_name (assembler, start, ptr - start,
+                                       operand->base);
+            }
+            else if (is_index)
+            {
+                operand->index = reg->number;
+                operand->scale = (int) scale;
+            }
+            else if (reg)
+            {
+                operand->reg = reg->number;
+            }
+            else
+            {
+                assembler_symbol_name (assembler, start, ptr - start,
+                                       operand->symbol);
+            }
+        }
+
+        ptr = assembler_skip_spaces (ptr);
+        if (ptr >= end)
+        {
+            break;
+        }
+
+        if (*ptr != '+' && *ptr != '-')
+        {
+            assembler_fail (assembler, "cannot encode operand", text);
+        }
+        sign = *ptr == '-' ? -1 : 1;
+        ptr = assembler_skip_spaces (ptr + 1);
+    }
+}
+
+static void
+assembler_parse_operand (struct assembler* assembler, const char* text,
+                         struct assembler_operand* operand)
+{
+    static const struct
+    {
+        const char* keyword;
+        int size;
+    } sizes[] = {
+        {"byte", 1}, {"word", 2}, {"dword", 4}, {"qword", 8}, {NULL, 0}
+    };
+
+    memset (operand, 0, sizeof (struct assembler_operand));
+    operand->reg = -1;
+    operand->index = -1;
+    const char* ptr = assembler_skip_spaces (text);
+    for (int i = 0; sizes[i].keyword; i++)
+    {
+        size_t len = strlen (sizes[i].keyword);
+        if (strncmp (ptr, sizes[i].keyword, len) == 0 && \
+            !assembler_is_name_char (ptr[len]))
+        {
+            operand->size = sizes[i].size;
+            ptr = assembler_skip_spaces (ptr + len);
+            break;
+        }
+    }
+
+    const char* end = ptr + strlen (ptr);
+    while (end > ptr && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        end--;
+    }
+
+    if (*ptr == '[')
+    {
+        const char* close = memchr (ptr, ']', end - ptr);
+        if (!close)
+        {
+            assembler_fail (assembler, "cannot encode operand", text);
+        }
+        operand->type = ASSEMBLER_OPERAND_MEMORY;
+        assembler_parse_expression (assembler, ptr + 1, close, operand);
+        if (operand->base[0])
+        {
+            assembler_fail (assembler, "cannot encode operand", text);
+        }
+        return;
+    }
+
+    const struct assembler_register* reg = assembler_register (ptr, end - ptr);
+    if (reg)
+    {
+        operand->type = ASSEMBLER_OPERAND_REGISTER;
+        operand->reg = reg->number;
+        operand->size = reg->size;
+        operand->needs_rex = reg->needs_rex;
+        return;
+    }
+
+    operand->type = ASSEMBLER_OPERAND_IMMEDIATE;
+    assembler_parse_expression (assembler, ptr, end, operand);
+    if (operand->reg != -1 || operand->index != -1)
+    {
+        assembler_fail (assembler, "cannot encode operand", text);
+    }
+}
+
+static bool
+assembler_fits_byte (struct assembler_operand* operand)
+{
+    return !operand->symbol[0] && operand->value >= -128 && operand->value <= 127;
+}
+
+static void
+assembler_immediate (struct assembler* assembler,
+                     struct assembler_operand* operand, int size)
+{
+    if (operand->base[0])
+    {
+        /* The distance from the base is the distance from here plus
+           how far here is past the base, the base has to be in the
+           same bytes for the latter to be known now.  */
+        struct assembler_symbol* base = \
+                        assembler_symbol (assembler, operand->base, true);
+        struct assembler_section* section = assembler->section;
+        struct assembler_fragment* fragment = assembler_bytes_fragment (assembler);
+        if (size != 4 || base->section != section || base->alias || \
+            base->fragment != vector_count (section->fragments) - 1)
+        {
+            assembler_fail (assembler, "cannot encode difference to", base->name);
+        }
+        assembler_reference (assembler, operand->symbol,
+                             operand->value + 4 + \
+                             (long long) (fragment->length - base->offset),
+                             true, size);
+        return;
+    }
+
+    if (operand->symbol[0])
+    {
+        if (size != 4 && (size != 8 || assembler->bits != 64))
+        {
+            assembler_fail (assembler, "address does not fit in", "a dword");
+        }
+        assembler_reference (assembler, operand->symbol, operand->value, false, size);
+        return;
+    }
+
+    assembler_value (assembler, operand->value, size);
+}
+
+/* Immediates are at most four bytes, sign extended to a qword.  */
+static int
+assembler_immediate_size (int size)
+{
+    return size == 8 ? 4 : size;
+}
+
+/* Emits the REX prefix an instruction of `size` needs, for the
+   registers in the middle field of ModRM and in `rm`.  Either may be
+   NULL.  Pushes and calls are 64-bit without REX.W, they pass 0.  */
+static void
+assembler_rex (struct assembler* assembler, int size,
+               struct assembler_operand* reg, struct assembler_operand* rm)
+{
+    int rex = size == 8 ? 0x48 : 0;
+    bool needs_rex = false;
+    if (reg && reg->type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        rex |= reg->reg > 7 ? 0x44 : 0;
+        needs_rex |= reg->needs_rex;
+    }
+
+    if (rm && rm->type != ASSEMBLER_OPERAND_IMMEDIATE && rm->reg > 7)
+    {
+        rex |= 0x41;
+    }
+
+    if (rm && rm->type == ASSEMBLER_OPERAND_MEMORY && rm->index > 7)
+    {
+        rex |= 0x42;
+    }
+    needs_rex |= rm && rm->needs_rex;
+
+    if (!rex && !needs_rex)
+    {
+        return;
+    }
+
+    if (assembler->bits != 64)
+    {
+        assembler_fail (assembler, "instruction needs x86-64 in", assembler->line);
+    }
+    assembler_byte (assembler, rex | 0x40);
+}
+
+/* Emits the ModRM byte, and what follows it, for `rm` with `reg`
+   in the middle field.  */
+static void
+assembler_modrm (struct assembler* assembler, int reg,
+                 struct assembler_operand* rm)
+{
+    reg &= 7;
+    if (rm->type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        assembler_byte (assembler, 0xc0 | (reg << 3) | (rm->reg & 7));
+        return;
+    }
+
+    if (rm->type != ASSEMBLER_OPERAND_MEMORY)
+    {
+        assembler_fail (assembler, "expected a register or memory in",
+                        assembler->line);
+    }
+
+    int sib = 0;
+    if (rm->index != -1)
+    {
+        /* The stack pointer cannot be an index.  */
+        if (rm->index == 4)
+        {
+            assembler_fail (assembler, "cannot encode operand", assembler->line);
+        }
+
+        int scale = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+        sib = (scale << 6) | ((rm->index & 7) << 3);
+    }
+
+    if (rm->reg == -1 && rm->index != -1)
+    {
+        /* No base, the index and an absolute address.  */
+        assembler_byte (assembler, (reg << 3) | 4);
+        assembler_byte (assembler, sib | 5);
+        assembler_immediate (assembler, rm, 4);
+        return;
+    }
+
+    if (rm->reg == -1 && assembler->bits == 64)
+    {
+        if (!rm->symbol[0])
+        {
+            /* Absolute address, the no base form of SIB.  */
+            assembler_byte (assembler, (reg << 3) | 4);
+            assembler_byte (assembler, 0x25);
+            assembler_value (assembler, rm->value, 4);
+            return;
+        }
+
+        /* Symbols are relative to the end of the instruction.  */
+        assembler_byte (assembler, (reg << 3) | 5);
+        assembler->rip_reference = assembler_reference (assembler, rm->symbol,
+                                                        rm->value, true, 4);
+        return;
+    }
+
+    if (rm->reg == -1)
+    {
+        /* Absolute address.  */
+        assembler_byte (assembler, (reg << 3) | 5);
+        assembler_immediate (assembler, rm, 4);
+        return;
+    }
+
+    int base = rm->reg & 7;
+    int mod = 2;
+    if (!rm->symbol[0] && rm->value == 0 && base != 5)
+    {
+        mod = 0;
+    }
+    else if (assembler_fits_byte (rm))
+    {
+        mod = 1;
+    }
+
+    if (rm->index != -1)
+    {
+        assembler_byte (assembler, (mod << 6) | (reg << 3) | 4);
+        assembler_byte (assembler, sib | base);
+    }
+    else
+    {
+        assembler_byte (assembler, (mod << 6) | (reg << 3) | base);
+        if (base == 4)
+        {
+            /* The stack pointer as base needs a SIB byte.  */
+            assembler_byte (assembler, 0x24);
+        }
+    }
+
+    if (mod == 1)
+    {
+        assembler_value (assembler, rm->value, 1);
+    }
+    else if (mod == 2)
+    {
+        assembler_immediate (assembler, rm, 4);
+    }
+}
+
+static int
+assembler_operand_size (struct assembler* assembler,
+                        struct assembler_operand* operands, int total_operands)
+{
+    for (int i = 0; i < total_operands; i++)
+    {
+        if (operands[i].type != ASSEMBLER_OPERAND_IMMEDIATE && operands[i].size)
+        {
+            return operands[i].size;
+        }
+    }
+
+    assembler_fail (assembler, "operation size not specified in",
+                    assembler->line);
+    return 0;
+}
+
+static void
+assembler_size_prefix (struct assembler* assembler, int size)
+{
+    if (size == 2)
+    {
+        assembler_byte (assembler, 0x66);
+    }
+}
+
+static void
+assembler_expect (struct assembler* assembler, bool condition)
+{
+    if (!condition)
+    {
+        assembler_fail (assembler, "invalid combination of operands in",
+                        assembler->line);
+    }
+}
+
+/* add, or, adc, sbb, and, sub, xor and cmp, `code` is the extension
+   used with an immediate.  */
+static void
+assembler_encode_arithmetic (struct assembler* assembler, int code,
+                             struct assembler_operand* operands,
+                             int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2);
+    struct assembler_operand* dst = &operands[0];
+    struct assembler_operand* src = &operands[1];
+    int size = assembler_operand_size (assembler, operands, total_operands);
+    int wide = size == 1 ? 0 : 1;
+    assembler_size_prefix (assembler, size);
+    if (src->type == ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        assembler_rex (assembler, size, NULL, dst);
+        if (size != 1 && assembler_fits_byte (src))
+        {
+            assembler_byte (assembler, 0x83);
+            assembler_modrm (assembler, code, dst);
+            assembler_value (assembler, src->value, 1);
+            return;
+        }
+
+        if (dst->type == ASSEMBLER_OPERAND_REGISTER && dst->reg == 0)
+        {
+            assembler_byte (assembler, (code << 3) | 4 | wide);
+        }
+        else
+        {
+            assembler_byte (assembler, 0x80 | wide);
+            assembler_modrm (assembler, code, dst);
+        }
+        assembler_immediate (assembler, src, assembler_immediate_size (size));
+        return;
+    }
+
+    if (src->type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        assembler_rex (assembler, size, src, dst);
+        assembler_byte (assembler, (code << 3) | wide);
+        assembler_modrm (assembler, src->reg, dst);
+        return;
+    }
+
+    assembler_expect (assembler, dst->type == ASSEMBLER_OPERAND_REGISTER);
+    assembler_rex (assembler, size, dst, src);
+    assembler_byte (assembler, (code << 3) | 2 | wide);
+    assembler_modrm (assembler, dst->reg, src);
+}
+
+static void
+assembler_encode_mov (struct assembler* assembler, int code,
+                      struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2);
+    struct assembler_operand* dst = &operands[0];
+    struct assembler_operand* src = &operands[1];
+    int size = assembler_operand_size (assembler, operands, total_operands);
+    int wide = size == 1 ? 0 : 1;
+    assembler_size_prefix (assembler, size);
+    if (src->type == ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        bool fits_dword = !src->symbol[0] && src->value >= INT32_MIN && \
+                          src->value <= INT32_MAX;
+        assembler_rex (assembler, size, NULL, dst);
+        if (dst->type == ASSEMBLER_OPERAND_REGISTER && (size != 8 || !fits_dword))
+        {
+            /* The only instruction with a full qword immediate.  */
+            assembler_byte (assembler, 0xb0 | (wide << 3) | (dst->reg & 7));
+            assembler_immediate (assembler, src, size);
+            return;
+        }
+
+        assembler_byte (assembler, 0xc6 | wide);
+        assembler_modrm (assembler, 0, dst);
+        assembler_immediate (assembler, src, assembler_immediate_size (size));
+        return;
+    }
+
+    if (src->type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        assembler_rex (assembler, size, src, dst);
+        assembler_byte (assembler, 0x88 | wide);
+        assembler_modrm (assembler, src->reg, dst);
+        return;
+    }
+
+    assembler_expect (assembler, dst->type == ASSEMBLER_OPERAND_REGISTER);
+    assembler_rex (assembler, size, dst, src);
+    assembler_byte (assembler, 0x8a | wide);
+    assembler_modrm (assembler, dst->reg, src);
+}
+
+static void
+assembler_encode_test (struct assembler* assembler, int code,
+                       struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2);
+    struct assembler_operand* dst = &operands[0];
+    struct assembler_operand* src = &operands[1];
+    if (dst->type == ASSEMBLER_OPERAND_REGISTER && \
+        src->type == ASSEMBLER_OPERAND_MEMORY)
+    {
+        dst = &operands[1];
+        src = &operands[0];
+    }
+
+    int size = assembler_operand_size (assembler, operands, total_operands);
+    int wide = size == 1 ? 0 : 1;
+    assembler_size_prefix (assembler, size);
+    if (src->type == ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        assembler_rex (assembler, size, NULL, dst);
+        if (dst->type == ASSEMBLER_OPERAND_REGISTER && dst->reg == 0)
+        {
+            assembler_byte (assembler, 0xa8 | wide);
+        }
+        else
+        {
+            assembler_byte (assembler, 0xf6 | wide);
+            assembler_modrm (assembler, 0, dst);
+        }
+        assembler_immediate (assembler, src, assembler_immediate_size (size));
+        return;
+    }
+
+    assembler_expect (assembler, src->type == ASSEMBLER_OPERAND_REGISTER);
+    assembler_rex (assembler, size, src, dst);
+    assembler_byte (assembler, 0x84 | wide);
+    assembler_modrm (assembler, src->reg, dst);
+}
+
+static void
+assembler_encode_lea (struct assembler* assembler, int code,
+                      struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2 && \
+                      operands[0].type == ASSEMBLER_OPERAND_REGISTER && \
+                      operands[1].type == ASSEMBLER_OPERAND_MEMORY);
+    assembler_size_prefix (assembler, operands[0].size);
+    assembler_rex (assembler, operands[0].size, &operands[0], &operands[1]);
+    assembler_byte (assembler, 0x8d);
+    assembler_modrm (assembler, operands[0].reg, &operands[1]);
+}
+
+/* movsx and movzx, `code` is the opcode for a byte source.  */
+static void
+assembler_encode_extend (struct assembler* assembler, int code,
+                         struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2 && \
+                      operands[0].type == ASSEMBLER_OPERAND_REGISTER && \
+                      operands[1].type != ASSEMBLER_OPERAND_IMMEDIATE);
+    int size = operands[1].size;
+    assembler_expect (assembler, size == 1 || size == 2);
+    assembler_size_prefix (assembler, operands[0].size);
+    assembler_rex (assembler, operands[0].size, &operands[0], &operands[1]);
+    assembler_byte (assembler, 0x0f);
+    assembler_byte (assembler, code | (size == 2 ? 1 : 0));
+    assembler_modrm (assembler, operands[0].reg, &operands[1]);
+}
+
+/* Sign extends a dword to a qword register.  */
+static void
+assembler_encode_movsxd (struct assembler* assembler, int code,
+                         struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2 && \
+                      operands[0].type == ASSEMBLER_OPERAND_REGISTER && \
+                      operands[0].size == 8 && \
+                      operands[1].type != ASSEMBLER_OPERAND_IMMEDIATE && \
+                      (operands[1].size == 4 || !operands[1].size));
+    assembler_rex (assembler, 8, &operands[0], &operands[1]);
+    assembler_byte (assembler, code);
+    assembler_modrm (assembler, operands[0].reg, &operands[1]);
+}
+
+static void
+assembler_encode_imul (struct assembler* assembler, int code,
+                       struct assembler_operand* operands, int total_operands)
+{
+    if (total_operands == 1)
+    {
+        assembler_size_prefix (assembler, operands[0].size);
+        assembler_rex (assembler, operands[0].size, NULL, &operands[0]);
+        assembler_byte (assembler, 0xf7);
+        assembler_modrm (assembler, 5, &operands[0]);
+        return;
+    }
+
+    assembler_expect (assembler, operands[0].type == ASSEMBLER_OPERAND_REGISTER);
+    struct assembler_operand* src = &operands[1];
+    struct assembler_operand* immediate = total_operands == 3 ? \
+                                          &operands[2] : NULL;
+    if (src->type == ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        /* `imul reg, imm` is `imul reg, reg, imm`.  */
+        assembler_expect (assembler, total_operands == 2);
+        immediate = src;
+        src = &operands[0];
+    }
+
+    assembler_size_prefix (assembler, operands[0].size);
+    assembler_rex (assembler, operands[0].size, &operands[0], src);
+    if (!immediate)
+    {
+        assembler_byte (assembler, 0x0f);
+        assembler_byte (assembler, 0xaf);
+        assembler_modrm (assembler, operands[0].reg, src);
+        return;
+    }
+
+    bool short_form = assembler_fits_byte (immediate);
+    assembler_byte (assembler, short_form ? 0x6b : 0x69);
+    assembler_modrm (assembler, operands[0].reg, src);
+    assembler_immediate (assembler, immediate, short_form ? \
+                         1 : assembler_immediate_size (operands[0].size));
+}
+
+/* shl, shr and sar by an immediate or cl.  */
+static void
+assembler_encode_shift (struct assembler* assembler, int code,
+                        struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2);
+    int size = operands[0].size;
+    assembler_expect (assembler, size != 0);
+    int wide = size == 1 ? 0 : 1;
+    assembler_size_prefix (assembler, size);
+    assembler_rex (assembler, size, NULL, &operands[0]);
+    if (operands[1].type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        assembler_expect (assembler, operands[1].reg == 1 && operands[1].size == 1);
+        assembler_byte (assembler, 0xd2 | wide);
+        assembler_modrm (assembler, code, &operands[0]);
+        return;
+    }
+
+    assembler_expect (assembler, assembler_fits_byte (&operands[1]) || \
+                      (!operands[1].symbol[0] && operands[1].value < 256));
+    if (operands[1].value == 1)
+    {
+        assembler_byte (assembler, 0xd0 | wide);
+        assembler_modrm (assembler, code, &operands[0]);
+        return;
+    }
+
+    assembler_byte (assembler, 0xc0 | wide);
+    assembler_modrm (assembler, code, &operands[0]);
+    assembler_value (assembler, operands[1].value, 1);
+}
+
+/* Instructions with a single register or memory operand under the
+   0xf6/0xf7 and 0xfe/0xff opcodes, `code` is opcode << 8 | extension.  */
+static void
+assembler_encode_unary (struct assembler* assembler, int code,
+                        struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1 && \
+                      operands[0].type != ASSEMBLER_OPERAND_IMMEDIATE);
+    int size = assembler_operand_size (assembler, operands, total_operands);
+    assembler_size_prefix (assembler, size);
+    assembler_rex (assembler, size, NULL, &operands[0]);
+    assembler_byte (assembler, (code >> 8) | (size == 1 ? 0 : 1));
+    assembler_modrm (assembler, code & 7, &operands[0]);
+}
+
+/* `code` is one byte, or two with the first in the high byte.  */
+static void
+assembler_encode_plain (struct assembler* assembler, int code,
+                        struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 0);
+    if (code > 0xff)
+    {
+        assembler_byte (assembler, code >> 8);
+    }
+    assembler_byte (assembler, code & 0xff);
+}
+
+/* `ret`, or `ret n` popping n more bytes of arguments.  */
+static void
+assembler_encode_ret (struct assembler* assembler, int code,
+                      struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands <= 1);
+    if (!total_operands)
+    {
+        assembler_byte (assembler, code);
+        return;
+    }
+
+    assembler_expect (assembler, operands[0].type == ASSEMBLER_OPERAND_IMMEDIATE && \
+                                 !operands[0].symbol[0]);
+    assembler_byte (assembler, 0xc2);
+    assembler_value (assembler, operands[0].value, 2);
+}
+
+static void
+assembler_encode_push (struct assembler* assembler, int code,
+                       struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1);
+    struct assembler_operand* operand = &operands[0];
+    if (operand->type != ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        assembler_rex (assembler, 0, NULL, operand);
+    }
+
+    switch (operand->type)
+    {
+        case ASSEMBLER_OPERAND_REGISTER:
+            assembler_byte (assembler, 0x50 | (operand->reg & 7));
+            break;
+
+        case ASSEMBLER_OPERAND_IMMEDIATE:
+            if (assembler_fits_byte (operand))
+            {
+                assembler_byte (assembler, 0x6a);
+                assembler_value (assembler, operand->value, 1);
+                break;
+            }
+            assembler_byte (assembler, 0x68);
+            assembler_immediate (assembler, operand, 4);
+            break;
+
+        default:
+            assembler_byte (assembler, 0xff);
+            assembler_modrm (assembler, 6, operand);
+    }
+}
+
+static void
+assembler_encode_pop (struct assembler* assembler, int code,
+                      struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1 && \
+                      operands[0].type != ASSEMBLER_OPERAND_IMMEDIATE);
+    assembler_rex (assembler, 0, NULL, &operands[0]);
+    if (operands[0].type == ASSEMBLER_OPERAND_REGISTER)
+    {
+        assembler_byte (assembler, 0x58 | (operands[0].reg & 7));
+        return;
+    }
+
+    assembler_byte (assembler, 0x8f);
+    assembler_modrm (assembler, 0, &operands[0]);
+}
+
+static void
+assembler_encode_call (struct assembler* assembler, int code,
+                       struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1);
+    if (operands[0].type == ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        assembler_expect (assembler, operands[0].symbol[0]);
+        assembler_byte (assembler, 0xe8);
+        assembler_reference (assembler, operands[0].symbol,
+                             operands[0].value, true, 4)->is_branch = true;
+        return;
+    }
+
+    assembler_rex (assembler, 0, NULL, &operands[0]);
+    assembler_byte (assembler, 0xff);
+    assembler_modrm (assembler, 2, &operands[0]);
+}
+
+/* jmp and jcc, `code` is the condition code or -1.  The size of the
+   jump is decided once the labels are known.  */
+static void
+assembler_encode_jump (struct assembler* assembler, int code,
+                       struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1);
+    if (operands[0].type != ASSEMBLER_OPERAND_IMMEDIATE)
+    {
+        assembler_expect (assembler, code == -1);
+        assembler_rex (assembler, 0, NULL, &operands[0]);
+        assembler_byte (assembler, 0xff);
+        assembler_modrm (assembler, 4, &operands[0]);
+        return;
+    }
+
+    assembler_expect (assembler, operands[0].symbol[0] && !operands[0].value);
+    struct assembler_fragment fragment = {
+        .type = ASSEMBLER_FRAGMENT_JUMP,
+        .condition = code,
+        .target = strdup (operands[0].symbol)
+    };
+    vector_push (assembler->section->fragments, &fragment);
+    assembler->total_jumps++;
+}
+
+static void
+assembler_encode_setcc (struct assembler* assembler, int code,
+                        struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 1 && \
+                      operands[0].type != ASSEMBLER_OPERAND_IMMEDIATE);
+    assembler_rex (assembler, 0, NULL, &operands[0]);
+    assembler_byte (assembler, 0x0f);
+    assembler_byte (assembler, 0x90 | code);
+    assembler_modrm (assembler, 0, &operands[0]);
+}
+
+static void
+assembler_encode_cmovcc (struct assembler* assembler, int code,
+                         struct assembler_operand* operands, int total_operands)
+{
+    assembler_expect (assembler, total_operands == 2 && \
+                      operands[0].type == ASSEMBLER_OPERAND_REGISTER && \
+                      operands[1].type != ASSEMBLER_OPERAND_IMMEDIATE);
+    assembler_size_prefix (assembler, operands[0].size);
+    assembler_rex (assembler, operands[0].size, &operands[0], &operands[1]);
+    assembler_byte (assembler, 0x0f);
+    assembler_byte (assembler, 0x40 | code);
+    assembler_modrm (assembler, operands[0].reg, &operands[1]);
+}
+
+static const struct assembler_mnemonic assembler_mnemonics[] = {
+    {"add", assembler_encode_arithmetic, 0},
+    {"or", assembler_encode_arithmetic, 1},
+    {"adc", assembler_encode_arithmetic, 2},
+    {"sbb", assembler_encode_arithmetic, 3},
+    {"and", assembler_encode_arithmetic, 4},
+    {"sub", assembler_encode_arithmetic, 5},
+    {"xor", assembler_encode_arithmetic, 6},
+    {"cmp", assembler_encode_arithmetic, 7},
+    {"mov", assembler_encode_mov, 0},
+    {"test", assembler_encode_test, 0},
+    {"lea", assembler_encode_lea, 0},
+    {"movzx", assembler_encode_extend, 0xb6},
+    {"movsx", assembler_encode_extend, 0xbe},
+    {"movsxd", assembler_encode_movsxd, 0x63},
+    {"imul", assembler_encode_imul, 0},
+    {"shl", assembler_encode_shift, 4},
+    {"sal", assembler_encode_shift, 4},
+    {"shr", assembler_encode_shift, 5},
+    {"sar", assembler_encode_shift, 7},
+    {"not", assembler_encode_unary, 0xf6 << 8 | 2},
+    {"neg", assembler_encode_unary, 0xf6 << 8 | 3},
+    {"mul", assembler_encode_unary, 0xf6 << 8 | 4},
+    {"div", assembler_encode_unary, 0xf6 << 8 | 6},
+    {"idiv", assembler_encode_unary, 0xf6 << 8 | 7},
+    {"inc", assembler_encode_unary, 0xfe << 8 | 0},
+    {"dec", assembler_encode_unary, 0xfe << 8 | 1},
+    {"cdq", assembler_encode_plain, 0x99},
+    {"cqo", assembler_encode_plain, 0x4899},
+    {"ret", assembler_encode_ret, 0xc3},
+    {"leave", assembler_encode_plain, 0xc9},
+    {"nop", assembler_encode_plain, 0x90},
+    {"push", assembler_encode_push, 0},
+    {"pop", assembler_encode_pop, 0},
+    {"call", assembler_encode_call, 0},
+    {"jmp", assembler_encode_jump, -1},
+    {NULL, NULL, 0}
+};
+
+/* Finds the encoder of `mnemonic`, conditional ones are made of
+   a prefix and one of the condition names.  */
+static bool
+assembler_find_mnemonic (const char* mnemonic, ASSEMBLER_ENCODE* encode,
+                         int* code)
+{
+    for (int i = 0; assembler_mnemonics[i].name; i++)
+    {
+        if (S_EQ (assembler_mnemonics[i].name, mnemonic))
+        {
+            *encode = assembler_mnemonics[i].encode;
+            *code = assembler_mnemonics[i].code;
+            return true;
+        }
+    }
+
+    static const struct
+    {
+        const char* prefix;
+        ASSEMBLER_ENCODE encode;
+    } conditionals[] = {
+        {"j", assembler_encode_jump},
+        {"set", assembler_encode_setcc},
+        {"cmov", assembler_encode_cmovcc},
+        {NULL, NULL}
+    };
+
+    for (int i = 0; conditionals[i].prefix; i++)
+    {
+        size_t len = strlen (conditionals[i].prefix);
+        if (strncmp (mnemonic, conditionals[i].prefix, len) != 0)
+        {
+            continue;
+        }
+
+        int condition = assembler_condition (mnemonic + len);
+        if (condition != -1)
+        {
+            *encode = conditionals[i].encode;
+            *code = condition;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Splits `text` at the commas outside of quotes, returns the number
+   of items.  */
+static int
+assembler_split (const char* text, char items[][ASSEMBLER_MAX_NAME], int max)
+{
+    int total = 0;
+    const char* ptr = assembler_skip_spaces (text);
+    while (*ptr && total < max)
+    {
+        const char* start = ptr;
+        char quote = 0;
+        while (*ptr && (quote || *ptr != ','))
+        {
+            if (quote && *ptr == quote)
+            {
+                quote = 0;
+            }
+            else if (!quote && (*ptr == '\'' || *ptr == '"'))
+            {
+                quote = *ptr;
+            }
+            ptr++;
+        }
+
+        const char* end = ptr;
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+        {
+            end--;
+        }
+        snprintf (items[total++], ASSEMBLER_MAX_NAME, "%.*s",
+                  (int) (end - start), start);
+        if (*ptr == ',')
+        {
+            ptr = assembler_skip_spaces (ptr + 1);
+        }
+    }
+
+    return total;
+}
+
+static void
+assembler_instruction (struct assembler* assembler, const char* mnemonic,
+                       const char* rest)
+{
+    ASSEMBLER_ENCODE encode = NULL;
+    int code = 0;
+    if (!assembler_find_mnemonic (mnemonic, &encode, &code))
+    {
+        assembler_fail (assembler, "unknown instruction", mnemonic);
+    }
+
+    char items[ASSEMBLER_MAX_OPERANDS + 1][ASSEMBLER_MAX_NAME];
+    int total_operands = assembler_split (rest, items, ASSEMBLER_MAX_OPERANDS + 1);
+    if (total_operands > ASSEMBLER_MAX_OPERANDS)
+    {
+        assembler_fail (assembler, "too many operands for", mnemonic);
+    }
+
+    struct assembler_operand operands[ASSEMBLER_MAX_OPERANDS];
+    for (int i = 0; i < total_operands; i++)
+    {
+        assembler_parse_operand (assembler, items[i], &operands[i]);
+    }
+
+    assembler->rip_reference = NULL;
+    encode (assembler, code, operands, total_operands);
+    struct assembler_reference* reference = assembler->rip_reference;
+    if (reference)
+    {
+        /* An immediate may follow the displacement, rip points past it.  */
+        struct assembler_fragment* fragment = assembler_bytes_fragment (assembler);
+        reference->trailing = (int) (fragment->length - reference->offset - 4);
+        assembler->rip_reference = NULL;
+    }
+}
+
+static size_t
+assembler_align_up (size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/* db, dw, dd and dq, strings are only allowed with db.  */
+static void
+assembler_data (struct assembler* assembler, int size, const char* rest)
+{
+    const char* ptr = assembler_skip_spaces (rest);
+    while (*ptr)
+    {
+        if (*ptr == '\'' || *ptr == '"')
+        {
+            const char* close = strchr (ptr + 1, *ptr);
+            if (!close)
+            {
+                assembler_fail (assembler, "unterminated string in", rest);
+            }
+            /* Padded with zeros to a multiple of the size.  */
+            size_t len = close - ptr - 1;
+            for (size_t i = 0; i < assembler_align_up (len, size); i++)
+            {
+                assembler_byte (assembler, i < len ? (unsigned char) ptr[1 + i] : 0);
+            }
+            ptr = close + 1;
+        }
+        else
+        {
+            const char* end = ptr;
+            while (*end && *end != ',')
+            {
+                end++;
+            }
+
+            char item[ASSEMBLER_MAX_NAME];
+            snprintf (item, sizeof (item), "%.*s", (int) (end - ptr), ptr);
+            struct assembler_operand operand;
+            assembler_parse_operand (assembler, item, &operand);
+            if (operand.type != ASSEMBLER_OPERAND_IMMEDIATE)
+            {
+                assembler_fail (assembler, "cannot encode data", item);
+            }
+            assembler_immediate (assembler, &operand, size);
+            ptr = end;
+        }
+
+        ptr = assembler_skip_spaces (ptr);
+        if (*ptr == ',')
+        {
+            ptr = assembler_skip_spaces (ptr + 1);
+        }
+    }
+}
+
+static void
+assembler_align (struct assembler* assembler, const char* rest)
+{
+    long long alignment = 0;
+    if (!assembler_parse_number (assembler_skip_spaces (rest), &alignment) || \
+        alignment <= 0 || (alignment & (alignment - 1)))
+    {
+        assembler_fail (assembler, "bad alignment", rest);
+    }
+
+    struct assembler_section* section = assembler->section;
+    if (alignment > section->alignment)
+    {
+        section->alignment = (int) alignment;
+    }
+
+    if (alignment == 1)
+    {
+        return;
+    }
+
+    struct assembler_fragment fragment = {
+        .type = ASSEMBLER_FRAGMENT_ALIGN,
+        .alignment = (int) alignment
+    };
+    vector_push (section->fragments, &fragment);
+}
+
+static void
+assembler_incbin (struct assembler* assembler, const char* rest)
+{
+    char path[ASSEMBLER_MAX_NAME];
+    const char* ptr = assembler_skip_spaces (rest);
+    const char* close = (*ptr == '"' || *ptr == '\'') ? strchr (ptr + 1, *ptr) : NULL;
+    if (!close)
+    {
+        assembler_fail (assembler, "bad incbin", rest);
+    }
+    snprintf (path, sizeof (path), "%.*s", (int) (close - ptr - 1), ptr + 1);
+
+    FILE* fp = fopen (path, "rb");
+    if (!fp)
+    {
+        assembler_fail (assembler, "cannot open", path);
+    }
+
+    int c;
+    while ((c = fgetc (fp)) != EOF)
+    {
+        assembler_byte (assembler, c);
+    }
+    fclose (fp);
+}
+
+static void
+assembler_switch_section (struct assembler* assembler, const char* name)
+{
+    for (int i = 0; i < vector_count (assembler->sections); i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        if (S_EQ (section->name, name))
+        {
+            assembler->section = section;
+            return;
+        }
+    }
+
+    assembler->section = assembler_section_new (assembler, name);
+}
+
+static void
+assembler_define (struct assembler* assembler, const char* name)
+{
+    struct assembler_symbol* symbol = assembler_symbol (assembler, name, true);
+    if (symbol->section || symbol->alias)
+    {
+        assembler_fail (assembler, "label redefined", name);
+    }
+
+    struct assembler_fragment* fragment = assembler_bytes_fragment (assembler);
+    symbol->section = assembler->section;
+    symbol->fragment = vector_count (assembler->section->fragments) - 1;
+    symbol->offset = fragment->length;
+}
+
+/* Data the code generator already holds as bytes, so it does not
+   have to be printed as `db` lines and parsed back.  */
+void
+assembler_bytes (struct assembler* assembler, const char* label,
+                 const char* data, size_t len)
+{
+    if (label)
+    {
+        assembler_define (assembler, label);
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        assembler_byte (assembler, (unsigned char) data[i]);
+    }
+}
+
+/* `name equ symbol+offset`.  */
+static void
+assembler_equ (struct assembler* assembler, const char* name, const char* rest)
+{
+    struct assembler_operand operand;
+    assembler_parse_operand (assembler, rest, &operand);
+    if (operand.type != ASSEMBLER_OPERAND_IMMEDIATE || !operand.symbol[0])
+    {
+        assembler_fail (assembler, "cannot encode equ", rest);
+    }
+
+    struct assembler_symbol* symbol = assembler_symbol (assembler, name, true);
+    if (symbol->section || symbol->alias)
+    {
+        assembler_fail (assembler, "label redefined", name);
+    }
+    symbol->alias = strdup (operand.symbol);
+    symbol->offset = (size_t) operand.value;
+}
+
+/* Reads the name at `ptr` to `out`, returns what follows it.  */
+static const char*
+assembler_word (const char* ptr, char* out)
+{
+    size_t len = 0;
+    while (assembler_is_name_char (ptr[len]) && len < ASSEMBLER_MAX_NAME - 1)
+    {
+        out[len] = ptr[len];
+        len++;
+    }
+    out[len] = 0;
+    return assembler_skip_spaces (ptr + len);
+}
+
+static void
+assembler_statement (struct assembler* assembler, const char* word,
+                     const char* rest)
+{
+    static const struct
+    {
+        const char* keyword;
+        int size;
+    } data[] = {
+        {"db", 1}, {"dw", 2}, {"dd", 4}, {"dq", 8}, {NULL, 0}
+    };
+
+    static const struct
+    {
+        const char* keyword;
+        int size;
+    } reserve[] = {
+        {"resb", 1}, {"resw", 2}, {"resd", 4}, {"resq", 8}, {NULL, 0}
+    };
+
+    for (int i = 0; data[i].keyword; i++)
+    {
+        if (S_EQ (word, data[i].keyword))
+        {
+            assembler_data (assembler, data[i].size, rest);
+            return;
+        }
+    }
+
+    for (int i = 0; reserve[i].keyword; i++)
+    {
+        if (S_EQ (word, reserve[i].keyword))
+        {
+            long long count = 0;
+            if (!assembler_parse_number (rest, &count))
+            {
+                assembler_fail (assembler, "bad reservation", rest);
+            }
+            assembler_reserve (assembler, (size_t) count * reserve[i].size);
+            return;
+        }
+    }
+
+    if (S_EQ (word, "times"))
+    {
+        long long count = 0;
+        const char* ptr = assembler_parse_number (rest, &count);
+        if (!ptr)
+        {
+            assembler_fail (assembler, "bad times", rest);
+        }
+
+        char inner[ASSEMBLER_MAX_NAME];
+        ptr = assembler_word (assembler_skip_spaces (ptr), inner);
+        for (long long i = 0; i < count; i++)
+        {
+            assembler_statement (assembler, inner, ptr);
+        }
+        return;
+    }
+
+    if (S_EQ (word, "incbin"))
+    {
+        assembler_incbin (assembler, rest);
+        return;
+    }
+
+    assembler_instruction (assembler, word, rest);
+}
+
+/* Assembles one line of output.  */
+void
+assembler_line (struct assembler* assembler, const char* line)
+{
+    char text[1024];
+    assembler->line = line;
+    const char* ptr = assembler_skip_spaces (line);
+    size_t len = 0;
+    char quote = 0;
+    while (ptr[len] && (quote || ptr[len] != ';') && len < sizeof (text) - 1)
+    {
+        if (quote && ptr[len] == quote)
+        {
+            quote = 0;
+        }
+        else if (!quote && (ptr[len] == '\'' || ptr[len] == '"'))
+        {
+            quote = ptr[len];
+        }
+        text[len] = ptr[len];
+        len++;
+    }
+    text[len] = 0;
+    if (!len)
+    {
+        return;
+    }
+
+    char word[ASSEMBLER_MAX_NAME];
+    ptr = assembler_word (text, word);
+    if (!word[0])
+    {
+        assembler_fail (assembler, "cannot parse", line);
+    }
+
+    if (S_EQ (word, "section"))
+    {
+        char name[ASSEMBLER_MAX_NAME];
+        assembler_word (ptr, name);
+        assembler_switch_section (assembler, name);
+        return;
+    }
+
+    if (S_EQ (word, "global") || S_EQ (word, "extern"))
+    {
+        char name[ASSEMBLER_MAX_NAME];
+        assembler_word (ptr, word);
+        assembler_symbol_name (assembler, word, strlen (word), name);
+        struct assembler_symbol* symbol = assembler_symbol (assembler, name, true);
+        symbol->global = true;
+        symbol->external = S_EQ (word, "extern");
+        return;
+    }
+
+    if (S_EQ (word, "align") || S_EQ (word, "alignb"))
+    {
+        assembler_align (assembler, ptr);
+        return;
+    }
+
+    if (S_EQ (word, "bits"))
+    {
+        long long bits = 0;
+        if (!assembler_parse_number (ptr, &bits) || (bits != 32 && bits != 64))
+        {
+            assembler_fail (assembler, "unsupported bits", ptr);
+        }
+        assembler->bits = (int) bits;
+        return;
+    }
+
+    if (S_EQ (word, "default"))
+    {
+        /* `default rel`, the only mode of symbols on x86-64.  */
+        return;
+    }
+
+    char name[ASSEMBLER_MAX_NAME];
+    if (*ptr == ':')
+    {
+        assembler_symbol_name (assembler, word, strlen (word), name);
+        if (word[0] != '.')
+        {
+            free (assembler->scope);
+            assembler->scope = strdup (name);
+        }
+        assembler_define (assembler, name);
+
+        ptr = assembler_skip_spaces (ptr + 1);
+        if (!*ptr)
+        {
+            return;
+        }
+        ptr = assembler_word (ptr, word);
+    }
+    else if (strncmp (ptr, "equ", 3) == 0 && !assembler_is_name_char (ptr[3]))
+    {
+        assembler_symbol_name (assembler, word, strlen (word), name);
+        assembler_equ (assembler, name, ptr + 3);
+        return;
+    }
+
+    assembler_statement (assembler, word, ptr);
+}
+
+static size_t
+assembler_fragment_size (struct assembler_fragment* fragment)
+{
+    switch (fragment->type)
+    {
+        case ASSEMBLER_FRAGMENT_JUMP:
+            if (!fragment->long_form)
+            {
+                return 2;
+            }
+            return fragment->condition == -1 ? 5 : 6;
+
+        case ASSEMBLER_FRAGMENT_ALIGN:
+        {
+            size_t alignment = fragment->alignment;
+            return (alignment - fragment->address % alignment) % alignment;
+        }
+    }
+
+    return fragment->length;
+}
+
+static void
+assembler_layout_section (struct assembler_section* section)
+{
+    size_t address = 0;
+    for (int i = 0; i < vector_count (section->fragments); i++)
+    {
+        struct assembler_fragment* fragment = vector_at (section->fragments, i);
+        fragment->address = address;
+        address += assembler_fragment_size (fragment);
+    }
+    section->size = address;
+}
+
+/* The target of a jump when it is in the same section, NULL if the
+   jump needs a relocation.  */
+static struct assembler_symbol*
+assembler_jump_target (struct assembler* assembler,
+                       struct assembler_section* section,
+                       struct assembler_fragment* fragment, long long* addend)
+{
+    *addend = 0;
+    struct assembler_symbol* symbol = assembler_symbol_resolve (
+                    assembler, assembler_symbol (assembler, fragment->target, true),
+                    addend);
+    if (!symbol || symbol->section != section)
+    {
+        return NULL;
+    }
+
+    return symbol;
+}
+
+/* Starts with every jump short and makes the ones that do not reach
+   their label long until nothing changes.  Jumps only ever grow so
+   this ends.  */
+static void
+assembler_relax_section (struct assembler* assembler,
+                         struct assembler_section* section)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        assembler_layout_section (section);
+        for (int i = 0; i < vector_count (section->fragments); i++)
+        {
+            struct assembler_fragment* fragment = vector_at (section->fragments, i);
+            if (fragment->type != ASSEMBLER_FRAGMENT_JUMP || fragment->long_form)
+            {
+                continue;
+            }
+
+            long long addend = 0;
+            struct assembler_symbol* target = \
+                    assembler_jump_target (assembler, section, fragment, &addend);
+            long long distance = target ? \
+                    (long long) assembler_symbol_address (target) + addend - \
+                    (long long) (fragment->address + 2) : 0;
+            if (!target || distance < -128 || distance > 127)
+            {
+                fragment->long_form = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+static void
+assembler_put_value (char* ptr, long long value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        ptr[i] = (char) ((value >> (i * 8)) & 0xff);
+    }
+}
+
+/* Pads code with as few nops as possible, the ones of up to 8 bytes
+   the processor decodes as one instruction.  */
+static void
+assembler_fill_nops (char* ptr, size_t size)
+{
+    static const unsigned char nops[][8] = {
+        {0x90},
+        {0x66, 0x90},
+        {0x0f, 0x1f, 0x00},
+        {0x0f, 0x1f, 0x40, 0x00},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}
+    };
+
+    while (size)
+    {
+        size_t length = size < 8 ? size : 8;
+        memcpy (ptr, nops[length - 1], length);
+        ptr += length;
+        size -= length;
+    }
+}
+
+/* Copies the fragments of `section` to one block of bytes.  */
+static void
+assembler_build_image (struct assembler* assembler,
+                       struct assembler_section* section)
+{
+    if (!section->bytes)
+    {
+        return;
+    }
+
+    bool text = S_EQ (section->name, ".text");
+    section->image = calloc (1, section->size ? section->size : 1);
+    for (int i = 0; i < vector_count (section->fragments); i++)
+    {
+        struct assembler_fragment* fragment = vector_at (section->fragments, i);
+        char* ptr = section->image + fragment->address;
+        switch (fragment->type)
+        {
+            case ASSEMBLER_FRAGMENT_BYTES:
+                memcpy (ptr, section->bytes->data + fragment->start,
+                        fragment->length);
+                break;
+
+            case ASSEMBLER_FRAGMENT_ALIGN:
+                if (text)
+                {
+                    assembler_fill_nops (ptr, assembler_fragment_size (fragment));
+                }
+                else
+                {
+                    memset (ptr, 0, assembler_fragment_size (fragment));
+                }
+                break;
+
+            case ASSEMBLER_FRAGMENT_JUMP:
+            {
+                assembler->short_jumps += !fragment->long_form;
+                int opcode_size = 1;
+                if (!fragment->long_form)
+                {
+                    ptr[0] = (char) (fragment->condition == -1 ? \
+                                     0xeb : 0x70 | fragment->condition);
+                }
+                else if (fragment->condition == -1)
+                {
+                    ptr[0] = (char) 0xe9;
+                }
+                else
+                {
+                    ptr[0] = 0x0f;
+                    ptr[1] = (char) (0x80 | fragment->condition);
+                    opcode_size = 2;
+                }
+
+                long long addend = 0;
+                struct assembler_symbol* target = \
+                        assembler_jump_target (assembler, section, fragment, &addend);
+                size_t end = fragment->address + assembler_fragment_size (fragment);
+                long long distance = target ? \
+                        (long long) assembler_symbol_address (target) + addend - \
+                        (long long) end : 0;
+                if (!fragment->long_form)
+                {
+                    ptr[1] = (char) distance;
+                }
+                else if (target)
+                {
+                    assembler_put_value (ptr + opcode_size, distance, 4);
+                }
+                else
+                {
+                    assembler_reference_at (assembler, section, i, opcode_size,
+                                            fragment->target, 0,
+                                            true)->is_branch = true;
+                }
+            }
+            break;
+        }
+    }
+}
+
+/* The relocation type of `reference` to a symbol of another
+   section, or defined elsewhere when `external`.  */
+static int
+assembler_relocation_type (struct assembler* assembler,
+                           struct assembler_reference* reference, bool external)
+{
+    if (assembler->bits != 64)
+    {
+        return reference->relative ? R_386_PC32 : R_386_32;
+    }
+
+    if (reference->relative)
+    {
+        return reference->is_branch && external ? R_X86_64_PLT32 : R_X86_64_PC32;
+    }
+    return reference->size == 8 ? R_X86_64_64 : R_X86_64_32;
+}
+
+static bool
+assembler_fixup_fix (struct fixup* fixup)
+{
+    struct assembler_reference* reference = fixup_private (fixup);
+    struct assembler* assembler = reference->assembler;
+    struct assembler_section* section = reference->section;
+    struct assembler_fragment* fragment = \
+                    vector_at (section->fragments, reference->fragment);
+    size_t place = fragment->address + reference->offset;
+
+    long long addend = reference->addend;
+    struct assembler_symbol* symbol = assembler_symbol_resolve (
+                    assembler, assembler_symbol (assembler, reference->symbol, true),
+                    &addend);
+    if (!symbol)
+    {
+        assembler_fail (assembler, "undefined equ target", reference->symbol);
+    }
+
+    long long value = addend;
+    int index = symbol->index;
+    if (symbol->section)
+    {
+        value += (long long) assembler_symbol_address (symbol);
+        if (reference->relative && symbol->section == section)
+        {
+            assembler_put_value (section->image + place,
+                                 value - (long long) (place + 4 + reference->trailing),
+                                 4);
+            return true;
+        }
+
+        /* Defined here, relocate against its section.  */
+        index = symbol->section->index;
+    }
+
+    if (reference->relative)
+    {
+        value -= 4 + reference->trailing;
+    }
+
+    struct assembler_relocation relocation = {
+        .offset = place,
+        .symbol = index,
+        .type = assembler_relocation_type (assembler, reference, !symbol->section),
+        .addend = value
+    };
+    /* x86-64 objects carry the addend in the relocation.  */
+    assembler_put_value (section->image + place,
+                         assembler->bits == 64 ? 0 : value, reference->size);
+    vector_push (section->relocations, &relocation);
+    assembler->total_relocations++;
+    return true;
+}
+
+static bool
+assembler_fixup_end (struct fixup* fixup)
+{
+    struct assembler_reference* reference = fixup_private (fixup);
+    free (reference->symbol);
+    free (reference);
+    return true;
+}
+
+static size_t
+assembler_string (struct buffer* table, const char* str)
+{
+    size_t offset = table->len;
+    while (*str)
+    {
+        buffer_write (table, *str++);
+    }
+    buffer_write (table, 0);
+    return offset;
+}
+
+static bool
+assembler_symbol_is_local (struct assembler_symbol* symbol)
+{
+    return !symbol->global && symbol->section && !symbol->alias && \
+           !strchr (symbol->name, '.');
+}
+
+static bool
+assembler_symbol_is_global (struct assembler_symbol* symbol)
+{
+    if (symbol->alias)
+    {
+        return false;
+    }
+
+    return (symbol->global && (symbol->section || symbol->referenced)) || \
+           (!symbol->section && symbol->referenced);
+}
+
+static void
+assembler_symbol_entry (struct assembler* assembler, struct vector* entries,
+                        struct buffer* strings, struct assembler_symbol* symbol,
+                        int binding)
+{
+    Elf64_Sym entry = {
+        .st_name = (Elf64_Word) assembler_string (strings, symbol->name),
+        .st_shndx = SHN_UNDEF
+    };
+    int type = STT_NOTYPE;
+    if (symbol->section)
+    {
+        entry.st_value = (Elf64_Addr) assembler_symbol_address (symbol);
+        entry.st_shndx = (Elf64_Section) symbol->section->index;
+        type = S_EQ (symbol->section->name, ".text") ? STT_FUNC : STT_OBJECT;
+    }
+    entry.st_info = ELF64_ST_INFO (binding, type);
+    symbol->index = vector_count (entries);
+    vector_push (entries, &entry);
+}
+
+/* Section symbols first, then the named locals, then the globals
+   and the symbols defined elsewhere.  Returns the index of the first
+   global.  The entries are Elf64_Sym whatever the class of the
+   object, they are narrowed when written.  */
+static int
+assembler_symbol_table (struct assembler* assembler, struct vector* entries,
+                        struct buffer* strings)
+{
+    Elf64_Sym null_entry = {0};
+    vector_push (entries, &null_entry);
+    for (int i = 0; i < vector_count (assembler->sections); i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        Elf64_Sym entry = {
+            .st_info = ELF64_ST_INFO (STB_LOCAL, STT_SECTION),
+            .st_shndx = (Elf64_Section) section->index
+        };
+        vector_push (entries, &entry);
+    }
+
+    for (int i = 0; i < vector_count (assembler->symbols); i++)
+    {
+        struct assembler_symbol* symbol = vector_peek_ptr_at (assembler->symbols, i);
+        if (assembler_symbol_is_local (symbol))
+        {
+            assembler_symbol_entry (assembler, entries, strings, symbol, STB_LOCAL);
+        }
+    }
+
+    int first_global = vector_count (entries);
+    for (int i = 0; i < vector_count (assembler->symbols); i++)
+    {
+        struct assembler_symbol* symbol = vector_peek_ptr_at (assembler->symbols, i);
+        if (assembler_symbol_is_global (symbol))
+        {
+            assembler_symbol_entry (assembler, entries, strings, symbol, STB_GLOBAL);
+        }
+    }
+
+    return first_global;
+}
+
+static void
+assembler_write_padded (FILE* out, const void* data, size_t size, size_t* offset,
+                        size_t alignment)
+{
+    static const char zeros[16] = {0};
+    while (*offset % alignment)
+    {
+        fwrite (zeros, 1, 1, out);
+        (*offset)++;
+    }
+
+    if (size)
+    {
+        fwrite (data, 1, size, out);
+    }
+    *offset += size;
+}
+
+/* The sizes of the ELF structures of the class the assembler
+   writes.  */
+static size_t
+assembler_elf_size (struct assembler* assembler, size_t size32, size_t size64)
+{
+    return assembler->bits == 64 ? size64 : size32;
+}
+
+static void
+assembler_write_symbols (struct assembler* assembler, FILE* out,
+                         struct vector* symbols, size_t* offset)
+{
+    for (int i = 0; i < vector_count (symbols); i++)
+    {
+        Elf64_Sym* symbol = vector_at (symbols, i);
+        if (assembler->bits == 64)
+        {
+            assembler_write_padded (out, symbol, sizeof (*symbol), offset, 8);
+            continue;
+        }
+
+        Elf32_Sym entry = {
+            .st_name = symbol->st_name,
+            .st_value = (Elf32_Addr) symbol->st_value,
+            .st_size = (Elf32_Word) symbol->st_size,
+            .st_info = symbol->st_info,
+            .st_other = symbol->st_other,
+            .st_shndx = symbol->st_shndx
+        };
+        assembler_write_padded (out, &entry, sizeof (entry), offset, 4);
+    }
+}
+
+static void
+assembler_write_relocations (struct assembler* assembler, FILE* out,
+                             struct vector* relocations, size_t* offset)
+{
+    for (int i = 0; i < vector_count (relocations); i++)
+    {
+        struct assembler_relocation* relocation = vector_at (relocations, i);
+        if (assembler->bits == 64)
+        {
+            Elf64_Rela entry = {
+                .r_offset = (Elf64_Addr) relocation->offset,
+                .r_info = ELF64_R_INFO (relocation->symbol, relocation->type),
+                .r_addend = (Elf64_Sxword) relocation->addend
+            };
+            assembler_write_padded (out, &entry, sizeof (entry), offset, 8);
+            continue;
+        }
+
+        Elf32_Rel entry = {
+            .r_offset = (Elf32_Addr) relocation->offset,
+            .r_info = ELF32_R_INFO (relocation->symbol, relocation->type)
+        };
+        assembler_write_padded (out, &entry, sizeof (entry), offset, 4);
+    }
+}
+
+static void
+assembler_write_headers (struct assembler* assembler, FILE* out,
+                         struct vector* headers, size_t* offset)
+{
+    for (int i = 0; i < vector_count (headers); i++)
+    {
+        Elf64_Shdr* header = vector_at (headers, i);
+        if (assembler->bits == 64)
+        {
+            assembler_write_padded (out, header, sizeof (*header), offset, 8);
+            continue;
+        }
+
+        Elf32_Shdr entry = {
+            .sh_name = header->sh_name,
+            .sh_type = header->sh_type,
+            .sh_flags = (Elf32_Word) header->sh_flags,
+            .sh_addr = (Elf32_Addr) header->sh_addr,
+            .sh_offset = (Elf32_Off) header->sh_offset,
+            .sh_size = (Elf32_Word) header->sh_size,
+            .sh_link = header->sh_link,
+            .sh_info = header->sh_info,
+            .sh_addralign = (Elf32_Word) header->sh_addralign,
+            .sh_entsize = (Elf32_Word) header->sh_entsize
+        };
+        assembler_write_padded (out, &entry, sizeof (entry), offset, 4);
+    }
+}
+
+static void
+assembler_write_elf_header (struct assembler* assembler, FILE* out,
+                            struct vector* headers, size_t header_offset,
+                            size_t* offset)
+{
+    unsigned char ident[EI_NIDENT] = {
+        ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+        ELFCLASS32, ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV
+    };
+    if (assembler->bits == 64)
+    {
+        ident[EI_CLASS] = ELFCLASS64;
+        Elf64_Ehdr elf_header = {
+            .e_type = ET_REL,
+            .e_machine = EM_X86_64,
+            .e_version = EV_CURRENT,
+            .e_shoff = (Elf64_Off) header_offset,
+            .e_ehsize = sizeof (Elf64_Ehdr),
+            .e_shentsize = sizeof (Elf64_Shdr),
+            .e_shnum = (Elf64_Half) vector_count (headers),
+            .e_shstrndx = (Elf64_Half) (vector_count (headers) - 1)
+        };
+        memcpy (elf_header.e_ident, ident, EI_NIDENT);
+        assembler_write_padded (out, &elf_header, sizeof (elf_header), offset, 1);
+        return;
+    }
+
+    Elf32_Ehdr elf_header = {
+        .e_type = ET_REL,
+        .e_machine = EM_386,
+        .e_version = EV_CURRENT,
+        .e_shoff = (Elf32_Off) header_offset,
+        .e_ehsize = sizeof (Elf32_Ehdr),
+        .e_shentsize = sizeof (Elf32_Shdr),
+        .e_shnum = (Elf32_Half) vector_count (headers),
+        .e_shstrndx = (Elf32_Half) (vector_count (headers) - 1)
+    };
+    memcpy (elf_header.e_ident, ident, EI_NIDENT);
+    assembler_write_padded (out, &elf_header, sizeof (elf_header), offset, 1);
+}
+
+/* Lays out every section, resolves the references and writes a
+   relocatable object to `out`, ELF32 for x86 and ELF64 for x86-64.  */
+void
+assembler_write (struct assembler* assembler, FILE* out)
+{
+    int total_sections = vector_count (assembler->sections);
+    for (int i = 0; i < total_sections; i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        section->index = i + 1;
+        assembler_relax_section (assembler, section);
+        assembler_build_image (assembler, section);
+    }
+
+    struct vector* symbols = vector_create (sizeof (Elf64_Sym));
+    struct buffer* strings = buffer_create ();
+    buffer_write (strings, 0);
+    int first_global = assembler_symbol_table (assembler, symbols, strings);
+    fixups_resolve (assembler->fixups);
+
+    bool x86_64 = assembler->bits == 64;
+    size_t word = assembler_elf_size (assembler, 4, 8);
+    size_t symbol_size = assembler_elf_size (assembler, sizeof (Elf32_Sym),
+                                             sizeof (Elf64_Sym));
+    size_t relocation_size = assembler_elf_size (assembler, sizeof (Elf32_Rel),
+                                                 sizeof (Elf64_Rela));
+
+    /* The sections of the object: null, ours, the stack note, the
+       relocations of ours, the symbol table and the string tables.  */
+    struct vector* headers = vector_create (sizeof (Elf64_Shdr));
+    struct buffer* section_names = buffer_create ();
+    buffer_write (section_names, 0);
+    Elf64_Shdr null_header = {0};
+    vector_push (headers, &null_header);
+
+    size_t offset = assembler_elf_size (assembler, sizeof (Elf32_Ehdr),
+                                        sizeof (Elf64_Ehdr));
+    for (int i = 0; i < total_sections; i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        bool text = S_EQ (section->name, ".text");
+        bool writable = !text && !S_EQ (section->name, ".rodata");
+        if (section->bytes)
+        {
+            offset = assembler_align_up (offset, section->alignment);
+        }
+        Elf64_Shdr header = {
+            .sh_name = (Elf64_Word) assembler_string (section_names, section->name),
+            .sh_type = section->bytes ? SHT_PROGBITS : SHT_NOBITS,
+            .sh_flags = SHF_ALLOC | (text ? SHF_EXECINSTR : 0) | \
+                        (writable ? SHF_WRITE : 0),
+            .sh_offset = (Elf64_Off) offset,
+            .sh_size = (Elf64_Xword) section->size,
+            .sh_addralign = (Elf64_Xword) section->alignment
+        };
+        vector_push (headers, &header);
+        if (section->bytes)
+        {
+            offset += section->size;
+        }
+    }
+
+    /* An empty .note.GNU-stack tells the linker the code does not
+       need an executable stack.  */
+    Elf64_Shdr stack_note_header = {
+        .sh_name = (Elf64_Word) assembler_string (section_names, ".note.GNU-stack"),
+        .sh_type = SHT_PROGBITS,
+        .sh_offset = (Elf64_Off) offset,
+        .sh_addralign = 1
+    };
+    vector_push (headers, &stack_note_header);
+
+    int symtab_index = 2 + total_sections;
+    for (int i = 0; i < total_sections; i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        if (vector_empty (section->relocations))
+        {
+            continue;
+        }
+
+        char name[ASSEMBLER_MAX_NAME];
+        snprintf (name, sizeof (name), x86_64 ? ".rela%s" : ".rel%s",
+                  section->name);
+        offset = assembler_align_up (offset, word);
+        Elf64_Shdr header = {
+            .sh_name = (Elf64_Word) assembler_string (section_names, name),
+            .sh_type = x86_64 ? SHT_RELA : SHT_REL,
+            .sh_flags = x86_64 ? SHF_INFO_LINK : 0,
+            .sh_offset = (Elf64_Off) offset,
+            .sh_size = (Elf64_Xword) (vector_count (section->relocations) * \
+                                      relocation_size),
+            .sh_info = (Elf64_Word) section->index,
+            .sh_addralign = word,
+            .sh_entsize = relocation_size
+        };
+        vector_push (headers, &header);
+        offset += header.sh_size;
+        symtab_index++;
+    }
+
+    /* Fix the links of the relocation sections now that the index
+       of the symbol table is known.  */
+    for (int i = 2 + total_sections; i < symtab_index; i++)
+    {
+        ((Elf64_Shdr*) vector_at (headers, i))->sh_link = symtab_index;
+    }
+
+    offset = assembler_align_up (offset, word);
+    Elf64_Shdr symtab_header = {
+        .sh_name = (Elf64_Word) assembler_string (section_names, ".symtab"),
+        .sh_type = SHT_SYMTAB,
+        .sh_offset = (Elf64_Off) offset,
+        .sh_size = (Elf64_Xword) (vector_count (symbols) * symbol_size),
+        .sh_link = symtab_index + 1,
+        .sh_info = first_global,
+        .sh_addralign = word,
+        .sh_entsize = symbol_size
+    };
+    vector_push (headers, &symtab_header);
+    offset += symtab_header.sh_size;
+
+    Elf64_Shdr strtab_header = {
+        .sh_name = (Elf64_Word) assembler_string (section_names, ".strtab"),
+        .sh_type = SHT_STRTAB,
+        .sh_offset = (Elf64_Off) offset,
+        .sh_size = (Elf64_Xword) strings->len,
+        .sh_addralign = 1
+    };
+    vector_push (headers, &strtab_header);
+    offset += strings->len;
+
+    Elf64_Shdr shstrtab_header = {
+        .sh_name = (Elf64_Word) assembler_string (section_names, ".shstrtab"),
+        .sh_type = SHT_STRTAB,
+        .sh_offset = (Elf64_Off) offset,
+        .sh_addralign = 1
+    };
+    shstrtab_header.sh_size = (Elf64_Xword) section_names->len;
+    vector_push (headers, &shstrtab_header);
+    offset += section_names->len;
+
+    size_t header_offset = assembler_align_up (offset, word);
+    offset = 0;
+    assembler_write_elf_header (assembler, out, headers, header_offset, &offset);
+    for (int i = 0; i < total_sections; i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        if (section->bytes)
+        {
+            assembler_write_padded (out, section->image, section->size, &offset,
+                                    section->alignment);
+        }
+    }
+
+    for (int i = 0; i < total_sections; i++)
+    {
+        struct assembler_section* section = \
+                        vector_peek_ptr_at (assembler->sections, i);
+        assembler_write_relocations (assembler, out, section->relocations,
+                                     &offset);
+    }
+
+    assembler_write_symbols (assembler, out, symbols, &offset);
+    assembler_write_padded (out, strings->data, strings->len, &offset, 1);
+    assembler_write_padded (out, section_names->data, section_names->len,
+                            &offset, 1);
+    assembler_write_headers (assembler, out, headers, &offset);
+
+    compiler_report (assembler->process,
+                     "assembler: %i bytes of code, %i of %i jumps short, "
+                     "%i relocations",
+                     (int) ((struct assembler_section*) \
+                            vector_peek_ptr_at (assembler->sections, 0))->size,
+                     assembler->short_jumps, assembler->total_jumps,
+                     assembler->total_relocations);
+
+    vector_free (symbols);
+    vector_free (headers);
+    buffer_free (strings);
+    buffer_free (section_names);
+}
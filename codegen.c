@@ -2,20 +2,30 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include "helpers/vector.h"
+#include "helpers/buffer.h"
 #include "assert.h"
 
 static struct compile_process* current_process = NULL;
 
+/* Register allocator of the function being generated, NULL when
+   variables stay in memory.  */
+static struct regalloc* codegen_regalloc = NULL;
+
+/* Set while the allocator walks a function, nothing is written.  */
+static bool codegen_silent = false;
+
+/* Codegen scopes hold the variable and function nodes
+   visible at the current point of the generated code.  */
 void
 codegen_new_scope (int flags)
 {
-    #warning "The resolver needs to exist for this to work."
+    scope_new (current_process, flags);
 }
 
 void
 codegen_finish_scope ()
 {
-    #warning "The resolver needs to exist for this to work."
+    scope_finish (current_process);
 }
 
 struct node*
@@ -27,8 +37,33 @@ codegen_node_next ()
 void
 asm_push_args (const char* insn, va_list args)
 {
+    if (codegen_silent)
+    {
+        return;
+    }
+
+    struct code_generator* generator = current_process->generator;
+    if (generator->instructions)
+    {
+        char line[512];
+        vsnprintf (line, sizeof (line), insn, args);
+        struct asm_instruction* instruction = asm_instruction_new (line);
+        vector_push (generator->instructions, &instruction);
+        return;
+    }
+
     va_list args2;
     va_copy (args2, args);
+    if (generator->assembler)
+    {
+        char line[1024];
+        vsnprintf (line, sizeof (line), insn, args);
+        fprintf (stdout, "%s\n", line);
+        assembler_line (generator->assembler, line);
+        va_end (args2);
+        return;
+    }
+
     vfprintf (stdout, insn, args);
     fprintf (stdout, "\n");
     if (current_process->ofile)
@@ -50,6 +85,11 @@ asm_push (const char* insn, ...)
 void
 asm_push_no_nl (const char* insn, ...)
 {
+    if (codegen_silent)
+    {
+        return;
+    }
+
     va_list args;
     va_start (args, insn);
     vfprintf (stdout, insn, args);
@@ -63,36 +103,71 @@ asm_push_no_nl (const char* insn, ...)
     }
 }
 
-const char*
-codegen_get_label_for_string (const char* str)
+static void
+codegen_string_table_grow ()
 {
-    const char* result = NULL;
     struct code_generator* generator = current_process->generator;
-    vector_set_peek_pointer (generator->string_table, 0);
-    struct string_table_element* current = \
-                        vector_peek_ptr (generator->string_table);
-    while (current)
+    size_t new_total = generator->total_string_buckets * 2;
+    struct string_table_element** new_buckets = \
+                        calloc (new_total, sizeof (struct string_table_element*));
+    for (size_t i = 0; i < generator->total_string_buckets; i++)
     {
-        if (S_EQ (current->str, str))
+        struct string_table_element* element = generator->string_buckets[i];
+        while (element)
         {
-            result = current->label;
-            break;
+            struct string_table_element* next = element->next;
+            size_t index = element->hash & (new_total - 1);
+            element->next = new_buckets[index];
+            new_buckets[index] = element;
+            element = next;
         }
-        current = vector_peek_ptr (generator->string_table);
     }
 
-    return result;
+    free (generator->string_buckets);
+    generator->string_buckets = new_buckets;
+    generator->total_string_buckets = new_total;
+}
+
+static struct string_table_element*
+codegen_string_table_find (const char* str, unsigned int hash)
+{
+    struct code_generator* generator = current_process->generator;
+    size_t index = hash & (generator->total_string_buckets - 1);
+    struct string_table_element* element = generator->string_buckets[index];
+    while (element)
+    {
+        if (element->hash == hash && S_EQ (element->str, str))
+        {
+            return element;
+        }
+        element = element->next;
+    }
+
+    return NULL;
+}
+
+const char*
+codegen_get_label_for_string (const char* str)
+{
+    size_t len = 0;
+    unsigned int hash = hash_string (str, &len);
+    struct string_table_element* element = \
+                        codegen_string_table_find (str, hash);
+    return element ? element->label : NULL;
 }
 
 const char*
 codegen_register_string (const char* str)
 {
-    const char* label = codegen_get_label_for_string (str);
-    if (label)
+    struct code_generator* generator = current_process->generator;
+    size_t len = 0;
+    unsigned int hash = hash_string (str, &len);
+    struct string_table_element* found = codegen_string_table_find (str, hash);
+    if (found)
     {
         /* Already registered this string, just return
            the label to the string memory.  */
-        return label;
+        return found->label;
     }
 
     struct string_table_element* str_elem = \
@@ -100,7 +175,19 @@ codegen_register_string (const char* str)
     int label_id = codegen_label_count ();
     sprintf ((char*)str_elem->label, "str_%i", label_id);
     str_elem->str = str;
-    vector_push (current_process->generator->string_table, &str_elem);
+    str_elem->hash = hash;
+    str_elem->len = len;
+    vector_push (generator->string_table, &str_elem);
+
+    /* Keep the load factor at most one.  */
+    if (vector_count (generator->string_table) > generator->total_string_buckets)
+    {
+        codegen_string_table_grow ();
+    }
+
+    size_t index = hash & (generator->total_string_buckets - 1);
+    str_elem->next = generator->string_buckets[index];
+    generator->string_buckets[index] = str_elem;
     return str_elem->label;
 }
 
@@ -111,10 +198,15 @@ codegenerator_new (struct compile_process* process)
                         calloc (1, sizeof (struct code_generator));
     generator->string_table = \
                         vector_create (sizeof (struct string_table_element*));
+    generator->total_string_buckets = STRING_TABLE_INITIAL_BUCKETS;
+    generator->string_buckets = \
+                        calloc (STRING_TABLE_INITIAL_BUCKETS,
+                                sizeof (struct string_table_element*));
     generator->entry_points = \
                         vector_create (sizeof (struct codegen_entry_point*));
     generator->exit_points  = \
                         vector_create (sizeof (struct codegen_exit_point*));
+    generator->switch_ids = vector_create (sizeof (int));
     return generator;
 }
 
@@ -189,7 +281,7 @@ codegen_begin_entry_point ()
 {
     int entry_point_id = codegen_label_count ();
     codegen_register_entry_point (entry_point_id);
-    asm_push (".entry_point_%i", entry_point_id);
+    asm_push (".entry_point_%i:", entry_point_id);
 }
 
 void
@@ -252,6 +344,100 @@ asm_keyword_for_size (size_t size, char* tmp_buf)
     return tmp_buf;
 }
 
+static const char*
+asm_reserve_keyword_for_size (size_t size)
+{
+    const char* keyword = "resb";
+    switch (size)
+    {
+        case DATA_SIZE_WORD:
+            keyword = "resw";
+            break;
+        case DATA_SIZE_DWORD:
+            keyword = "resd";
+            break;
+        case DATA_SIZE_DDWORD:
+            keyword = "resq";
+            break;
+    }
+
+    return keyword;
+}
+
+/* Alignment of a global, the largest power of two (up to 16) that
+   divides the size of one of its elements.  */
+size_t
+codegen_align_for_datatype (struct datatype* dtype)
+{
+    size_t size = datatype_size (dtype);
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
+    {
+        size = datatype_element_size (dtype);
+    }
+
+    if (datatype_is_struct_or_union (dtype) && \
+        !(dtype->flags & DATATYPE_FLAG_IS_POINTER))
+    {
+        /* Structures are aligned to their largest member.  */
+        struct node* su_node = dtype->type == DATA_TYPE_STRUCT ? \
+                               dtype->struct_node : dtype->union_node;
+        struct node* body_node = NULL;
+        if (su_node)
+        {
+            body_node = dtype->type == DATA_TYPE_STRUCT ? \
+                        su_node->_struct.body_n : su_node->_union.body_n;
+        }
+
+        size = DATA_SIZE_BYTE;
+        if (body_node && body_node->body.largest_var_node)
+        {
+            size = body_node->body.largest_var_node->var.type.size;
+        }
+    }
+
+    size_t align = 1;
+    while (align < 16 && size && (size % (align * 2)) == 0)
+    {
+        align *= 2;
+    }
+
+    return align;
+}
+
+/* True if the global is initialised with a value that is not zero.
+   Anything else can live in .bss.  */
+bool
+codegen_global_has_initial_value (struct node* node)
+{
+    struct node* val = node->var.val;
+    if (!val)
+    {
+        return false;
+    }
+
+    return val->type != NODE_TYPE_NUMBER || val->llnum != 0;
+}
+
+int
+codegen_section_for_global (struct node* node)
+{
+    struct datatype* dtype = &node->var.type;
+    /* For pointers we cannot tell `const char* p` from `char* const p`,
+       so only non pointer constants are placed in read only memory.  */
+    if (dtype->flags & DATATYPE_FLAG_IS_CONST && \
+        !(dtype->flags & DATATYPE_FLAG_IS_POINTER))
+    {
+        return CODEGEN_SECTION_RODATA;
+    }
+
+    if (!codegen_global_has_initial_value (node))
+    {
+        return CODEGEN_SECTION_BSS;
+    }
+
+    return CODEGEN_SECTION_DATA;
+}
+
 void
 codegen_generate_global_variable_for_primitive (struct node* node)
 {
@@ -262,162 +448,2424 @@ codegen_generate_global_variable_for_primitive (struct node* node)
         if (node->var.val->type == NODE_TYPE_STRING)
         {
             const char* label = codegen_register_string (node->var.val->sval);
-            asm_push ("%s: %s %s", node->var.name, \
+            asm_push ("$%s: %s %s", node->var.name, \
                       asm_keyword_for_size (variable_size (node), tmp_buf), \
                       label);
         }
         else
         {
-            asm_push ("%s: %s %lld", node->var.name, \
+            asm_push ("$%s: %s %lld", node->var.name, \
                       asm_keyword_for_size (variable_size (node), tmp_buf), \
                       node->var.val->llnum);
         }
     }
     else
     {
-        asm_push ("%s: %s 0", node->var.name, \
+        asm_push ("$%s: %s 0", node->var.name, \
                   asm_keyword_for_size (variable_size (node), tmp_buf));
     }
 }
 
+/* Uninitialised and zero initialised globals only reserve space,
+   they take no room in the object file.  */
+void
+codegen_generate_global_variable_reserved (struct node* node)
+{
+    struct datatype* dtype = &node->var.type;
+    size_t size = variable_size (node);
+    size_t element_size = codegen_align_for_datatype (dtype);
+    if (element_size > DATA_SIZE_DDWORD || (size % element_size) != 0)
+    {
+        element_size = DATA_SIZE_BYTE;
+    }
+
+    asm_push ("alignb %lu", (unsigned long) codegen_align_for_datatype (dtype));
+    asm_push ("$%s: %s %lu", node->var.name,
+              asm_reserve_keyword_for_size (element_size),
+              (unsigned long) (size / element_size));
+}
+
+/* A scalar set to a number or the address of a string is a single
+   directive, anything else goes through the initializer evaluator.  */
+bool
+codegen_global_is_primitive (struct node* node)
+{
+    struct datatype* dtype = &node->var.type;
+    struct node* val = node->var.val;
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
+    {
+        return false;
+    }
+
+    if (datatype_is_struct_or_union (dtype) && \
+        !(dtype->flags & DATATYPE_FLAG_IS_POINTER))
+    {
+        return false;
+    }
+
+    return !val || val->type == NODE_TYPE_NUMBER || val->type == NODE_TYPE_STRING;
+}
+
+void codegen_write_bytes (const char* label, const char* data, size_t len);
+void codegen_write_data (const char* label, const char* data, size_t len);
+
+/* Writes the bytes of the evaluated initializer, with an address
+   directive for every word that points somewhere.  */
+void
+codegen_generate_global_variable_evaluated (struct node* node)
+{
+    char tmp_buf[256];
+    struct initializer_data* data = initializer_evaluate (current_process, node);
+    struct vector* relocations = data->relocations;
+    if (vector_empty (relocations))
+    {
+        codegen_write_data (node->var.name, data->bytes, data->size);
+        initializer_data_free (data);
+        return;
+    }
+
+    asm_push ("$%s:", node->var.name);
+    size_t offset = 0;
+    for (int i = 0; i < vector_count (relocations); i++)
+    {
+        struct initializer_relocation* relocation = vector_at (relocations, i);
+        if (relocation->offset > offset)
+        {
+            codegen_write_bytes (NULL, data->bytes + offset,
+                                 relocation->offset - offset);
+        }
+
+        const char* label = relocation->string ? \
+                            codegen_register_string (relocation->string) : \
+                            relocation->label;
+        const char* keyword = asm_keyword_for_size (DATA_SIZE_POINTER, tmp_buf);
+        if (relocation->addend)
+        {
+            asm_push ("%s $%s%+lld", keyword, label, relocation->addend);
+        }
+        else
+        {
+            asm_push ("%s $%s", keyword, label);
+        }
+        offset = relocation->offset + DATA_SIZE_POINTER;
+    }
+
+    if (data->size > offset)
+    {
+        codegen_write_bytes (NULL, data->bytes + offset, data->size - offset);
+    }
+    initializer_data_free (data);
+}
+
 void
-codegen_generate_global_variable (struct node *node)
+codegen_generate_global_variable (struct node *node, int section)
 {
     asm_push ("; %s %s", node->var.type.type_str, node->var.name);
+    if (section == CODEGEN_SECTION_BSS)
+    {
+        codegen_generate_global_variable_reserved (node);
+        return;
+    }
+
     switch (node->var.type.type)
     {
-        case DATA_TYPE_VOID:
-        case DATA_TYPE_CHAR:
-        case DATA_TYPE_SHORT:
-        case DATA_TYPE_INTEGER:
-        case DATA_TYPE_LONG:
-            codegen_generate_global_variable_for_primitive (node);
-            break;
         case DATA_TYPE_DOUBLE:
         case DATA_TYPE_FLOAT:
             compiler_error(current_process,
                     "Doubles and floats are not supported in our subset of C");
             break;
     }
+
+    asm_push ("align %lu", \
+              (unsigned long) codegen_align_for_datatype (&node->var.type));
+    if (codegen_global_is_primitive (node))
+    {
+        codegen_generate_global_variable_for_primitive (node);
+        return;
+    }
+
+    codegen_generate_global_variable_evaluated (node);
+}
+
+void
+codegen_generate_data_section_for_variable (struct node* node, int section)
+{
+    if (!node || !node->var.name)
+    {
+        return;
+    }
+
+    /* Defined in another object.  */
+    if (node->var.type.flags & DATATYPE_FLAG_IS_EXTERN)
+    {
+        return;
+    }
+
+    if (codegen_section_for_global (node) != section)
+    {
+        return;
+    }
+
+    codegen_generate_global_variable (node, section);
 }
 
 void
-codegen_generate_data_section_part (struct node* node)
+codegen_generate_data_section_part (struct node* node, int section)
 {
     /* Switch to process the global data..  */
     switch (node->type)
     {
         case NODE_TYPE_VARIABLE:
-            codegen_generate_global_variable (node);
+            codegen_generate_data_section_for_variable (node, section);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            vector_set_peek_pointer (node->var_list.list, 0);
+            struct node* var_node = vector_peek_ptr (node->var_list.list);
+            while (var_node)
+            {
+                codegen_generate_data_section_for_variable (var_node, section);
+                var_node = vector_peek_ptr (node->var_list.list);
+            }
+            break;
+
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            /* `struct abc { int x; } abc;`  */
+            codegen_generate_data_section_for_variable (variable_node (node),
+                                                        section);
             break;
     }
 }
 
 void
-codegen_generate_data_section ()
+codegen_generate_section (int section, const char* section_name)
 {
-    asm_push ("section .data");
+    asm_push ("section %s", section_name);
+    vector_set_peek_pointer (current_process->node_tree_vec, 0);
     struct node* node = NULL;
     while ((node = codegen_node_next ()) != NULL)
     {
-        codegen_generate_data_section_part (node);
+        codegen_generate_data_section_part (node, section);
     }
 }
 
 void
-codegen_generate_root_node (struct node* node)
+codegen_generate_data_section ()
+{
+    codegen_generate_section (CODEGEN_SECTION_DATA, ".data");
+    codegen_generate_section (CODEGEN_SECTION_BSS, ".bss");
+    codegen_generate_section (CODEGEN_SECTION_RODATA, ".rodata");
+}
+
+/* Function currently being generated.  */
+static struct node* codegen_current_function = NULL;
+/* Label every `return` jumps to, the function epilogue lives there.  */
+static int codegen_current_function_exit_id = 0;
+
+struct codegen_exp_type codegen_generate_expression (struct node* node);
+struct codegen_exp_type codegen_generate_address (struct node* node);
+void codegen_generate_statement (struct node* node);
+void codegen_generate_body (struct node* node);
+
+/* Pushes `reg` to the stack and records it in the stack frame.  */
+void
+asm_push_ins_push (const char* reg, int stack_entity_type,
+                   const char* stack_entity_name)
 {
-    /* Process any functions.  */
+    asm_push ("push %s", reg);
+    stack_frame_push (codegen_current_function,
+                      &(struct stack_frame_element)
+    {
+        .type=stack_entity_type,
+        .name=stack_entity_name
+    });
 }
 
+/* Pops the last value pushed with `asm_push_ins_push` into `reg`.  */
 void
-codegen_generate_root ()
+asm_push_ins_pop (const char* reg, int expecting_stack_entity_type,
+                  const char* expecting_stack_entity_name)
 {
-    asm_push ("section .text");
-    struct node* node = NULL;
-    while ((node = codegen_node_next ()) != NULL)
+    asm_push ("pop %s", reg);
+    stack_frame_pop_expecting (codegen_current_function,
+                               expecting_stack_entity_type,
+                               expecting_stack_entity_name);
+}
+
+struct codegen_exp_type
+codegen_type_for_datatype (struct datatype* dtype)
+{
+    return (struct codegen_exp_type) {.dtype=*dtype, .array_index=0};
+}
+
+struct codegen_exp_type
+codegen_int_type ()
+{
+    return (struct codegen_exp_type)
     {
-        codegen_generate_root_node (node);
-    }
+        .dtype=
+        {
+            .flags=DATATYPE_FLAG_IS_SIGNED,
+            .type=DATA_TYPE_INTEGER,
+            .type_str="int",
+            .size=DATA_SIZE_DWORD
+        }
+    };
+}
+
+bool
+codegen_type_is_array (struct codegen_exp_type* type)
+{
+    return type->dtype.flags & DATATYPE_FLAG_IS_ARRAY && \
+           type->array_index < array_total_indexes (&type->dtype);
+}
+
+bool
+codegen_type_is_pointer (struct codegen_exp_type* type)
+{
+    return !codegen_type_is_array (type) && \
+           type->dtype.flags & DATATYPE_FLAG_IS_POINTER && \
+           type->dtype.pointer_depth > 0;
+}
+
+/* Pointers and arrays take part in pointer arithmetic.  */
+bool
+codegen_type_is_pointer_like (struct codegen_exp_type* type)
+{
+    return codegen_type_is_array (type) || codegen_type_is_pointer (type);
+}
+
+bool
+codegen_type_is_struct_or_union (struct codegen_exp_type* type)
+{
+    return !codegen_type_is_pointer_like (type) && \
+           datatype_is_struct_or_union (&type->dtype);
 }
 
 bool
-codegen_write_string_char_escaped (char c)
+codegen_type_is_signed (struct codegen_exp_type* type)
+{
+    return !codegen_type_is_pointer_like (type) && \
+           type->dtype.flags & DATATYPE_FLAG_IS_SIGNED;
+}
+
+size_t
+codegen_type_size (struct codegen_exp_type* type)
 {
-    const char* c_out = NULL;
-    switch (c)
+    if (codegen_type_is_array (type))
     {
-        case '\n':
-            c_out = "10";
-            break;
-        case '\t':
-            c_out = "9";
-            break;
+        return array_brackets_calculate_size_from_index (&type->dtype,
+                                type->dtype.array.brackets, type->array_index);
     }
 
-    if (c_out)
+    if (codegen_type_is_pointer (type))
     {
-        asm_push_no_nl ("%s, ", c_out);
+        return DATA_SIZE_POINTER;
     }
-    return c_out != NULL;
+
+    return type->dtype.size;
 }
 
-void
-codegen_write_string (struct string_table_element* element)
+/* Size of the element `type` points to, `p + 1` advances by this much.  */
+size_t
+codegen_type_stride (struct codegen_exp_type* type)
+{
+    size_t stride = 0;
+    if (codegen_type_is_array (type))
+    {
+        stride = array_brackets_calculate_size_from_index (&type->dtype,
+                            type->dtype.array.brackets, type->array_index + 1);
+    }
+    else if (type->dtype.pointer_depth > 1)
+    {
+        stride = DATA_SIZE_POINTER;
+    }
+    else
+    {
+        stride = type->dtype.size;
+    }
+
+    /* `void*` arithmetic works on bytes.  */
+    return stride ? stride : DATA_SIZE_BYTE;
+}
+
+/* Type of `*type` or `type[0]`.  */
+struct codegen_exp_type
+codegen_type_dereference (struct codegen_exp_type* type)
 {
-    asm_push_no_nl ("%s: db ", element->label);
-    size_t len = strlen (element->str);
-    for (int i = 0; i < len; i++)
+    struct codegen_exp_type result = *type;
+    if (codegen_type_is_array (type))
     {
-        char c = element->str[i];
-        bool handled = codegen_write_string_char_escaped (c);
-        if (handled)
+        result.array_index++;
+        if (result.array_index >= array_total_indexes (&result.dtype))
         {
-            continue;
+            result.dtype.flags &= ~DATATYPE_FLAG_IS_ARRAY;
         }
-        asm_push_no_nl ("'%c', ", c);
+        return result;
+    }
+
+    if (!codegen_type_is_pointer (type))
+    {
+        compiler_error (current_process,
+                        "Cannot dereference a value that is not a pointer");
     }
 
-    asm_push_no_nl ("0");
-    asm_push ("");
+    result.dtype.pointer_depth--;
+    if (result.dtype.pointer_depth == 0)
+    {
+        result.dtype.flags &= ~DATATYPE_FLAG_IS_POINTER;
+    }
+    return result;
 }
 
-void
-codegen_write_strings ()
+/* Type of `&type`.  Arrays decay to a pointer to their first element.  */
+struct codegen_exp_type
+codegen_type_address_of (struct codegen_exp_type* type)
 {
-    #warning "Loop through the string table and write all the strings"
-    struct code_generator* generator = current_process->generator;
-    vector_set_peek_pointer (generator->string_table, 0);
-    struct string_table_element* element = \
-                        vector_peek_ptr (generator->string_table);
-    while (element)
+    struct codegen_exp_type result = *type;
+    if (codegen_type_is_array (type))
     {
-        codegen_write_string (element);
-        element = vector_peek_ptr (generator->string_table);
+        result = codegen_type_dereference (type);
     }
+
+    result.dtype.flags &= ~DATATYPE_FLAG_IS_ARRAY;
+    result.dtype.flags |= DATATYPE_FLAG_IS_POINTER;
+    result.dtype.pointer_depth++;
+    return result;
 }
 
-void
-codegen_generate_readonly ()
+/* Arrays and structures have no value that fits a register,
+   using them yields their address.  */
+bool
+codegen_type_is_addressed (struct codegen_exp_type* type)
 {
-    asm_push ("section .rodata");
-    codegen_write_strings ();
+    return codegen_type_is_array (type) || \
+           codegen_type_is_struct_or_union (type);
 }
 
-int
-codegen (struct compile_process* process)
+const char*
+codegen_size_keyword (size_t size)
 {
-    current_process = process;
-    scope_create_root (process);
-    vector_set_peek_pointer (process->node_tree_vec, 0);
-    codegen_new_scope (0);
-    codegen_generate_data_section ();
-    vector_set_peek_pointer (process->node_tree_vec, 0);
-    codegen_generate_root ();
-    codegen_finish_scope ();
+    switch (size)
+    {
+        case DATA_SIZE_BYTE:
+            return "byte";
+        case DATA_SIZE_WORD:
+            return "word";
+        case DATA_SIZE_DDWORD:
+            return "qword";
+    }
 
-    /* Generate read only data.  */
-    codegen_generate_readonly ();
+    return "dword";
+}
+
+/* `eax` and `edx` viewed with the width of `size`.  */
+static const char*
+codegen_sub_register (const char* reg, size_t size)
+{
+    bool is_edx = S_EQ (reg, "edx");
+    switch (size)
+    {
+        case DATA_SIZE_BYTE:
+            return is_edx ? "dl" : "al";
+        case DATA_SIZE_WORD:
+            return is_edx ? "dx" : "ax";
+    }
+
+    return reg;
+}
+
+/* Loads the value of `type` found at `address` into eax.  */
+void
+codegen_load (const char* address, struct codegen_exp_type* type)
+{
+    if (codegen_type_is_addressed (type))
+    {
+        asm_push ("lea eax, %s", address);
+        return;
+    }
+
+    size_t size = codegen_type_size (type);
+    if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
+    {
+        asm_push ("%s eax, %s %s",
+                  codegen_type_is_signed (type) ? "movsx" : "movzx",
+                  codegen_size_keyword (size), address);
+        return;
+    }
+
+    asm_push ("mov eax, %s %s", codegen_size_keyword (size), address);
+}
+
+/* Stores `reg` into the object of `type` found at `address`.  */
+void
+codegen_store (const char* address, struct codegen_exp_type* type,
+               const char* reg)
+{
+    if (codegen_type_is_addressed (type))
+    {
+        compiler_error (current_process,
+                        "Assigning arrays or structures is not supported");
+    }
+
+    size_t size = codegen_type_size (type);
+    asm_push ("mov %s %s, %s", codegen_size_keyword (size), address,
+              codegen_sub_register (reg, size));
+}
+
+/* Truncates or extends eax to the width of `type`.  */
+void
+codegen_convert (struct codegen_exp_type* type)
+{
+    if (codegen_type_is_pointer_like (type) || \
+        codegen_type_is_struct_or_union (type))
+    {
+        return;
+    }
+
+    size_t size = codegen_type_size (type);
+    if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
+    {
+        asm_push ("%s eax, %s", codegen_type_is_signed (type) ? "movsx" : "movzx",
+                  codegen_sub_register ("eax", size));
+    }
+}
+
+/* Memory operand of a variable, e.g. `[ebp-4]` for locals,
+   `[ebp+8]` for arguments and `[name]` for globals.  */
+void
+codegen_variable_address (struct node* var_node, char* out)
+{
+    if (!var_node->binded.function)
+    {
+        sprintf (out, "[$%s]", var_node->var.name);
+        return;
+    }
+
+    sprintf (out, "[ebp%+i]", var_node->var.aoffset);
+}
+
+/* Register holding `var_node`, NULL if it lives in memory.  */
+static const char*
+codegen_variable_register (struct node* var_node)
+{
+    if (!codegen_regalloc)
+    {
+        return NULL;
+    }
+
+    regalloc_record_use (codegen_regalloc, var_node);
+    return regalloc_register_for_variable (codegen_regalloc, var_node);
+}
+
+/* Loads the variable `var_node` of `type` into eax.  */
+void
+codegen_load_variable (struct node* var_node, struct codegen_exp_type* type)
+{
+    char address[64];
+    const char* reg = codegen_variable_register (var_node);
+    if (reg)
+    {
+        asm_push ("mov eax, %s", reg);
+        return;
+    }
+
+    codegen_variable_address (var_node, address);
+    codegen_load (address, type);
+}
+
+/* Stores `reg` into the variable `var_node` of `type`.  Registers
+   keep small values extended, as they would be after a load.  */
+void
+codegen_store_variable (struct node* var_node, struct codegen_exp_type* type,
+                        const char* reg)
+{
+    char address[64];
+    const char* var_reg = codegen_variable_register (var_node);
+    if (!var_reg)
+    {
+        codegen_variable_address (var_node, address);
+        codegen_store (address, type, reg);
+        return;
+    }
+
+    size_t size = codegen_type_size (type);
+    if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
+    {
+        asm_push ("%s %s, %s", codegen_type_is_signed (type) ? "movsx" : "movzx",
+                  var_reg, codegen_sub_register (reg, size));
+        return;
+    }
+
+    asm_push ("mov %s, %s", var_reg, reg);
+}
+
+/* Keeps the value in eax aside in a free register, or on the stack
+   when there is none.  Returns the register, NULL if pushed.  */
+static const char*
+codegen_save_temporary (const char* stack_entity_name)
+{
+    const char* reg = codegen_regalloc ? \
+                      regalloc_temporary_acquire (codegen_regalloc) : NULL;
+    if (reg)
+    {
+        asm_push ("mov %s, eax", reg);
+        return reg;
+    }
+
+    asm_push_ins_push ("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                       stack_entity_name);
+    return NULL;
+}
+
+/* Moves a value kept with `codegen_save_temporary` into `out_reg`.  */
+static void
+codegen_restore_temporary (const char* reg, const char* out_reg,
+                           const char* stack_entity_name)
+{
+    if (reg)
+    {
+        asm_push ("mov %s, %s", out_reg, reg);
+        regalloc_temporary_release (codegen_regalloc, reg);
+        return;
+    }
+
+    asm_push_ins_pop (out_reg, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                      stack_entity_name);
+}
+
+struct node*
+codegen_scope_find (const char* name)
+{
+    struct scope* scope = scope_current (current_process);
+    while (scope)
+    {
+        for (int i = vector_count (scope->entities) - 1; i >= 0; i--)
+        {
+            struct node* node = vector_peek_ptr_at (scope->entities, i);
+            const char* node_name = node->type == NODE_TYPE_FUNCTION ? \
+                                    node->func.name : node->var.name;
+            if (node_name && S_EQ (node_name, name))
+            {
+                return node;
+            }
+        }
+        scope = scope->parent;
+    }
+
+    return NULL;
+}
+
+void
+codegen_scope_register (struct node* node)
+{
+    if (node->type == NODE_TYPE_VARIABLE && !node->var.name)
+    {
+        return;
+    }
+
+    scope_push (current_process, node, 0);
+}
+
+struct node*
+codegen_variable_for_identifier (struct node* node)
+{
+    struct node* var_node = codegen_scope_find (node->sval);
+    if (!var_node)
+    {
+        compiler_error (current_process, "Undeclared identifier `%s`",
+                        node->sval);
+    }
+
+    return var_node;
+}
+
+/* Finds member `name` in the structure or union body `body_node`.  */
+struct node*
+codegen_struct_member (struct node* body_node, const char* name)
+{
+    vector_set_peek_pointer (body_node->body.statements, 0);
+    struct node* statement = vector_peek_ptr (body_node->body.statements);
+    while (statement)
+    {
+        if (statement->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            for (int i = 0; i < vector_count (statement->var_list.list); i++)
+            {
+                struct node* var_node = \
+                        vector_peek_ptr_at (statement->var_list.list, i);
+                if (S_EQ (var_node->var.name, name))
+                {
+                    return var_node;
+                }
+            }
+        }
+        else
+        {
+            struct node* var_node = variable_node (statement);
+            if (var_node && var_node->var.name && \
+                S_EQ (var_node->var.name, name))
+            {
+                return var_node;
+            }
+        }
+        statement = vector_peek_ptr (body_node->body.statements);
+    }
+
+    return NULL;
+}
+
+/* Address of `left.right` or `left->right` in eax.  */
+struct codegen_exp_type
+codegen_generate_member_address (struct node* node)
+{
+    struct codegen_exp_type type;
+    if (S_EQ (node->exp.op, "->"))
+    {
+        type = codegen_generate_expression (node->exp.left);
+        if (!codegen_type_is_pointer (&type))
+        {
+            compiler_error (current_process, "`->` used on a non pointer");
+        }
+        type = codegen_type_dereference (&type);
+    }
+    else
+    {
+        type = codegen_generate_address (node->exp.left);
+    }
+
+    if (!codegen_type_is_struct_or_union (&type) || !type.dtype.struct_node)
+    {
+        compiler_error (current_process,
+                        "Member access on something that is not a structure");
+    }
+
+    struct node* body_node = type.dtype.type == DATA_TYPE_STRUCT ? \
+                             type.dtype.struct_node->_struct.body_n : \
+                             type.dtype.union_node->_union.body_n;
+    if (node->exp.right->type != NODE_TYPE_IDENTIFIER || !body_node)
+    {
+        compiler_error (current_process, "Invalid member access");
+    }
+
+    struct node* member = codegen_struct_member (body_node,
+                                                 node->exp.right->sval);
+    if (!member)
+    {
+        compiler_error (current_process, "No member named `%s`",
+                        node->exp.right->sval);
+    }
+
+    if (member->var.aoffset)
+    {
+        asm_push ("add eax, %i", member->var.aoffset);
+    }
+    return codegen_type_for_datatype (&member->var.type);
+}
+
+/* Multiplies `reg` by the constant `value`.  */
+void
+codegen_scale (const char* reg, size_t value)
+{
+    if (value == 1)
+    {
+        return;
+    }
+
+    if ((value & (value - 1)) == 0)
+    {
+        int shift = 0;
+        while ((1u << shift) != value)
+        {
+            shift++;
+        }
+        asm_push ("shl %s, %i", reg, shift);
+        return;
+    }
+
+    asm_push ("imul %s, %s, %lu", reg, reg, (unsigned long) value);
+}
+
+/* Address of `left[right]` in eax.  */
+struct codegen_exp_type
+codegen_generate_array_address (struct node* node)
+{
+    struct codegen_exp_type type = codegen_generate_expression (node->exp.left);
+    if (!codegen_type_is_pointer_like (&type))
+    {
+        compiler_error (current_process, "Indexing something that is not "
+                        "an array or a pointer");
+    }
+
+    const char* base_reg = codegen_save_temporary ("array_base");
+    struct node* index_node = node->exp.right;
+    if (index_node->type == NODE_TYPE_BRACKET)
+    {
+        index_node = index_node->bracket.inner;
+    }
+    codegen_generate_expression (index_node);
+    codegen_scale ("eax", codegen_type_stride (&type));
+    codegen_restore_temporary (base_reg, "ecx", "array_base");
+    asm_push ("add eax, ecx");
+    return codegen_type_dereference (&type);
+}
+
+/* Computes the address of the lvalue `node` into eax and returns the
+   type of the object stored there.  */
+struct codegen_exp_type
+codegen_generate_address (struct node* node)
+{
+    char address[64];
+    switch (node->type)
+    {
+        case NODE_TYPE_IDENTIFIER:
+        {
+            struct node* var_node = codegen_variable_for_identifier (node);
+            if (var_node->type != NODE_TYPE_VARIABLE)
+            {
+                compiler_error (current_process,
+                                "`%s` is not a variable", node->sval);
+            }
+            if (codegen_regalloc)
+            {
+                regalloc_record_address_taken (codegen_regalloc, var_node);
+            }
+            codegen_variable_address (var_node, address);
+            asm_push ("lea eax, %s", address);
+            return codegen_type_for_datatype (&var_node->var.type);
+        }
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return codegen_generate_address (node->parenthesis.exp);
+
+        case NODE_TYPE_UNARY:
+            if (S_EQ (node->unary.op, "*"))
+            {
+                struct codegen_exp_type type = \
+                        codegen_generate_expression (node->unary.operand);
+                return codegen_type_dereference (&type);
+            }
+            break;
+
+        case NODE_TYPE_EXPRESSION:
+            if (S_EQ (node->exp.op, "[]"))
+            {
+                return codegen_generate_array_address (node);
+            }
+
+            if (S_EQ (node->exp.op, ".") || S_EQ (node->exp.op, "->"))
+            {
+                return codegen_generate_member_address (node);
+            }
+            break;
+    }
+
+    compiler_error (current_process, "Expression is not assignable");
+    return codegen_int_type ();
+}
+
+/* Plain variables are read and written in place, without
+   computing their address first.  */
+static struct node*
+codegen_direct_variable (struct node* node)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESES)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    if (node->type != NODE_TYPE_IDENTIFIER)
+    {
+        return NULL;
+    }
+
+    struct node* var_node = codegen_variable_for_identifier (node);
+    return var_node->type == NODE_TYPE_VARIABLE ? var_node : NULL;
+}
+
+/* eax = eax `op` ecx.  */
+void
+codegen_generate_arithmetic (const char* op, bool is_signed)
+{
+    if (S_EQ (op, "+"))
+    {
+        asm_push ("add eax, ecx");
+    }
+    else if (S_EQ (op, "-"))
+    {
+        asm_push ("sub eax, ecx");
+    }
+    else if (S_EQ (op, "*"))
+    {
+        asm_push ("imul eax, ecx");
+    }
+    else if (S_EQ (op, "/") || S_EQ (op, "%"))
+    {
+        if (is_signed)
+        {
+            asm_push ("cdq");
+            asm_push ("idiv ecx");
+        }
+        else
+        {
+            asm_push ("xor edx, edx");
+            asm_push ("div ecx");
+        }
+
+        if (S_EQ (op, "%"))
+        {
+            asm_push ("mov eax, edx");
+        }
+    }
+    else if (S_EQ (op, "&"))
+    {
+        asm_push ("and eax, ecx");
+    }
+    else if (S_EQ (op, "|"))
+    {
+        asm_push ("or eax, ecx");
+    }
+    else if (S_EQ (op, "^"))
+    {
+        asm_push ("xor eax, ecx");
+    }
+    else if (S_EQ (op, "<<"))
+    {
+        asm_push ("shl eax, cl");
+    }
+    else if (S_EQ (op, ">>"))
+    {
+        asm_push ("%s eax, cl", is_signed ? "sar" : "shr");
+    }
+    else
+    {
+        compiler_error (current_process, "Unsupported operator `%s`", op);
+    }
+}
+
+/* The setcc condition for a comparison operator.  */
+static const char*
+codegen_condition_for_op (const char* op, bool is_signed)
+{
+    if (S_EQ (op, "=="))
+        return "e";
+    if (S_EQ (op, "!="))
+        return "ne";
+    if (S_EQ (op, "<"))
+        return is_signed ? "l" : "b";
+    if (S_EQ (op, "<="))
+        return is_signed ? "le" : "be";
+    if (S_EQ (op, ">"))
+        return is_signed ? "g" : "a";
+    if (S_EQ (op, ">="))
+        return is_signed ? "ge" : "ae";
+    return NULL;
+}
+
+struct codegen_exp_type
+codegen_generate_logical (struct node* node)
+{
+    bool is_and = S_EQ (node->exp.op, "&&");
+    int id = codegen_label_count ();
+    codegen_generate_expression (node->exp.left);
+    asm_push ("test eax, eax");
+    asm_push ("%s .logical_%i_short", is_and ? "jz" : "jnz", id);
+    codegen_generate_expression (node->exp.right);
+    asm_push ("test eax, eax");
+    asm_push ("%s .logical_%i_short", is_and ? "jz" : "jnz", id);
+    asm_push ("mov eax, %i", is_and ? 1 : 0);
+    asm_push ("jmp .logical_%i_end", id);
+    asm_push (".logical_%i_short:", id);
+    asm_push ("mov eax, %i", is_and ? 0 : 1);
+    asm_push (".logical_%i_end:", id);
+    return codegen_int_type ();
+}
+
+/* `a ? b : c` is parsed as `?` with `a` on the left and
+   a tenary node holding `b` and `c` on the right.  */
+struct codegen_exp_type
+codegen_generate_tenary (struct node* node)
+{
+    int id = codegen_label_count ();
+    struct node* tenary_node = node->exp.right;
+    codegen_generate_expression (node->exp.left);
+    asm_push ("test eax, eax");
+    asm_push ("jz .tenary_%i_false", id);
+    struct codegen_exp_type type = \
+                    codegen_generate_expression (tenary_node->tenary.true_node);
+    asm_push ("jmp .tenary_%i_end", id);
+    asm_push (".tenary_%i_false:", id);
+    codegen_generate_expression (tenary_node->tenary.false_node);
+    asm_push (".tenary_%i_end:", id);
+    return type;
+}
+
+/* Both operands have to be signed for a signed operation, except for
+   a shift, which takes the sign of its promoted left operand alone.  */
+static bool
+codegen_operation_is_signed (const char* op, struct codegen_exp_type* left,
+                             struct codegen_exp_type* right)
+{
+    if (S_EQ (op, "<<") || S_EQ (op, ">>"))
+    {
+        return codegen_type_is_signed (left) || \
+               codegen_type_size (left) < DATA_SIZE_DWORD;
+    }
+
+    return codegen_type_is_signed (left) && codegen_type_is_signed (right);
+}
+
+struct codegen_exp_type
+codegen_generate_assignment (struct node* node)
+{
+    /* `+=` is `+`, `<<=` is `<<`.  */
+    char op[4] = {0};
+    strncpy (op, node->exp.op, strlen (node->exp.op) - 1);
+    struct node* var_node = codegen_direct_variable (node->exp.left);
+    struct codegen_exp_type type;
+    if (var_node)
+    {
+        type = codegen_type_for_datatype (&var_node->var.type);
+        struct codegen_exp_type right_type = \
+                        codegen_generate_expression (node->exp.right);
+        if (op[0])
+        {
+            asm_push ("mov ecx, eax");
+            codegen_load_variable (var_node, &type);
+            if (codegen_type_is_pointer (&type))
+            {
+                codegen_scale ("ecx", codegen_type_stride (&type));
+            }
+            codegen_generate_arithmetic (op, codegen_operation_is_signed (op, &type,
+                                                                     &right_type));
+        }
+        codegen_store_variable (var_node, &type, "eax");
+        codegen_convert (&type);
+        return type;
+    }
+
+    type = codegen_generate_address (node->exp.left);
+    const char* address_reg = codegen_save_temporary ("assignment_address");
+    struct codegen_exp_type right_type = \
+                        codegen_generate_expression (node->exp.right);
+    if (op[0])
+    {
+        asm_push ("mov ecx, eax");
+        asm_push ("mov eax, %s", address_reg ? address_reg : "[esp]");
+        codegen_load ("[eax]", &type);
+        if (codegen_type_is_pointer (&type))
+        {
+            codegen_scale ("ecx", codegen_type_stride (&type));
+        }
+        codegen_generate_arithmetic (op, codegen_operation_is_signed (op, &type,
+                                                                 &right_type));
+    }
+    codegen_restore_temporary (address_reg, "edx", "assignment_address");
+    codegen_store ("[edx]", &type, "eax");
+    codegen_convert (&type);
+    return type;
+}
+
+struct codegen_exp_type
+codegen_generate_binary (struct node* node)
+{
+    const char* op = node->exp.op;
+    struct codegen_exp_type left_type = \
+                        codegen_generate_expression (node->exp.left);
+    const char* left_reg = codegen_save_temporary ("result_value");
+    struct codegen_exp_type right_type = \
+                        codegen_generate_expression (node->exp.right);
+    asm_push ("mov ecx, eax");
+    codegen_restore_temporary (left_reg, "eax", "result_value");
+
+    bool left_is_pointer = codegen_type_is_pointer_like (&left_type);
+    bool right_is_pointer = codegen_type_is_pointer_like (&right_type);
+    bool is_signed = codegen_operation_is_signed (op, &left_type, &right_type);
+
+    const char* condition = codegen_condition_for_op (op, is_signed);
+    if (condition)
+    {
+        asm_push ("cmp eax, ecx");
+        asm_push ("set%s al", condition);
+        asm_push ("movzx eax, al");
+        return codegen_int_type ();
+    }
+
+    /* Pointer arithmetic, `p + 1` moves by the size of `*p`.  */
+    if (S_EQ (op, "-") && left_is_pointer && right_is_pointer)
+    {
+        asm_push ("sub eax, ecx");
+        size_t stride = codegen_type_stride (&left_type);
+        if (stride > 1)
+        {
+            asm_push ("cdq");
+            asm_push ("mov ecx, %lu", (unsigned long) stride);
+            asm_push ("idiv ecx");
+        }
+        return codegen_int_type ();
+    }
+
+    struct codegen_exp_type result_type = left_type;
+    if ((S_EQ (op, "+") || S_EQ (op, "-")) && left_is_pointer)
+    {
+        codegen_scale ("ecx", codegen_type_stride (&left_type));
+    }
+    else if (S_EQ (op, "+") && right_is_pointer)
+    {
+        codegen_scale ("eax", codegen_type_stride (&right_type));
+        result_type = right_type;
+    }
+    else if (!left_is_pointer)
+    {
+        /* Integer promotion, `char + char` is an int.  */
+        result_type = codegen_int_type ();
+        if (!is_signed)
+        {
+            result_type.dtype.flags &= ~DATATYPE_FLAG_IS_SIGNED;
+        }
+    }
+
+    codegen_generate_arithmetic (op, is_signed);
+    if (codegen_type_is_array (&result_type))
+    {
+        /* `array + 1` is a pointer to the second element.  */
+        result_type = codegen_type_address_of (&result_type);
+    }
+    return result_type;
+}
+
+/* `++x`, `x--`, ...  */
+struct codegen_exp_type
+codegen_generate_increment (struct node* node)
+{
+    bool is_increment = S_EQ (node->unary.op, "++");
+    bool is_postfix = node->unary.flags & UNARY_FLAG_IS_POSTFIX;
+    struct codegen_exp_type type;
+    struct node* var_node = codegen_direct_variable (node->unary.operand);
+    if (var_node)
+    {
+        type = codegen_type_for_datatype (&var_node->var.type);
+        codegen_load_variable (var_node, &type);
+    }
+    else
+    {
+        type = codegen_generate_address (node->unary.operand);
+        asm_push ("mov ecx, eax");
+        codegen_load ("[ecx]", &type);
+    }
+
+    size_t step = codegen_type_is_pointer (&type) ? \
+                  codegen_type_stride (&type) : 1;
+    const char* result_reg = "eax";
+    if (is_postfix)
+    {
+        asm_push ("lea edx, [eax%+i]", is_increment ? (int) step : -(int) step);
+        result_reg = "edx";
+    }
+    else
+    {
+        asm_push ("%s eax, %lu", is_increment ? "add" : "sub",
+                  (unsigned long) step);
+    }
+
+    if (var_node)
+    {
+        codegen_store_variable (var_node, &type, result_reg);
+    }
+    else
+    {
+        codegen_store ("[ecx]", &type, result_reg);
+    }
+
+    if (is_postfix)
+    {
+        return type;
+    }
+
+    codegen_convert (&type);
+    return type;
+}
+
+struct codegen_exp_type
+codegen_generate_unary (struct node* node)
+{
+    const char* op = node->unary.op;
+    if (S_EQ (op, "++") || S_EQ (op, "--"))
+    {
+        return codegen_generate_increment (node);
+    }
+
+    if (S_EQ (op, "&"))
+    {
+        struct codegen_exp_type type = codegen_generate_address (node->unary.operand);
+        return codegen_type_address_of (&type);
+    }
+
+    if (S_EQ (op, "*"))
+    {
+        struct codegen_exp_type type = codegen_generate_address (node);
+        codegen_load ("[eax]", &type);
+        return type;
+    }
+
+    struct codegen_exp_type type = codegen_generate_expression (node->unary.operand);
+    if (S_EQ (op, "-"))
+    {
+        asm_push ("neg eax");
+    }
+    else if (S_EQ (op, "~"))
+    {
+        asm_push ("not eax");
+    }
+    else if (S_EQ (op, "!"))
+    {
+        asm_push ("test eax, eax");
+        asm_push ("sete al");
+        asm_push ("movzx eax, al");
+        return codegen_int_type ();
+    }
+    else if (!S_EQ (op, "+"))
+    {
+        compiler_error (current_process, "Unsupported unary operator `%s`", op);
+    }
+
+    return type;
+}
+
+/* Flattens `a, b, c` into the vector of call arguments.  */
+void
+codegen_call_arguments (struct node* node, struct vector* arguments)
+{
+    if (!node || node->type == NODE_TYPE_BLANK)
+    {
+        return;
+    }
+
+    if (node_is_expression (node, ","))
+    {
+        codegen_call_arguments (node->exp.left, arguments);
+        codegen_call_arguments (node->exp.right, arguments);
+        return;
+    }
+
+    vector_push (arguments, &node);
+}
+
+/* `exp` of `__builtin_expect (exp, value)`, which is worth `exp`
+   and says it is usually `value`.  NULL when `node` is not one.  */
+struct node*
+codegen_expected_expression (struct node* node, long long* value)
+{
+    if (node->type != NODE_TYPE_EXPRESSION || !S_EQ (node->exp.op, "()") || \
+        node->exp.left->type != NODE_TYPE_IDENTIFIER || \
+        !S_EQ (node->exp.left->sval, "__builtin_expect"))
+    {
+        return NULL;
+    }
+
+    struct vector* arguments = vector_create (sizeof (struct node*));
+    codegen_call_arguments (node->exp.right->parenthesis.exp, arguments);
+    struct node* expected = vector_count (arguments) == 2 ? \
+                            vector_peek_ptr_at (arguments, 1) : NULL;
+    if (!expected || expected->type != NODE_TYPE_NUMBER)
+    {
+        compiler_error (current_process, "`__builtin_expect` takes an expression "
+                        "and a constant");
+    }
+
+    struct node* exp = vector_peek_ptr_at (arguments, 0);
+    *value = expected->llnum;
+    vector_free (arguments);
+    return exp;
+}
+
+struct codegen_exp_type
+codegen_generate_call (struct node* node)
+{
+    long long expected = 0;
+    struct node* expected_node = codegen_expected_expression (node, &expected);
+    if (expected_node)
+    {
+        return codegen_generate_expression (expected_node);
+    }
+
+    struct vector* arguments = vector_create (sizeof (struct node*));
+    codegen_call_arguments (node->exp.right->parenthesis.exp, arguments);
+
+    /* cdecl, arguments are pushed from right to left and
+       every argument takes at least one stack slot.  */
+    for (int i = vector_count (arguments) - 1; i >= 0; i--)
+    {
+        struct node* argument = vector_peek_ptr_at (arguments, i);
+        struct codegen_exp_type type = codegen_generate_expression (argument);
+        if (codegen_type_is_struct_or_union (&type))
+        {
+            compiler_error (current_process,
+                    "Passing structures by value is not supported");
+        }
+        asm_push_ins_push ("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                           "call_argument");
+    }
+
+    struct codegen_exp_type type = codegen_int_type ();
+    struct node* callee = node->exp.left;
+    struct node* function_node = NULL;
+    if (callee->type == NODE_TYPE_IDENTIFIER)
+    {
+        function_node = codegen_scope_find (callee->sval);
+        if (!function_node)
+        {
+            compiler_error (current_process, "Call to undeclared function `%s`",
+                            callee->sval);
+        }
+    }
+
+    if (function_node && function_node->type == NODE_TYPE_FUNCTION)
+    {
+        asm_push ("call $%s", function_node->func.name);
+        type = codegen_type_for_datatype (&function_node->func.rtype);
+    }
+    else
+    {
+        /* Call through a function pointer.  */
+        codegen_generate_expression (callee);
+        asm_push ("call eax");
+    }
+
+    size_t total_arguments = vector_count (arguments);
+    if (total_arguments)
+    {
+        asm_push ("add esp, %lu",
+                  (unsigned long) (total_arguments * STACK_PUSH_SIZE));
+        stack_frame_add (codegen_current_function,
+                         STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                         "call_argument",
+                         total_arguments * STACK_PUSH_SIZE);
+    }
+    vector_free (arguments);
+
+    /* The callee does not extend a char or short result.  */
+    codegen_convert (&type);
+    return type;
+}
+
+struct codegen_exp_type
+codegen_generate_identifier (struct node* node)
+{
+    struct node* found = codegen_variable_for_identifier (node);
+    if (found->type == NODE_TYPE_FUNCTION)
+    {
+        /* Name of a function is its address.  */
+        asm_push ("mov eax, $%s", found->func.name);
+        struct codegen_exp_type type = \
+                        codegen_type_for_datatype (&found->func.rtype);
+        return codegen_type_address_of (&type);
+    }
+
+    struct codegen_exp_type type = codegen_type_for_datatype (&found->var.type);
+    codegen_load_variable (found, &type);
+    return type;
+}
+
+/* Generates `node` leaving its value in eax, arrays and structures
+   leave their address.  Returns the type of the value.  */
+struct codegen_exp_type
+codegen_generate_expression (struct node* node)
+{
+    switch (node->type)
+    {
+        case NODE_TYPE_NUMBER:
+            asm_push ("mov eax, %lld", node->llnum);
+            return codegen_int_type ();
+
+        case NODE_TYPE_STRING:
+        {
+            asm_push ("mov eax, %s", codegen_register_string (node->sval));
+            struct codegen_exp_type type = codegen_int_type ();
+            type.dtype.type = DATA_TYPE_CHAR;
+            type.dtype.type_str = "char";
+            type.dtype.size = DATA_SIZE_BYTE;
+            return codegen_type_address_of (&type);
+        }
+
+        case NODE_TYPE_IDENTIFIER:
+            return codegen_generate_identifier (node);
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return codegen_generate_expression (node->parenthesis.exp);
+
+        case NODE_TYPE_UNARY:
+            return codegen_generate_unary (node);
+
+        case NODE_TYPE_CAST:
+        {
+            codegen_generate_expression (node->cast.operand);
+            struct codegen_exp_type type = \
+                            codegen_type_for_datatype (&node->cast.dtype);
+            codegen_convert (&type);
+            return type;
+        }
+
+        case NODE_TYPE_EXPRESSION:
+            break;
+
+        default:
+            compiler_error (current_process, "Unexpected node in expression");
+    }
+
+    const char* op = node->exp.op;
+    if (S_EQ (op, "[]") || S_EQ (op, ".") || S_EQ (op, "->"))
+    {
+        struct codegen_exp_type type = codegen_generate_address (node);
+        codegen_load ("[eax]", &type);
+        return type;
+    }
+
+    if (S_EQ (op, "()"))
+    {
+        return codegen_generate_call (node);
+    }
+
+    if (S_EQ (op, ","))
+    {
+        codegen_generate_expression (node->exp.left);
+        return codegen_generate_expression (node->exp.right);
+    }
+
+    if (S_EQ (op, "&&") || S_EQ (op, "||"))
+    {
+        return codegen_generate_logical (node);
+    }
+
+    if (S_EQ (op, "?"))
+    {
+        return codegen_generate_tenary (node);
+    }
+
+    if (op[strlen (op) - 1] == '=' && !codegen_condition_for_op (op, true))
+    {
+        return codegen_generate_assignment (node);
+    }
+
+    return codegen_generate_binary (node);
+}
+
+void
+codegen_generate_local_variable (struct node* node)
+{
+    if (!node || !node->var.name)
+    {
+        return;
+    }
+
+    if (node->var.type.flags & (DATATYPE_FLAG_IS_STATIC | DATATYPE_FLAG_IS_EXTERN))
+    {
+        compiler_error (current_process,
+                "Static and extern local variables are not supported");
+    }
+
+    if (node->var.val && node->var.val->type == NODE_TYPE_INITIALIZER)
+    {
+        compiler_error (current_process,
+                "Initializer lists are only supported for global variables");
+    }
+
+    if (node->var.val)
+    {
+        struct codegen_exp_type type = codegen_type_for_datatype (&node->var.type);
+        codegen_generate_expression (node->var.val);
+        codegen_store_variable (node, &type, "eax");
+    }
+
+    codegen_scope_register (node);
+}
+
+/* Values used inside a loop live until its last statement.  */
+static int
+codegen_loop_begin ()
+{
+    return codegen_regalloc ? codegen_regalloc->position : 0;
+}
+
+static void
+codegen_loop_end (int start)
+{
+    if (codegen_regalloc)
+    {
+        regalloc_record_loop (codegen_regalloc, start,
+                              codegen_regalloc->position);
+    }
+}
+
+void
+codegen_generate_if (struct node* node)
+{
+    int id = codegen_label_count ();
+    codegen_generate_expression (node->stmt.if_stmt.cond_node);
+    asm_push ("test eax, eax");
+    asm_push ("jz .if_%i_false", id);
+    codegen_generate_body (node->stmt.if_stmt.body_node);
+    struct node* next = node->stmt.if_stmt.next;
+    if (next)
+    {
+        asm_push ("jmp .if_%i_end", id);
+    }
+    asm_push (".if_%i_false:", id);
+    if (next)
+    {
+        if (next->type == NODE_TYPE_STATEMENT_ELSE)
+        {
+            codegen_generate_body (next->stmt.else_stmt.body_node);
+        }
+        else
+        {
+            codegen_generate_if (next);
+        }
+        asm_push (".if_%i_end:", id);
+    }
+}
+
+/* `continue` jumps to the entry point and `break` to the exit point.  */
+void
+codegen_generate_while (struct node* node)
+{
+    int loop_start = codegen_loop_begin ();
+    codegen_begin_entry_exit_point ();
+    struct codegen_exit_point* exit_point = codegen_current_exit_point ();
+    codegen_generate_expression (node->stmt.while_stmt.exp_node);
+    asm_push ("test eax, eax");
+    asm_push ("jz .exit_point_%i", exit_point->id);
+    codegen_generate_body (node->stmt.while_stmt.body_node);
+    codegen_goto_entry_point (node);
+    codegen_end_entry_exit_point ();
+    codegen_loop_end (loop_start);
+}
+
+/* The entry point of `do` and `for` loops is not their first
+   instruction, so it is placed after registering it.  */
+void
+codegen_generate_do_while (struct node* node)
+{
+    int loop_start = codegen_loop_begin ();
+    int body_id = codegen_label_count ();
+    int entry_point_id = codegen_label_count ();
+    codegen_register_entry_point (entry_point_id);
+    codegen_begin_exit_point ();
+    asm_push (".do_while_%i_body:", body_id);
+    codegen_generate_body (node->stmt.do_while_node.body_node);
+    asm_push (".entry_point_%i:", entry_point_id);
+    codegen_generate_expression (node->stmt.do_while_node.exp_node);
+    asm_push ("test eax, eax");
+    asm_push ("jnz .do_while_%i_body", body_id);
+    codegen_end_entry_exit_point ();
+    codegen_loop_end (loop_start);
+}
+
+void
+codegen_generate_for (struct node* node)
+{
+    struct for_stmt* for_stmt = &node->stmt.for_stmt;
+    codegen_new_scope (0);
+    if (for_stmt->init_node)
+    {
+        codegen_generate_statement (for_stmt->init_node);
+    }
+
+    int loop_start = codegen_loop_begin ();
+    int loop_id = codegen_label_count ();
+    int entry_point_id = codegen_label_count ();
+    codegen_register_entry_point (entry_point_id);
+    codegen_begin_exit_point ();
+    struct codegen_exit_point* exit_point = codegen_current_exit_point ();
+    asm_push (".for_loop_%i:", loop_id);
+    if (for_stmt->cond_node)
+    {
+        codegen_generate_expression (for_stmt->cond_node);
+        asm_push ("test eax, eax");
+        asm_push ("jz .exit_point_%i", exit_point->id);
+    }
+
+    codegen_generate_body (for_stmt->body_node);
+    asm_push (".entry_point_%i:", entry_point_id);
+    if (for_stmt->loop_node)
+    {
+        codegen_generate_expression (for_stmt->loop_node);
+    }
+    asm_push ("jmp .for_loop_%i", loop_id);
+    codegen_end_entry_exit_point ();
+    codegen_loop_end (loop_start);
+    codegen_finish_scope ();
+}
+
+static void
+codegen_case_label (char* out, int switch_id, long long value)
+{
+    /* Labels cannot contain a minus sign.  */
+    sprintf (out, ".switch_%i_case_%s%lld", switch_id, value < 0 ? "n" : "",
+             value < 0 ? -value : value);
+}
+
+int
+codegen_current_switch_id ()
+{
+    struct vector* switch_ids = current_process->generator->switch_ids;
+    if (vector_empty (switch_ids))
+    {
+        compiler_error (current_process, "`case` outside of a switch");
+    }
+    return *(int*) vector_back (switch_ids);
+}
+
+/* Only `break` leaves a switch, `continue` still belongs to the
+   enclosing loop, so a switch has an exit point but no entry point.  */
+void
+codegen_generate_switch (struct node* node)
+{
+    struct switch_stmt* switch_stmt = &node->stmt.switch_stmt;
+    char label[64];
+    codegen_begin_exit_point ();
+    struct codegen_exit_point* exit_point = codegen_current_exit_point ();
+    int id = exit_point->id;
+    vector_push (current_process->generator->switch_ids, &id);
+
+    codegen_generate_expression (switch_stmt->exp_node);
+    vector_set_peek_pointer (switch_stmt->cases, 0);
+    struct parsed_switch_case* s_case = vector_peek (switch_stmt->cases);
+    while (s_case)
+    {
+        /* The controlling expression is compared in 32 bits.  */
+        codegen_case_label (label, id, s_case->value);
+        asm_push ("cmp eax, %i", (int) s_case->value);
+        asm_push ("je %s", label);
+        s_case = vector_peek (switch_stmt->cases);
+    }
+
+    if (switch_stmt->has_default_case)
+    {
+        asm_push ("jmp .switch_%i_default", id);
+    }
+    else
+    {
+        codegen_goto_exit_point (node);
+    }
+
+    codegen_generate_body (switch_stmt->body_node);
+    vector_pop (current_process->generator->switch_ids);
+    codegen_end_exit_point ();
+}
+
+void
+codegen_generate_return (struct node* node)
+{
+    struct node* exp = node->stmt.return_stmt.exp;
+    if (exp)
+    {
+        codegen_generate_expression (exp);
+        struct codegen_exp_type type = \
+                codegen_type_for_datatype (&codegen_current_function->func.rtype);
+        codegen_convert (&type);
+    }
+    asm_push ("jmp .function_exit_%i", codegen_current_function_exit_id);
+}
+
+void
+codegen_generate_statement (struct node* node)
+{
+    char label[64];
+    if (codegen_regalloc)
+    {
+        regalloc_next_position (codegen_regalloc);
+    }
+
+    switch (node->type)
+    {
+        case NODE_TYPE_VARIABLE:
+            codegen_generate_local_variable (node);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                codegen_generate_local_variable (
+                        vector_peek_ptr_at (node->var_list.list, i));
+            }
+            break;
+
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            /* `struct abc { int x; } abc;`  */
+            codegen_generate_local_variable (variable_node (node));
+            break;
+
+        case NODE_TYPE_BODY:
+            codegen_generate_body (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_RETURN:
+            codegen_generate_return (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_IF:
+            codegen_generate_if (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_WHILE:
+            codegen_generate_while (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_DO_WHILE:
+            codegen_generate_do_while (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_FOR:
+            codegen_generate_for (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_SWITCH:
+            codegen_generate_switch (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_CASE:
+            codegen_case_label (label, codegen_current_switch_id (),
+                                node->stmt._case.exp_node->llnum);
+            asm_push ("%s:", label);
+            break;
+
+        case NODE_TYPE_STATEMENT_DEFAULT:
+            asm_push (".switch_%i_default:", codegen_current_switch_id ());
+            break;
+
+        case NODE_TYPE_STATEMENT_BREAK:
+            if (!codegen_current_exit_point ())
+            {
+                compiler_error (current_process, "`break` outside of a loop "
+                                "or switch");
+            }
+            codegen_goto_exit_point (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_CONTINUE:
+            if (!codegen_current_entry_point ())
+            {
+                compiler_error (current_process, "`continue` outside of a loop");
+            }
+            codegen_goto_entry_point (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_GOTO:
+            asm_push ("jmp .label_%s", node->stmt._goto.label->sval);
+            break;
+
+        case NODE_TYPE_LABEL:
+            if (codegen_regalloc)
+            {
+                regalloc_record_label (codegen_regalloc);
+            }
+            asm_push (".label_%s:", node->label.name->sval);
+            break;
+
+        case NODE_TYPE_BLANK:
+            break;
+
+        default:
+            /* Expression statement, the value is discarded.  */
+            codegen_generate_expression (node);
+    }
+}
+
+void
+codegen_generate_body (struct node* node)
+{
+    if (node->type != NODE_TYPE_BODY)
+    {
+        codegen_generate_statement (node);
+        return;
+    }
+
+    codegen_new_scope (0);
+    vector_set_peek_pointer (node->body.statements, 0);
+    for (int i = 0; i < vector_count (node->body.statements); i++)
+    {
+        codegen_generate_statement (
+                vector_peek_ptr_at (node->body.statements, i));
+    }
+    codegen_finish_scope ();
+}
+
+static void
+codegen_lowest_offset_for_variable (struct node* node, int* lowest)
+{
+    if (node && node->type == NODE_TYPE_VARIABLE && \
+        node->var.aoffset < *lowest)
+    {
+        *lowest = node->var.aoffset;
+    }
+}
+
+/* Walks the statements of `node` looking for the local that lives
+   furthest away from the base pointer.  */
+void
+codegen_lowest_offset (struct node* node, int* lowest)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    switch (node->type)
+    {
+        case NODE_TYPE_BODY:
+            for (int i = 0; i < vector_count (node->body.statements); i++)
+            {
+                codegen_lowest_offset (
+                        vector_peek_ptr_at (node->body.statements, i), lowest);
+            }
+            break;
+
+        case NODE_TYPE_VARIABLE:
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            codegen_lowest_offset_for_variable (variable_node (node), lowest);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                codegen_lowest_offset_for_variable (
+                        vector_peek_ptr_at (node->var_list.list, i), lowest);
+            }
+            break;
+
+        case NODE_TYPE_STATEMENT_IF:
+            codegen_lowest_offset (node->stmt.if_stmt.body_node, lowest);
+            codegen_lowest_offset (node->stmt.if_stmt.next, lowest);
+            break;
+
+        case NODE_TYPE_STATEMENT_ELSE:
+            codegen_lowest_offset (node->stmt.else_stmt.body_node, lowest);
+            break;
+
+        case NODE_TYPE_STATEMENT_WHILE:
+            codegen_lowest_offset (node->stmt.while_stmt.body_node, lowest);
+            break;
+
+        case NODE_TYPE_STATEMENT_DO_WHILE:
+            codegen_lowest_offset (node->stmt.do_while_node.body_node, lowest);
+            break;
+
+        case NODE_TYPE_STATEMENT_FOR:
+            codegen_lowest_offset (node->stmt.for_stmt.init_node, lowest);
+            codegen_lowest_offset (node->stmt.for_stmt.body_node, lowest);
+            break;
+
+        case NODE_TYPE_STATEMENT_SWITCH:
+            codegen_lowest_offset (node->stmt.switch_stmt.body_node, lowest);
+            break;
+    }
+}
+
+/* Bytes to reserve below the base pointer for the locals of `node`.  */
+size_t
+codegen_function_frame_size (struct node* node)
+{
+    int lowest = 0;
+    codegen_lowest_offset (node->func.body_n, &lowest);
+    return align_value (-lowest, STACK_PUSH_SIZE);
+}
+
+bool
+codegen_function_is_defined (const char* name)
+{
+    struct vector* tree = current_process->node_tree_vec;
+    for (int i = 0; i < vector_count (tree); i++)
+    {
+        struct node* node = vector_peek_ptr_at (tree, i);
+        if (node->type == NODE_TYPE_FUNCTION && node->func.body_n && \
+            S_EQ (node->func.name, name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Arguments are registered first so the body can find them.  */
+void
+codegen_generate_function_body (struct node* node)
+{
+    codegen_new_scope (0);
+    struct vector* arguments = node->func.args.vector;
+    for (int i = 0; arguments && i < vector_count (arguments); i++)
+    {
+        codegen_scope_register (vector_peek_ptr_at (arguments, i));
+    }
+    codegen_generate_body (node->func.body_n);
+    codegen_finish_scope ();
+}
+
+/* Runs the allocator over `node`.  The body is walked once to find
+   the live intervals and once more, with registers assigned, to see
+   which registers the temporaries take.  Both walks are silent.  */
+void
+codegen_allocate_registers (struct node* node)
+{
+    if (current_process->flags & COMPILE_PROCESS_FLAG_NO_REGISTER_ALLOCATION)
+    {
+        return;
+    }
+
+    codegen_regalloc = regalloc_new (node);
+    codegen_silent = true;
+    regalloc_begin (codegen_regalloc, REGALLOC_STATE_COLLECT);
+    codegen_generate_function_body (node);
+    regalloc_allocate (codegen_regalloc);
+    regalloc_begin (codegen_regalloc, REGALLOC_STATE_ALLOCATED);
+    codegen_generate_function_body (node);
+    codegen_silent = false;
+    regalloc_begin (codegen_regalloc, REGALLOC_STATE_EMIT);
+}
+
+/* Saves the callee saved registers the function uses and loads the
+   arguments that live in registers.  */
+void
+codegen_generate_register_prologue (struct node* node)
+{
+    char address[64];
+    if (!codegen_regalloc)
+    {
+        return;
+    }
+
+    for (int i = 0; i < regalloc_total_registers (); i++)
+    {
+        if (codegen_regalloc->used_registers & (1 << i))
+        {
+            asm_push_ins_push (regalloc_register_name (i),
+                               STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER,
+                               "function_saved_register");
+        }
+    }
+
+    struct vector* arguments = node->func.args.vector;
+    for (int i = 0; arguments && i < vector_count (arguments); i++)
+    {
+        struct node* var_node = vector_peek_ptr_at (arguments, i);
+        const char* reg = regalloc_register_for_variable (codegen_regalloc,
+                                                          var_node);
+        if (!reg)
+        {
+            continue;
+        }
+
+        struct codegen_exp_type type = \
+                        codegen_type_for_datatype (&var_node->var.type);
+        codegen_variable_address (var_node, address);
+        codegen_load (address, &type);
+        asm_push ("mov %s, eax", reg);
+    }
+}
+
+void
+codegen_generate_register_epilogue ()
+{
+    if (!codegen_regalloc)
+    {
+        return;
+    }
+
+    for (int i = regalloc_total_registers () - 1; i >= 0; i--)
+    {
+        if (codegen_regalloc->used_registers & (1 << i))
+        {
+            asm_push_ins_pop (regalloc_register_name (i),
+                              STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER,
+                              "function_saved_register");
+        }
+    }
+
+    regalloc_free (codegen_regalloc);
+    codegen_regalloc = NULL;
+}
+
+/* Prints the instructions of the function held back so far, after
+   the peephole pass had a look at them.  */
+static void
+codegen_flush_instructions ()
+{
+    struct code_generator* generator = current_process->generator;
+    struct vector* instructions = generator->instructions;
+    if (!(current_process->flags & COMPILE_PROCESS_FLAG_NO_PEEPHOLE))
+    {
+        peephole_optimize (current_process, instructions);
+    }
+
+    generator->instructions = NULL;
+    for (int i = 0; i < vector_count (instructions); i++)
+    {
+        struct asm_instruction* instruction = vector_peek_ptr_at (instructions, i);
+        if (!instruction->deleted)
+        {
+            asm_push ("%s", instruction->text);
+        }
+        asm_instruction_free (instruction);
+    }
+    vector_free (instructions);
+}
+
+/* Goes through the IR, built from the tree and put in SSA form so
+   the scalar locals become virtual registers.  */
+static void
+codegen_generate_function_ir (struct node* node)
+{
+    struct ir_function* function = ir_build (current_process, node);
+    ir_inline (function);
+    ir_verify (function);
+    ir_mem2reg (function);
+    ir_verify (function);
+    ir_cse (function);
+    ir_verify (function);
+    ir_optimize_loops (function);
+    ir_verify (function);
+    ir_select (function);
+    ir_verify (function);
+    if (current_process->flags & COMPILE_PROCESS_FLAG_DUMP_IR)
+    {
+        ir_dump (function, stderr);
+    }
+
+    ir_leave_ssa (function);
+    ir_layout (function);
+    ir_lower (function);
+    ir_function_free (function);
+}
+
+/* Emits the function straight from the tree.  */
+static void
+codegen_generate_function_direct (struct node* node)
+{
+    codegen_allocate_registers (node);
+    codegen_current_function_exit_id = codegen_label_count ();
+    size_t frame_size = codegen_function_frame_size (node);
+    compiler_report (current_process, "stack: %s: %lu bytes of locals",
+                     node->func.name, (unsigned long) frame_size);
+
+    asm_push_ins_push ("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP,
+                       "function_entry_saved_ebp");
+    asm_push ("mov ebp, esp");
+    if (frame_size)
+    {
+        asm_push ("sub esp, %lu", (unsigned long) frame_size);
+        stack_frame_sub (node, STACK_FRAME_ELEMENT_TYPE_LOCAL_VARIABLE,
+                         "local_variables", frame_size);
+    }
+    codegen_generate_register_prologue (node);
+
+    codegen_generate_function_body (node);
+
+    asm_push (".function_exit_%i:", codegen_current_function_exit_id);
+    codegen_generate_register_epilogue ();
+    if (frame_size)
+    {
+        stack_frame_add (node, STACK_FRAME_ELEMENT_TYPE_LOCAL_VARIABLE,
+                         "local_variables", frame_size);
+    }
+    asm_push ("mov esp, ebp");
+    asm_push_ins_pop ("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP,
+                      "function_entry_saved_ebp");
+    asm_push ("ret");
+    stack_frame_assert_empty (node);
+}
+
+void
+codegen_generate_function (struct node* node)
+{
+    codegen_scope_register (node);
+    if (!node->func.body_n)
+    {
+        /* A prototype, the function lives in another object.  */
+        if (!codegen_function_is_defined (node->func.name))
+        {
+            asm_push ("extern $%s", node->func.name);
+        }
+        return;
+    }
+
+    codegen_current_function = node;
+    if (!(node->func.rtype.flags & DATATYPE_FLAG_IS_STATIC))
+    {
+        asm_push ("global $%s", node->func.name);
+    }
+    asm_push ("; %s function", node->func.name);
+    asm_push ("$%s:", node->func.name);
+
+    current_process->generator->instructions = \
+                    vector_create (sizeof (struct asm_instruction*));
+    if (!(current_process->flags & COMPILE_PROCESS_FLAG_NO_IR))
+    {
+        codegen_generate_function_ir (node);
+    }
+    else
+    {
+        codegen_generate_function_direct (node);
+    }
+    codegen_flush_instructions ();
+    codegen_current_function = NULL;
+}
+
+void
+codegen_generate_root_node (struct node* node)
+{
+    switch (node->type)
+    {
+        case NODE_TYPE_FUNCTION:
+            codegen_generate_function (node);
+            break;
+
+        case NODE_TYPE_VARIABLE:
+            if (node->var.type.flags & DATATYPE_FLAG_IS_EXTERN)
+            {
+                asm_push ("extern $%s", node->var.name);
+            }
+            codegen_scope_register (node);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                codegen_generate_root_node (
+                        vector_peek_ptr_at (node->var_list.list, i));
+            }
+            break;
+
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            if (variable_node (node))
+            {
+                codegen_generate_root_node (variable_node (node));
+            }
+            break;
+    }
+}
+
+void
+codegen_generate_root ()
+{
+    asm_push ("section .text");
+    struct node* node = NULL;
+    while ((node = codegen_node_next ()) != NULL)
+    {
+        codegen_generate_root_node (node);
+    }
+}
+
+static bool
+codegen_char_is_quotable (char c)
+{
+    /* NASM single quoted strings have no escapes, so the quote
+       itself must be written as a number.  */
+    return c >= 0x20 && c <= 0x7e && c != '\'';
+}
+
+static void
+codegen_buffer_write_str (struct buffer* buffer, const char* str)
+{
+    while (*str)
+    {
+        buffer_write (buffer, *str++);
+    }
+}
+
+/* Writes `len` bytes of `data` as `db` directives.  Runs of printable
+   characters become one quoted string, everything else a number.  */
+void
+codegen_write_bytes (const char* label, const char* data, size_t len)
+{
+    struct buffer* line = buffer_create ();
+    char tmp_buf[16];
+    bool in_quote = false;
+    bool first_item = true;
+
+    if (label)
+    {
+        codegen_buffer_write_str (line, "$");
+        codegen_buffer_write_str (line, label);
+        codegen_buffer_write_str (line, ": ");
+    }
+    codegen_buffer_write_str (line, "db ");
+
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = data[i];
+        if (in_quote && (!codegen_char_is_quotable (c) || \
+                         line->len >= CODEGEN_DATA_LINE_LIMIT))
+        {
+            buffer_write (line, '\'');
+            in_quote = false;
+        }
+
+        if (line->len >= CODEGEN_DATA_LINE_LIMIT)
+        {
+            buffer_write (line, 0x00);
+            asm_push ("%s", (const char*) buffer_ptr (line));
+            line->len = 0;
+            codegen_buffer_write_str (line, "db ");
+            first_item = true;
+        }
+
+        if (!in_quote)
+        {
+            if (!first_item)
+            {
+                codegen_buffer_write_str (line, ", ");
+            }
+            first_item = false;
+
+            if (!codegen_char_is_quotable (c))
+            {
+                sprintf (tmp_buf, "%u", (unsigned char) c);
+                codegen_buffer_write_str (line, tmp_buf);
+                continue;
+            }
+
+            buffer_write (line, '\'');
+            in_quote = true;
+        }
+
+        buffer_write (line, c);
+    }
+
+    if (in_quote)
+    {
+        buffer_write (line, '\'');
+    }
+
+    buffer_write (line, 0x00);
+    asm_push ("%s", (const char*) buffer_ptr (line));
+    buffer_free (line);
+}
+
+/* In assembly output, large blobs are written to `<output>.<label>.bin`
+   and included with `incbin`, which the assembler copies without
+   parsing.  Returns false if the data should be written inline
+   instead.  */
+bool
+codegen_write_incbin (const char* label, const char* data, size_t len)
+{
+    if (len < CODEGEN_INCBIN_THRESHOLD || !current_process->ofile_name)
+    {
+        return false;
+    }
+
+    char path[512];
+    snprintf (path, sizeof (path), "%s.%s.bin",
+              current_process->ofile_name, label);
+    FILE* fp = fopen (path, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    size_t written = fwrite (data, 1, len, fp);
+    fclose (fp);
+    if (written != len)
+    {
+        return false;
+    }
+
+    asm_push ("$%s: incbin \"%s\"", label, path);
+    return true;
+}
+
+void
+codegen_write_data (const char* label, const char* data, size_t len)
+{
+    struct assembler* assembler = current_process->generator->assembler;
+    if (assembler && !codegen_silent)
+    {
+        assembler_bytes (assembler, label, data, len);
+        return;
+    }
+
+    if (codegen_write_incbin (label, data, len))
+    {
+        return;
+    }
+
+    codegen_write_bytes (label, data, len);
+}
+
+void
+codegen_write_string (struct string_table_element* element)
+{
+    if (element->merged_into)
+    {
+        /* Tail of a longer string, share its storage.  */
+        asm_push ("$%s equ $%s+%lu", element->label,
+                  element->merged_into->label,
+                  (unsigned long) element->merged_offset);
+        return;
+    }
+
+    /* Include the null terminator.  */
+    codegen_write_data (element->label, element->str, element->len + 1);
+}
+
+/* Compares two strings starting from their last character.  */
+static int
+codegen_string_compare_reversed (const void* a, const void* b)
+{
+    const struct string_table_element* elem_a = \
+                        *(const struct string_table_element**) a;
+    const struct string_table_element* elem_b = \
+                        *(const struct string_table_element**) b;
+    const char* str_a = elem_a->str + elem_a->len;
+    const char* str_b = elem_b->str + elem_b->len;
+    while (str_a != elem_a->str && str_b != elem_b->str)
+    {
+        str_a--;
+        str_b--;
+        if (*str_a != *str_b)
+        {
+            return (unsigned char) *str_a - (unsigned char) *str_b;
+        }
+    }
+
+    return (int) ((long) elem_a->len - (long) elem_b->len);
+}
+
+static bool
+codegen_string_is_suffix (struct string_table_element* suffix,
+                          struct string_table_element* str)
+{
+    return suffix->len <= str->len && \
+           memcmp (str->str + (str->len - suffix->len),
+                   suffix->str, suffix->len) == 0;
+}
+
+/* Points every string that is the tail of a longer string to the
+   storage of the longer one.  Sorting by the reversed strings places
+   a string right before the strings it is a suffix of.  */
+void
+codegen_merge_string_suffixes ()
+{
+    struct code_generator* generator = current_process->generator;
+    int total = vector_count (generator->string_table);
+    if (total < 2)
+    {
+        return;
+    }
+
+    struct string_table_element** sorted = \
+                        malloc (total * sizeof (struct string_table_element*));
+    memcpy (sorted, vector_data_ptr (generator->string_table),
+            total * sizeof (struct string_table_element*));
+    qsort (sorted, total, sizeof (struct string_table_element*),
+           codegen_string_compare_reversed);
+
+    for (int i = total - 2; i >= 0; i--)
+    {
+        struct string_table_element* element = sorted[i];
+        struct string_table_element* longer = sorted[i + 1];
+        if (!codegen_string_is_suffix (element, longer))
+        {
+            continue;
+        }
+
+        struct string_table_element* owner = longer->merged_into ? \
+                                             longer->merged_into : longer;
+        element->merged_into = owner;
+        element->merged_offset = owner->len - element->len;
+    }
+
+    free (sorted);
+}
+
+void
+codegen_write_strings ()
+{
+    struct code_generator* generator = current_process->generator;
+    codegen_merge_string_suffixes ();
+
+    /* Strings that own storage must be written before the
+       labels that alias into them.  */
+    vector_set_peek_pointer (generator->string_table, 0);
+    struct string_table_element* element = \
+                        vector_peek_ptr (generator->string_table);
+    while (element)
+    {
+        if (!element->merged_into)
+        {
+            codegen_write_string (element);
+        }
+        element = vector_peek_ptr (generator->string_table);
+    }
+
+    vector_set_peek_pointer (generator->string_table, 0);
+    element = vector_peek_ptr (generator->string_table);
+    while (element)
+    {
+        if (element->merged_into)
+        {
+            codegen_write_string (element);
+        }
+        element = vector_peek_ptr (generator->string_table);
+    }
+}
+
+void
+codegen_generate_readonly ()
+{
+    asm_push ("section .rodata");
+    codegen_write_strings ();
+}
+
+int
+codegen (struct compile_process* process)
+{
+    current_process = process;
+    if (process->ofile && \
+        !(process->flags & COMPILE_PROCESS_FLAG_ASSEMBLY_OUTPUT))
+    {
+        process->generator->assembler = assembler_new (process);
+    }
+
+    if (compiler_target_is_x86_64 ())
+    {
+        if (process->flags & COMPILE_PROCESS_FLAG_NO_IR)
+        {
+            compiler_error (process, "The tree code generator only targets x86, "
+                            "-fno-ir cannot be used with -m64");
+        }
+
+        /* Symbols are addressed relative to rip.  */
+        asm_push ("bits 64");
+        asm_push ("default rel");
+    }
+
+    scope_create_root (process);
+    codegen_new_scope (0);
+    codegen_generate_data_section ();
+    vector_set_peek_pointer (process->node_tree_vec, 0);
+    codegen_generate_root ();
+    codegen_finish_scope ();
+
+    /* Generate read only data.  */
+    codegen_generate_readonly ();
+
+    int* hits = process->generator->peephole_hits;
+    compiler_report (process, "peephole: %i push/pop pairs, %i loads forwarded, "
+                     "%i jumps removed, %i stack adjustments folded",
+                     hits[PEEPHOLE_RULE_PUSH_POP], hits[PEEPHOLE_RULE_FORWARD],
+                     hits[PEEPHOLE_RULE_JUMP], hits[PEEPHOLE_RULE_STACK_ADJUSTMENT]);
+
+    if (process->generator->assembler)
+    {
+        assembler_write (process->generator->assembler, process->ofile);
+        assembler_free (process->generator->assembler);
+        process->generator->assembler = NULL;
+    }
 
     return 0;
 }
@@ -36,9 +36,36 @@ compiler_warning (struct compile_process *compiler, const char *msg, ...)
 			compiler->pos.line, compiler->pos.col, compiler->pos.filename);
 }
 
+/* Statistics of the optimisation passes, only shown when asked for.  */
+void
+compiler_report (struct compile_process *compiler, const char *msg, ...)
+{
+	if (!(compiler->flags & COMPILE_PROCESS_FLAG_REPORT))
+		return;
+
+	va_list args;
+
+	va_start(args, msg);
+	vfprintf(stderr, msg, args);
+	va_end (args);
+
+	fprintf(stderr, "\n");
+}
+
+/* Flags of the file being compiled, the sizes of the types depend
+   on the target they pick.  */
+static int compiler_flags = 0;
+
+bool
+compiler_target_is_x86_64 ()
+{
+	return compiler_flags & COMPILE_PROCESS_FLAG_X86_64;
+}
+
 int
 compile_file (const char* file_name, const char* out_file_name, int flags)
 {
+	compiler_flags = flags;
 	struct compile_process* process = compile_process_create(file_name, out_file_name, flags);
 	if (!process)
 		return COMPILER_FAILED_WITH_ERRORS;
@@ -59,6 +86,12 @@ compile_file (const char* file_name, const char* out_file_name, int flags)
 		return COMPILER_FAILED_WITH_ERRORS;
 	}
 
+	/* Fold constant expressions */
+	if (fold (process) != FOLD_ALL_OK)
+	{
+		return COMPILER_FAILED_WITH_ERRORS;
+	}
+
 	/* Preform code generation */
 	if (codegen (process) != CODEGEN_ALL_OK)
 	{
@@ -171,6 +171,45 @@ enum
 	COMPILER_FAILED_WITH_ERRORS,
 };
 
+enum
+{
+	/* Keep every local variable in its stack slot.  */
+	COMPILE_PROCESS_FLAG_NO_REGISTER_ALLOCATION = 0b00000001,
+	/* Print what the optimisation passes did to stderr.  */
+	COMPILE_PROCESS_FLAG_REPORT                 = 0b00000010,
+	/* Generate code straight from the tree, skipping the IR.  */
+	COMPILE_PROCESS_FLAG_NO_IR                  = 0b00000100,
+	/* Print the IR of every function to stderr.  */
+	COMPILE_PROCESS_FLAG_DUMP_IR                = 0b00001000,
+	/* Print the instructions as generated, without the peephole pass.  */
+	COMPILE_PROCESS_FLAG_NO_PEEPHOLE            = 0b00010000,
+	/* Write NASM assembly instead of an object file.  */
+	COMPILE_PROCESS_FLAG_ASSEMBLY_OUTPUT        = 0b00100000,
+	/* Generate x86-64 code for the System V ABI instead of x86.  */
+	COMPILE_PROCESS_FLAG_X86_64                 = 0b01000000,
+	/* Functions that call nobody address their frame from the stack
+	   pointer and give the frame pointer to the allocator.  */
+	COMPILE_PROCESS_FLAG_OMIT_FRAME_POINTER     = 0b10000000,
+	/* Keep every call, even to the functions declared `inline`.  */
+	COMPILE_PROCESS_FLAG_NO_INLINE              = 0b100000000,
+	/* Keep calling the function a function returns the result of,
+	   instead of jumping to it from a frame already taken down.  */
+	COMPILE_PROCESS_FLAG_NO_SIBLING_CALLS       = 0b1000000000,
+	/* Leave the loops as written, without hoisting the values they
+	   do not change or reducing the strength of their indexing.  */
+	COMPILE_PROCESS_FLAG_NO_LOOP_OPTIMIZATION   = 0b10000000000,
+	/* Unroll only the loops a `#pragma unroll` asks to.  */
+	COMPILE_PROCESS_FLAG_NO_UNROLL_LOOPS        = 0b100000000000,
+	/* Keep the branches around cheap conditional values instead of
+	   selecting between both with cmov.  */
+	COMPILE_PROCESS_FLAG_NO_IF_CONVERSION       = 0b1000000000000,
+	/* Lay the blocks out in the order they were built, without
+	   rotating loops, moving unlikely code away or aligning loops.  */
+	COMPILE_PROCESS_FLAG_NO_REORDER_BLOCKS      = 0b10000000000000,
+	/* Compute every expression and load as often as it is written.  */
+	COMPILE_PROCESS_FLAG_NO_CSE                 = 0b100000000000000,
+};
+
 struct scope
 {
     int flags;
@@ -224,16 +263,214 @@ struct string_table_element
 	/* Assembly label that points to the memory
 	   where the string can be found.  */
 	const char label[50];
+
+	/* Cached hash and length of `str`.  */
+	unsigned int hash;
+	size_t len;
+
+	/* Next element in the same hash bucket.  */
+	struct string_table_element* next;
+
+	/* Set when this string is the tail of a longer string,
+	   e.g. "world" inside "hello world".  No storage is emitted
+	   for it, its label points `merged_offset` bytes into the
+	   storage of `merged_into`.  */
+	struct string_table_element* merged_into;
+	size_t merged_offset;
+};
+
+/* Initial number of buckets of the string table index,
+   must be a power of two.  */
+#define STRING_TABLE_INITIAL_BUCKETS 64
+
+/* In assembly output, constant data of at least this many bytes is
+   written to a side file next to the output and pulled in with
+   `incbin`.  */
+#define CODEGEN_INCBIN_THRESHOLD 4096
+
+/* Soft limit for the length of a single data directive line.  */
+#define CODEGEN_DATA_LINE_LIMIT 80
+
+/* Sections global data can be placed in.  */
+enum
+{
+	CODEGEN_SECTION_DATA,
+	CODEGEN_SECTION_BSS,
+	CODEGEN_SECTION_RODATA
+};
+
+enum
+{
+	PEEPHOLE_RULE_PUSH_POP,
+	PEEPHOLE_RULE_FORWARD,
+	PEEPHOLE_RULE_JUMP,
+	PEEPHOLE_RULE_STACK_ADJUSTMENT,
+	PEEPHOLE_TOTAL_RULES
+};
+
+/* A line of assembly split into its parts.  */
+struct asm_instruction
+{
+	/* The line as it is printed.  */
+	char* text;
+	/* NULL for labels and comments.  */
+	char* mnemonic;
+	char* operands[2];
+	int total_operands;
+	/* Name of the label the line defines, NULL for instructions.  */
+	char* label;
+	bool deleted;
+};
+
+/* Initial number of buckets of the assembler symbol table,
+   must be a power of two.  */
+#define ASSEMBLER_INITIAL_BUCKETS 256
+
+enum
+{
+	/* Bytes of the section, or only a length in `.bss`.  */
+	ASSEMBLER_FRAGMENT_BYTES,
+	/* A jump to a label, two bytes if the label is close enough.  */
+	ASSEMBLER_FRAGMENT_JUMP,
+	/* Padding up to `alignment`.  */
+	ASSEMBLER_FRAGMENT_ALIGN
+};
+
+/* A piece of a section.  Only jumps and padding change their size
+   once all the labels are known, the rest is fixed.  */
+struct assembler_fragment
+{
+	int type;
+	/* Offset of the bytes in the section buffer.  */
+	size_t start;
+	size_t length;
+	/* Offset in the section, known after layout.  */
+	size_t address;
+	/* Condition code of a jump, -1 for `jmp`.  */
+	int condition;
+	char* target;
+	bool long_form;
+	int alignment;
+};
+
+struct assembler_section
+{
+	char* name;
+	/* Bytes of the fixed fragments, NULL in `.bss`.  */
+	struct buffer* bytes;
+	/* Vector of struct assembler_fragment.  */
+	struct vector* fragments;
+	/* Vector of struct assembler_relocation, filled while resolving
+	   the fixups.  */
+	struct vector* relocations;
+	/* The laid out section, NULL in `.bss`.  */
+	char* image;
+	size_t size;
+	int alignment;
+	/* Index of the section in the object file.  */
+	int index;
+};
+
+struct assembler_symbol
+{
+	char* name;
+	/* NULL while the symbol is not defined.  */
+	struct assembler_section* section;
+	int fragment;
+	size_t offset;
+	/* `name equ alias+offset`.  */
+	char* alias;
+	bool global;
+	bool external;
+	bool referenced;
+	/* Index in the symbol table of the object file.  */
+	int index;
+	struct assembler_symbol* next;
+};
+
+/* Bytes of a section that hold the address of a symbol.  */
+struct assembler_reference
+{
+	struct assembler* assembler;
+	struct assembler_section* section;
+	int fragment;
+	size_t offset;
+	/* 4, or 8 for a full address on x86-64.  */
+	int size;
+	char* symbol;
+	long long addend;
+	/* Relative to the end of the instruction, which is `trailing`
+	   bytes past the end of the four.  */
+	bool relative;
+	int trailing;
+	/* Target of a call or a jump, through the PLT when it is
+	   elsewhere.  */
+	bool is_branch;
+};
+
+/* A relocation of a section, written as an Elf32_Rel or an
+   Elf64_Rela.  */
+struct assembler_relocation
+{
+	size_t offset;
+	/* Index in the symbol table.  */
+	int symbol;
+	/* One of R_386_* or R_X86_64_*.  */
+	int type;
+	/* Only kept here on x86-64, x86 keeps it in the section.  */
+	long long addend;
+};
+
+/* Turns the assembly codegen prints into a relocatable object
+   without an external assembler.  */
+struct assembler
+{
+	struct compile_process* process;
+	/* Vector of struct assembler_section*.  */
+	struct vector* sections;
+	struct assembler_section* section;
+	/* Vector of struct assembler_symbol*.  */
+	struct vector* symbols;
+	struct assembler_symbol** buckets;
+	size_t total_buckets;
+	/* Last label not starting with a dot, local labels belong to it.  */
+	char* scope;
+	/* The line being assembled, for errors.  */
+	const char* line;
+	/* 32 or 64, set by `bits`.  */
+	int bits;
+	/* Rip relative reference of the instruction being encoded.  */
+	struct assembler_reference* rip_reference;
+	/* References to symbols, resolved once the layout is known.  */
+	struct fixup_system* fixups;
+	int total_jumps;
+	int short_jumps;
+	int total_relocations;
 };
 
 struct code_generator
 {
 	/* Vector of struct string_table_element.  */
 	struct vector* string_table;
+	/* Hash index over the string table.  Each bucket is a
+	   linked list of struct string_table_element.  */
+	struct string_table_element** string_buckets;
+	size_t total_string_buckets;
 	/* Vector of struct codegen_entry_point*.  */
 	struct vector* entry_points;
 	/* Vector of struct codegen_exit_point*.  */
 	struct vector* exit_points;
+	/* Vector of int, ids of the switch statements being generated.  */
+	struct vector* switch_ids;
+	/* Vector of struct asm_instruction*, the code of the function
+	   being generated, held back for the peephole pass.  NULL
+	   outside of functions.  */
+	struct vector* instructions;
+	/* How often each peephole rule applied, by PEEPHOLE_RULE_*.  */
+	int peephole_hits[PEEPHOLE_TOTAL_RULES];
+	/* Assembles the output into an object file, NULL when the
+	   output is assembly text.  */
+	struct assembler* assembler;
 };
 
 struct compile_process
@@ -256,6 +493,9 @@ struct compile_process
 	/* Actual root of the tree. */
 	struct vector *node_tree_vec;
 	FILE *ofile;
+	/* Path of `ofile`, side files such as incbin blobs
+	   are written next to it.  */
+	const char* ofile_name;
 
 	struct
 	{
@@ -285,6 +525,12 @@ enum
 	PARSE_GENERAL_ERROR
 };
 
+enum
+{
+	FOLD_ALL_OK,
+	FOLD_GENERAL_ERROR
+};
+
 enum
 {
 	CODEGEN_ALL_OK,
@@ -323,6 +569,7 @@ enum
 	NODE_TYPE_UNION,
 	NODE_TYPE_BRACKET,
 	NODE_TYPE_CAST,
+	NODE_TYPE_INITIALIZER,
 
 	/*
 	 * A node that doesnt mean anything - like void.
@@ -331,11 +578,20 @@ enum
 	NODE_TYPE_BLANK
 };
 
+enum
+{
+	/* `i++` rather than `++i`.  */
+	UNARY_FLAG_IS_POSTFIX = 0b00000001
+};
+
 enum
 {
 	NODE_FLAG_INSIDE_EXPRESSION      = 0b00000001,
 	NODE_FLAG_IS_FORWARD_DECLARATION = 0b00000010,
-	NODE_FLAG_HAS_VARIABLE_COMBINED  = 0b00000100
+	NODE_FLAG_HAS_VARIABLE_COMBINED  = 0b00000100,
+	/* A number folded from long operands, a long even when its
+	   value fits an int.  */
+	NODE_FLAG_IS_LONG                = 0b00001000
 };
 
 struct array_brackets
@@ -380,10 +636,20 @@ struct datatype
 	} array;
 };
 
+/* Type of an expression as seen by the code generator.  */
+struct codegen_exp_type
+{
+	struct datatype dtype;
+
+	/* For arrays, how many of the brackets were already indexed.
+	   `int x[2][3]`, `x[1]` has an array_index of 1.  */
+	int array_index;
+};
+
 struct parsed_switch_case
 {
-	/* Index of the parsed case.  */
-	int index;
+	/* Value of the parsed case.  */
+	long long value;
 };
 
 struct stack_frame_data
@@ -405,16 +671,23 @@ struct stack_frame_element
 	   I.e result_value.  */
 	const char* name;
 
-	/* The offset this element is on the base pointer.  */
+	/* The offset this element is on the base pointer, it covers the
+	   `size` bytes below it.  */
 	int offset_from_bp;
 
+	/* Bytes of the element, a whole range of locals is one element.  */
+	size_t size;
+
 	struct stack_frame_data data;
 };
 
-/* Change according to target architecture.
+/* Depends on the target architecture.
    32-bit = 4 bytes.
    64-bit = 8 bytes.  */
-#define STACK_PUSH_SIZE 4
+#define STACK_PUSH_SIZE (compiler_target_is_x86_64 () ? 8 : 4)
+
+/* Pointers are as wide as a push on both targets, so is `long`.  */
+#define DATA_SIZE_POINTER STACK_PUSH_SIZE
 
 enum
 {
@@ -436,7 +709,7 @@ enum
 void
 stack_frame_pop (struct node* func_node);
 struct stack_frame_element*
-stackframe_back (struct node* func_node);
+stack_frame_back (struct node* func_node);
 struct stack_frame_element*
 stack_frame_back_expect (struct node* func_node, int expecting_type,
 						 const char* expecting_name);
@@ -451,13 +724,15 @@ void
 stack_frame_push (struct node* func_ode,
                   struct stack_frame_element* element);
 void
-stackframe_sub (struct node* func_node, int type,
+stack_frame_sub (struct node* func_node, int type,
                 const char* name, size_t amount);
 void
-stackframe_add (struct node* func_node, int type,
+stack_frame_add (struct node* func_node, int type,
                 const char* name, size_t amount);
 void
 stack_frame_assert_empty (struct node* func_node);
+struct stack_frame_element*
+stack_frame_find (struct node* func_node, int offset);
 
 struct node
 {
@@ -506,6 +781,14 @@ struct node
 			struct node* false_node;
 		} tenary;
 
+		/* `-x`, `*ptr`, `&x`, `++i` or `i++`.  */
+		struct unary
+		{
+			int flags;
+			const char* op;
+			struct node* operand;
+		} unary;
+
 		struct varlist
 		{
 			/* A list of struct node* variables. */
@@ -584,6 +867,9 @@ struct node
 			{
 				/* A vector of stack_frame_element.  */
 				struct vector* elements;
+
+				/* Bytes the elements take together.  */
+				size_t size;
 			} frame;
 
 			/* The stack size for all variables inside this function. */
@@ -621,6 +907,9 @@ struct node
 				struct node* cond_node;
 				struct node* loop_node;
 				struct node* body_node;
+				/* Copies of the body `#pragma unroll` asked for, 0
+				   when none did and -1 for one per iteration.  */
+				int unroll;
 			} for_stmt;
 
 			struct while_stmt
@@ -668,6 +957,14 @@ struct node
 			struct node* operand;
 		} cast;
 
+		/* `{1, 2, {3, 4}}`  */
+		struct initializer
+		{
+			/* Vector of struct node*, each value is an
+			   expression or a nested initializer.  */
+			struct vector* values;
+		} initializer;
+
 	};
 
 	union {
@@ -691,7 +988,12 @@ enum
 	DATATYPE_FLAG_IS_IGNORE_TYPE_CHECKING	= 0b00010000000,
 	DATATYPE_FLAG_IS_SECONDARY 		= 0b00100000000,
 	DATATYPE_FLAG_STRUCT_UNION_NO_NAME 	= 0b01000000000,
-	DATATYPE_FLAG_IS_LITERAL 		= 0b10000000000
+	DATATYPE_FLAG_IS_LITERAL 		= 0b10000000000,
+	/* Of the return type of functions, `inline` and the attributes
+	   that force or forbid inlining.  */
+	DATATYPE_FLAG_IS_INLINE 		= 0b100000000000,
+	DATATYPE_FLAG_ALWAYS_INLINE 		= 0b1000000000000,
+	DATATYPE_FLAG_NO_INLINE 		= 0b10000000000000
 };
 
 enum
@@ -728,9 +1030,12 @@ enum
 {
 	/* The flag is set for native functions. */
 	FUNCTION_NODE_FLAG_IS_NATIVE = 0b00000001,
+	/* Ends with `...`.  */
+	FUNCTION_NODE_FLAG_IS_VARIADIC = 0b00000010,
 };
 
 int compile_file (const char* file_name, const char* out_file_name, int flags);
+bool compiler_target_is_x86_64 ();
 struct compile_process *compile_process_create (const char* file_name, const char* out_file_name, int flags);
 
 char compile_process_next_char (struct lex_process *lex_process);
@@ -739,6 +1044,7 @@ void compile_process_push_char (struct lex_process *lex_process, char c);
 
 void compiler_error (struct compile_process *compiler, const char *msg, ...);
 void compiler_warning (struct compile_process *compiler, const char *msg, ...);
+void compiler_report (struct compile_process *compiler, const char *msg, ...);
 
 struct lex_process *lex_process_create (struct compile_process *compiler, struct lex_process_functions *functions, void *private);
 void lex_process_free (struct lex_process *process);
@@ -746,8 +1052,38 @@ void *lex_process_private (struct lex_process *process);
 struct vector *lex_process_tokens (struct lex_process *process);
 int lex (struct lex_process *process);
 int parse (struct compile_process *process);
+int fold (struct compile_process* process);
 int codegen (struct compile_process* process);
 struct code_generator* codegenerator_new (struct compile_process* process);
+int codegen_label_count ();
+
+void asm_push (const char* insn, ...);
+void asm_push_ins_push (const char* reg, int stack_entity_type, const char* stack_entity_name);
+void asm_push_ins_pop (const char* reg, int expecting_stack_entity_type, const char* expecting_stack_entity_name);
+void codegen_new_scope (int flags);
+void codegen_finish_scope ();
+struct node* codegen_scope_find (const char* name);
+void codegen_scope_register (struct node* node);
+struct node* codegen_variable_for_identifier (struct node* node);
+struct node* codegen_struct_member (struct node* body_node, const char* name);
+const char* codegen_register_string (const char* str);
+size_t codegen_function_frame_size (struct node* node);
+bool codegen_function_is_defined (const char* name);
+void codegen_call_arguments (struct node* node, struct vector* arguments);
+struct node* codegen_expected_expression (struct node* node, long long* value);
+struct codegen_exp_type codegen_type_for_datatype (struct datatype* dtype);
+struct codegen_exp_type codegen_int_type ();
+bool codegen_type_is_array (struct codegen_exp_type* type);
+bool codegen_type_is_pointer (struct codegen_exp_type* type);
+bool codegen_type_is_pointer_like (struct codegen_exp_type* type);
+bool codegen_type_is_struct_or_union (struct codegen_exp_type* type);
+bool codegen_type_is_signed (struct codegen_exp_type* type);
+size_t codegen_type_size (struct codegen_exp_type* type);
+size_t codegen_type_stride (struct codegen_exp_type* type);
+struct codegen_exp_type codegen_type_dereference (struct codegen_exp_type* type);
+struct codegen_exp_type codegen_type_address_of (struct codegen_exp_type* type);
+bool codegen_type_is_addressed (struct codegen_exp_type* type);
+const char* codegen_size_keyword (size_t size);
 
 /* Builds tokens for the input string. */
 struct lex_process* tokens_build_for_string (struct compile_process* compiler, const char* str);
@@ -766,6 +1102,7 @@ size_t datatype_element_size (struct datatype* dtype);
 size_t datatype_size_no_ptr (struct datatype* dtype);
 size_t datatype_size (struct datatype* dtype);
 bool datatype_is_primitive (struct datatype* dtype);
+bool datatype_is_returned_in_registers (struct datatype* dtype);
 
 struct node *node_create (struct node *_node);
 struct node* node_from_sym (struct symbol* sym);
@@ -780,8 +1117,11 @@ struct node* union_node_for_name (struct compile_process* current_process,
 								  const char* name);
 struct node* struct_node_for_name (struct compile_process* current_process, const char* name);
 void make_cast_node (struct datatype* dtype, struct node* operand_node);
+void make_initializer_node (struct vector* values);
 void make_tenary_node (struct node* true_node, struct node* false_node);
 void make_case_node (struct node* exp_node);
+void make_default_node ();
+void make_unary_node (const char* op, struct node* operand_node, int flags);
 void make_goto_node (struct node* name_node);
 void make_label_node (struct node* name_node);
 void make_continue_node ();
@@ -812,6 +1152,7 @@ void node_push (struct node *node);
 void node_set_vector (struct vector *vec, struct vector *root_vec);
 
 bool node_is_expressionable (struct node* node);
+bool number_node_is_long (struct node* node);
 struct node* node_peek_expressionable_or_null ();
 bool node_is_struct_or_union_variable (struct node* node);
 
@@ -837,6 +1178,7 @@ int padding (int val, int to);
 int align_value (int val, int to);
 int align_value_treat_positive (int val, int to);
 int compute_sum_padding (struct vector* vec);
+unsigned int hash_string (const char* str, size_t* len_out);
 
 struct scope* scope_new(struct compile_process *process, int flags);
 struct scope* scope_create_root (struct compile_process* process);
@@ -925,4 +1267,339 @@ bool fixup_resolve (struct fixup* fixup);
 void* fixup_private (struct fixup* fixup);
 bool fixups_resolve (struct fixup_system* system);
 
+/* A word of initialised data holding an address.  */
+struct initializer_relocation
+{
+	size_t offset;
+	/* Symbol the address points into, or the literal `string`.  */
+	const char* label;
+	const char* string;
+	long long addend;
+};
+
+/* Value of a global computed at compile time.  */
+struct initializer_data
+{
+	char* bytes;
+	size_t size;
+	/* Vector of struct initializer_relocation, sorted by offset.  */
+	struct vector* relocations;
+};
+
+struct initializer_data* initializer_evaluate (struct compile_process* process, struct node* var_node);
+void initializer_data_free (struct initializer_data* data);
+
+/* Most registers the allocator hands out, three on x86 and five on
+   x86-64.  They are callee saved in cdecl and System V, so values
+   kept in them survive calls.  eax, ecx and edx stay free as scratch
+   registers for the expression code.  The frame pointer comes on
+   top for the functions that do without it.  */
+#define REGALLOC_MAX_REGISTERS 6
+
+enum
+{
+	/* Walking the function to find live intervals.  */
+	REGALLOC_STATE_COLLECT,
+	/* Intervals have registers, walking again to find
+	   which registers temporaries need.  */
+	REGALLOC_STATE_ALLOCATED,
+	/* Generating the final code.  */
+	REGALLOC_STATE_EMIT
+};
+
+/* Positions during which a variable holds a value.  A position is
+   a statement, in the order the code generator visits them.  */
+struct regalloc_interval
+{
+	struct node* var_node;
+	/* Virtual register of the IR instead of a variable, 0 if none.  */
+	int vreg;
+	int start;
+	int end;
+
+	/* `&x` was used, the variable must live in memory.  */
+	bool address_taken;
+
+	/* Register of the variable, NULL when spilled.  */
+	const char* reg;
+};
+
+struct regalloc_loop
+{
+	int start;
+	int end;
+};
+
+struct regalloc
+{
+	int state;
+	struct node* function;
+
+	/* Current position.  */
+	int position;
+
+	/* Vector of struct regalloc_interval*.  */
+	struct vector* intervals;
+	/* Vector of struct regalloc_loop.  */
+	struct vector* loops;
+
+	/* Labels allow jumping backwards anywhere,
+	   every interval then covers the whole function.  */
+	bool has_labels;
+
+	/* Bitmask of registers currently holding a temporary.  */
+	int temporaries_in_use;
+	/* Bitmask of registers the function writes to.  */
+	int used_registers;
+	/* Registers it hands out, one more than regalloc_total_registers
+	   when the frame pointer is free.  */
+	int total_registers;
+};
+
+struct regalloc* regalloc_new (struct node* function_node);
+void regalloc_free (struct regalloc* regalloc);
+void regalloc_free_frame_register (struct regalloc* regalloc);
+void regalloc_begin (struct regalloc* regalloc, int state);
+void regalloc_next_position (struct regalloc* regalloc);
+bool regalloc_variable_is_eligible (struct regalloc* regalloc, struct node* var_node);
+void regalloc_record_use (struct regalloc* regalloc, struct node* var_node);
+void regalloc_record_address_taken (struct regalloc* regalloc, struct node* var_node);
+void regalloc_record_loop (struct regalloc* regalloc, int start, int end);
+void regalloc_record_label (struct regalloc* regalloc);
+void regalloc_allocate (struct regalloc* regalloc);
+const char* regalloc_register_for_variable (struct regalloc* regalloc, struct node* var_node);
+const char* regalloc_temporary_acquire (struct regalloc* regalloc);
+void regalloc_temporary_release (struct regalloc* regalloc, const char* reg);
+int regalloc_total_registers ();
+const char* regalloc_register_name (int index);
+struct regalloc_interval* regalloc_add_interval (struct regalloc* regalloc, int vreg, int start, int end);
+
+/* Types of virtual registers.  Narrow values only exist in memory,
+   once loaded every value is a full register.  An i32 held in a 64
+   bit register only has meaningful low bits, a wider operation first
+   extends it.  */
+enum
+{
+	IR_TYPE_I32,
+	IR_TYPE_I64,
+	IR_TYPE_PTR
+};
+
+enum
+{
+	/* Removed instruction, dropped by ir_block_compact.  */
+	IR_OP_NOP,
+	/* dst = imm  */
+	IR_OP_CONST,
+	/* dst = a  */
+	IR_OP_COPY,
+	/* dst = a op b  */
+	IR_OP_ADD,
+	IR_OP_SUB,
+	IR_OP_MUL,
+	IR_OP_DIV,
+	IR_OP_UDIV,
+	IR_OP_MOD,
+	IR_OP_UMOD,
+	IR_OP_AND,
+	IR_OP_OR,
+	IR_OP_XOR,
+	IR_OP_SHL,
+	IR_OP_SHR,
+	IR_OP_SAR,
+	/* dst = op a  */
+	IR_OP_NEG,
+	IR_OP_NOT,
+	/* dst = a condition b, one or zero.  */
+	IR_OP_COMPARE,
+	/* dst = a if c is not zero, else b.  c is the third argument.  */
+	IR_OP_SELECT,
+	/* dst = the low `size` bytes of a, sign or zero extended.  */
+	IR_OP_EXTEND,
+	/* dst = label + imm  */
+	IR_OP_ADDRESS,
+	/* dst = address of slot  */
+	IR_OP_SLOT_ADDRESS,
+	/* dst = slot  */
+	IR_OP_SLOT_LOAD,
+	/* slot = a  */
+	IR_OP_SLOT_STORE,
+	/* dst = [a + imm], `size` bytes.  */
+	IR_OP_LOAD,
+	/* [a + imm] = b, `size` bytes.  */
+	IR_OP_STORE,
+	/* dst = value the caller passed for the argument slot.  */
+	IR_OP_ARGUMENT,
+	/* dst = label (call_args) or a (call_args)  */
+	IR_OP_CALL,
+	/* dst = value coming from the predecessor that was left.  */
+	IR_OP_PHI,
+	/* Terminators.  */
+	IR_OP_JUMP,
+	IR_OP_BRANCH,
+	IR_OP_RETURN,
+	/* Goes to entry a of the switch targets, a is within the table.  */
+	IR_OP_SWITCH
+};
+
+enum
+{
+	IR_CONDITION_EQ,
+	IR_CONDITION_NE,
+	IR_CONDITION_LT,
+	IR_CONDITION_LE,
+	IR_CONDITION_GT,
+	IR_CONDITION_GE,
+	IR_CONDITION_ULT,
+	IR_CONDITION_ULE,
+	IR_CONDITION_UGT,
+	IR_CONDITION_UGE
+};
+
+/* A local variable or a temporary of the builder.  Slots live in the
+   stack frame until ir_mem2reg turns them into virtual registers.  */
+struct ir_slot
+{
+	int id;
+	/* NULL for temporaries.  */
+	struct node* var_node;
+	size_t size;
+	bool is_signed;
+	/* Arrays and structures are always used through their address.  */
+	bool is_scalar;
+	bool address_taken;
+	/* IR type of the values held.  */
+	int type;
+	/* Argument number, -1 for locals.  */
+	int argument;
+	/* Offset from ebp.  Locals and temporaries get theirs when lowered,
+	   where slots not in use at the same time share bytes.  */
+	int offset;
+	bool promoted;
+};
+
+struct ir_phi_value
+{
+	struct ir_block* block;
+	int vreg;
+};
+
+struct ir_instruction
+{
+	int op;
+	/* Virtual register written, 0 for none.  */
+	int dst;
+	/* Virtual registers read, 0 for none.  Only IR_OP_SELECT reads
+	   a third.  */
+	int args[3];
+	/* Value of IR_OP_CONST, offset of memory accesses and addresses.  */
+	long long imm;
+	/* Width and signedness of memory accesses and extensions.  */
+	size_t size;
+	bool is_signed;
+	int condition;
+	/* Symbol of IR_OP_ADDRESS and of direct calls.  */
+	const char* label;
+	/* IR_OP_CALL of a function taking `...` or through a pointer.  */
+	bool is_variadic;
+	/* IR_OP_CALL and IR_OP_RETURN of a small structure, its `size`
+	   bytes travel in eax and edx.  The call stores them to `slot`.  */
+	bool is_struct;
+	struct ir_slot* slot;
+	/* Vector of int, the arguments of IR_OP_CALL.  */
+	struct vector* call_args;
+	/* Vector of struct ir_phi_value.  */
+	struct vector* phi_values;
+	/* IR_OP_JUMP goes to the first target, IR_OP_BRANCH to the first
+	   if a is not zero and to the second otherwise.  A branch with
+	   b set compares a and b with `condition` instead.  */
+	struct ir_block* targets[2];
+	/* By target of IR_OP_BRANCH, whether `__builtin_expect` says it
+	   is rarely taken.  */
+	bool is_unlikely[2];
+	/* Vector of struct ir_block*, the jump table of IR_OP_SWITCH.  */
+	struct vector* switch_targets;
+};
+
+struct ir_block
+{
+	int id;
+	/* Vector of struct ir_instruction*, the last one is a terminator.  */
+	struct vector* instructions;
+	/* Vectors of struct ir_block*.  */
+	struct vector* predecessors;
+	struct vector* successors;
+	/* Immediate dominator, NULL for the entry block.  */
+	struct ir_block* idom;
+	/* Index in reverse postorder, in the layout once ir_layout ran.  */
+	int order;
+	/* Label of the block in the assembly.  */
+	int label_id;
+	/* `unroll` of the `for` whose condition the block tests.  */
+	int unroll;
+	/* Starts a loop, its code is aligned.  */
+	bool is_aligned;
+};
+
+struct ir_function
+{
+	struct compile_process* process;
+	struct node* node;
+	/* Vector of struct ir_block*, the entry block first.  */
+	struct vector* blocks;
+	/* Vector of struct ir_slot*.  */
+	struct vector* slots;
+	/* Vector of int, type of every virtual register.  */
+	struct vector* vreg_types;
+	int next_block_id;
+};
+
+struct ir_function* ir_function_new (struct compile_process* process, struct node* function_node);
+void ir_function_free (struct ir_function* function);
+struct ir_block* ir_block_new (struct ir_function* function);
+struct ir_block* ir_entry_block (struct ir_function* function);
+int ir_vreg_new (struct ir_function* function, int type);
+int ir_vreg_type (struct ir_function* function, int vreg);
+size_t ir_type_size (int type);
+int ir_total_vregs (struct ir_function* function);
+struct ir_instruction* ir_instruction_new (int op);
+struct ir_instruction* ir_instruction_copy (struct ir_instruction* instruction);
+void ir_instruction_free (struct ir_instruction* instruction);
+void ir_block_append (struct ir_block* block, struct ir_instruction* instruction);
+void ir_block_insert (struct ir_block* block, int index, struct ir_instruction* instruction);
+void ir_block_compact (struct ir_block* block);
+struct ir_instruction* ir_block_terminator (struct ir_block* block);
+int ir_condition_inverse (int condition);
+bool ir_op_is_terminator (int op);
+bool ir_instruction_has_side_effects (struct ir_instruction* instruction);
+int ir_instruction_total_uses (struct ir_instruction* instruction);
+int* ir_instruction_use_at (struct ir_instruction* instruction, int index);
+int ir_instruction_total_targets (struct ir_instruction* instruction);
+struct ir_block** ir_instruction_target_at (struct ir_instruction* instruction, int index);
+void ir_compute_cfg (struct ir_function* function);
+bool ir_dominates (struct ir_block* a, struct ir_block* b);
+void ir_verify (struct ir_function* function);
+void ir_dump (struct ir_function* function, FILE* out);
+
+struct ir_function* ir_build (struct compile_process* process, struct node* function_node);
+void ir_mem2reg (struct ir_function* function);
+void ir_remove_dead_code (struct ir_function* function);
+void ir_leave_ssa (struct ir_function* function);
+void ir_inline (struct ir_function* function);
+void ir_cse (struct ir_function* function);
+void ir_optimize_loops (struct ir_function* function);
+void ir_select (struct ir_function* function);
+void ir_layout (struct ir_function* function);
+void ir_lower (struct ir_function* function);
+
+struct asm_instruction* asm_instruction_new (const char* text);
+void asm_instruction_free (struct asm_instruction* instruction);
+void peephole_optimize (struct compile_process* process, struct vector* instructions);
+
+struct assembler* assembler_new (struct compile_process* process);
+void assembler_free (struct assembler* assembler);
+void assembler_line (struct assembler* assembler, const char* line);
+void assembler_bytes (struct assembler* assembler, const char* label, const char* data, size_t len);
+void assembler_write (struct assembler* assembler, FILE* out);
+
 #endif
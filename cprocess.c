@@ -15,7 +15,7 @@ struct compile_process
 	FILE* out_file = NULL;
 	if (out_file_name)
 	{
-		out_file = fopen(out_file_name, "w");
+		out_file = fopen(out_file_name, "wb");
 		if (!out_file)
 		{
 			return NULL;
@@ -29,6 +29,7 @@ struct compile_process
 	process->flags=flags;
 	process->cfile.fp = file;
 	process->ofile = out_file;
+	process->ofile_name = out_file_name;
 	process->generator = codegenerator_new (process);
 
 	symbol_resolver_initialize(process);
@@ -29,7 +29,7 @@ datatype_element_size (struct datatype* dtype)
 {
     if (dtype->flags & DATATYPE_FLAG_IS_POINTER)
     {
-        return DATA_SIZE_DWORD;
+        return DATA_SIZE_POINTER;
     }
 
     return dtype->size;
@@ -50,14 +50,15 @@ datatype_size_no_ptr (struct datatype* dtype)
 size_t
 datatype_size (struct datatype* dtype)
 {
-    if (dtype->flags & DATATYPE_FLAG_IS_POINTER && dtype->pointer_depth > 0)
+    /* `char* names[4]` is an array of four pointers.  */
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
     {
-        return DATA_SIZE_DWORD;
+        return dtype->array.size;
     }
 
-    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
+    if (dtype->flags & DATATYPE_FLAG_IS_POINTER && dtype->pointer_depth > 0)
     {
-        return dtype->array.size;
+        return DATA_SIZE_POINTER;
     }
 
     return dtype->size;
@@ -67,4 +68,32 @@ bool
 datatype_is_primitive (struct datatype* dtype)
 {
     return !datatype_is_struct_or_union(dtype);
+}
+
+static bool
+datatype_is_move_size (size_t size)
+{
+    return size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD || \
+           size == DATA_SIZE_DWORD || size == DATA_SIZE_DDWORD;
+}
+
+/* Structures and unions of up to two registers come back in eax and
+   edx, rax and rdx on x86-64, like with -freg-struct-return.  Each
+   half has to be a size one move can carry.  */
+bool
+datatype_is_returned_in_registers (struct datatype* dtype)
+{
+    if (!datatype_is_struct_or_union(dtype) || dtype->flags & DATATYPE_FLAG_IS_POINTER)
+    {
+        return false;
+    }
+
+    size_t size = datatype_size(dtype);
+    size_t word = DATA_SIZE_POINTER;
+    if (size > word)
+    {
+        return size <= 2 * word && datatype_is_move_size(size - word);
+    }
+
+    return datatype_is_move_size(size);
 }
\ No newline at end of file
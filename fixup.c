@@ -6,7 +6,7 @@ struct fixup_system*
 fixup_sys_new (void)
 {
     struct fixup_system* system = calloc (1, sizeof (struct fixup_system));
-    system->fixups = vector_create (sizeof (struct fixup));
+    system->fixups = vector_create (sizeof (struct fixup*));
     return system;
 }
 
@@ -62,7 +62,7 @@ fixup_sys_unresolved_fixups_count (struct fixup_system* system)
     struct fixup* fixup = fixup_next (system);
     while (fixup)
     {
-        if (fixup->flags = FIXUP_FLAG_RESOLVED)
+        if (fixup->flags & FIXUP_FLAG_RESOLVED)
         {
             fixup = fixup_next (system);
             continue;
@@ -80,7 +80,7 @@ fixup_register (struct fixup_system* system, struct fixup_config* config)
     struct fixup* fixup = calloc (1, sizeof (struct fixup));
     memcpy (&fixup->config, config, sizeof(struct fixup_config));
     fixup->system = system;
-    vector_push (system->fixups, fixup);
+    vector_push (system->fixups, &fixup);
     return fixup;
 }
 
@@ -110,6 +110,7 @@ fixups_resolve (struct fixup_system* system)
     {
         if (fixup->flags & FIXUP_FLAG_RESOLVED)
         {
+            fixup = fixup_next (system);
             continue;
         }
         fixup_resolve (fixup);
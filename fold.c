@@ -0,0 +1,801 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Constant folding runs between the parser and the code generator.
+   Constant subtrees are replaced in place by a number node, so the
+   code generator never sees `4 * 1024` or `(1 << 12) - 1`.  Numbers
+   are ints to the code generator unless they are longs of x86-64,
+   folding works on values of the width of their type too.  */
+
+static struct compile_process* current_process = NULL;
+
+/* Vector of struct node*, variables visible at the current point.  */
+static struct vector* fold_scope = NULL;
+/* Vector of const char*, names that are assigned or have their
+   address taken in the current function.  */
+static struct vector* fold_written_names = NULL;
+
+static int fold_total_eliminated = 0;
+static int fold_total_propagated = 0;
+
+void fold_node (struct node* node);
+void fold_statement (struct node* node);
+
+static int
+fold_count_nodes (struct node* node)
+{
+    if (!node)
+    {
+        return 0;
+    }
+
+    switch (node->type)
+    {
+        case NODE_TYPE_EXPRESSION:
+            return 1 + fold_count_nodes (node->exp.left) + \
+                   fold_count_nodes (node->exp.right);
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return 1 + fold_count_nodes (node->parenthesis.exp);
+
+        case NODE_TYPE_UNARY:
+            return 1 + fold_count_nodes (node->unary.operand);
+
+        case NODE_TYPE_CAST:
+            return 1 + fold_count_nodes (node->cast.operand);
+
+        case NODE_TYPE_TENARY:
+            return 1 + fold_count_nodes (node->tenary.true_node) + \
+                   fold_count_nodes (node->tenary.false_node);
+
+        case NODE_TYPE_BRACKET:
+            return 1 + fold_count_nodes (node->bracket.inner);
+    }
+
+    return 1;
+}
+
+static bool
+fold_is_number (struct node* node)
+{
+    return node && node->type == NODE_TYPE_NUMBER;
+}
+
+/* Value of a number node as the int or long the code generator
+   loads.  */
+static long long
+fold_number_value (struct node* node)
+{
+    if (number_node_is_long (node))
+    {
+        return (long long) node->llnum;
+    }
+
+    return (int) (unsigned int) node->llnum;
+}
+
+/* Turns `node` into a number, `eliminated` nodes went away.  An int
+   `value` is truncated to 32 bits.  */
+static void
+fold_replace_with_number (struct node* node, long long value, bool is_long,
+                          int eliminated)
+{
+    struct node number = {
+        .type=NODE_TYPE_NUMBER,
+        .flags=is_long ? NODE_FLAG_IS_LONG : 0,
+        .pos=node->pos,
+        .binded=node->binded,
+        .llnum=is_long ? value : (long long) (int) (unsigned int) value
+    };
+    *node = number;
+    fold_total_eliminated += eliminated;
+}
+
+/* Replaces `node` by its child `child`.  */
+static void
+fold_replace_with_child (struct node* node, struct node* child,
+                         int eliminated)
+{
+    *node = *child;
+    fold_total_eliminated += eliminated;
+}
+
+/* Integer types that survive being folded to an int or a long.
+   Unsigned ints and longs and pointers would lose their type, their
+   arithmetic and comparisons are unsigned.  */
+static bool
+fold_datatype_is_foldable (struct datatype* dtype)
+{
+    if (dtype->flags & (DATATYPE_FLAG_IS_POINTER | DATATYPE_FLAG_IS_ARRAY))
+    {
+        return false;
+    }
+
+    switch (dtype->type)
+    {
+        case DATA_TYPE_CHAR:
+        case DATA_TYPE_SHORT:
+        case DATA_TYPE_INTEGER:
+        case DATA_TYPE_LONG:
+            break;
+
+        default:
+            return false;
+    }
+
+    size_t size = datatype_size (dtype);
+    if (size < DATA_SIZE_DWORD)
+    {
+        /* Promoted to int whatever the sign.  */
+        return true;
+    }
+
+    return (size == DATA_SIZE_DWORD || size == DATA_SIZE_DDWORD) && \
+           dtype->flags & DATATYPE_FLAG_IS_SIGNED;
+}
+
+/* `value` converted to `dtype`, as a cast or a store would.  */
+static long long
+fold_convert (struct datatype* dtype, long long value)
+{
+    bool is_signed = dtype->flags & DATATYPE_FLAG_IS_SIGNED;
+    switch (datatype_size (dtype))
+    {
+        case DATA_SIZE_BYTE:
+            return is_signed ? (int) (signed char) value : \
+                               (int) (unsigned char) value;
+        case DATA_SIZE_WORD:
+            return is_signed ? (int) (short) value : \
+                               (int) (unsigned short) value;
+        case DATA_SIZE_DWORD:
+            return (int) (unsigned int) value;
+    }
+
+    return value;
+}
+
+/* Evaluates `left op right`, false if it cannot be done at compile
+   time, e.g. a division by zero.  Both values have the type of the
+   result, an int unless `is_long`.  */
+static bool
+fold_binary_value (const char* op, long long left, long long right,
+                   bool is_long, long long* out)
+{
+    unsigned long long uleft = left;
+    unsigned long long uright = right;
+    int shift_mask = is_long ? 63 : 31;
+    if (S_EQ (op, "+"))
+        *out = (long long) (uleft + uright);
+    else if (S_EQ (op, "-"))
+        *out = (long long) (uleft - uright);
+    else if (S_EQ (op, "*"))
+        *out = (long long) (uleft * uright);
+    else if (S_EQ (op, "/") || S_EQ (op, "%"))
+    {
+        long long min = is_long ? LLONG_MIN : INT_MIN;
+        if (right == 0 || (left == min && right == -1))
+        {
+            return false;
+        }
+        *out = S_EQ (op, "/") ? left / right : left % right;
+    }
+    else if (S_EQ (op, "&"))
+        *out = left & right;
+    else if (S_EQ (op, "|"))
+        *out = left | right;
+    else if (S_EQ (op, "^"))
+        *out = left ^ right;
+    else if (S_EQ (op, "<<"))
+        *out = (long long) (uleft << (right & shift_mask));
+    else if (S_EQ (op, ">>"))
+        *out = left >> (right & shift_mask);
+    else if (S_EQ (op, "=="))
+        *out = left == right;
+    else if (S_EQ (op, "!="))
+        *out = left != right;
+    else if (S_EQ (op, "<"))
+        *out = left < right;
+    else if (S_EQ (op, "<="))
+        *out = left <= right;
+    else if (S_EQ (op, ">"))
+        *out = left > right;
+    else if (S_EQ (op, ">="))
+        *out = left >= right;
+    else if (S_EQ (op, "&&"))
+        *out = left && right;
+    else if (S_EQ (op, "||"))
+        *out = left || right;
+    else
+        return false;
+
+    return true;
+}
+
+static bool
+fold_is_assignment_op (const char* op)
+{
+    size_t len = strlen (op);
+    return op[len - 1] == '=' && !S_EQ (op, "==") && !S_EQ (op, "!=") && \
+           !S_EQ (op, "<=") && !S_EQ (op, ">=");
+}
+
+static struct node*
+fold_strip_parentheses (struct node* node)
+{
+    while (node && node->type == NODE_TYPE_EXPRESSION_PARENTHESES)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    return node;
+}
+
+/* Records the names the function writes to or takes the address of,
+   a const local with one of these names is not propagated.  */
+static void
+fold_collect_written (struct node* node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    struct node* target = NULL;
+    switch (node->type)
+    {
+        case NODE_TYPE_EXPRESSION:
+            if (fold_is_assignment_op (node->exp.op))
+            {
+                target = fold_strip_parentheses (node->exp.left);
+            }
+            fold_collect_written (node->exp.left);
+            fold_collect_written (node->exp.right);
+            break;
+
+        case NODE_TYPE_UNARY:
+            if (S_EQ (node->unary.op, "&") || S_EQ (node->unary.op, "++") || \
+                S_EQ (node->unary.op, "--"))
+            {
+                target = fold_strip_parentheses (node->unary.operand);
+            }
+            fold_collect_written (node->unary.operand);
+            break;
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            fold_collect_written (node->parenthesis.exp);
+            break;
+
+        case NODE_TYPE_CAST:
+            fold_collect_written (node->cast.operand);
+            break;
+
+        case NODE_TYPE_TENARY:
+            fold_collect_written (node->tenary.true_node);
+            fold_collect_written (node->tenary.false_node);
+            break;
+
+        case NODE_TYPE_VARIABLE:
+            fold_collect_written (node->var.val);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                fold_collect_written (vector_peek_ptr_at (node->var_list.list, i));
+            }
+            break;
+
+        case NODE_TYPE_BODY:
+            for (int i = 0; i < vector_count (node->body.statements); i++)
+            {
+                fold_collect_written (vector_peek_ptr_at (node->body.statements, i));
+            }
+            break;
+
+        case NODE_TYPE_STATEMENT_RETURN:
+            fold_collect_written (node->stmt.return_stmt.exp);
+            break;
+
+        case NODE_TYPE_STATEMENT_IF:
+            fold_collect_written (node->stmt.if_stmt.cond_node);
+            fold_collect_written (node->stmt.if_stmt.body_node);
+            fold_collect_written (node->stmt.if_stmt.next);
+            break;
+
+        case NODE_TYPE_STATEMENT_ELSE:
+            fold_collect_written (node->stmt.else_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_WHILE:
+            fold_collect_written (node->stmt.while_stmt.exp_node);
+            fold_collect_written (node->stmt.while_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_DO_WHILE:
+            fold_collect_written (node->stmt.do_while_node.exp_node);
+            fold_collect_written (node->stmt.do_while_node.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_FOR:
+            fold_collect_written (node->stmt.for_stmt.init_node);
+            fold_collect_written (node->stmt.for_stmt.cond_node);
+            fold_collect_written (node->stmt.for_stmt.loop_node);
+            fold_collect_written (node->stmt.for_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_SWITCH:
+            fold_collect_written (node->stmt.switch_stmt.exp_node);
+            fold_collect_written (node->stmt.switch_stmt.body_node);
+            break;
+    }
+
+    if (target && target->type == NODE_TYPE_IDENTIFIER)
+    {
+        vector_push (fold_written_names, &target->sval);
+    }
+}
+
+static bool
+fold_name_is_written (const char* name)
+{
+    for (int i = 0; i < vector_count (fold_written_names); i++)
+    {
+        const char* written = vector_peek_ptr_at (fold_written_names, i);
+        if (S_EQ (written, name))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct node*
+fold_scope_find (const char* name)
+{
+    for (int i = vector_count (fold_scope) - 1; i >= 0; i--)
+    {
+        struct node* var_node = vector_peek_ptr_at (fold_scope, i);
+        if (S_EQ (var_node->var.name, name))
+        {
+            return var_node;
+        }
+    }
+
+    return NULL;
+}
+
+/* A const local whose initialiser folded to a number, and that is
+   never written to, can be replaced by its value everywhere.  */
+static bool
+fold_variable_is_propagated (struct node* var_node)
+{
+    struct datatype* dtype = &var_node->var.type;
+    return var_node->binded.function && \
+           dtype->flags & DATATYPE_FLAG_IS_CONST && \
+           !(dtype->flags & (DATATYPE_FLAG_IS_STATIC | DATATYPE_FLAG_IS_EXTERN)) && \
+           fold_datatype_is_foldable (dtype) && \
+           fold_is_number (var_node->var.val) && \
+           !fold_name_is_written (var_node->var.name);
+}
+
+static void
+fold_identifier (struct node* node)
+{
+    struct node* var_node = fold_scope_find (node->sval);
+    if (!var_node || !fold_variable_is_propagated (var_node))
+    {
+        return;
+    }
+
+    struct datatype* dtype = &var_node->var.type;
+    long long value = fold_convert (dtype, fold_number_value (var_node->var.val));
+    fold_replace_with_number (node, value, datatype_size (dtype) == DATA_SIZE_DDWORD, 0);
+    fold_total_propagated++;
+}
+
+static void
+fold_unary (struct node* node)
+{
+    const char* op = node->unary.op;
+    if (S_EQ (op, "&") || S_EQ (op, "++") || S_EQ (op, "--"))
+    {
+        /* The operand is an lvalue, a const local stays a variable.  */
+        struct node* operand = fold_strip_parentheses (node->unary.operand);
+        if (operand->type != NODE_TYPE_IDENTIFIER)
+        {
+            fold_node (node->unary.operand);
+        }
+        return;
+    }
+
+    fold_node (node->unary.operand);
+    if (!fold_is_number (node->unary.operand))
+    {
+        return;
+    }
+
+    long long value = fold_number_value (node->unary.operand);
+    bool is_long = number_node_is_long (node->unary.operand);
+    if (S_EQ (op, "-"))
+        value = (long long) (0ull - (unsigned long long) value);
+    else if (S_EQ (op, "~"))
+        value = ~value;
+    else if (S_EQ (op, "!"))
+    {
+        value = !value;
+        is_long = false;
+    }
+    else if (!S_EQ (op, "+"))
+        return;
+
+    fold_replace_with_number (node, value, is_long, 1);
+}
+
+/* `a ? b : c` with a constant `a` is the branch it selects.  */
+static void
+fold_tenary (struct node* node)
+{
+    struct node* tenary_node = node->exp.right;
+    fold_node (node->exp.left);
+    fold_node (tenary_node->tenary.true_node);
+    fold_node (tenary_node->tenary.false_node);
+    if (!fold_is_number (node->exp.left))
+    {
+        return;
+    }
+
+    bool condition = fold_number_value (node->exp.left) != 0;
+    struct node* taken = condition ? tenary_node->tenary.true_node : \
+                                     tenary_node->tenary.false_node;
+    struct node* dropped = condition ? tenary_node->tenary.false_node : \
+                                       tenary_node->tenary.true_node;
+    fold_replace_with_child (node, taken, 2 + fold_count_nodes (node->exp.left) + \
+                             fold_count_nodes (dropped));
+}
+
+/* Commas between call arguments separate them, they are not
+   comma operators and must stay.  */
+static void
+fold_call_arguments (struct node* node)
+{
+    if (node && node->type == NODE_TYPE_EXPRESSION && S_EQ (node->exp.op, ","))
+    {
+        fold_call_arguments (node->exp.left);
+        fold_call_arguments (node->exp.right);
+        return;
+    }
+
+    fold_node (node);
+}
+
+static void
+fold_expression (struct node* node)
+{
+    const char* op = node->exp.op;
+    if (S_EQ (op, "?"))
+    {
+        fold_tenary (node);
+        return;
+    }
+
+    if (S_EQ (op, "()"))
+    {
+        fold_node (node->exp.left);
+        fold_call_arguments (node->exp.right->parenthesis.exp);
+        return;
+    }
+
+    if (S_EQ (op, ".") || S_EQ (op, "->"))
+    {
+        /* The right side is a member name, not a variable.  */
+        fold_node (node->exp.left);
+        return;
+    }
+
+    if (fold_is_assignment_op (op))
+    {
+        struct node* target = fold_strip_parentheses (node->exp.left);
+        if (target->type != NODE_TYPE_IDENTIFIER)
+        {
+            fold_node (node->exp.left);
+        }
+        fold_node (node->exp.right);
+        return;
+    }
+
+    fold_node (node->exp.left);
+    fold_node (node->exp.right);
+
+    if (S_EQ (op, ",") && fold_is_number (node->exp.left))
+    {
+        /* A number on the left of a comma has no effect.  */
+        fold_replace_with_child (node, node->exp.right, 2);
+        return;
+    }
+
+    bool left_is_number = fold_is_number (node->exp.left);
+    if (left_is_number && (S_EQ (op, "&&") || S_EQ (op, "||")))
+    {
+        /* `0 && f ()` and `1 || f ()` never evaluate the right side.  */
+        bool left = fold_number_value (node->exp.left) != 0;
+        if (S_EQ (op, "&&") ? !left : left)
+        {
+            fold_replace_with_number (node, left, false, fold_count_nodes (node) - 1);
+            return;
+        }
+    }
+
+    if (!left_is_number || !fold_is_number (node->exp.right))
+    {
+        return;
+    }
+
+    /* The usual conversions make both sides long if either is, but a
+       shift has the type of its left side and a comparison is an
+       int.  */
+    bool is_shift = S_EQ (op, "<<") || S_EQ (op, ">>");
+    bool is_long = number_node_is_long (node->exp.left) || \
+                   (!is_shift && number_node_is_long (node->exp.right));
+    bool is_comparison = S_EQ (op, "==") || S_EQ (op, "!=") || \
+                         S_EQ (op, "<") || S_EQ (op, "<=") || \
+                         S_EQ (op, ">") || S_EQ (op, ">=") || \
+                         S_EQ (op, "&&") || S_EQ (op, "||");
+    long long value = 0;
+    if (fold_binary_value (op, fold_number_value (node->exp.left),
+                           fold_number_value (node->exp.right),
+                           is_long, &value))
+    {
+        fold_replace_with_number (node, value, is_long && !is_comparison, 2);
+    }
+}
+
+void
+fold_node (struct node* node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    switch (node->type)
+    {
+        case NODE_TYPE_EXPRESSION:
+            fold_expression (node);
+            break;
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            fold_node (node->parenthesis.exp);
+            if (fold_is_number (node->parenthesis.exp))
+            {
+                fold_replace_with_child (node, node->parenthesis.exp, 1);
+            }
+            break;
+
+        case NODE_TYPE_IDENTIFIER:
+            fold_identifier (node);
+            break;
+
+        case NODE_TYPE_UNARY:
+            fold_unary (node);
+            break;
+
+        case NODE_TYPE_CAST:
+            fold_node (node->cast.operand);
+            if (fold_is_number (node->cast.operand) && \
+                fold_datatype_is_foldable (&node->cast.dtype))
+            {
+                struct datatype* dtype = &node->cast.dtype;
+                long long value = fold_convert (dtype,
+                                                fold_number_value (node->cast.operand));
+                fold_replace_with_number (node, value,
+                                          datatype_size (dtype) == DATA_SIZE_DDWORD, 1);
+            }
+            break;
+
+        case NODE_TYPE_BRACKET:
+            fold_node (node->bracket.inner);
+            break;
+
+        case NODE_TYPE_INITIALIZER:
+            for (int i = 0; i < vector_count (node->initializer.values); i++)
+            {
+                fold_node (vector_peek_ptr_at (node->initializer.values, i));
+            }
+            break;
+    }
+}
+
+void
+fold_variable (struct node* node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    fold_node (node->var.val);
+    if (node->var.name)
+    {
+        vector_push (fold_scope, &node);
+    }
+}
+
+void
+fold_body (struct node* node)
+{
+    if (node->type != NODE_TYPE_BODY)
+    {
+        fold_statement (node);
+        return;
+    }
+
+    int scope_start = vector_count (fold_scope);
+    for (int i = 0; i < vector_count (node->body.statements); i++)
+    {
+        fold_statement (vector_peek_ptr_at (node->body.statements, i));
+    }
+
+    while (vector_count (fold_scope) > scope_start)
+    {
+        vector_pop (fold_scope);
+    }
+}
+
+void
+fold_statement (struct node* node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    int scope_start = vector_count (fold_scope);
+    switch (node->type)
+    {
+        case NODE_TYPE_VARIABLE:
+            fold_variable (node);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                fold_variable (vector_peek_ptr_at (node->var_list.list, i));
+            }
+            break;
+
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            fold_variable (variable_node (node));
+            break;
+
+        case NODE_TYPE_BODY:
+            fold_body (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_RETURN:
+            fold_node (node->stmt.return_stmt.exp);
+            break;
+
+        case NODE_TYPE_STATEMENT_IF:
+            fold_node (node->stmt.if_stmt.cond_node);
+            fold_body (node->stmt.if_stmt.body_node);
+            fold_statement (node->stmt.if_stmt.next);
+            break;
+
+        case NODE_TYPE_STATEMENT_ELSE:
+            fold_body (node->stmt.else_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_WHILE:
+            fold_node (node->stmt.while_stmt.exp_node);
+            fold_body (node->stmt.while_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_DO_WHILE:
+            fold_body (node->stmt.do_while_node.body_node);
+            fold_node (node->stmt.do_while_node.exp_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_FOR:
+            /* Variables of the init statement belong to the loop.  */
+            fold_statement (node->stmt.for_stmt.init_node);
+            fold_node (node->stmt.for_stmt.cond_node);
+            fold_node (node->stmt.for_stmt.loop_node);
+            fold_body (node->stmt.for_stmt.body_node);
+            while (vector_count (fold_scope) > scope_start)
+            {
+                vector_pop (fold_scope);
+            }
+            break;
+
+        case NODE_TYPE_STATEMENT_SWITCH:
+            fold_node (node->stmt.switch_stmt.exp_node);
+            fold_body (node->stmt.switch_stmt.body_node);
+            break;
+
+        case NODE_TYPE_STATEMENT_CASE:
+        case NODE_TYPE_STATEMENT_DEFAULT:
+        case NODE_TYPE_STATEMENT_BREAK:
+        case NODE_TYPE_STATEMENT_CONTINUE:
+        case NODE_TYPE_STATEMENT_GOTO:
+        case NODE_TYPE_LABEL:
+        case NODE_TYPE_BLANK:
+            break;
+
+        default:
+            /* Expression statement.  */
+            fold_node (node);
+    }
+}
+
+void
+fold_function (struct node* node)
+{
+    if (!node->func.body_n)
+    {
+        return;
+    }
+
+    fold_written_names = vector_create (sizeof (const char*));
+    fold_collect_written (node->func.body_n);
+
+    int scope_start = vector_count (fold_scope);
+    struct vector* arguments = node->func.args.vector;
+    for (int i = 0; arguments && i < vector_count (arguments); i++)
+    {
+        struct node* var_node = vector_peek_ptr_at (arguments, i);
+        if (var_node->var.name)
+        {
+            vector_push (fold_scope, &var_node);
+        }
+    }
+    fold_body (node->func.body_n);
+    while (vector_count (fold_scope) > scope_start)
+    {
+        vector_pop (fold_scope);
+    }
+
+    vector_free (fold_written_names);
+    fold_written_names = NULL;
+}
+
+int
+fold (struct compile_process* process)
+{
+    current_process = process;
+    fold_scope = vector_create (sizeof (struct node*));
+    fold_total_eliminated = 0;
+    fold_total_propagated = 0;
+
+    struct vector* tree = process->node_tree_vec;
+    for (int i = 0; i < vector_count (tree); i++)
+    {
+        struct node* node = vector_peek_ptr_at (tree, i);
+        switch (node->type)
+        {
+            case NODE_TYPE_FUNCTION:
+                fold_function (node);
+                break;
+
+            case NODE_TYPE_VARIABLE:
+            case NODE_TYPE_VARIABLE_LIST:
+            case NODE_TYPE_STRUCT:
+            case NODE_TYPE_UNION:
+                /* Globals are visible to the functions that follow,
+                   they are never propagated.  */
+                fold_statement (node);
+                break;
+        }
+    }
+
+    vector_free (fold_scope);
+    fold_scope = NULL;
+    compiler_report (process, "fold: %i nodes eliminated, %i constants "
+                     "propagated", fold_total_eliminated,
+                     fold_total_propagated);
+    return FOLD_ALL_OK;
+}
@@ -115,4 +115,23 @@ compute_sum_padding (struct vector* vec)
     }
 
     return padding;
-}
\ No newline at end of file
+}
+
+/* FNV-1a hash of `str`, its length goes to `len_out` unless NULL.  */
+unsigned int
+hash_string (const char* str, size_t* len_out)
+{
+    unsigned int hash = 2166136261u;
+    const char* ptr = str;
+    while (*ptr)
+    {
+        hash ^= (unsigned char) *ptr++;
+        hash *= 16777619u;
+    }
+
+    if (len_out)
+    {
+        *len_out = ptr - str;
+    }
+    return hash;
+}
@@ -0,0 +1,376 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/* Evaluates the initializer of a global at compile time into the
+   bytes of the object, so the data section holds the final value and
+   no code has to run at startup.  Words holding an address are left
+   as relocations for the assembler.  */
+
+static struct compile_process* current_process = NULL;
+
+void initializer_write (struct initializer_data* data, struct datatype* dtype,
+                        int bracket_index, size_t offset, struct node* node);
+
+static struct initializer_data*
+initializer_data_new (size_t size)
+{
+    struct initializer_data* data = calloc (1, sizeof (struct initializer_data));
+    data->bytes = calloc (size ? size : 1, 1);
+    data->size = size;
+    data->relocations = vector_create (sizeof (struct initializer_relocation));
+    return data;
+}
+
+void
+initializer_data_free (struct initializer_data* data)
+{
+    vector_free (data->relocations);
+    free (data->bytes);
+    free (data);
+}
+
+static void
+initializer_write_number (struct initializer_data* data, size_t offset,
+                          size_t size, long long value)
+{
+    /* Little endian.  */
+    for (size_t i = 0; i < size; i++)
+    {
+        data->bytes[offset + i] = (char) ((unsigned long long) value >> (i * 8));
+    }
+}
+
+static struct node*
+initializer_find_global (const char* name)
+{
+    struct vector* tree = current_process->node_tree_vec;
+    for (int i = 0; i < vector_count (tree); i++)
+    {
+        struct node* node = vector_peek_ptr_at (tree, i);
+        if (node->type == NODE_TYPE_FUNCTION && S_EQ (node->func.name, name))
+        {
+            return node;
+        }
+
+        if (node->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            for (int j = 0; j < vector_count (node->var_list.list); j++)
+            {
+                struct node* var_node = vector_peek_ptr_at (node->var_list.list, j);
+                if (var_node->var.name && S_EQ (var_node->var.name, name))
+                {
+                    return var_node;
+                }
+            }
+            continue;
+        }
+
+        struct node* var_node = variable_node (node);
+        if (var_node && var_node->var.name && S_EQ (var_node->var.name, name))
+        {
+            return var_node;
+        }
+    }
+
+    return NULL;
+}
+
+/* Size of what a pointer of `dtype` points to, for `p + n`.  */
+static size_t
+initializer_pointee_size (struct datatype* dtype)
+{
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
+    {
+        return array_brackets_calculate_size_from_index (dtype,
+                                                         dtype->array.brackets, 1);
+    }
+
+    if (dtype->pointer_depth > 1)
+    {
+        return DATA_SIZE_POINTER;
+    }
+
+    return dtype->size ? dtype->size : DATA_SIZE_BYTE;
+}
+
+/* An address known at link time, `&x`, `array`, `&array[2]`, `"abc"`,
+   `function` or one of those plus a number.  `dtype_out` is the type
+   the address points into, used to scale additions.  */
+static bool
+initializer_address (struct node* node, struct initializer_relocation* out,
+                     struct datatype** dtype_out)
+{
+    struct node* found = NULL;
+    switch (node->type)
+    {
+        case NODE_TYPE_STRING:
+            out->string = node->sval;
+            *dtype_out = NULL;
+            return true;
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return initializer_address (node->parenthesis.exp, out, dtype_out);
+
+        case NODE_TYPE_CAST:
+            return initializer_address (node->cast.operand, out, dtype_out);
+
+        case NODE_TYPE_IDENTIFIER:
+            /* Arrays and functions decay to their address.  */
+            found = initializer_find_global (node->sval);
+            if (!found)
+            {
+                return false;
+            }
+
+            if (found->type == NODE_TYPE_FUNCTION)
+            {
+                out->label = found->func.name;
+                *dtype_out = NULL;
+                return true;
+            }
+
+            if (!(found->var.type.flags & DATATYPE_FLAG_IS_ARRAY))
+            {
+                return false;
+            }
+            out->label = found->var.name;
+            *dtype_out = &found->var.type;
+            return true;
+
+        case NODE_TYPE_UNARY:
+        {
+            if (!S_EQ (node->unary.op, "&"))
+            {
+                return false;
+            }
+
+            struct node* operand = node->unary.operand;
+            while (operand->type == NODE_TYPE_EXPRESSION_PARENTHESES)
+            {
+                operand = operand->parenthesis.exp;
+            }
+
+            if (operand->type == NODE_TYPE_IDENTIFIER)
+            {
+                found = initializer_find_global (operand->sval);
+                if (!found)
+                {
+                    return false;
+                }
+                out->label = found->type == NODE_TYPE_FUNCTION ? \
+                             found->func.name : found->var.name;
+                *dtype_out = NULL;
+                return true;
+            }
+
+            /* `&array[n]`  */
+            if (operand->type == NODE_TYPE_EXPRESSION && \
+                S_EQ (operand->exp.op, "[]"))
+            {
+                struct node* index = operand->exp.right;
+                if (index->type == NODE_TYPE_BRACKET)
+                {
+                    index = index->bracket.inner;
+                }
+                if (index->type != NODE_TYPE_NUMBER || \
+                    !initializer_address (operand->exp.left, out, dtype_out) || \
+                    !*dtype_out)
+                {
+                    return false;
+                }
+                out->addend += (long long) index->llnum * \
+                               initializer_pointee_size (*dtype_out);
+                *dtype_out = NULL;
+                return true;
+            }
+            return false;
+        }
+
+        case NODE_TYPE_EXPRESSION:
+        {
+            bool is_add = S_EQ (node->exp.op, "+");
+            if ((!is_add && !S_EQ (node->exp.op, "-")) || \
+                node->exp.right->type != NODE_TYPE_NUMBER || \
+                !initializer_address (node->exp.left, out, dtype_out))
+            {
+                return false;
+            }
+
+            long long scale = *dtype_out ? \
+                              initializer_pointee_size (*dtype_out) : 1;
+            long long value = (long long) node->exp.right->llnum * scale;
+            out->addend += is_add ? value : -value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+initializer_write_scalar (struct initializer_data* data, struct datatype* dtype,
+                          size_t offset, struct node* node)
+{
+    /* `int x = {5};`  */
+    if (node->type == NODE_TYPE_INITIALIZER)
+    {
+        if (vector_count (node->initializer.values) != 1)
+        {
+            compiler_error (current_process,
+                            "A scalar needs exactly one value");
+        }
+        node = vector_peek_ptr_at (node->initializer.values, 0);
+    }
+
+    size_t size = dtype->flags & DATATYPE_FLAG_IS_ARRAY ? \
+                  datatype_element_size (dtype) : datatype_size (dtype);
+    if (node->type == NODE_TYPE_NUMBER)
+    {
+        initializer_write_number (data, offset, size, node->llnum);
+        return;
+    }
+
+    struct initializer_relocation relocation = {.offset=offset};
+    struct datatype* pointed = NULL;
+    if (size != DATA_SIZE_POINTER || \
+        !initializer_address (node, &relocation, &pointed))
+    {
+        compiler_error (current_process, "Initializer is not a constant");
+    }
+
+    vector_push (data->relocations, &relocation);
+}
+
+static void
+initializer_write_array (struct initializer_data* data, struct datatype* dtype,
+                         int bracket_index, size_t offset, struct node* node)
+{
+    struct vector* brackets = array_brackets_node_vector (dtype->array.brackets);
+    struct node* bracket_node = vector_peek_ptr_at (brackets, bracket_index);
+    size_t total = bracket_node->bracket.inner->llnum;
+    size_t element_size = array_brackets_calculate_size_from_index (
+                                dtype, dtype->array.brackets, bracket_index + 1);
+    bool is_last_bracket = bracket_index + 1 == vector_count (brackets);
+
+    /* `char s[4] = "abc";`  */
+    if (node->type == NODE_TYPE_STRING && is_last_bracket && \
+        element_size == DATA_SIZE_BYTE)
+    {
+        size_t len = strlen (node->sval) + 1;
+        if (len > total + 1)
+        {
+            compiler_error (current_process, "String is longer than the array");
+        }
+        memcpy (data->bytes + offset, node->sval, len > total ? total : len);
+        return;
+    }
+
+    if (node->type != NODE_TYPE_INITIALIZER)
+    {
+        compiler_error (current_process, "Arrays need an initializer list");
+    }
+
+    struct vector* values = node->initializer.values;
+    if (vector_count (values) > total)
+    {
+        compiler_error (current_process, "Too many values for the array");
+    }
+
+    for (int i = 0; i < vector_count (values); i++)
+    {
+        initializer_write (data, dtype, bracket_index + 1,
+                           offset + i * element_size,
+                           vector_peek_ptr_at (values, i));
+    }
+}
+
+/* Members of a structure or union body, in declaration order.  */
+static void
+initializer_members (struct node* body_node, struct vector* members)
+{
+    for (int i = 0; i < vector_count (body_node->body.statements); i++)
+    {
+        struct node* statement = vector_peek_ptr_at (body_node->body.statements, i);
+        if (statement->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            for (int j = 0; j < vector_count (statement->var_list.list); j++)
+            {
+                struct node* var_node = vector_peek_ptr_at (statement->var_list.list, j);
+                vector_push (members, &var_node);
+            }
+            continue;
+        }
+
+        struct node* var_node = variable_node (statement);
+        if (var_node && var_node->var.name)
+        {
+            vector_push (members, &var_node);
+        }
+    }
+}
+
+/* Members start at their `aoffset`, the padding between them
+   stays zero.  A union is initialised through its first member.  */
+static void
+initializer_write_struct (struct initializer_data* data, struct datatype* dtype,
+                          size_t offset, struct node* node)
+{
+    if (node->type != NODE_TYPE_INITIALIZER)
+    {
+        compiler_error (current_process,
+                        "Structures need an initializer list");
+    }
+
+    bool is_union = dtype->type == DATA_TYPE_UNION;
+    struct node* body_node = is_union ? dtype->union_node->_union.body_n : \
+                                        dtype->struct_node->_struct.body_n;
+    struct vector* members = vector_create (sizeof (struct node*));
+    initializer_members (body_node, members);
+
+    struct vector* values = node->initializer.values;
+    int total = is_union && vector_count (members) ? 1 : vector_count (members);
+    if (vector_count (values) > total)
+    {
+        compiler_error (current_process, "Too many values for the structure");
+    }
+
+    for (int i = 0; i < vector_count (values); i++)
+    {
+        struct node* member = vector_peek_ptr_at (members, i);
+        initializer_write (data, &member->var.type, 0,
+                           offset + (is_union ? 0 : member->var.aoffset),
+                           vector_peek_ptr_at (values, i));
+    }
+    vector_free (members);
+}
+
+void
+initializer_write (struct initializer_data* data, struct datatype* dtype,
+                   int bracket_index, size_t offset, struct node* node)
+{
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY && \
+        bracket_index < array_total_indexes (dtype))
+    {
+        initializer_write_array (data, dtype, bracket_index, offset, node);
+        return;
+    }
+
+    if (datatype_is_struct_or_union (dtype) && \
+        !(dtype->flags & DATATYPE_FLAG_IS_POINTER))
+    {
+        initializer_write_struct (data, dtype, offset, node);
+        return;
+    }
+
+    initializer_write_scalar (data, dtype, offset, node);
+}
+
+struct initializer_data*
+initializer_evaluate (struct compile_process* process, struct node* var_node)
+{
+    current_process = process;
+    struct initializer_data* data = initializer_data_new (variable_size (var_node));
+    initializer_write (data, &var_node->var.type, 0, 0, var_node->var.val);
+    return data;
+}
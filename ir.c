@@ -0,0 +1,976 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/* Three address code of a function.  Instructions live in basic
+   blocks that end with a jump, a branch, a switch or a return.  After
+   ir_mem2reg every virtual register is written exactly once and the
+   values of variables meet in phi instructions.  */
+
+struct ir_function*
+ir_function_new (struct compile_process* process, struct node* function_node)
+{
+    struct ir_function* function = calloc (1, sizeof (struct ir_function));
+    function->process = process;
+    function->node = function_node;
+    function->blocks = vector_create (sizeof (struct ir_block*));
+    function->slots = vector_create (sizeof (struct ir_slot*));
+    function->vreg_types = vector_create (sizeof (int));
+
+    /* Virtual register zero means no value.  */
+    int type = IR_TYPE_I32;
+    vector_push (function->vreg_types, &type);
+    return function;
+}
+
+void
+ir_instruction_free (struct ir_instruction* instruction)
+{
+    if (instruction->call_args)
+    {
+        vector_free (instruction->call_args);
+    }
+
+    if (instruction->phi_values)
+    {
+        vector_free (instruction->phi_values);
+    }
+
+    if (instruction->switch_targets)
+    {
+        vector_free (instruction->switch_targets);
+    }
+    free (instruction);
+}
+
+static void
+ir_block_free (struct ir_block* block)
+{
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        ir_instruction_free (vector_peek_ptr_at (block->instructions, i));
+    }
+    vector_free (block->instructions);
+    vector_free (block->predecessors);
+    vector_free (block->successors);
+    free (block);
+}
+
+void
+ir_function_free (struct ir_function* function)
+{
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        ir_block_free (vector_peek_ptr_at (function->blocks, i));
+    }
+
+    for (int i = 0; i < vector_count (function->slots); i++)
+    {
+        free (vector_peek_ptr_at (function->slots, i));
+    }
+    vector_free (function->blocks);
+    vector_free (function->slots);
+    vector_free (function->vreg_types);
+    free (function);
+}
+
+struct ir_block*
+ir_block_new (struct ir_function* function)
+{
+    struct ir_block* block = calloc (1, sizeof (struct ir_block));
+    block->id = function->next_block_id++;
+    block->instructions = vector_create (sizeof (struct ir_instruction*));
+    block->predecessors = vector_create (sizeof (struct ir_block*));
+    block->successors = vector_create (sizeof (struct ir_block*));
+    vector_push (function->blocks, &block);
+    return block;
+}
+
+struct ir_block*
+ir_entry_block (struct ir_function* function)
+{
+    return vector_peek_ptr_at (function->blocks, 0);
+}
+
+int
+ir_vreg_new (struct ir_function* function, int type)
+{
+    vector_push (function->vreg_types, &type);
+    return vector_count (function->vreg_types) - 1;
+}
+
+int
+ir_vreg_type (struct ir_function* function, int vreg)
+{
+    return *(int*) vector_at (function->vreg_types, vreg);
+}
+
+/* Width in bytes of a value of `type`.  */
+size_t
+ir_type_size (int type)
+{
+    switch (type)
+    {
+        case IR_TYPE_I64:
+            return DATA_SIZE_DDWORD;
+        case IR_TYPE_PTR:
+            return DATA_SIZE_POINTER;
+    }
+
+    return DATA_SIZE_DWORD;
+}
+
+/* Virtual registers are numbered below this.  */
+int
+ir_total_vregs (struct ir_function* function)
+{
+    return vector_count (function->vreg_types);
+}
+
+struct ir_instruction*
+ir_instruction_new (int op)
+{
+    struct ir_instruction* instruction = calloc (1, sizeof (struct ir_instruction));
+    instruction->op = op;
+    return instruction;
+}
+
+static struct vector*
+ir_vector_copy (struct vector* vector)
+{
+    struct vector* copy = vector_create (vector_element_size (vector));
+    for (int i = 0; i < vector_count (vector); i++)
+    {
+        vector_push (copy, vector_at (vector, i));
+    }
+
+    return copy;
+}
+
+/* A new instruction doing what `instruction` does, with vectors of
+   its own.  */
+struct ir_instruction*
+ir_instruction_copy (struct ir_instruction* instruction)
+{
+    struct ir_instruction* copy = ir_instruction_new (instruction->op);
+    *copy = *instruction;
+    if (instruction->call_args)
+    {
+        copy->call_args = ir_vector_copy (instruction->call_args);
+    }
+
+    if (instruction->phi_values)
+    {
+        copy->phi_values = ir_vector_copy (instruction->phi_values);
+    }
+
+    if (instruction->switch_targets)
+    {
+        copy->switch_targets = ir_vector_copy (instruction->switch_targets);
+    }
+    return copy;
+}
+
+void
+ir_block_append (struct ir_block* block, struct ir_instruction* instruction)
+{
+    vector_push (block->instructions, &instruction);
+}
+
+void
+ir_block_insert (struct ir_block* block, int index, struct ir_instruction* instruction)
+{
+    struct vector* instructions = vector_create (sizeof (struct ir_instruction*));
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        if (i == index)
+        {
+            vector_push (instructions, &instruction);
+        }
+        vector_push (instructions, vector_at (block->instructions, i));
+    }
+
+    if (index >= vector_count (block->instructions))
+    {
+        vector_push (instructions, &instruction);
+    }
+    vector_free (block->instructions);
+    block->instructions = instructions;
+}
+
+/* Drops the instructions turned into IR_OP_NOP.  */
+void
+ir_block_compact (struct ir_block* block)
+{
+    struct vector* kept = vector_create (sizeof (struct ir_instruction*));
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* instruction = \
+                        vector_peek_ptr_at (block->instructions, i);
+        if (instruction->op == IR_OP_NOP)
+        {
+            ir_instruction_free (instruction);
+            continue;
+        }
+        vector_push (kept, &instruction);
+    }
+
+    vector_free (block->instructions);
+    block->instructions = kept;
+}
+
+/* The condition holding when `condition` does not.  */
+int
+ir_condition_inverse (int condition)
+{
+    static const int inverses[] = {
+        [IR_CONDITION_EQ] = IR_CONDITION_NE,
+        [IR_CONDITION_NE] = IR_CONDITION_EQ,
+        [IR_CONDITION_LT] = IR_CONDITION_GE,
+        [IR_CONDITION_LE] = IR_CONDITION_GT,
+        [IR_CONDITION_GT] = IR_CONDITION_LE,
+        [IR_CONDITION_GE] = IR_CONDITION_LT,
+        [IR_CONDITION_ULT] = IR_CONDITION_UGE,
+        [IR_CONDITION_ULE] = IR_CONDITION_UGT,
+        [IR_CONDITION_UGT] = IR_CONDITION_ULE,
+        [IR_CONDITION_UGE] = IR_CONDITION_ULT
+    };
+    return inverses[condition];
+}
+
+bool
+ir_op_is_terminator (int op)
+{
+    return op == IR_OP_JUMP || op == IR_OP_BRANCH || op == IR_OP_RETURN || \
+           op == IR_OP_SWITCH;
+}
+
+struct ir_instruction*
+ir_block_terminator (struct ir_block* block)
+{
+    struct ir_instruction* last = vector_back_ptr_or_null (block->instructions);
+    return last && ir_op_is_terminator (last->op) ? last : NULL;
+}
+
+/* Instructions that must stay even when nothing reads their value.  */
+bool
+ir_instruction_has_side_effects (struct ir_instruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_OP_SLOT_STORE:
+        case IR_OP_STORE:
+        case IR_OP_CALL:
+        case IR_OP_JUMP:
+        case IR_OP_BRANCH:
+        case IR_OP_RETURN:
+        case IR_OP_SWITCH:
+            return true;
+
+        /* Division by zero traps.  */
+        case IR_OP_DIV:
+        case IR_OP_UDIV:
+        case IR_OP_MOD:
+        case IR_OP_UMOD:
+            return true;
+    }
+
+    return false;
+}
+
+/* Operands are the three arguments followed by the call arguments
+   or the phi values.  */
+int
+ir_instruction_total_uses (struct ir_instruction* instruction)
+{
+    int total = 3;
+    if (instruction->call_args)
+    {
+        total += vector_count (instruction->call_args);
+    }
+
+    if (instruction->phi_values)
+    {
+        total += vector_count (instruction->phi_values);
+    }
+    return total;
+}
+
+/* Pointer to operand `index`, which holds 0 when unused.  */
+int*
+ir_instruction_use_at (struct ir_instruction* instruction, int index)
+{
+    if (index < 3)
+    {
+        return &instruction->args[index];
+    }
+
+    index -= 3;
+    if (instruction->call_args)
+    {
+        return vector_at (instruction->call_args, index);
+    }
+
+    struct ir_phi_value* value = vector_at (instruction->phi_values, index);
+    return &value->vreg;
+}
+
+/* Blocks a terminator goes to, the two targets or the table of a
+   switch.  */
+int
+ir_instruction_total_targets (struct ir_instruction* instruction)
+{
+    if (instruction->switch_targets)
+    {
+        return vector_count (instruction->switch_targets);
+    }
+    return 2;
+}
+
+/* Pointer to target `index`, which holds NULL when unused.  */
+struct ir_block**
+ir_instruction_target_at (struct ir_instruction* instruction, int index)
+{
+    if (instruction->switch_targets)
+    {
+        return vector_at (instruction->switch_targets, index);
+    }
+    return &instruction->targets[index];
+}
+
+static void
+ir_block_add_edge (struct ir_block* from, struct ir_block* to)
+{
+    vector_push (from->successors, &to);
+    vector_push (to->predecessors, &from);
+}
+
+static bool
+ir_block_has_successor (struct ir_block* block, struct ir_block* successor)
+{
+    for (int i = 0; i < vector_count (block->successors); i++)
+    {
+        if (vector_peek_ptr_at (block->successors, i) == successor)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Successors are visited last first, so in reverse postorder the
+   first target of a branch, the body of a loop, follows the branch.  */
+static void
+ir_postorder (struct ir_block* block, bool* visited, struct vector* out)
+{
+    visited[block->id] = true;
+    for (int i = vector_count (block->successors) - 1; i >= 0; i--)
+    {
+        struct ir_block* successor = vector_peek_ptr_at (block->successors, i);
+        if (!visited[successor->id])
+        {
+            ir_postorder (successor, visited, out);
+        }
+    }
+    vector_push (out, &block);
+}
+
+static struct ir_block*
+ir_intersect (struct ir_block* a, struct ir_block* b)
+{
+    while (a != b)
+    {
+        while (a->order > b->order)
+        {
+            a = a->idom;
+        }
+
+        while (b->order > a->order)
+        {
+            b = b->idom;
+        }
+    }
+
+    return a;
+}
+
+/* Dominators by Cooper, Harvey and Kennedy, iterating over the
+   blocks in reverse postorder until nothing changes.  */
+static void
+ir_compute_dominators (struct ir_function* function)
+{
+    struct ir_block* entry = ir_entry_block (function);
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        block->idom = NULL;
+    }
+
+    entry->idom = entry;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < vector_count (function->blocks); i++)
+        {
+            struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+            struct ir_block* idom = NULL;
+            for (int j = 0; j < vector_count (block->predecessors); j++)
+            {
+                struct ir_block* predecessor = \
+                                vector_peek_ptr_at (block->predecessors, j);
+                if (!predecessor->idom)
+                {
+                    continue;
+                }
+                idom = idom ? ir_intersect (predecessor, idom) : predecessor;
+            }
+
+            if (idom != block->idom)
+            {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    entry->idom = NULL;
+}
+
+/* Rebuilds the edges from the terminators, drops the blocks that
+   cannot be reached, orders the rest in reverse postorder and finds
+   their dominators.  Phi values of dropped predecessors go too.  */
+void
+ir_compute_cfg (struct ir_function* function)
+{
+    int total = vector_count (function->blocks);
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        vector_clear (block->predecessors);
+        vector_clear (block->successors);
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        struct ir_instruction* terminator = ir_block_terminator (block);
+        assert (terminator);
+        for (int j = 0; j < ir_instruction_total_targets (terminator); j++)
+        {
+            /* A block is a successor once, however many entries of a
+               table go to it.  */
+            struct ir_block* target = *ir_instruction_target_at (terminator, j);
+            if (target && !ir_block_has_successor (block, target))
+            {
+                ir_block_add_edge (block, target);
+            }
+        }
+    }
+
+    bool* visited = calloc (function->next_block_id, sizeof (bool));
+    struct vector* postorder = vector_create (sizeof (struct ir_block*));
+    ir_postorder (ir_entry_block (function), visited, postorder);
+
+    /* Edges from dropped blocks.  */
+    for (int i = 0; i < vector_count (postorder); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (postorder, i);
+        struct vector* predecessors = vector_create (sizeof (struct ir_block*));
+        for (int j = 0; j < vector_count (block->predecessors); j++)
+        {
+            struct ir_block* predecessor = \
+                            vector_peek_ptr_at (block->predecessors, j);
+            if (visited[predecessor->id])
+            {
+                vector_push (predecessors, &predecessor);
+            }
+        }
+        vector_free (block->predecessors);
+        block->predecessors = predecessors;
+
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->op != IR_OP_PHI)
+            {
+                break;
+            }
+
+            struct vector* values = vector_create (sizeof (struct ir_phi_value));
+            for (int k = 0; k < vector_count (instruction->phi_values); k++)
+            {
+                struct ir_phi_value* value = \
+                                vector_at (instruction->phi_values, k);
+                if (visited[value->block->id])
+                {
+                    vector_push (values, value);
+                }
+            }
+            vector_free (instruction->phi_values);
+            instruction->phi_values = values;
+        }
+    }
+
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        if (!visited[block->id])
+        {
+            ir_block_free (block);
+        }
+    }
+
+    vector_clear (function->blocks);
+    for (int i = vector_count (postorder) - 1; i >= 0; i--)
+    {
+        struct ir_block* block = vector_peek_ptr_at (postorder, i);
+        block->order = vector_count (function->blocks);
+        vector_push (function->blocks, &block);
+    }
+    vector_free (postorder);
+
+    free (visited);
+    ir_compute_dominators (function);
+}
+
+bool
+ir_dominates (struct ir_block* a, struct ir_block* b)
+{
+    while (b && b != a)
+    {
+        b = b->idom;
+    }
+
+    return b == a;
+}
+
+static void
+ir_verify_error (struct ir_function* function, const char* message, int id)
+{
+    compiler_error (function->process, "Invalid IR in function `%s`, %s %i",
+                    function->node->func.name, message, id);
+}
+
+static bool
+ir_block_has_predecessor (struct ir_block* block, struct ir_block* predecessor)
+{
+    for (int i = 0; i < vector_count (block->predecessors); i++)
+    {
+        if (vector_peek_ptr_at (block->predecessors, i) == predecessor)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Checks the structure of the blocks and, if `in_ssa`, that every
+   virtual register has one definition which dominates its uses.  */
+static void
+ir_verify_blocks (struct ir_function* function, struct ir_instruction** definitions,
+                  struct ir_block** definition_blocks, int* definition_indexes)
+{
+    if (vector_count (ir_entry_block (function)->predecessors))
+    {
+        ir_verify_error (function, "the entry block has predecessors", 0);
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        int total = vector_count (block->instructions);
+        if (!ir_block_terminator (block))
+        {
+            ir_verify_error (function, "missing terminator in block", block->id);
+        }
+
+        bool phis_allowed = true;
+        for (int j = 0; j < total; j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (ir_op_is_terminator (instruction->op) && j != total - 1)
+            {
+                ir_verify_error (function, "terminator in the middle of block",
+                                 block->id);
+            }
+
+            if (instruction->op == IR_OP_PHI)
+            {
+                if (!phis_allowed)
+                {
+                    ir_verify_error (function, "phi after an instruction in block",
+                                     block->id);
+                }
+
+                if (vector_count (instruction->phi_values) != \
+                    vector_count (block->predecessors))
+                {
+                    ir_verify_error (function, "phi without a value for every "
+                                     "predecessor, defining", instruction->dst);
+                }
+
+                for (int k = 0; k < vector_count (instruction->phi_values); k++)
+                {
+                    struct ir_phi_value* value = \
+                                    vector_at (instruction->phi_values, k);
+                    if (!ir_block_has_predecessor (block, value->block))
+                    {
+                        ir_verify_error (function, "phi value from a block that "
+                                         "is not a predecessor, defining",
+                                         instruction->dst);
+                    }
+                }
+            }
+            else
+            {
+                phis_allowed = false;
+            }
+
+            bool uses_slot = instruction->op == IR_OP_SLOT_ADDRESS || \
+                             instruction->op == IR_OP_SLOT_LOAD || \
+                             instruction->op == IR_OP_SLOT_STORE || \
+                             instruction->op == IR_OP_ARGUMENT;
+            if (uses_slot && (!instruction->slot || \
+                              (instruction->op != IR_OP_ARGUMENT && \
+                               instruction->slot->promoted)))
+            {
+                ir_verify_error (function, "bad slot access in block", block->id);
+            }
+
+            int dst = instruction->dst;
+            if (!dst)
+            {
+                continue;
+            }
+
+            if (dst >= ir_total_vregs (function))
+            {
+                ir_verify_error (function, "unknown virtual register", dst);
+            }
+
+            if (definitions[dst])
+            {
+                ir_verify_error (function, "second definition of", dst);
+            }
+            definitions[dst] = instruction;
+            definition_blocks[dst] = block;
+            definition_indexes[dst] = j;
+        }
+    }
+}
+
+/* A definition in `block` before `index` must reach the use.  */
+static bool
+ir_definition_reaches (struct ir_block* definition_block, int definition_index,
+                       struct ir_block* block, int index)
+{
+    if (definition_block == block)
+    {
+        return definition_index < index;
+    }
+
+    return ir_dominates (definition_block, block);
+}
+
+void
+ir_verify (struct ir_function* function)
+{
+    int total_vregs = ir_total_vregs (function);
+    struct ir_instruction** definitions = \
+                    calloc (total_vregs, sizeof (struct ir_instruction*));
+    struct ir_block** definition_blocks = \
+                    calloc (total_vregs, sizeof (struct ir_block*));
+    int* definition_indexes = calloc (total_vregs, sizeof (int));
+    ir_verify_blocks (function, definitions, definition_blocks,
+                      definition_indexes);
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                int vreg = *ir_instruction_use_at (instruction, k);
+                if (!vreg)
+                {
+                    continue;
+                }
+
+                if (vreg >= total_vregs || !definitions[vreg])
+                {
+                    ir_verify_error (function, "use of undefined virtual register",
+                                     vreg);
+                }
+
+                /* A phi reads its value at the end of the predecessor.  */
+                bool reaches = false;
+                if (instruction->op == IR_OP_PHI)
+                {
+                    struct ir_phi_value* value = \
+                                    vector_at (instruction->phi_values, k - 3);
+                    reaches = ir_definition_reaches (
+                                definition_blocks[vreg], definition_indexes[vreg],
+                                value->block,
+                                vector_count (value->block->instructions));
+                }
+                else
+                {
+                    reaches = ir_definition_reaches (
+                                definition_blocks[vreg], definition_indexes[vreg],
+                                block, j);
+                }
+
+                if (!reaches)
+                {
+                    ir_verify_error (function, "definition does not dominate "
+                                     "the use of", vreg);
+                }
+            }
+        }
+    }
+
+    free (definitions);
+    free (definition_blocks);
+    free (definition_indexes);
+}
+
+static const char* ir_op_names[] = {
+    [IR_OP_NOP] = "nop",
+    [IR_OP_CONST] = "const",
+    [IR_OP_COPY] = "copy",
+    [IR_OP_ADD] = "add",
+    [IR_OP_SUB] = "sub",
+    [IR_OP_MUL] = "mul",
+    [IR_OP_DIV] = "div",
+    [IR_OP_UDIV] = "udiv",
+    [IR_OP_MOD] = "mod",
+    [IR_OP_UMOD] = "umod",
+    [IR_OP_AND] = "and",
+    [IR_OP_OR] = "or",
+    [IR_OP_XOR] = "xor",
+    [IR_OP_SHL] = "shl",
+    [IR_OP_SHR] = "shr",
+    [IR_OP_SAR] = "sar",
+    [IR_OP_NEG] = "neg",
+    [IR_OP_NOT] = "not",
+    [IR_OP_COMPARE] = "compare",
+    [IR_OP_SELECT] = "select",
+    [IR_OP_EXTEND] = "extend",
+    [IR_OP_ADDRESS] = "address",
+    [IR_OP_SLOT_ADDRESS] = "slot_address",
+    [IR_OP_SLOT_LOAD] = "slot_load",
+    [IR_OP_SLOT_STORE] = "slot_store",
+    [IR_OP_LOAD] = "load",
+    [IR_OP_STORE] = "store",
+    [IR_OP_ARGUMENT] = "argument",
+    [IR_OP_CALL] = "call",
+    [IR_OP_PHI] = "phi",
+    [IR_OP_JUMP] = "jump",
+    [IR_OP_BRANCH] = "branch",
+    [IR_OP_RETURN] = "return",
+    [IR_OP_SWITCH] = "switch"
+};
+
+static const char* ir_condition_names[] = {
+    [IR_CONDITION_EQ] = "eq",
+    [IR_CONDITION_NE] = "ne",
+    [IR_CONDITION_LT] = "lt",
+    [IR_CONDITION_LE] = "le",
+    [IR_CONDITION_GT] = "gt",
+    [IR_CONDITION_GE] = "ge",
+    [IR_CONDITION_ULT] = "ult",
+    [IR_CONDITION_ULE] = "ule",
+    [IR_CONDITION_UGT] = "ugt",
+    [IR_CONDITION_UGE] = "uge"
+};
+
+static const char* ir_type_names[] = {
+    [IR_TYPE_I32] = "i32",
+    [IR_TYPE_I64] = "i64",
+    [IR_TYPE_PTR] = "ptr"
+};
+
+static void
+ir_dump_instruction (struct ir_function* function,
+                     struct ir_instruction* instruction, FILE* out)
+{
+    fprintf (out, "    ");
+    if (instruction->dst)
+    {
+        fprintf (out, "%%%i:%s = ", instruction->dst,
+                 ir_type_names[ir_vreg_type (function, instruction->dst)]);
+    }
+
+    fprintf (out, "%s", ir_op_names[instruction->op]);
+    switch (instruction->op)
+    {
+        case IR_OP_CONST:
+            fprintf (out, " %lld", instruction->imm);
+            break;
+
+        case IR_OP_COMPARE:
+            fprintf (out, ".%s %%%i, %%%i",
+                     ir_condition_names[instruction->condition],
+                     instruction->args[0], instruction->args[1]);
+            break;
+
+        case IR_OP_SELECT:
+            fprintf (out, " %%%i, %%%i, %%%i", instruction->args[2],
+                     instruction->args[0], instruction->args[1]);
+            break;
+
+        case IR_OP_EXTEND:
+            fprintf (out, ".%c%lu %%%i", instruction->is_signed ? 's' : 'u',
+                     (unsigned long) instruction->size * 8, instruction->args[0]);
+            break;
+
+        case IR_OP_ADDRESS:
+            fprintf (out, " %s%+lld", instruction->label, instruction->imm);
+            break;
+
+        case IR_OP_SLOT_ADDRESS:
+        case IR_OP_SLOT_LOAD:
+        case IR_OP_ARGUMENT:
+            fprintf (out, " $%i", instruction->slot->id);
+            break;
+
+        case IR_OP_SLOT_STORE:
+            fprintf (out, " $%i, %%%i", instruction->slot->id,
+                     instruction->args[0]);
+            break;
+
+        case IR_OP_LOAD:
+            fprintf (out, ".%c%lu [%%%i%+lld]", instruction->is_signed ? 's' : 'u',
+                     (unsigned long) instruction->size * 8, instruction->args[0],
+                     instruction->imm);
+            break;
+
+        case IR_OP_STORE:
+            fprintf (out, ".%lu [%%%i%+lld], %%%i",
+                     (unsigned long) instruction->size * 8, instruction->args[0],
+                     instruction->imm, instruction->args[1]);
+            break;
+
+        case IR_OP_CALL:
+            if (instruction->label)
+            {
+                fprintf (out, " %s (", instruction->label);
+            }
+            else
+            {
+                fprintf (out, " %%%i (", instruction->args[0]);
+            }
+
+            for (int i = 0; i < vector_count (instruction->call_args); i++)
+            {
+                fprintf (out, "%s%%%i", i ? ", " : "",
+                         *(int*) vector_at (instruction->call_args, i));
+            }
+            fprintf (out, ")");
+            if (instruction->is_struct)
+            {
+                fprintf (out, " -> $%i", instruction->slot->id);
+            }
+            break;
+
+        case IR_OP_PHI:
+            for (int i = 0; i < vector_count (instruction->phi_values); i++)
+            {
+                struct ir_phi_value* value = vector_at (instruction->phi_values, i);
+                fprintf (out, "%s [block_%i: %%%i]", i ? "," : "",
+                         value->block->id, value->vreg);
+            }
+            break;
+
+        case IR_OP_JUMP:
+            fprintf (out, " block_%i", instruction->targets[0]->id);
+            break;
+
+        case IR_OP_BRANCH:
+            if (instruction->args[1])
+            {
+                fprintf (out, ".%s %%%i, %%%i,",
+                         ir_condition_names[instruction->condition],
+                         instruction->args[0], instruction->args[1]);
+            }
+            else
+            {
+                fprintf (out, " %%%i,", instruction->args[0]);
+            }
+            for (int i = 0; i < 2; i++)
+            {
+                fprintf (out, "%s block_%i%s", i ? "," : "", instruction->targets[i]->id,
+                         instruction->is_unlikely[i] ? " unlikely" : "");
+            }
+            break;
+
+        case IR_OP_SWITCH:
+            fprintf (out, " %%%i [", instruction->args[0]);
+            for (int i = 0; i < vector_count (instruction->switch_targets); i++)
+            {
+                struct ir_block* target = \
+                                vector_peek_ptr_at (instruction->switch_targets, i);
+                fprintf (out, "%sblock_%i", i ? ", " : "", target->id);
+            }
+            fprintf (out, "]");
+            break;
+
+        default:
+            for (int i = 0; i < 2 && instruction->args[i]; i++)
+            {
+                fprintf (out, "%s %%%i", i ? "," : "", instruction->args[i]);
+            }
+    }
+    fprintf (out, "\n");
+}
+
+void
+ir_dump (struct ir_function* function, FILE* out)
+{
+    fprintf (out, "function %s\n", function->node->func.name);
+    for (int i = 0; i < vector_count (function->slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        if (slot->promoted)
+        {
+            continue;
+        }
+
+        fprintf (out, "    slot $%i %s, %lu bytes\n", slot->id,
+                 slot->var_node ? slot->var_node->var.name : "<temporary>",
+                 (unsigned long) slot->size);
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        fprintf (out, "block_%i:", block->id);
+        if (vector_count (block->predecessors))
+        {
+            fprintf (out, "  ; from");
+            for (int j = 0; j < vector_count (block->predecessors); j++)
+            {
+                struct ir_block* predecessor = \
+                                vector_peek_ptr_at (block->predecessors, j);
+                fprintf (out, " block_%i", predecessor->id);
+            }
+        }
+        fprintf (out, "\n");
+
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            ir_dump_instruction (function,
+                                 vector_peek_ptr_at (block->instructions, j), out);
+        }
+    }
+    fprintf (out, "\n");
+}
@@ -0,0 +1,1922 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/* Builds the IR of a function from its tree.  Every variable is a
+   slot that is read and written in place, ir_mem2reg later turns the
+   scalars into virtual registers.  Expressions are typed the same way
+   the direct code generator types them.  */
+
+static struct compile_process* current_process = NULL;
+static struct ir_function* ir_current_function = NULL;
+/* Block instructions are added to, NULL after a jump until the
+   next block starts.  */
+static struct ir_block* ir_current_block = NULL;
+
+/* Vectors of struct ir_block*, where `break` and `continue` go.  */
+static struct vector* ir_break_targets = NULL;
+static struct vector* ir_continue_targets = NULL;
+/* Vector of struct ir_switch*, innermost last.  */
+static struct vector* ir_switches = NULL;
+/* Vector of struct ir_label.  */
+static struct vector* ir_labels = NULL;
+/* Block the condition being built rarely goes to, according to the
+   `__builtin_expect` around it.  */
+static struct ir_block* ir_unlikely_block = NULL;
+
+/* A jump table covers at least this many cases, and they are at
+   least this percentage of the values in its range.  */
+#define IR_BUILD_TABLE_MIN_CASES 4
+#define IR_BUILD_TABLE_MIN_DENSITY 40
+#define IR_BUILD_TABLE_MAX_ENTRIES 4096
+/* Up to this many clusters are tested one after the other, more are
+   searched by halves.  */
+#define IR_BUILD_SWITCH_LINEAR_CLUSTERS 3
+
+struct ir_switch_case
+{
+    long long value;
+    struct ir_block* block;
+    /* Orders the cases as unsigned, like the switch compares them.  */
+    unsigned long long key;
+};
+
+struct ir_switch
+{
+    /* Vector of struct ir_switch_case, in the order of their keys.  */
+    struct vector* cases;
+    struct ir_block* default_block;
+    /* Where values without a case go, the default or the exit.  */
+    struct ir_block* otherwise;
+    int value;
+    int type;
+    size_t width;
+    bool is_signed;
+};
+
+/* Cases next to each other in value order, tested with a compare or
+   looked up in one jump table.  */
+struct ir_switch_cluster
+{
+    int first;
+    int last;
+    bool is_table;
+};
+
+struct ir_label
+{
+    const char* name;
+    struct ir_block* block;
+};
+
+struct ir_value
+{
+    int vreg;
+    struct codegen_exp_type type;
+};
+
+/* Something that can be assigned, a slot or the memory at
+   `address` + `offset`.  */
+struct ir_lvalue
+{
+    struct ir_slot* slot;
+    int address;
+    long long offset;
+    struct codegen_exp_type type;
+};
+
+struct ir_value ir_build_expression (struct node* node);
+struct ir_lvalue ir_build_lvalue (struct node* node);
+void ir_build_statement (struct node* node);
+void ir_build_body (struct node* node);
+
+static void
+ir_build_emit (struct ir_instruction* instruction)
+{
+    if (!ir_current_block)
+    {
+        /* Code after a jump, nothing reaches it.  */
+        ir_current_block = ir_block_new (ir_current_function);
+    }
+
+    ir_block_append (ir_current_block, instruction);
+}
+
+static int
+ir_build_type_for (struct codegen_exp_type* type)
+{
+    if (codegen_type_is_pointer_like (type) || codegen_type_is_addressed (type))
+    {
+        return IR_TYPE_PTR;
+    }
+
+    return codegen_type_size (type) == DATA_SIZE_DDWORD ? IR_TYPE_I64 : IR_TYPE_I32;
+}
+
+/* Width of the register a value of `type` is held in.  */
+static size_t
+ir_build_width (struct codegen_exp_type* type)
+{
+    return ir_type_size (ir_build_type_for (type));
+}
+
+/* `long`, as wide as a pointer.  */
+static struct codegen_exp_type
+ir_build_long_type ()
+{
+    struct codegen_exp_type type = codegen_int_type ();
+    type.dtype.type = DATA_TYPE_LONG;
+    type.dtype.type_str = "long";
+    type.dtype.size = DATA_SIZE_POINTER;
+    return type;
+}
+
+static struct ir_instruction*
+ir_build_value (int op, int type)
+{
+    struct ir_instruction* instruction = ir_instruction_new (op);
+    instruction->dst = ir_vreg_new (ir_current_function, type);
+    ir_build_emit (instruction);
+    return instruction;
+}
+
+static int
+ir_build_const_of_type (long long value, int type)
+{
+    struct ir_instruction* instruction = ir_build_value (IR_OP_CONST, type);
+    instruction->imm = type == IR_TYPE_I32 ? (int) value : value;
+    return instruction->dst;
+}
+
+static int
+ir_build_const (long long value)
+{
+    return ir_build_const_of_type (value, IR_TYPE_I32);
+}
+
+/* The constant `vreg` was just set to, false if it is not one.  */
+static bool
+ir_build_const_value (int vreg, long long* value)
+{
+    if (!ir_current_block)
+    {
+        return false;
+    }
+
+    struct vector* instructions = ir_current_block->instructions;
+    for (int i = vector_count (instructions) - 1; i >= 0; i--)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (instructions, i);
+        if (instruction->dst == vreg)
+        {
+            *value = instruction->imm;
+            return instruction->op == IR_OP_CONST;
+        }
+    }
+
+    return false;
+}
+
+static int
+ir_build_binary (int op, int a, int b, int type)
+{
+    struct ir_instruction* instruction = ir_build_value (op, type);
+    instruction->args[0] = a;
+    instruction->args[1] = b;
+    return instruction->dst;
+}
+
+static int
+ir_build_unary (int op, int a, int type)
+{
+    struct ir_instruction* instruction = ir_build_value (op, type);
+    instruction->args[0] = a;
+    return instruction->dst;
+}
+
+/* Compares the low `size` bytes of `a` and `b`.  */
+static int
+ir_build_compare (int condition, int a, int b, size_t size)
+{
+    struct ir_instruction* instruction = ir_build_value (IR_OP_COMPARE, IR_TYPE_I32);
+    instruction->condition = condition;
+    instruction->args[0] = a;
+    instruction->args[1] = b;
+    instruction->size = size;
+    return instruction->dst;
+}
+
+static int
+ir_build_address (const char* label)
+{
+    struct ir_instruction* instruction = ir_build_value (IR_OP_ADDRESS, IR_TYPE_PTR);
+    instruction->label = label;
+    return instruction->dst;
+}
+
+/* Truncates or extends `vreg` to the width of `type`.  */
+static int
+ir_build_convert (int vreg, struct codegen_exp_type* type)
+{
+    if (codegen_type_is_pointer_like (type) || \
+        codegen_type_is_struct_or_union (type))
+    {
+        return vreg;
+    }
+
+    size_t size = codegen_type_size (type);
+    if (size != DATA_SIZE_BYTE && size != DATA_SIZE_WORD)
+    {
+        return vreg;
+    }
+
+    bool is_signed = codegen_type_is_signed (type);
+    long long constant = 0;
+    if (ir_build_const_value (vreg, &constant))
+    {
+        if (size == DATA_SIZE_BYTE)
+        {
+            constant = is_signed ? (signed char) constant : (unsigned char) constant;
+        }
+        else
+        {
+            constant = is_signed ? (short) constant : (unsigned short) constant;
+        }
+        return ir_build_const_of_type (constant, IR_TYPE_I32);
+    }
+
+    struct ir_instruction* instruction = ir_build_value (IR_OP_EXTEND, IR_TYPE_I32);
+    instruction->args[0] = vreg;
+    instruction->size = size;
+    instruction->is_signed = is_signed;
+    return instruction->dst;
+}
+
+/* Extends `value` to the width of `type` when it is narrower, the
+   sign comes from the type of `value`.  A narrower `type` only needs
+   the low bits, which are already there.  */
+static int
+ir_build_widen (struct ir_value* value, struct codegen_exp_type* type)
+{
+    int to = ir_build_type_for (type);
+    if (ir_type_size (to) <= ir_build_width (&value->type))
+    {
+        return value->vreg;
+    }
+
+    bool is_signed = codegen_type_is_signed (&value->type);
+    long long constant = 0;
+    if (ir_build_const_value (value->vreg, &constant))
+    {
+        return ir_build_const_of_type (is_signed ? (long long) (int) constant : \
+                                       (long long) (unsigned int) constant, to);
+    }
+
+    struct ir_instruction* instruction = ir_build_value (IR_OP_EXTEND, to);
+    instruction->args[0] = value->vreg;
+    instruction->size = DATA_SIZE_DWORD;
+    instruction->is_signed = is_signed;
+    return instruction->dst;
+}
+
+/* `value` converted to `type`, as a cast or an assignment does.  */
+static int
+ir_build_cast (struct ir_value* value, struct codegen_exp_type* type)
+{
+    return ir_build_convert (ir_build_widen (value, type), type);
+}
+
+/* Index `value` as wide as a pointer.  */
+static int
+ir_build_index (struct ir_value* value)
+{
+    struct codegen_exp_type type = ir_build_long_type ();
+    return ir_build_widen (value, &type);
+}
+
+/* Multiplies `vreg` by the constant `value`.  */
+static int
+ir_build_scale (int vreg, size_t value, int type)
+{
+    if (value == 1)
+    {
+        return vreg;
+    }
+
+    if ((value & (value - 1)) == 0)
+    {
+        int shift = 0;
+        while ((1u << shift) != value)
+        {
+            shift++;
+        }
+        return ir_build_binary (IR_OP_SHL, vreg, ir_build_const (shift), type);
+    }
+
+    return ir_build_binary (IR_OP_MUL, vreg, ir_build_const_of_type (value, type),
+                            type);
+}
+
+static void
+ir_build_terminate (struct ir_instruction* instruction)
+{
+    ir_build_emit (instruction);
+    ir_current_block = NULL;
+}
+
+static void
+ir_build_jump (struct ir_block* target)
+{
+    if (!ir_current_block)
+    {
+        return;
+    }
+
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_JUMP);
+    instruction->targets[0] = target;
+    ir_build_terminate (instruction);
+}
+
+/* Goes to `if_true` when `condition` is not zero.  */
+static void
+ir_build_branch (struct ir_value* condition, struct ir_block* if_true,
+                 struct ir_block* if_false)
+{
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_BRANCH);
+    instruction->args[0] = condition->vreg;
+    instruction->size = ir_build_width (&condition->type);
+    instruction->targets[0] = if_true;
+    instruction->targets[1] = if_false;
+    instruction->is_unlikely[0] = if_true == ir_unlikely_block;
+    instruction->is_unlikely[1] = if_false == ir_unlikely_block;
+    ir_build_terminate (instruction);
+}
+
+/* Continues in `block`, the current block falls through to it.  */
+static void
+ir_build_start_block (struct ir_block* block)
+{
+    ir_build_jump (block);
+    ir_current_block = block;
+}
+
+static struct ir_slot*
+ir_build_slot_new (struct node* var_node, struct codegen_exp_type* type)
+{
+    struct ir_slot* slot = calloc (1, sizeof (struct ir_slot));
+    slot->id = vector_count (ir_current_function->slots);
+    slot->var_node = var_node;
+    slot->size = codegen_type_size (type);
+    slot->is_signed = codegen_type_is_signed (type);
+    slot->is_scalar = !codegen_type_is_addressed (type);
+    slot->type = ir_build_type_for (type);
+    slot->argument = -1;
+    slot->offset = var_node ? var_node->var.aoffset : 0;
+    vector_push (ir_current_function->slots, &slot);
+    return slot;
+}
+
+/* A slot for a value of `type` the builder keeps, `a && b` or
+   `a ? b : c`.  */
+static struct ir_slot*
+ir_build_temporary_slot (struct codegen_exp_type* type)
+{
+    struct codegen_exp_type slot_type = codegen_int_type ();
+    if (ir_build_width (type) > DATA_SIZE_DWORD)
+    {
+        slot_type = ir_build_long_type ();
+    }
+    return ir_build_slot_new (NULL, &slot_type);
+}
+
+static struct ir_slot*
+ir_build_slot_for_variable (struct node* var_node)
+{
+    struct vector* slots = ir_current_function->slots;
+    for (int i = 0; i < vector_count (slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (slots, i);
+        if (slot->var_node == var_node)
+        {
+            return slot;
+        }
+    }
+
+    struct codegen_exp_type type = codegen_type_for_datatype (&var_node->var.type);
+    return ir_build_slot_new (var_node, &type);
+}
+
+static void
+ir_build_slot_store (struct ir_slot* slot, int vreg)
+{
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_SLOT_STORE);
+    instruction->slot = slot;
+    instruction->args[0] = vreg;
+    ir_build_emit (instruction);
+}
+
+static int
+ir_build_slot_load (struct ir_slot* slot, int type)
+{
+    struct ir_instruction* instruction = ir_build_value (IR_OP_SLOT_LOAD, type);
+    instruction->slot = slot;
+    return instruction->dst;
+}
+
+static struct ir_lvalue
+ir_build_variable_lvalue (struct node* var_node)
+{
+    struct ir_lvalue lvalue = {
+        .type=codegen_type_for_datatype (&var_node->var.type)
+    };
+
+    if (var_node->binded.function)
+    {
+        lvalue.slot = ir_build_slot_for_variable (var_node);
+        return lvalue;
+    }
+
+    lvalue.address = ir_build_address (var_node->var.name);
+    return lvalue;
+}
+
+/* Address of the object, a slot whose address is taken has to stay
+   in memory.  */
+static int
+ir_build_lvalue_address (struct ir_lvalue* lvalue)
+{
+    if (lvalue->slot)
+    {
+        struct ir_instruction* instruction = \
+                        ir_build_value (IR_OP_SLOT_ADDRESS, IR_TYPE_PTR);
+        instruction->slot = lvalue->slot;
+        lvalue->slot->address_taken = true;
+        lvalue->address = instruction->dst;
+        lvalue->slot = NULL;
+    }
+
+    if (lvalue->offset)
+    {
+        lvalue->address = ir_build_binary (IR_OP_ADD, lvalue->address,
+                                           ir_build_const_of_type (lvalue->offset,
+                                                                   IR_TYPE_PTR),
+                                           IR_TYPE_PTR);
+        lvalue->offset = 0;
+    }
+
+    return lvalue->address;
+}
+
+/* Arrays and structures yield their address.  */
+static struct ir_value
+ir_build_load (struct ir_lvalue* lvalue)
+{
+    struct ir_value value = {.type=lvalue->type};
+    if (codegen_type_is_addressed (&lvalue->type))
+    {
+        value.vreg = ir_build_lvalue_address (lvalue);
+        return value;
+    }
+
+    int type = ir_build_type_for (&lvalue->type);
+    if (lvalue->slot)
+    {
+        value.vreg = ir_build_slot_load (lvalue->slot, type);
+        return value;
+    }
+
+    struct ir_instruction* instruction = ir_build_value (IR_OP_LOAD, type);
+    instruction->args[0] = lvalue->address;
+    instruction->imm = lvalue->offset;
+    instruction->size = codegen_type_size (&lvalue->type);
+    instruction->is_signed = codegen_type_is_signed (&lvalue->type);
+    value.vreg = instruction->dst;
+    return value;
+}
+
+static void
+ir_build_store (struct ir_lvalue* lvalue, int vreg)
+{
+    if (codegen_type_is_addressed (&lvalue->type))
+    {
+        compiler_error (current_process,
+                        "Assigning arrays or structures is not supported");
+    }
+
+    if (lvalue->slot)
+    {
+        ir_build_slot_store (lvalue->slot, vreg);
+        return;
+    }
+
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_STORE);
+    instruction->args[0] = lvalue->address;
+    instruction->args[1] = vreg;
+    instruction->imm = lvalue->offset;
+    instruction->size = codegen_type_size (&lvalue->type);
+    ir_build_emit (instruction);
+}
+
+/* `left.right` or `left->right`.  */
+static struct ir_lvalue
+ir_build_member_lvalue (struct node* node)
+{
+    struct ir_lvalue lvalue = {0};
+    if (S_EQ (node->exp.op, "->"))
+    {
+        struct ir_value pointer = ir_build_expression (node->exp.left);
+        if (!codegen_type_is_pointer (&pointer.type))
+        {
+            compiler_error (current_process, "`->` used on a non pointer");
+        }
+        lvalue.address = pointer.vreg;
+        lvalue.type = codegen_type_dereference (&pointer.type);
+    }
+    else if (node->exp.left->type == NODE_TYPE_EXPRESSION && \
+             S_EQ (node->exp.left->exp.op, "()"))
+    {
+        /* `f ().x`, the structure f returned is in the caller.  */
+        struct ir_value value = ir_build_expression (node->exp.left);
+        lvalue.address = value.vreg;
+        lvalue.type = value.type;
+    }
+    else
+    {
+        lvalue = ir_build_lvalue (node->exp.left);
+    }
+
+    struct codegen_exp_type* type = &lvalue.type;
+    if (!codegen_type_is_struct_or_union (type) || !type->dtype.struct_node)
+    {
+        compiler_error (current_process,
+                        "Member access on something that is not a structure");
+    }
+
+    struct node* body_node = type->dtype.type == DATA_TYPE_STRUCT ? \
+                             type->dtype.struct_node->_struct.body_n : \
+                             type->dtype.union_node->_union.body_n;
+    if (node->exp.right->type != NODE_TYPE_IDENTIFIER || !body_node)
+    {
+        compiler_error (current_process, "Invalid member access");
+    }
+
+    struct node* member = codegen_struct_member (body_node,
+                                                 node->exp.right->sval);
+    if (!member)
+    {
+        compiler_error (current_process, "No member named `%s`",
+                        node->exp.right->sval);
+    }
+
+    if (lvalue.slot)
+    {
+        ir_build_lvalue_address (&lvalue);
+    }
+    lvalue.offset += member->var.aoffset;
+    lvalue.type = codegen_type_for_datatype (&member->var.type);
+    return lvalue;
+}
+
+/* `left[right]`, a constant index becomes the offset of the access.  */
+static struct ir_lvalue
+ir_build_array_lvalue (struct node* node)
+{
+    struct ir_value base = ir_build_expression (node->exp.left);
+    if (!codegen_type_is_pointer_like (&base.type))
+    {
+        compiler_error (current_process, "Indexing something that is not "
+                        "an array or a pointer");
+    }
+
+    struct node* index_node = node->exp.right;
+    if (index_node->type == NODE_TYPE_BRACKET)
+    {
+        index_node = index_node->bracket.inner;
+    }
+
+    size_t stride = codegen_type_stride (&base.type);
+    struct ir_lvalue lvalue = {
+        .address=base.vreg,
+        .type=codegen_type_dereference (&base.type)
+    };
+
+    if (index_node->type == NODE_TYPE_NUMBER)
+    {
+        lvalue.offset = (long long) (int) index_node->llnum * (long long) stride;
+        return lvalue;
+    }
+
+    struct ir_value index = ir_build_expression (index_node);
+    lvalue.address = ir_build_binary (IR_OP_ADD, base.vreg,
+                                      ir_build_scale (ir_build_index (&index),
+                                                      stride, IR_TYPE_PTR),
+                                      IR_TYPE_PTR);
+    return lvalue;
+}
+
+struct ir_lvalue
+ir_build_lvalue (struct node* node)
+{
+    switch (node->type)
+    {
+        case NODE_TYPE_IDENTIFIER:
+        {
+            struct node* var_node = codegen_variable_for_identifier (node);
+            if (var_node->type != NODE_TYPE_VARIABLE)
+            {
+                compiler_error (current_process,
+                                "`%s` is not a variable", node->sval);
+            }
+            return ir_build_variable_lvalue (var_node);
+        }
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return ir_build_lvalue (node->parenthesis.exp);
+
+        case NODE_TYPE_UNARY:
+            if (S_EQ (node->unary.op, "*"))
+            {
+                struct ir_value pointer = ir_build_expression (node->unary.operand);
+                return (struct ir_lvalue) {
+                    .address=pointer.vreg,
+                    .type=codegen_type_dereference (&pointer.type)
+                };
+            }
+            break;
+
+        case NODE_TYPE_EXPRESSION:
+            if (S_EQ (node->exp.op, "[]"))
+            {
+                return ir_build_array_lvalue (node);
+            }
+
+            if (S_EQ (node->exp.op, ".") || S_EQ (node->exp.op, "->"))
+            {
+                return ir_build_member_lvalue (node);
+            }
+            break;
+    }
+
+    compiler_error (current_process, "Expression is not assignable");
+    return (struct ir_lvalue) {0};
+}
+
+static int
+ir_build_condition_for_op (const char* op, bool is_signed)
+{
+    if (S_EQ (op, "=="))
+        return IR_CONDITION_EQ;
+    if (S_EQ (op, "!="))
+        return IR_CONDITION_NE;
+    if (S_EQ (op, "<"))
+        return is_signed ? IR_CONDITION_LT : IR_CONDITION_ULT;
+    if (S_EQ (op, "<="))
+        return is_signed ? IR_CONDITION_LE : IR_CONDITION_ULE;
+    if (S_EQ (op, ">"))
+        return is_signed ? IR_CONDITION_GT : IR_CONDITION_UGT;
+    if (S_EQ (op, ">="))
+        return is_signed ? IR_CONDITION_GE : IR_CONDITION_UGE;
+    return -1;
+}
+
+/* a `op` b for the arithmetic operators.  */
+static int
+ir_build_arithmetic (const char* op, int a, int b, bool is_signed, int type)
+{
+    int ir_op = -1;
+    if (S_EQ (op, "+"))
+        ir_op = IR_OP_ADD;
+    else if (S_EQ (op, "-"))
+        ir_op = IR_OP_SUB;
+    else if (S_EQ (op, "*"))
+        ir_op = IR_OP_MUL;
+    else if (S_EQ (op, "/"))
+        ir_op = is_signed ? IR_OP_DIV : IR_OP_UDIV;
+    else if (S_EQ (op, "%"))
+        ir_op = is_signed ? IR_OP_MOD : IR_OP_UMOD;
+    else if (S_EQ (op, "&"))
+        ir_op = IR_OP_AND;
+    else if (S_EQ (op, "|"))
+        ir_op = IR_OP_OR;
+    else if (S_EQ (op, "^"))
+        ir_op = IR_OP_XOR;
+    else if (S_EQ (op, "<<"))
+        ir_op = IR_OP_SHL;
+    else if (S_EQ (op, ">>"))
+        ir_op = is_signed ? IR_OP_SAR : IR_OP_SHR;
+    else
+        compiler_error (current_process, "Unsupported operator `%s`", op);
+
+    return ir_build_binary (ir_op, a, b, type);
+}
+
+/* Goes to `if_true` when `node` is not zero and to `if_false`
+   otherwise.  `&&`, `||` and `!` go straight to where their operands
+   lead, no 0 or 1 is made of them to be tested again, and each
+   compare ends up in the jump after it.  Within `__builtin_expect`
+   the branches say which way they rarely go.  */
+static void
+ir_build_condition (struct node* node, struct ir_block* if_true,
+                    struct ir_block* if_false)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESES)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    if (node->type == NODE_TYPE_UNARY && S_EQ (node->unary.op, "!"))
+    {
+        ir_build_condition (node->unary.operand, if_false, if_true);
+        return;
+    }
+
+    if (node->type == NODE_TYPE_EXPRESSION && \
+        (S_EQ (node->exp.op, "&&") || S_EQ (node->exp.op, "||")))
+    {
+        bool is_and = S_EQ (node->exp.op, "&&");
+        struct ir_block* right_block = ir_block_new (ir_current_function);
+        ir_build_condition (node->exp.left, is_and ? right_block : if_true,
+                            is_and ? if_false : right_block);
+        ir_current_block = right_block;
+        ir_build_condition (node->exp.right, if_true, if_false);
+        return;
+    }
+
+    long long expected = 0;
+    struct node* expected_node = codegen_expected_expression (node, &expected);
+    if (expected_node)
+    {
+        struct ir_block* unlikely = ir_unlikely_block;
+        ir_unlikely_block = expected ? if_false : if_true;
+        ir_build_condition (expected_node, if_true, if_false);
+        ir_unlikely_block = unlikely;
+        return;
+    }
+
+    struct ir_value condition = ir_build_expression (node);
+    ir_build_branch (&condition, if_true, if_false);
+}
+
+/* `a && b` and `a || b`, the right side only runs when needed.  */
+static struct ir_value
+ir_build_logical (struct node* node)
+{
+    struct codegen_exp_type type = codegen_int_type ();
+    struct ir_slot* result = ir_build_temporary_slot (&type);
+    struct ir_block* true_block = ir_block_new (ir_current_function);
+    struct ir_block* false_block = ir_block_new (ir_current_function);
+    struct ir_block* end_block = ir_block_new (ir_current_function);
+    ir_build_condition (node, true_block, false_block);
+
+    ir_current_block = true_block;
+    ir_build_slot_store (result, ir_build_const (1));
+    ir_build_jump (end_block);
+
+    ir_current_block = false_block;
+    ir_build_slot_store (result, ir_build_const (0));
+    ir_build_jump (end_block);
+
+    ir_current_block = end_block;
+    return (struct ir_value) {
+        .vreg=ir_build_slot_load (result, IR_TYPE_I32),
+        .type=type
+    };
+}
+
+/* `a ? b : c` is parsed as `?` with `a` on the left and
+   a tenary node holding `b` and `c` on the right.  */
+static struct ir_value
+ir_build_tenary (struct node* node)
+{
+    struct node* tenary_node = node->exp.right;
+    struct ir_block* true_block = ir_block_new (ir_current_function);
+    struct ir_block* false_block = ir_block_new (ir_current_function);
+    struct ir_block* end_block = ir_block_new (ir_current_function);
+
+    ir_build_condition (node->exp.left, true_block, false_block);
+
+    ir_current_block = true_block;
+    struct ir_value value = ir_build_expression (tenary_node->tenary.true_node);
+    struct ir_block* true_end = ir_current_block;
+
+    ir_current_block = false_block;
+    struct ir_value other = ir_build_expression (tenary_node->tenary.false_node);
+
+    /* The arms are stored once both types are known, the narrower
+       one is extended to the type of the result.  */
+    struct codegen_exp_type type = value.type;
+    if (ir_build_width (&other.type) > ir_build_width (&value.type))
+    {
+        type = other.type;
+    }
+
+    struct ir_slot* result = ir_build_temporary_slot (&type);
+    ir_build_slot_store (result, ir_build_widen (&other, &type));
+    ir_build_jump (end_block);
+
+    ir_current_block = true_end;
+    ir_build_slot_store (result, ir_build_widen (&value, &type));
+    ir_build_jump (end_block);
+
+    ir_current_block = end_block;
+    return (struct ir_value) {
+        .vreg=ir_build_slot_load (result, ir_build_type_for (&type)),
+        .type=type
+    };
+}
+
+/* `<<` or `>>`, whose type is the one of their left operand.  */
+static bool
+ir_build_is_shift (const char* op)
+{
+    return S_EQ (op, "<<") || S_EQ (op, ">>");
+}
+
+/* Extends the narrower of two integer operands, the usual arithmetic
+   conversions.  Returns the type both now have.  */
+static struct codegen_exp_type
+ir_build_balance (struct ir_value* left, struct ir_value* right)
+{
+    size_t left_width = ir_build_width (&left->type);
+    size_t right_width = ir_build_width (&right->type);
+    if (left_width > right_width)
+    {
+        right->vreg = ir_build_widen (right, &left->type);
+        return left->type;
+    }
+
+    if (right_width > left_width)
+    {
+        left->vreg = ir_build_widen (left, &right->type);
+        return right->type;
+    }
+
+    return left->type;
+}
+
+static struct ir_value
+ir_build_assignment (struct node* node)
+{
+    /* `+=` is `+`, `<<=` is `<<`.  */
+    char op[4] = {0};
+    strncpy (op, node->exp.op, strlen (node->exp.op) - 1);
+
+    struct ir_lvalue lvalue = ir_build_lvalue (node->exp.left);
+    struct codegen_exp_type type = lvalue.type;
+    struct ir_value right = ir_build_expression (node->exp.right);
+    int vreg = ir_build_widen (&right, &type);
+    if (op[0])
+    {
+        struct ir_value current = ir_build_load (&lvalue);
+        struct codegen_exp_type operation_type = type;
+        if (codegen_type_is_pointer (&type))
+        {
+            vreg = ir_build_scale (ir_build_index (&right),
+                                   codegen_type_stride (&type), IR_TYPE_PTR);
+        }
+        else
+        {
+            /* `int += long` is done as a long and then truncated.  */
+            operation_type = ir_build_balance (&current, &right);
+            vreg = right.vreg;
+        }
+        bool is_signed = codegen_type_is_signed (&type) && \
+                         codegen_type_is_signed (&right.type);
+        if (ir_build_is_shift (op))
+        {
+            is_signed = codegen_type_is_signed (&type);
+        }
+        vreg = ir_build_arithmetic (op, current.vreg, vreg, is_signed,
+                                    ir_build_type_for (&operation_type));
+    }
+
+    ir_build_store (&lvalue, vreg);
+    return (struct ir_value) {.vreg=ir_build_convert (vreg, &type), .type=type};
+}
+
+static struct ir_value
+ir_build_binary_expression (struct node* node)
+{
+    const char* op = node->exp.op;
+    struct ir_value left = ir_build_expression (node->exp.left);
+    struct ir_value right = ir_build_expression (node->exp.right);
+
+    bool left_is_pointer = codegen_type_is_pointer_like (&left.type);
+    bool right_is_pointer = codegen_type_is_pointer_like (&right.type);
+    bool is_shift = ir_build_is_shift (op);
+    if (is_shift && !left_is_pointer && !right_is_pointer && \
+        ir_build_width (&right.type) > ir_build_width (&left.type))
+    {
+        /* `int << long` is an int, the count only says how far.  */
+        right.vreg = ir_build_cast (&right, &left.type);
+        right.type = left.type;
+    }
+
+    struct codegen_exp_type common_type = left.type;
+    if (!left_is_pointer && !right_is_pointer)
+    {
+        common_type = ir_build_balance (&left, &right);
+    }
+
+    /* A wider type holds every value of the narrower one, so its sign
+       decides.  A shift takes the sign of its promoted left operand
+       alone.  */
+    bool is_signed = codegen_type_is_signed (&left.type) && \
+                     codegen_type_is_signed (&right.type);
+    if (ir_build_width (&left.type) != ir_build_width (&right.type) && \
+        !left_is_pointer && !right_is_pointer)
+    {
+        is_signed = codegen_type_is_signed (&common_type);
+    }
+    if (is_shift)
+    {
+        is_signed = codegen_type_is_signed (&left.type) || \
+                    codegen_type_size (&left.type) < DATA_SIZE_DWORD;
+    }
+
+    int condition = ir_build_condition_for_op (op, is_signed);
+    if (condition != -1)
+    {
+        size_t size = ir_build_width (&common_type);
+        if (left_is_pointer || right_is_pointer)
+        {
+            /* `p == 0` compares the whole pointer.  */
+            size = DATA_SIZE_POINTER;
+            left.vreg = left_is_pointer ? left.vreg : ir_build_index (&left);
+            right.vreg = right_is_pointer ? right.vreg : ir_build_index (&right);
+        }
+        return (struct ir_value) {
+            .vreg=ir_build_compare (condition, left.vreg, right.vreg, size),
+            .type=codegen_int_type ()
+        };
+    }
+
+    /* Pointer arithmetic, `p + 1` moves by the size of `*p`.  */
+    if (S_EQ (op, "-") && left_is_pointer && right_is_pointer)
+    {
+        struct codegen_exp_type type = ir_build_long_type ();
+        int ir_type = ir_build_type_for (&type);
+        int vreg = ir_build_binary (IR_OP_SUB, left.vreg, right.vreg, ir_type);
+        size_t stride = codegen_type_stride (&left.type);
+        if (stride > 1)
+        {
+            vreg = ir_build_binary (IR_OP_DIV, vreg,
+                                    ir_build_const_of_type (stride, ir_type), ir_type);
+        }
+        return (struct ir_value) {.vreg=vreg, .type=type};
+    }
+
+    struct codegen_exp_type result_type = left.type;
+    int a = left.vreg;
+    int b = right.vreg;
+    if ((S_EQ (op, "+") || S_EQ (op, "-")) && left_is_pointer)
+    {
+        b = ir_build_scale (ir_build_index (&right), codegen_type_stride (&left.type),
+                            IR_TYPE_PTR);
+    }
+    else if (S_EQ (op, "+") && right_is_pointer)
+    {
+        a = ir_build_scale (ir_build_index (&left), codegen_type_stride (&right.type),
+                            IR_TYPE_PTR);
+        result_type = right.type;
+    }
+    else if (!left_is_pointer)
+    {
+        /* Integer promotion, `char + char` is an int.  */
+        result_type = codegen_int_type ();
+        if (ir_build_width (&common_type) > DATA_SIZE_DWORD)
+        {
+            result_type = ir_build_long_type ();
+        }
+        if (!is_signed)
+        {
+            result_type.dtype.flags &= ~DATATYPE_FLAG_IS_SIGNED;
+        }
+    }
+
+    int vreg = ir_build_arithmetic (op, a, b, is_signed,
+                                    ir_build_type_for (&result_type));
+    if (codegen_type_is_array (&result_type))
+    {
+        /* `array + 1` is a pointer to the second element.  */
+        result_type = codegen_type_address_of (&result_type);
+    }
+    return (struct ir_value) {.vreg=vreg, .type=result_type};
+}
+
+/* `++x`, `x--`, ...  */
+static struct ir_value
+ir_build_increment (struct node* node)
+{
+    bool is_increment = S_EQ (node->unary.op, "++");
+    bool is_postfix = node->unary.flags & UNARY_FLAG_IS_POSTFIX;
+    struct ir_lvalue lvalue = ir_build_lvalue (node->unary.operand);
+    struct ir_value old = ir_build_load (&lvalue);
+    size_t step = codegen_type_is_pointer (&lvalue.type) ? \
+                  codegen_type_stride (&lvalue.type) : 1;
+    int vreg = ir_build_binary (is_increment ? IR_OP_ADD : IR_OP_SUB,
+                                old.vreg, ir_build_const (step),
+                                ir_build_type_for (&lvalue.type));
+    ir_build_store (&lvalue, vreg);
+    if (is_postfix)
+    {
+        return old;
+    }
+
+    return (struct ir_value) {
+        .vreg=ir_build_convert (vreg, &lvalue.type),
+        .type=lvalue.type
+    };
+}
+
+static struct ir_value
+ir_build_unary_expression (struct node* node)
+{
+    const char* op = node->unary.op;
+    if (S_EQ (op, "++") || S_EQ (op, "--"))
+    {
+        return ir_build_increment (node);
+    }
+
+    if (S_EQ (op, "&"))
+    {
+        struct ir_lvalue lvalue = ir_build_lvalue (node->unary.operand);
+        return (struct ir_value) {
+            .vreg=ir_build_lvalue_address (&lvalue),
+            .type=codegen_type_address_of (&lvalue.type)
+        };
+    }
+
+    if (S_EQ (op, "*"))
+    {
+        struct ir_lvalue lvalue = ir_build_lvalue (node);
+        return ir_build_load (&lvalue);
+    }
+
+    struct ir_value value = ir_build_expression (node->unary.operand);
+    if (S_EQ (op, "-"))
+    {
+        value.vreg = ir_build_unary (IR_OP_NEG, value.vreg,
+                                     ir_build_type_for (&value.type));
+    }
+    else if (S_EQ (op, "~"))
+    {
+        value.vreg = ir_build_unary (IR_OP_NOT, value.vreg,
+                                     ir_build_type_for (&value.type));
+    }
+    else if (S_EQ (op, "!"))
+    {
+        value.vreg = ir_build_compare (IR_CONDITION_EQ, value.vreg,
+                                       ir_build_const (0),
+                                       ir_build_width (&value.type));
+        value.type = codegen_int_type ();
+    }
+    else if (!S_EQ (op, "+"))
+    {
+        compiler_error (current_process, "Unsupported unary operator `%s`", op);
+    }
+
+    return value;
+}
+
+/* Arguments are evaluated from right to left, like the pushes of
+   the direct code generator.  */
+static struct ir_value
+ir_build_call (struct node* node)
+{
+    long long expected = 0;
+    struct node* expected_node = codegen_expected_expression (node, &expected);
+    if (expected_node)
+    {
+        return ir_build_expression (expected_node);
+    }
+
+    struct vector* arguments = vector_create (sizeof (struct node*));
+    codegen_call_arguments (node->exp.right->parenthesis.exp, arguments);
+
+    struct node* callee = node->exp.left;
+    struct node* function_node = NULL;
+    if (callee->type == NODE_TYPE_IDENTIFIER)
+    {
+        function_node = codegen_scope_find (callee->sval);
+        if (!function_node)
+        {
+            compiler_error (current_process, "Call to undeclared function `%s`",
+                            callee->sval);
+        }
+    }
+
+    /* Parameters of the prototype, arguments are converted to them.  */
+    struct vector* parameters = NULL;
+    if (function_node && function_node->type == NODE_TYPE_FUNCTION)
+    {
+        parameters = function_node->func.args.vector;
+    }
+
+    int total = vector_count (arguments);
+    int* values = calloc (total + 1, sizeof (int));
+    for (int i = total - 1; i >= 0; i--)
+    {
+        struct ir_value value = \
+                        ir_build_expression (vector_peek_ptr_at (arguments, i));
+        if (codegen_type_is_struct_or_union (&value.type))
+        {
+            compiler_error (current_process,
+                    "Passing structures by value is not supported");
+        }
+        values[i] = value.vreg;
+        if (parameters && i < vector_count (parameters))
+        {
+            struct node* parameter = vector_peek_ptr_at (parameters, i);
+            struct codegen_exp_type type = \
+                            codegen_type_for_datatype (&parameter->var.type);
+            values[i] = ir_build_cast (&value, &type);
+        }
+    }
+
+    struct codegen_exp_type type = codegen_int_type ();
+    int target = 0;
+    if (parameters)
+    {
+        type = codegen_type_for_datatype (&function_node->func.rtype);
+    }
+    else
+    {
+        /* Call through a function pointer.  */
+        target = ir_build_expression (callee).vreg;
+    }
+
+    /* A small structure comes back in registers, the call puts it in
+       a slot of the caller and the value is the address of that.  */
+    struct ir_slot* result = NULL;
+    struct ir_instruction* instruction = NULL;
+    struct datatype* rtype = NULL;
+    if (function_node && function_node->type == NODE_TYPE_FUNCTION)
+    {
+        rtype = &function_node->func.rtype;
+    }
+    if (rtype && datatype_is_struct_or_union (rtype) && \
+        !(rtype->flags & DATATYPE_FLAG_IS_POINTER) && \
+        !datatype_is_returned_in_registers (rtype))
+    {
+        compiler_error (current_process, "Calling `%s`, returning a structure "
+                        "too big for registers is not supported",
+                        function_node->func.name);
+    }
+
+    if (rtype && datatype_is_returned_in_registers (rtype))
+    {
+        result = ir_build_slot_new (NULL, &type);
+        instruction = ir_instruction_new (IR_OP_CALL);
+        instruction->slot = result;
+        instruction->size = result->size;
+        instruction->is_struct = true;
+        ir_build_emit (instruction);
+    }
+    else
+    {
+        instruction = ir_build_value (IR_OP_CALL, ir_build_type_for (&type));
+    }
+    instruction->args[0] = target;
+    instruction->label = target ? NULL : function_node->func.name;
+    instruction->is_variadic = target || \
+                               function_node->func.flags & FUNCTION_NODE_FLAG_IS_VARIADIC;
+    instruction->call_args = vector_create (sizeof (int));
+    for (int i = 0; i < total; i++)
+    {
+        vector_push (instruction->call_args, &values[i]);
+    }
+
+    free (values);
+    vector_free (arguments);
+    if (result)
+    {
+        struct ir_lvalue lvalue = {.slot=result, .type=type};
+        return (struct ir_value) {.vreg=ir_build_lvalue_address (&lvalue), .type=type};
+    }
+
+    /* Neither ABI has the callee extend a char or short result.  */
+    return (struct ir_value) {.vreg=ir_build_convert (instruction->dst, &type),
+                              .type=type};
+}
+
+static struct ir_value
+ir_build_identifier (struct node* node)
+{
+    struct node* found = codegen_variable_for_identifier (node);
+    if (found->type == NODE_TYPE_FUNCTION)
+    {
+        /* Name of a function is its address.  */
+        struct codegen_exp_type type = codegen_type_for_datatype (&found->func.rtype);
+        return (struct ir_value) {
+            .vreg=ir_build_address (found->func.name),
+            .type=codegen_type_address_of (&type)
+        };
+    }
+
+    struct ir_lvalue lvalue = ir_build_variable_lvalue (found);
+    return ir_build_load (&lvalue);
+}
+
+struct ir_value
+ir_build_expression (struct node* node)
+{
+    switch (node->type)
+    {
+        case NODE_TYPE_NUMBER:
+            if (number_node_is_long (node))
+            {
+                struct codegen_exp_type type = ir_build_long_type ();
+                return (struct ir_value) {
+                    .vreg=ir_build_const_of_type (node->llnum, IR_TYPE_I64),
+                    .type=type
+                };
+            }
+
+            return (struct ir_value) {
+                .vreg=ir_build_const (node->llnum),
+                .type=codegen_int_type ()
+            };
+
+        case NODE_TYPE_STRING:
+        {
+            struct codegen_exp_type type = codegen_int_type ();
+            type.dtype.type = DATA_TYPE_CHAR;
+            type.dtype.type_str = "char";
+            type.dtype.size = DATA_SIZE_BYTE;
+            return (struct ir_value) {
+                .vreg=ir_build_address (codegen_register_string (node->sval)),
+                .type=codegen_type_address_of (&type)
+            };
+        }
+
+        case NODE_TYPE_IDENTIFIER:
+            return ir_build_identifier (node);
+
+        case NODE_TYPE_EXPRESSION_PARENTHESES:
+            return ir_build_expression (node->parenthesis.exp);
+
+        case NODE_TYPE_UNARY:
+            return ir_build_unary_expression (node);
+
+        case NODE_TYPE_CAST:
+        {
+            struct ir_value value = ir_build_expression (node->cast.operand);
+            struct codegen_exp_type type = codegen_type_for_datatype (&node->cast.dtype);
+            value.vreg = ir_build_cast (&value, &type);
+            value.type = type;
+            return value;
+        }
+
+        case NODE_TYPE_EXPRESSION:
+            break;
+
+        default:
+            compiler_error (current_process, "Unexpected node in expression");
+    }
+
+    const char* op = node->exp.op;
+    if (S_EQ (op, "[]") || S_EQ (op, ".") || S_EQ (op, "->"))
+    {
+        struct ir_lvalue lvalue = ir_build_lvalue (node);
+        return ir_build_load (&lvalue);
+    }
+
+    if (S_EQ (op, "()"))
+    {
+        return ir_build_call (node);
+    }
+
+    if (S_EQ (op, ","))
+    {
+        ir_build_expression (node->exp.left);
+        return ir_build_expression (node->exp.right);
+    }
+
+    if (S_EQ (op, "&&") || S_EQ (op, "||"))
+    {
+        return ir_build_logical (node);
+    }
+
+    if (S_EQ (op, "?"))
+    {
+        return ir_build_tenary (node);
+    }
+
+    if (op[strlen (op) - 1] == '=' && ir_build_condition_for_op (op, true) == -1)
+    {
+        return ir_build_assignment (node);
+    }
+
+    return ir_build_binary_expression (node);
+}
+
+static void
+ir_build_local_variable (struct node* node)
+{
+    if (!node || !node->var.name)
+    {
+        return;
+    }
+
+    if (node->var.type.flags & (DATATYPE_FLAG_IS_STATIC | DATATYPE_FLAG_IS_EXTERN))
+    {
+        compiler_error (current_process,
+                "Static and extern local variables are not supported");
+    }
+
+    if (node->var.val && node->var.val->type == NODE_TYPE_INITIALIZER)
+    {
+        compiler_error (current_process,
+                "Initializer lists are only supported for global variables");
+    }
+
+    if (node->var.val)
+    {
+        struct ir_value value = ir_build_expression (node->var.val);
+        struct ir_lvalue lvalue = ir_build_variable_lvalue (node);
+        ir_build_store (&lvalue, ir_build_widen (&value, &lvalue.type));
+    }
+
+    codegen_scope_register (node);
+}
+
+static void
+ir_build_if (struct node* node)
+{
+    struct ir_block* true_block = ir_block_new (ir_current_function);
+    struct ir_block* false_block = ir_block_new (ir_current_function);
+    struct ir_block* end_block = ir_block_new (ir_current_function);
+    struct node* next = node->stmt.if_stmt.next;
+
+    ir_build_condition (node->stmt.if_stmt.cond_node, true_block,
+                        next ? false_block : end_block);
+
+    ir_current_block = true_block;
+    ir_build_body (node->stmt.if_stmt.body_node);
+    ir_build_jump (end_block);
+
+    if (next)
+    {
+        ir_current_block = false_block;
+        if (next->type == NODE_TYPE_STATEMENT_ELSE)
+        {
+            ir_build_body (next->stmt.else_stmt.body_node);
+        }
+        else
+        {
+            ir_build_if (next);
+        }
+        ir_build_jump (end_block);
+    }
+
+    ir_current_block = end_block;
+}
+
+static void
+ir_build_loop_body (struct node* body_node, struct ir_block* break_target,
+                    struct ir_block* continue_target)
+{
+    vector_push (ir_break_targets, &break_target);
+    vector_push (ir_continue_targets, &continue_target);
+    ir_build_body (body_node);
+    vector_pop (ir_break_targets);
+    vector_pop (ir_continue_targets);
+}
+
+static void
+ir_build_while (struct node* node)
+{
+    struct ir_block* condition_block = ir_block_new (ir_current_function);
+    struct ir_block* body_block = ir_block_new (ir_current_function);
+    struct ir_block* exit_block = ir_block_new (ir_current_function);
+
+    ir_build_start_block (condition_block);
+    ir_build_condition (node->stmt.while_stmt.exp_node, body_block, exit_block);
+
+    ir_current_block = body_block;
+    ir_build_loop_body (node->stmt.while_stmt.body_node, exit_block,
+                        condition_block);
+    ir_build_jump (condition_block);
+    ir_current_block = exit_block;
+}
+
+static void
+ir_build_do_while (struct node* node)
+{
+    struct ir_block* body_block = ir_block_new (ir_current_function);
+    struct ir_block* condition_block = ir_block_new (ir_current_function);
+    struct ir_block* exit_block = ir_block_new (ir_current_function);
+
+    ir_build_start_block (body_block);
+    ir_build_loop_body (node->stmt.do_while_node.body_node, exit_block,
+                        condition_block);
+    ir_build_start_block (condition_block);
+    ir_build_condition (node->stmt.do_while_node.exp_node, body_block, exit_block);
+    ir_current_block = exit_block;
+}
+
+static void
+ir_build_for (struct node* node)
+{
+    struct for_stmt* for_stmt = &node->stmt.for_stmt;
+    codegen_new_scope (0);
+    if (for_stmt->init_node)
+    {
+        ir_build_statement (for_stmt->init_node);
+    }
+
+    struct ir_block* condition_block = ir_block_new (ir_current_function);
+    struct ir_block* body_block = ir_block_new (ir_current_function);
+    struct ir_block* step_block = ir_block_new (ir_current_function);
+    struct ir_block* exit_block = ir_block_new (ir_current_function);
+
+    condition_block->unroll = for_stmt->unroll;
+    ir_build_start_block (condition_block);
+    if (for_stmt->cond_node)
+    {
+        ir_build_condition (for_stmt->cond_node, body_block, exit_block);
+    }
+    else
+    {
+        ir_build_jump (body_block);
+    }
+
+    ir_current_block = body_block;
+    ir_build_loop_body (for_stmt->body_node, exit_block, step_block);
+    ir_build_start_block (step_block);
+    if (for_stmt->loop_node)
+    {
+        ir_build_expression (for_stmt->loop_node);
+    }
+    ir_build_jump (condition_block);
+    ir_current_block = exit_block;
+    codegen_finish_scope ();
+}
+
+static unsigned long long
+ir_build_switch_key (struct ir_switch* ir_switch, long long value)
+{
+    if (ir_switch->width == DATA_SIZE_DWORD)
+    {
+        value = ir_switch->is_signed ? (long long) (int) value : \
+                                       (long long) (unsigned int) value;
+    }
+
+    /* Flipping the sign bit orders signed values as unsigned ones.  */
+    return ir_switch->is_signed ? (unsigned long long) value ^ (1ull << 63) : \
+                                  (unsigned long long) value;
+}
+
+static int
+ir_build_switch_case_compare (const void* a, const void* b)
+{
+    unsigned long long key_a = ((const struct ir_switch_case*) a)->key;
+    unsigned long long key_b = ((const struct ir_switch_case*) b)->key;
+    return key_a < key_b ? -1 : key_a > key_b;
+}
+
+/* Cases `first` to `last` fill enough of their range for a table.  */
+static bool
+ir_build_switch_is_dense (struct ir_switch_case* cases, int first, int last)
+{
+    unsigned long long span = cases[last].key - cases[first].key;
+    unsigned long long total = last - first + 1;
+    return total >= IR_BUILD_TABLE_MIN_CASES && \
+           total * 100 >= (span + 1) * IR_BUILD_TABLE_MIN_DENSITY;
+}
+
+/* Splits the sorted cases in as few clusters as possible, each a
+   single case or a dense run of them.  Returns a vector of struct
+   ir_switch_cluster.  */
+static struct vector*
+ir_build_switch_clusters (struct ir_switch* ir_switch)
+{
+    struct ir_switch_case* cases = vector_data_ptr (ir_switch->cases);
+    int total = vector_count (ir_switch->cases);
+    /* From case i on, `fewest[i]` clusters are needed and the first
+       one ends at `ends[i]`.  */
+    int* fewest = calloc (total + 1, sizeof (int));
+    int* ends = calloc (total + 1, sizeof (int));
+    for (int i = total - 1; i >= 0; i--)
+    {
+        fewest[i] = fewest[i + 1] + 1;
+        ends[i] = i;
+        for (int j = i + IR_BUILD_TABLE_MIN_CASES - 1; j < total; j++)
+        {
+            if (cases[j].key - cases[i].key >= IR_BUILD_TABLE_MAX_ENTRIES)
+            {
+                break;
+            }
+
+            /* On a tie the larger table wins.  */
+            if (fewest[j + 1] + 1 <= fewest[i] && \
+                ir_build_switch_is_dense (cases, i, j))
+            {
+                fewest[i] = fewest[j + 1] + 1;
+                ends[i] = j;
+            }
+        }
+    }
+
+    struct vector* clusters = vector_create (sizeof (struct ir_switch_cluster));
+    for (int i = 0; i < total; i = ends[i] + 1)
+    {
+        struct ir_switch_cluster cluster = {
+            .first=i,
+            .last=ends[i],
+            .is_table=ends[i] > i
+        };
+        vector_push (clusters, &cluster);
+    }
+
+    free (fewest);
+    free (ends);
+    return clusters;
+}
+
+/* Goes to `if_true` when `a condition constant`.  */
+static void
+ir_build_switch_branch (struct ir_switch* ir_switch, int condition, int a,
+                        long long constant, struct ir_block* if_true,
+                        struct ir_block* if_false)
+{
+    struct ir_value test = {
+        .vreg=ir_build_compare (condition, a,
+                                ir_build_const_of_type (constant, ir_switch->type),
+                                ir_switch->width),
+        .type=codegen_int_type ()
+    };
+    ir_build_branch (&test, if_true, if_false);
+}
+
+/* Goes to the case of `cluster` the value matches, or to
+   `otherwise`.  Below the lowest case of a table the subtraction
+   wraps, one unsigned compare checks both ends.  */
+static void
+ir_build_switch_cluster (struct ir_switch* ir_switch, struct ir_switch_cluster* cluster,
+                         struct ir_block* otherwise)
+{
+    struct ir_switch_case* cases = vector_data_ptr (ir_switch->cases);
+    struct ir_switch_case* low = &cases[cluster->first];
+    if (!cluster->is_table)
+    {
+        ir_build_switch_branch (ir_switch, IR_CONDITION_EQ, ir_switch->value,
+                                low->value, low->block, otherwise);
+        return;
+    }
+
+    unsigned long long span = cases[cluster->last].key - low->key;
+    int index = ir_build_binary (IR_OP_SUB, ir_switch->value,
+                                 ir_build_const_of_type (low->value, ir_switch->type),
+                                 ir_switch->type);
+    struct ir_block* table_block = ir_block_new (ir_current_function);
+    ir_build_switch_branch (ir_switch, IR_CONDITION_UGT, index, span,
+                            otherwise, table_block);
+    ir_current_block = table_block;
+
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_SWITCH);
+    instruction->args[0] = index;
+    instruction->switch_targets = vector_create (sizeof (struct ir_block*));
+    int next = cluster->first;
+    for (unsigned long long i = 0; i <= span; i++)
+    {
+        struct ir_block* target = otherwise;
+        if (next <= cluster->last && cases[next].key == low->key + i)
+        {
+            target = cases[next++].block;
+        }
+        vector_push (instruction->switch_targets, &target);
+    }
+    ir_build_terminate (instruction);
+}
+
+/* Halves the clusters on the lowest value of the middle one until
+   a few are left, those are tested in turn.  */
+static void
+ir_build_switch_tree (struct ir_switch* ir_switch, struct ir_switch_cluster* clusters,
+                      int first, int last)
+{
+    if (last - first < IR_BUILD_SWITCH_LINEAR_CLUSTERS)
+    {
+        for (int i = first; i <= last; i++)
+        {
+            struct ir_block* next_block = i < last ? \
+                            ir_block_new (ir_current_function) : ir_switch->otherwise;
+            ir_build_switch_cluster (ir_switch, &clusters[i], next_block);
+            ir_current_block = i < last ? next_block : NULL;
+        }
+        return;
+    }
+
+    struct ir_switch_case* cases = vector_data_ptr (ir_switch->cases);
+    int middle = (first + last + 1) / 2;
+    struct ir_block* low_block = ir_block_new (ir_current_function);
+    struct ir_block* high_block = ir_block_new (ir_current_function);
+    ir_build_switch_branch (ir_switch,
+                            ir_switch->is_signed ? IR_CONDITION_LT : IR_CONDITION_ULT,
+                            ir_switch->value, cases[clusters[middle].first].value,
+                            low_block, high_block);
+    ir_current_block = low_block;
+    ir_build_switch_tree (ir_switch, clusters, first, middle - 1);
+    ir_current_block = high_block;
+    ir_build_switch_tree (ir_switch, clusters, middle, last);
+}
+
+/* Dense runs of cases become jump tables, the rest single compares,
+   and a binary search over the value picks the right one.  The case
+   labels inside the body start the blocks the search goes to.  */
+static void
+ir_build_switch (struct node* node)
+{
+    struct switch_stmt* switch_stmt = &node->stmt.switch_stmt;
+    struct ir_switch* ir_switch = calloc (1, sizeof (struct ir_switch));
+    ir_switch->cases = vector_create (sizeof (struct ir_switch_case));
+    struct ir_block* exit_block = ir_block_new (ir_current_function);
+    if (switch_stmt->has_default_case)
+    {
+        ir_switch->default_block = ir_block_new (ir_current_function);
+    }
+    ir_switch->otherwise = ir_switch->default_block ? ir_switch->default_block : \
+                                                      exit_block;
+
+    /* Values narrower than int are promoted to it.  */
+    struct ir_value value = ir_build_expression (switch_stmt->exp_node);
+    ir_switch->value = value.vreg;
+    ir_switch->type = ir_build_type_for (&value.type);
+    ir_switch->width = ir_build_width (&value.type);
+    ir_switch->is_signed = codegen_type_is_signed (&value.type) || \
+                           codegen_type_size (&value.type) < DATA_SIZE_DWORD;
+    for (int i = 0; i < vector_count (switch_stmt->cases); i++)
+    {
+        struct parsed_switch_case* s_case = vector_at (switch_stmt->cases, i);
+        struct ir_switch_case ir_case = {
+            .value=s_case->value,
+            .block=ir_block_new (ir_current_function),
+            .key=ir_build_switch_key (ir_switch, s_case->value)
+        };
+        vector_push (ir_switch->cases, &ir_case);
+    }
+    qsort (vector_data_ptr (ir_switch->cases), vector_count (ir_switch->cases),
+           sizeof (struct ir_switch_case), ir_build_switch_case_compare);
+    struct ir_switch_case* cases = vector_data_ptr (ir_switch->cases);
+    for (int i = 1; i < vector_count (ir_switch->cases); i++)
+    {
+        if (cases[i].key == cases[i - 1].key)
+        {
+            compiler_error (current_process, "Duplicate case value %lld",
+                            cases[i].value);
+        }
+    }
+
+    struct vector* clusters = ir_build_switch_clusters (ir_switch);
+    ir_build_switch_tree (ir_switch, vector_data_ptr (clusters), 0,
+                          vector_count (clusters) - 1);
+    ir_build_jump (ir_switch->otherwise);
+    vector_free (clusters);
+
+    vector_push (ir_switches, &ir_switch);
+    vector_push (ir_break_targets, &exit_block);
+    ir_build_body (switch_stmt->body_node);
+    vector_pop (ir_break_targets);
+    vector_pop (ir_switches);
+
+    ir_build_start_block (exit_block);
+    vector_free (ir_switch->cases);
+    free (ir_switch);
+}
+
+static struct ir_switch*
+ir_build_current_switch ()
+{
+    if (vector_empty (ir_switches))
+    {
+        compiler_error (current_process, "`case` outside of a switch");
+    }
+    return vector_back_ptr (ir_switches);
+}
+
+static void
+ir_build_case (struct node* node)
+{
+    struct ir_switch* ir_switch = ir_build_current_switch ();
+    long long value = node->stmt._case.exp_node->llnum;
+    for (int i = 0; i < vector_count (ir_switch->cases); i++)
+    {
+        struct ir_switch_case* ir_case = vector_at (ir_switch->cases, i);
+        if (ir_case->value == value)
+        {
+            ir_build_start_block (ir_case->block);
+            return;
+        }
+    }
+
+    compiler_error (current_process, "`case` outside of a switch");
+}
+
+static struct ir_block*
+ir_build_label_block (const char* name)
+{
+    for (int i = 0; i < vector_count (ir_labels); i++)
+    {
+        struct ir_label* label = vector_at (ir_labels, i);
+        if (S_EQ (label->name, name))
+        {
+            return label->block;
+        }
+    }
+
+    struct ir_label label = {
+        .name=name,
+        .block=ir_block_new (ir_current_function)
+    };
+    vector_push (ir_labels, &label);
+    return label.block;
+}
+
+static void
+ir_build_return (struct node* node)
+{
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_RETURN);
+    struct node* exp = node->stmt.return_stmt.exp;
+    struct datatype* rtype = &ir_current_function->node->func.rtype;
+    if (exp && datatype_is_struct_or_union (rtype) && \
+        !(rtype->flags & DATATYPE_FLAG_IS_POINTER) && \
+        !datatype_is_returned_in_registers (rtype))
+    {
+        compiler_error (current_process, "Returning a structure too big for "
+                        "registers is not supported");
+    }
+
+    if (exp && datatype_is_returned_in_registers (rtype))
+    {
+        /* The value of a structure is its address.  */
+        instruction->args[0] = ir_build_expression (exp).vreg;
+        instruction->size = datatype_size (rtype);
+        instruction->is_struct = true;
+    }
+    else if (exp)
+    {
+        struct codegen_exp_type type = codegen_type_for_datatype (rtype);
+        struct ir_value value = ir_build_expression (exp);
+        instruction->args[0] = ir_build_cast (&value, &type);
+        instruction->size = ir_build_width (&type);
+    }
+    ir_build_terminate (instruction);
+}
+
+void
+ir_build_statement (struct node* node)
+{
+    switch (node->type)
+    {
+        case NODE_TYPE_VARIABLE:
+            ir_build_local_variable (node);
+            break;
+
+        case NODE_TYPE_VARIABLE_LIST:
+            for (int i = 0; i < vector_count (node->var_list.list); i++)
+            {
+                ir_build_local_variable (vector_peek_ptr_at (node->var_list.list, i));
+            }
+            break;
+
+        case NODE_TYPE_STRUCT:
+        case NODE_TYPE_UNION:
+            /* `struct abc { int x; } abc;`  */
+            ir_build_local_variable (variable_node (node));
+            break;
+
+        case NODE_TYPE_BODY:
+            ir_build_body (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_RETURN:
+            ir_build_return (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_IF:
+            ir_build_if (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_WHILE:
+            ir_build_while (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_DO_WHILE:
+            ir_build_do_while (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_FOR:
+            ir_build_for (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_SWITCH:
+            ir_build_switch (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_CASE:
+            ir_build_case (node);
+            break;
+
+        case NODE_TYPE_STATEMENT_DEFAULT:
+            ir_build_start_block (ir_build_current_switch ()->default_block);
+            break;
+
+        case NODE_TYPE_STATEMENT_BREAK:
+            if (vector_empty (ir_break_targets))
+            {
+                compiler_error (current_process, "`break` outside of a loop "
+                                "or switch");
+            }
+            ir_build_jump (vector_back_ptr (ir_break_targets));
+            break;
+
+        case NODE_TYPE_STATEMENT_CONTINUE:
+            if (vector_empty (ir_continue_targets))
+            {
+                compiler_error (current_process, "`continue` outside of a loop");
+            }
+            ir_build_jump (vector_back_ptr (ir_continue_targets));
+            break;
+
+        case NODE_TYPE_STATEMENT_GOTO:
+            ir_build_jump (ir_build_label_block (node->stmt._goto.label->sval));
+            break;
+
+        case NODE_TYPE_LABEL:
+            ir_build_start_block (ir_build_label_block (node->label.name->sval));
+            break;
+
+        case NODE_TYPE_BLANK:
+            break;
+
+        default:
+            /* Expression statement, the value is discarded.  */
+            ir_build_expression (node);
+    }
+}
+
+void
+ir_build_body (struct node* node)
+{
+    if (node->type != NODE_TYPE_BODY)
+    {
+        ir_build_statement (node);
+        return;
+    }
+
+    codegen_new_scope (0);
+    for (int i = 0; i < vector_count (node->body.statements); i++)
+    {
+        ir_build_statement (vector_peek_ptr_at (node->body.statements, i));
+    }
+    codegen_finish_scope ();
+}
+
+struct ir_function*
+ir_build (struct compile_process* process, struct node* function_node)
+{
+    current_process = process;
+    ir_current_function = ir_function_new (process, function_node);
+    ir_current_block = ir_block_new (ir_current_function);
+    ir_break_targets = vector_create (sizeof (struct ir_block*));
+    ir_continue_targets = vector_create (sizeof (struct ir_block*));
+    ir_switches = vector_create (sizeof (struct ir_switch*));
+    ir_labels = vector_create (sizeof (struct ir_label));
+
+    /* Arguments are registered first so the body can find them.  */
+    codegen_new_scope (0);
+    struct vector* arguments = function_node->func.args.vector;
+    for (int i = 0; arguments && i < vector_count (arguments); i++)
+    {
+        struct node* var_node = vector_peek_ptr_at (arguments, i);
+        if (datatype_is_struct_or_union (&var_node->var.type) && \
+            !(var_node->var.type.flags & DATATYPE_FLAG_IS_POINTER))
+        {
+            compiler_error (process,
+                    "Passing structures by value is not supported");
+        }
+        codegen_scope_register (var_node);
+        ir_build_slot_for_variable (var_node)->argument = i;
+    }
+    ir_build_body (function_node->func.body_n);
+    codegen_finish_scope ();
+
+    /* Falling off the end of a block returns.  */
+    for (int i = 0; i < vector_count (ir_current_function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (ir_current_function->blocks, i);
+        if (!ir_block_terminator (block))
+        {
+            ir_block_append (block, ir_instruction_new (IR_OP_RETURN));
+        }
+    }
+
+    vector_free (ir_break_targets);
+    vector_free (ir_continue_targets);
+    vector_free (ir_switches);
+    vector_free (ir_labels);
+    ir_compute_cfg (ir_current_function);
+    return ir_current_function;
+}
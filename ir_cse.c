@@ -0,0 +1,427 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Local value numbering on the SSA form.  Within a block, an
+   instruction computing what an earlier one already did, the same
+   operation on the same registers, goes and its register is replaced
+   by the earlier one.  `p->a->b + p->a->c` then loads `p->a` once and
+   `a[i][j]` read twice computes its address once.  A load is dropped
+   the same way until a call or a store that may write what it read,
+   and a load of what a store just wrote reads the stored register.
+   Two accesses may touch the same bytes unless they are at different
+   offsets from the same address, in different slots or globals, or
+   one is in a slot whose address is never taken.  */
+
+/* A load or a store, `base` and `imm` giving its address or `slot`
+   for the slot loads and stores.  The slot or global the address
+   points into, when known, is `object_slot` or `object_label`.  */
+struct ir_cse_access
+{
+    int base;
+    long long imm;
+    size_t size;
+    struct ir_slot* slot;
+    struct ir_slot* object_slot;
+    const char* object_label;
+    struct ir_instruction* instruction;
+    /* Register holding the bytes accessed.  */
+    int value;
+};
+
+struct ir_cse
+{
+    struct ir_function* function;
+    /* By virtual register, the instruction defining it.  */
+    struct ir_instruction** definitions;
+    /* By virtual register, the one it was replaced by, 0 if none.  */
+    int* replacements;
+    /* Open addressing table of the instructions numbered in the block,
+       `table_size` a power of two.  */
+    struct ir_instruction** table;
+    int table_size;
+    /* Vector of struct ir_cse_access, what the memory is known to hold
+       at this point of the block.  */
+    struct vector* accesses;
+    int expressions;
+    int loads;
+};
+
+static bool
+ir_cse_is_numbered (int op)
+{
+    switch (op)
+    {
+        case IR_OP_CONST:
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_DIV:
+        case IR_OP_UDIV:
+        case IR_OP_MOD:
+        case IR_OP_UMOD:
+        case IR_OP_AND:
+        case IR_OP_OR:
+        case IR_OP_XOR:
+        case IR_OP_SHL:
+        case IR_OP_SHR:
+        case IR_OP_SAR:
+        case IR_OP_NEG:
+        case IR_OP_NOT:
+        case IR_OP_COMPARE:
+        case IR_OP_SELECT:
+        case IR_OP_EXTEND:
+        case IR_OP_ADDRESS:
+        case IR_OP_SLOT_ADDRESS:
+            return true;
+    }
+
+    return false;
+}
+
+/* The first two operands of `instruction`, in a fixed order when
+   they commute.  */
+static void
+ir_cse_operands (struct ir_instruction* instruction, int* a, int* b)
+{
+    *a = instruction->args[0];
+    *b = instruction->args[1];
+    switch (instruction->op)
+    {
+        case IR_OP_ADD:
+        case IR_OP_MUL:
+        case IR_OP_AND:
+        case IR_OP_OR:
+        case IR_OP_XOR:
+            if (*a > *b)
+            {
+                *a = instruction->args[1];
+                *b = instruction->args[0];
+            }
+            break;
+    }
+}
+
+static unsigned int
+ir_cse_hash (struct ir_instruction* instruction)
+{
+    int a = 0, b = 0;
+    ir_cse_operands (instruction, &a, &b);
+    unsigned long long hash = (unsigned long long) instruction->op;
+    hash = hash * 31 + (unsigned int) a;
+    hash = hash * 31 + (unsigned int) b;
+    hash = hash * 31 + (unsigned int) instruction->args[2];
+    hash = hash * 31 + (unsigned long long) instruction->imm;
+    hash = hash * 31 + instruction->size;
+    hash = hash * 31 + (unsigned int) instruction->condition;
+    return (unsigned int) (hash ^ (hash >> 32));
+}
+
+static bool
+ir_cse_is_same_label (const char* a, const char* b)
+{
+    return a == b || (a && b && S_EQ (a, b));
+}
+
+/* Whether `a` and `b` compute the same value of the same type.  */
+static bool
+ir_cse_is_same (struct ir_cse* cse, struct ir_instruction* a, struct ir_instruction* b)
+{
+    int a0 = 0, a1 = 0, b0 = 0, b1 = 0;
+    ir_cse_operands (a, &a0, &a1);
+    ir_cse_operands (b, &b0, &b1);
+    return a->op == b->op && a0 == b0 && a1 == b1 && a->args[2] == b->args[2] && \
+           a->imm == b->imm && a->size == b->size && a->is_signed == b->is_signed && \
+           a->condition == b->condition && a->slot == b->slot && \
+           ir_cse_is_same_label (a->label, b->label) && \
+           ir_vreg_type (cse->function, a->dst) == ir_vreg_type (cse->function, b->dst);
+}
+
+/* The instruction of the table computing what `instruction` does,
+   added to the table when there is none.  */
+static struct ir_instruction*
+ir_cse_find (struct ir_cse* cse, struct ir_instruction* instruction)
+{
+    unsigned int mask = (unsigned int) cse->table_size - 1;
+    for (unsigned int i = ir_cse_hash (instruction) & mask;; i = (i + 1) & mask)
+    {
+        struct ir_instruction* entry = cse->table[i];
+        if (!entry)
+        {
+            cse->table[i] = instruction;
+            return NULL;
+        }
+
+        if (ir_cse_is_same (cse, entry, instruction))
+        {
+            return entry;
+        }
+    }
+}
+
+static void
+ir_cse_replace (struct ir_cse* cse, struct ir_instruction* instruction, int vreg)
+{
+    cse->replacements[instruction->dst] = vreg;
+    instruction->op = IR_OP_NOP;
+}
+
+static void
+ir_cse_rewrite (struct ir_cse* cse, struct ir_instruction* instruction)
+{
+    for (int i = 0; i < ir_instruction_total_uses (instruction); i++)
+    {
+        int* use = ir_instruction_use_at (instruction, i);
+        while (*use && cse->replacements[*use])
+        {
+            *use = cse->replacements[*use];
+        }
+    }
+}
+
+static struct ir_cse_access
+ir_cse_access_of (struct ir_cse* cse, struct ir_instruction* instruction)
+{
+    struct ir_cse_access access = {.instruction=instruction};
+    switch (instruction->op)
+    {
+        case IR_OP_SLOT_LOAD:
+        case IR_OP_SLOT_STORE:
+            access.slot = instruction->slot;
+            access.object_slot = instruction->slot;
+            access.size = instruction->slot->size;
+            access.value = instruction->op == IR_OP_SLOT_LOAD ? instruction->dst : \
+                                                                  instruction->args[0];
+            return access;
+
+        case IR_OP_LOAD:
+            access.value = instruction->dst;
+            break;
+
+        default:
+            access.value = instruction->args[1];
+    }
+
+    access.base = instruction->args[0];
+    access.imm = instruction->imm;
+    access.size = instruction->size;
+
+    /* An address computed from a slot or a global points into it.  */
+    int vreg = access.base;
+    for (int depth = 0; depth < 16 && cse->definitions[vreg]; depth++)
+    {
+        struct ir_instruction* definition = cse->definitions[vreg];
+        if (definition->op == IR_OP_SLOT_ADDRESS)
+        {
+            access.object_slot = definition->slot;
+            break;
+        }
+
+        if (definition->op == IR_OP_ADDRESS)
+        {
+            access.object_label = definition->label;
+            break;
+        }
+
+        if (definition->op != IR_OP_ADD && definition->op != IR_OP_SUB)
+        {
+            break;
+        }
+        vreg = definition->args[0];
+    }
+
+    return access;
+}
+
+static bool
+ir_cse_is_known (struct ir_cse_access* access)
+{
+    return access->object_slot || access->object_label;
+}
+
+static bool
+ir_cse_may_alias (struct ir_cse_access* a, struct ir_cse_access* b)
+{
+    if (a->slot || b->slot)
+    {
+        struct ir_cse_access* slot_access = a->slot ? a : b;
+        struct ir_cse_access* other = a->slot ? b : a;
+        if (other->slot)
+        {
+            return a->slot == b->slot;
+        }
+
+        return slot_access->slot->address_taken && \
+               (!ir_cse_is_known (other) || other->object_slot == slot_access->slot);
+    }
+
+    if (a->base == b->base)
+    {
+        return a->imm < b->imm + (long long) b->size && \
+               b->imm < a->imm + (long long) a->size;
+    }
+
+    if (ir_cse_is_known (a) && ir_cse_is_known (b))
+    {
+        return a->object_slot == b->object_slot && \
+               ir_cse_is_same_label (a->object_label, b->object_label);
+    }
+
+    return true;
+}
+
+/* Drops `load` when the memory is known to hold what it reads.  */
+static void
+ir_cse_load (struct ir_cse* cse, struct ir_instruction* load)
+{
+    struct ir_cse_access access = ir_cse_access_of (cse, load);
+    int type = ir_vreg_type (cse->function, load->dst);
+    for (int i = vector_count (cse->accesses) - 1; i >= 0; i--)
+    {
+        struct ir_cse_access* known = vector_at (cse->accesses, i);
+        if (known->base != access.base || known->imm != access.imm || \
+            known->size != access.size || known->slot != access.slot || \
+            ir_vreg_type (cse->function, known->value) != type)
+        {
+            continue;
+        }
+
+        /* A store narrower than the register leaves the load to
+           extend what it wrote.  */
+        struct ir_instruction* other = known->instruction;
+        bool is_loaded = other->op == load->op && other->is_signed == load->is_signed;
+        bool is_stored = (other->op == IR_OP_STORE || other->op == IR_OP_SLOT_STORE) && \
+                         access.size == ir_type_size (type);
+        if (is_loaded || is_stored)
+        {
+            ir_cse_replace (cse, load, known->value);
+            cse->loads++;
+            return;
+        }
+    }
+
+    vector_push (cse->accesses, &access);
+}
+
+/* Forgets what `store` may overwrite and remembers what it wrote.  */
+static void
+ir_cse_store (struct ir_cse* cse, struct ir_instruction* store)
+{
+    struct ir_cse_access access = ir_cse_access_of (cse, store);
+    for (int i = vector_count (cse->accesses) - 1; i >= 0; i--)
+    {
+        if (ir_cse_may_alias (vector_at (cse->accesses, i), &access))
+        {
+            vector_pop_at (cse->accesses, i);
+        }
+    }
+
+    vector_push (cse->accesses, &access);
+}
+
+static void
+ir_cse_block (struct ir_cse* cse, struct ir_block* block)
+{
+    memset (cse->table, 0, cse->table_size * sizeof (struct ir_instruction*));
+    vector_clear (cse->accesses);
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (block->instructions, i);
+        ir_cse_rewrite (cse, instruction);
+        switch (instruction->op)
+        {
+            case IR_OP_LOAD:
+            case IR_OP_SLOT_LOAD:
+                ir_cse_load (cse, instruction);
+                break;
+
+            case IR_OP_STORE:
+            case IR_OP_SLOT_STORE:
+                ir_cse_store (cse, instruction);
+                break;
+
+            case IR_OP_CALL:
+                vector_clear (cse->accesses);
+                break;
+
+            default:
+                if (ir_cse_is_numbered (instruction->op))
+                {
+                    struct ir_instruction* same = ir_cse_find (cse, instruction);
+                    if (same)
+                    {
+                        ir_cse_replace (cse, instruction, same->dst);
+                        cse->expressions++;
+                    }
+                }
+        }
+    }
+}
+
+void
+ir_cse (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_CSE)
+    {
+        return;
+    }
+
+    int total_vregs = ir_total_vregs (function);
+    struct ir_cse cse = {.function=function};
+    cse.definitions = calloc (total_vregs, sizeof (struct ir_instruction*));
+    cse.replacements = calloc (total_vregs, sizeof (int));
+    cse.accesses = vector_create (sizeof (struct ir_cse_access));
+    int largest = 0;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->dst)
+            {
+                cse.definitions[instruction->dst] = instruction;
+            }
+        }
+        largest = vector_count (block->instructions) > largest ? \
+                  vector_count (block->instructions) : largest;
+    }
+
+    cse.table_size = 1;
+    while (cse.table_size < largest * 2)
+    {
+        cse.table_size *= 2;
+    }
+    cse.table = calloc (cse.table_size, sizeof (struct ir_instruction*));
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        ir_cse_block (&cse, vector_peek_ptr_at (function->blocks, i));
+    }
+
+    /* Phis of loop headers read registers of blocks numbered after
+       them.  */
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            ir_cse_rewrite (&cse, vector_peek_ptr_at (block->instructions, j));
+        }
+        ir_block_compact (block);
+    }
+
+    if (cse.expressions || cse.loads)
+    {
+        compiler_report (function->process, "cse: %s: %i expressions, %i loads "
+                         "eliminated", function->node->func.name, cse.expressions,
+                         cse.loads);
+    }
+
+    free (cse.definitions);
+    free (cse.replacements);
+    free (cse.table);
+    vector_free (cse.accesses);
+}
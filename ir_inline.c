@@ -0,0 +1,399 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/* Replaces calls to small functions by a copy of their body.  The
+   callee is built again from its tree for every call it replaces,
+   its arguments become locals the call site stores to and its
+   returns jump back to the rest of the caller.  This runs before
+   ir_mem2reg, which then turns the copied locals into registers like
+   any other.  Only functions defined before the one being generated
+   are candidates, everything their body names is then in scope.  */
+
+/* Most instructions of a function inlined without being asked to,
+   and of one declared `inline`.  */
+#define IR_INLINE_MAX_INSTRUCTIONS 24
+#define IR_INLINE_MAX_INLINE_INSTRUCTIONS 96
+/* Calls inside inlined bodies are inlined this many levels deep.  */
+#define IR_INLINE_MAX_DEPTH 4
+/* Instructions a function may gain from inlining, past that only
+   `always_inline` functions still are.  */
+#define IR_INLINE_MAX_GROWTH 1024
+
+struct ir_inline
+{
+    struct compile_process* process;
+    /* The function being generated, then the functions whose body
+       is being copied into it, innermost last.  */
+    struct node* path[IR_INLINE_MAX_DEPTH + 1];
+    int depth;
+    int growth;
+};
+
+static void ir_inline_function (struct ir_inline* state, struct ir_function* function);
+
+/* Definition of `name`, NULL unless it is the function being
+   generated or comes before it.  */
+static struct node*
+ir_inline_definition (struct ir_inline* state, const char* name)
+{
+    struct vector* tree = state->process->node_tree_vec;
+    for (int i = 0; i < vector_count (tree); i++)
+    {
+        struct node* node = vector_peek_ptr_at (tree, i);
+        if (node->type == NODE_TYPE_FUNCTION && node->func.body_n && \
+            S_EQ (node->func.name, name))
+        {
+            return node;
+        }
+
+        if (node == state->path[0])
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/* The inlining attributes of `name`, those of its definition and of
+   its prototypes together.  */
+static int
+ir_inline_attributes (struct ir_inline* state, const char* name)
+{
+    int flags = 0;
+    struct vector* tree = state->process->node_tree_vec;
+    for (int i = 0; i < vector_count (tree); i++)
+    {
+        struct node* node = vector_peek_ptr_at (tree, i);
+        if (node->type == NODE_TYPE_FUNCTION && S_EQ (node->func.name, name))
+        {
+            flags |= node->func.rtype.flags & (DATATYPE_FLAG_IS_INLINE | \
+                                               DATATYPE_FLAG_ALWAYS_INLINE | \
+                                               DATATYPE_FLAG_NO_INLINE);
+        }
+    }
+
+    return flags;
+}
+
+static int
+ir_inline_size (struct ir_function* function)
+{
+    int total = 0;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        total += vector_count (block->instructions);
+    }
+
+    return total;
+}
+
+/* Why `call` keeps calling, NULL when its callee may be inlined.
+   `flags` are the attributes of the callee.  */
+static const char*
+ir_inline_refusal (struct ir_inline* state, struct ir_instruction* call,
+                   struct node* callee, int flags)
+{
+    if (!callee)
+    {
+        return "not defined before";
+    }
+
+    if (flags & DATATYPE_FLAG_NO_INLINE)
+    {
+        return "noinline";
+    }
+
+    for (int i = 0; i <= state->depth; i++)
+    {
+        if (state->path[i] == callee)
+        {
+            return "recursive";
+        }
+    }
+
+    if (state->depth == IR_INLINE_MAX_DEPTH)
+    {
+        return "too deep";
+    }
+
+    struct vector* arguments = callee->func.args.vector;
+    if (call->is_variadic || call->is_struct || \
+        vector_count (call->call_args) != (arguments ? vector_count (arguments) : 0))
+    {
+        return "unsupported call";
+    }
+
+    if (state->growth >= IR_INLINE_MAX_GROWTH && !(flags & DATATYPE_FLAG_ALWAYS_INLINE))
+    {
+        return "caller too big";
+    }
+
+    return NULL;
+}
+
+static struct ir_slot*
+ir_inline_slot_new (struct ir_function* function, int type)
+{
+    struct ir_slot* slot = calloc (1, sizeof (struct ir_slot));
+    slot->id = vector_count (function->slots);
+    slot->size = ir_type_size (type);
+    slot->is_scalar = true;
+    slot->type = type;
+    slot->argument = -1;
+    vector_push (function->slots, &slot);
+    return slot;
+}
+
+static void
+ir_inline_store (struct ir_block* block, struct ir_slot* slot, int vreg)
+{
+    struct ir_instruction* instruction = ir_instruction_new (IR_OP_SLOT_STORE);
+    instruction->slot = slot;
+    instruction->args[0] = vreg;
+    ir_block_append (block, instruction);
+}
+
+/* Moves the instructions of `block` past `index` to a new block. */
+static struct ir_block*
+ir_inline_split (struct ir_function* function, struct ir_block* block, int index)
+{
+    struct ir_block* rest = ir_block_new (function);
+    struct vector* kept = vector_create (sizeof (struct ir_instruction*));
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* instruction = \
+                        vector_peek_ptr_at (block->instructions, i);
+        if (i < index)
+        {
+            vector_push (kept, &instruction);
+        }
+        else if (i > index)
+        {
+            ir_block_append (rest, instruction);
+        }
+    }
+
+    vector_free (block->instructions);
+    block->instructions = kept;
+    return rest;
+}
+
+/* Whether `next`, the instruction after `call`, returns what the
+   call does.  */
+static bool
+ir_inline_is_tail (struct ir_function* function, struct ir_instruction* call,
+                   struct ir_instruction* next)
+{
+    if (next->op != IR_OP_RETURN || next->is_struct)
+    {
+        return false;
+    }
+
+    return !next->args[0] || \
+           (next->args[0] == call->dst && \
+            next->size == ir_type_size (ir_vreg_type (function, call->dst)));
+}
+
+/* Puts the body of `callee` in place of the call at `index` of
+   `block`, its virtual registers, slots and blocks now belong to
+   `function` and the rest of `block` goes on in the returned block.
+   A call in tail position leaves the returns of the body as they
+   are, the calls they return the result of stay sibling calls, and
+   nothing goes to the rest any more.  `callee` itself is freed.  */
+static struct ir_block*
+ir_inline_splice (struct ir_function* function, struct ir_block* block, int index,
+                  struct ir_function* callee)
+{
+    struct ir_instruction* call = vector_peek_ptr_at (block->instructions, index);
+    bool is_tail = ir_inline_is_tail (function, call,
+                                      vector_peek_ptr_at (block->instructions,
+                                                          index + 1));
+    struct ir_block* rest = ir_inline_split (function, block, index);
+
+    int base = ir_total_vregs (function) - 1;
+    for (int vreg = 1; vreg < ir_total_vregs (callee); vreg++)
+    {
+        ir_vreg_new (function, ir_vreg_type (callee, vreg));
+    }
+
+    /* Locals of the callee get a place in the caller's frame like
+       temporaries, the arguments are set by the call site.  */
+    for (int i = 0; i < vector_count (callee->slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (callee->slots, i);
+        slot->id = vector_count (function->slots);
+        vector_push (function->slots, &slot);
+        if (slot->argument >= 0)
+        {
+            ir_inline_store (block, slot, *(int*) vector_at (call->call_args,
+                                                             slot->argument));
+        }
+        slot->var_node = NULL;
+        slot->argument = -1;
+        slot->offset = 0;
+    }
+
+    struct ir_slot* result = NULL;
+    if (call->dst && !is_tail)
+    {
+        result = ir_inline_slot_new (function, ir_vreg_type (function, call->dst));
+        struct ir_instruction* load = ir_instruction_new (IR_OP_SLOT_LOAD);
+        load->dst = call->dst;
+        load->slot = result;
+        ir_block_insert (rest, 0, load);
+    }
+
+    struct ir_instruction* jump = ir_instruction_new (IR_OP_JUMP);
+    jump->targets[0] = ir_entry_block (callee);
+    ir_block_append (block, jump);
+
+    for (int i = 0; i < vector_count (callee->blocks); i++)
+    {
+        struct ir_block* callee_block = vector_peek_ptr_at (callee->blocks, i);
+        callee_block->id = function->next_block_id++;
+        vector_push (function->blocks, &callee_block);
+        for (int j = 0; j < vector_count (callee_block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (callee_block->instructions, j);
+            instruction->dst += instruction->dst ? base : 0;
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                int* use = ir_instruction_use_at (instruction, k);
+                *use += *use ? base : 0;
+            }
+        }
+
+        struct ir_instruction* terminator = ir_block_terminator (callee_block);
+        if (terminator->op != IR_OP_RETURN || is_tail)
+        {
+            continue;
+        }
+
+        if (result && terminator->args[0])
+        {
+            struct ir_instruction* store = ir_instruction_new (IR_OP_SLOT_STORE);
+            store->slot = result;
+            store->args[0] = terminator->args[0];
+            ir_block_insert (callee_block, vector_count (callee_block->instructions) - 1,
+                             store);
+        }
+        terminator->op = IR_OP_JUMP;
+        terminator->args[0] = 0;
+        terminator->size = 0;
+        terminator->targets[0] = rest;
+    }
+
+    ir_instruction_free (call);
+    vector_free (callee->blocks);
+    vector_free (callee->slots);
+    vector_free (callee->vreg_types);
+    free (callee);
+    return rest;
+}
+
+/* Inlines the call at `index` of `block` if it is worth it, returns
+   the block the instructions after the call are in then.  */
+static struct ir_block*
+ir_inline_call (struct ir_inline* state, struct ir_function* function,
+                struct ir_block* block, int index)
+{
+    struct ir_instruction* call = vector_peek_ptr_at (block->instructions, index);
+    struct node* callee_node = ir_inline_definition (state, call->label);
+    int flags = ir_inline_attributes (state, call->label);
+    const char* refusal = ir_inline_refusal (state, call, callee_node, flags);
+    if (refusal && !codegen_function_is_defined (call->label))
+    {
+        /* Functions of other objects are no candidates at all.  */
+        return NULL;
+    }
+
+    /* The calls of a callee being copied are not reported, only what
+       becomes of the calls of the function being generated.  */
+    bool reports = !state->depth;
+    if (refusal)
+    {
+        if (reports)
+        {
+            compiler_report (state->process, "inline: kept call to %s in %s, %s",
+                             call->label, function->node->func.name, refusal);
+        }
+        return NULL;
+    }
+
+    struct ir_function* callee = ir_build (state->process, callee_node);
+    state->path[++state->depth] = callee_node;
+    ir_inline_function (state, callee);
+    state->depth--;
+
+    int limit = flags & DATATYPE_FLAG_IS_INLINE ? IR_INLINE_MAX_INLINE_INSTRUCTIONS : \
+                                                  IR_INLINE_MAX_INSTRUCTIONS;
+    int size = ir_inline_size (callee);
+    if (size > limit && !(flags & DATATYPE_FLAG_ALWAYS_INLINE))
+    {
+        if (reports)
+        {
+            compiler_report (state->process, "inline: kept call to %s in %s, "
+                             "%i instructions", call->label,
+                             function->node->func.name, size);
+        }
+        ir_function_free (callee);
+        return NULL;
+    }
+
+    if (reports)
+    {
+        compiler_report (state->process, "inline: %s into %s, %i instructions",
+                         call->label, function->node->func.name, size);
+    }
+    state->growth += size;
+    return ir_inline_splice (function, block, index, callee);
+}
+
+/* Walks the blocks `function` had to begin with, following each one
+   into the block its rest moves to when a call is inlined.  */
+static void
+ir_inline_function (struct ir_inline* state, struct ir_function* function)
+{
+    int total = vector_count (function->blocks);
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->op != IR_OP_CALL || !instruction->label)
+            {
+                continue;
+            }
+
+            struct ir_block* rest = ir_inline_call (state, function, block, j);
+            if (rest)
+            {
+                block = rest;
+                j = -1;
+            }
+        }
+    }
+}
+
+void
+ir_inline (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_INLINE)
+    {
+        return;
+    }
+
+    struct ir_inline state = {.process=function->process};
+    state.path[0] = function->node;
+    ir_inline_function (&state, function);
+    if (state.growth)
+    {
+        ir_compute_cfg (function);
+    }
+}
@@ -0,0 +1,279 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/* Order of the blocks in the code, once out of SSA.  A loop testing
+   its condition at the top, a `while` or a `for`, is rotated: the
+   test is copied into the block going back to it, which then goes
+   back to the body when the condition holds and falls out of the
+   loop when it does not.  An iteration takes one branch instead of a
+   branch and a jump, the test at the top only guards the first one.
+   The blocks only reached through branches `__builtin_expect` says
+   are rarely taken then go after all the others, the likely side of
+   those branches coming right after them, and loops are aligned.  */
+
+/* Instructions a header copied into its latch may have besides its
+   branch.  */
+#define IR_LAYOUT_MAX_HEADER_INSTRUCTIONS 8
+
+/* Marks in `body` the blocks of the loop of `header` the edge from
+   `latch` closes, those reaching `latch` without passing `header`.  */
+static void
+ir_layout_loop_body (struct ir_block* header, struct ir_block* latch, bool* body)
+{
+    body[header->id] = true;
+    struct vector* work = vector_create (sizeof (struct ir_block*));
+    vector_push (work, &latch);
+    while (!vector_empty (work))
+    {
+        struct ir_block* block = vector_back_ptr (work);
+        vector_pop (work);
+        if (body[block->id])
+        {
+            continue;
+        }
+
+        body[block->id] = true;
+        for (int i = 0; i < vector_count (block->predecessors); i++)
+        {
+            vector_push (work, vector_at (block->predecessors, i));
+        }
+    }
+    vector_free (work);
+}
+
+/* The one block going back to `header` from the loop it starts, with
+   a jump, or NULL.  */
+static struct ir_block*
+ir_layout_latch (struct ir_block* header)
+{
+    struct ir_block* latch = NULL;
+    for (int i = 0; i < vector_count (header->predecessors); i++)
+    {
+        struct ir_block* predecessor = vector_peek_ptr_at (header->predecessors, i);
+        if (!ir_dominates (header, predecessor))
+        {
+            continue;
+        }
+
+        if (latch)
+        {
+            return NULL;
+        }
+        latch = predecessor;
+    }
+
+    if (!latch || latch == header || ir_block_terminator (latch)->op != IR_OP_JUMP)
+    {
+        return NULL;
+    }
+
+    return latch;
+}
+
+/* Whether `vreg`, written by instruction `index` of `header`, is only
+   read by the instructions after it there.  */
+static bool
+ir_layout_is_local (struct ir_function* function, struct ir_block* header, int index,
+                    int vreg)
+{
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                if (*ir_instruction_use_at (instruction, k) == vreg && \
+                    (block != header || j <= index))
+                {
+                    return false;
+                }
+            }
+
+            if (block == header && j != index && instruction->dst == vreg)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Rotates the loop `header` starts when it is small and branches in
+   or out of the loop.  The latch gets a copy of it in place of its
+   jump.  What the copy computes only for its branch goes to new
+   registers, so a compare stays fused with the branch reading it,
+   the rest is written again in the same registers.  */
+static bool
+ir_layout_rotate (struct ir_function* function, struct ir_block* header)
+{
+    struct ir_instruction* branch = ir_block_terminator (header);
+    int total = vector_count (header->instructions);
+    struct ir_block* latch = ir_layout_latch (header);
+    if (branch->op != IR_OP_BRANCH || !latch || \
+        total - 1 > IR_LAYOUT_MAX_HEADER_INSTRUCTIONS)
+    {
+        return false;
+    }
+
+    bool* body = calloc (function->next_block_id, sizeof (bool));
+    ir_layout_loop_body (header, latch, body);
+    bool leaves = body[branch->targets[0]->id] != body[branch->targets[1]->id];
+    free (body);
+    if (!leaves)
+    {
+        return false;
+    }
+
+    int* renamed = calloc (ir_total_vregs (function), sizeof (int));
+    struct ir_instruction* jump = ir_block_terminator (latch);
+    vector_pop (latch->instructions);
+    ir_instruction_free (jump);
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (header->instructions, i);
+        struct ir_instruction* copy = ir_instruction_copy (instruction);
+        for (int j = 0; j < ir_instruction_total_uses (copy); j++)
+        {
+            int* use = ir_instruction_use_at (copy, j);
+            if (*use && renamed[*use])
+            {
+                *use = renamed[*use];
+            }
+        }
+
+        if (copy->dst && ir_layout_is_local (function, header, i, copy->dst))
+        {
+            renamed[copy->dst] = ir_vreg_new (function, ir_vreg_type (function, copy->dst));
+            copy->dst = renamed[copy->dst];
+        }
+        ir_block_append (latch, copy);
+    }
+    free (renamed);
+    return true;
+}
+
+/* Whether `block` goes to `successor` with a branch rarely taken.  */
+static bool
+ir_layout_is_unlikely (struct ir_block* block, struct ir_block* successor)
+{
+    struct ir_instruction* branch = ir_block_terminator (block);
+    if (branch->op != IR_OP_BRANCH)
+    {
+        return false;
+    }
+
+    return (branch->targets[0] == successor && branch->is_unlikely[0]) || \
+           (branch->targets[1] == successor && branch->is_unlikely[1]);
+}
+
+/* Moves the blocks only entered through unlikely edges or from other
+   such blocks after the others, keeping the order within each part.
+   Returns how many moved.  */
+static int
+ir_layout_place (struct ir_function* function)
+{
+    int total = vector_count (function->blocks);
+    bool* is_cold = calloc (function->next_block_id, sizeof (bool));
+    int total_cold = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < total; i++)
+        {
+            struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+            if (is_cold[block->id])
+            {
+                continue;
+            }
+
+            bool cold = true;
+            for (int j = 0; j < vector_count (block->predecessors) && cold; j++)
+            {
+                struct ir_block* predecessor = vector_peek_ptr_at (block->predecessors, j);
+                cold = is_cold[predecessor->id] || \
+                       ir_layout_is_unlikely (predecessor, block);
+            }
+
+            if (cold)
+            {
+                is_cold[block->id] = true;
+                total_cold++;
+                changed = true;
+            }
+        }
+    }
+
+    if (total_cold)
+    {
+        struct vector* blocks = vector_create (sizeof (struct ir_block*));
+        for (int part = 0; part < 2; part++)
+        {
+            for (int i = 0; i < total; i++)
+            {
+                struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+                if (is_cold[block->id] == part)
+                {
+                    vector_push (blocks, &block);
+                }
+            }
+        }
+
+        vector_free (function->blocks);
+        function->blocks = blocks;
+        for (int i = 0; i < total; i++)
+        {
+            ((struct ir_block*) vector_peek_ptr_at (function->blocks, i))->order = i;
+        }
+    }
+
+    free (is_cold);
+    return total_cold;
+}
+
+void
+ir_layout (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_REORDER_BLOCKS)
+    {
+        return;
+    }
+
+    /* The loops change with every rotation, the walk starts over once
+       they are known again.  */
+    int rotated = 0;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        if (ir_layout_rotate (function, vector_peek_ptr_at (function->blocks, i)))
+        {
+            rotated++;
+            ir_compute_cfg (function);
+            i = -1;
+        }
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->predecessors); j++)
+        {
+            if (ir_dominates (block, vector_peek_ptr_at (block->predecessors, j)))
+            {
+                block->is_aligned = true;
+            }
+        }
+    }
+
+    int moved = ir_layout_place (function);
+    if (rotated || moved)
+    {
+        compiler_report (function->process, "layout: %s: %i loops rotated, "
+                         "%i unlikely blocks moved", function->node->func.name,
+                         rotated, moved);
+    }
+}
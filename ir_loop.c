@@ -0,0 +1,1531 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <limits.h>
+#include <stdlib.h>
+
+/* Loop optimisations on the SSA form.  Every natural loop gets a
+   preheader, a block entering it from outside, where the values the
+   loop computes the same way on every iteration are then computed
+   once.  Multiplications of an induction variable, the `i * stride`
+   of an array index, become induction variables of their own that
+   the loop adds the stride to, the address of `a[i]` a pointer
+   walking the array.  Inner loops go first, what leaves them may
+   then leave the loop around them too.  Innermost loops running a
+   number of times known here are then unrolled, the small ones
+   replaced by a copy of their body per iteration, the others running
+   several copies per test ahead of the loop left for the rest.  */
+
+/* Instructions the body of a loop may have once unrolled, unless a
+   `#pragma unroll` asks for more.  */
+#define IR_LOOP_UNROLL_MAX_INSTRUCTIONS 96
+/* Copies of a body partial unrolling makes, the most first.  */
+static const int ir_loop_unroll_factors[] = {8, 4, 2};
+/* Most copies of a body whatever the pragma asks.  */
+#define IR_LOOP_UNROLL_MAX_COPIES 1024
+
+struct ir_loop
+{
+    struct ir_block* header;
+    /* The only block outside the loop going to the header, NULL
+       until there is one.  */
+    struct ir_block* preheader;
+    /* The block the back edge comes from, NULL when there are
+       several.  */
+    struct ir_block* latch;
+    /* By block id, whether the block is in the loop.  */
+    bool* body;
+    int size;
+};
+
+/* A phi of the header going up or down by the same value on every
+   iteration, `next` computing its value for the next one with `op`.
+   Derived ones replaced an expression of another.  */
+struct ir_loop_iv
+{
+    int vreg;
+    int init;
+    int step;
+    int op;
+    struct ir_instruction* next;
+    bool is_derived;
+};
+
+struct ir_loops
+{
+    struct ir_function* function;
+    /* By virtual register, the instruction defining it and its block.  */
+    struct ir_instruction** definitions;
+    struct ir_block** blocks;
+    int total_vregs;
+    int hoisted;
+    int reduced;
+    int unrolled;
+};
+
+/* Registers and blocks of an iteration copied by ir_loops_copy.  */
+struct ir_loop_copy
+{
+    /* By block id, the copy of the blocks of the loop.  */
+    struct ir_block** blocks;
+    /* By virtual register, its copy or the register itself when it is
+       not defined in the loop.  */
+    int* vregs;
+};
+
+static void
+ir_loops_define (struct ir_loops* state, struct ir_instruction* instruction,
+                 struct ir_block* block)
+{
+    int vreg = instruction->dst;
+    if (vreg >= state->total_vregs)
+    {
+        int total = ir_total_vregs (state->function) * 2;
+        state->definitions = realloc (state->definitions,
+                                      total * sizeof (struct ir_instruction*));
+        state->blocks = realloc (state->blocks, total * sizeof (struct ir_block*));
+        for (int i = state->total_vregs; i < total; i++)
+        {
+            state->definitions[i] = NULL;
+            state->blocks[i] = NULL;
+        }
+        state->total_vregs = total;
+    }
+
+    state->definitions[vreg] = instruction;
+    state->blocks[vreg] = block;
+}
+
+static void
+ir_loops_define_all (struct ir_loops* state)
+{
+    struct ir_function* function = state->function;
+    for (int i = 0; i < state->total_vregs; i++)
+    {
+        state->definitions[i] = NULL;
+        state->blocks[i] = NULL;
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->dst)
+            {
+                ir_loops_define (state, instruction, block);
+            }
+        }
+    }
+}
+
+static void
+ir_loops_add_block (struct ir_loop* loop, struct ir_block* block)
+{
+    struct vector* work = vector_create (sizeof (struct ir_block*));
+    vector_push (work, &block);
+    while (!vector_empty (work))
+    {
+        struct ir_block* current = vector_back_ptr (work);
+        vector_pop (work);
+        if (loop->body[current->id])
+        {
+            continue;
+        }
+
+        loop->body[current->id] = true;
+        loop->size++;
+        for (int i = 0; i < vector_count (current->predecessors); i++)
+        {
+            vector_push (work, vector_at (current->predecessors, i));
+        }
+    }
+    vector_free (work);
+}
+
+static int
+ir_loops_compare_size (const void* a, const void* b)
+{
+    return ((struct ir_loop*) a)->size - ((struct ir_loop*) b)->size;
+}
+
+/* The natural loops of `function`, one per header whatever the
+   number of its back edges, the smallest first.  A back edge goes
+   to a block dominating the one it leaves.  */
+static struct vector*
+ir_loops_find (struct ir_function* function)
+{
+    struct vector* loops = vector_create (sizeof (struct ir_loop));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* header = vector_peek_ptr_at (function->blocks, i);
+        struct ir_loop loop = {.header=header};
+        int total_latches = 0;
+        for (int j = 0; j < vector_count (header->predecessors); j++)
+        {
+            struct ir_block* predecessor = vector_peek_ptr_at (header->predecessors, j);
+            if (!ir_dominates (header, predecessor))
+            {
+                continue;
+            }
+
+            if (!loop.body)
+            {
+                loop.body = calloc (function->next_block_id, sizeof (bool));
+                loop.body[header->id] = true;
+                loop.size = 1;
+            }
+            loop.latch = predecessor;
+            total_latches++;
+            ir_loops_add_block (&loop, predecessor);
+        }
+
+        if (!loop.body)
+        {
+            continue;
+        }
+
+        loop.latch = total_latches == 1 ? loop.latch : NULL;
+        int total_outside = 0;
+        for (int j = 0; j < vector_count (header->predecessors); j++)
+        {
+            struct ir_block* predecessor = vector_peek_ptr_at (header->predecessors, j);
+            if (!loop.body[predecessor->id])
+            {
+                loop.preheader = predecessor;
+                total_outside++;
+            }
+        }
+
+        if (total_outside != 1 || \
+            ir_block_terminator (loop.preheader)->op != IR_OP_JUMP)
+        {
+            loop.preheader = NULL;
+        }
+        vector_push (loops, &loop);
+    }
+
+    qsort (vector_data_ptr (loops), vector_count (loops), sizeof (struct ir_loop),
+           ir_loops_compare_size);
+    return loops;
+}
+
+static void
+ir_loops_free (struct vector* loops)
+{
+    for (int i = 0; i < vector_count (loops); i++)
+    {
+        free (((struct ir_loop*) vector_at (loops, i))->body);
+    }
+    vector_free (loops);
+}
+
+/* Sends the edges entering `loop` from outside to a new block going
+   to the header.  The values its phis had on them then come from
+   that block, merged by a phi there when there are several.  */
+static void
+ir_loops_add_preheader (struct ir_function* function, struct ir_loop* loop)
+{
+    struct ir_block* header = loop->header;
+    struct ir_block* preheader = ir_block_new (function);
+    for (int i = 0; i < vector_count (header->predecessors); i++)
+    {
+        struct ir_block* predecessor = vector_peek_ptr_at (header->predecessors, i);
+        if (loop->body[predecessor->id])
+        {
+            continue;
+        }
+
+        struct ir_instruction* terminator = ir_block_terminator (predecessor);
+        for (int j = 0; j < ir_instruction_total_targets (terminator); j++)
+        {
+            struct ir_block** target = ir_instruction_target_at (terminator, j);
+            *target = *target == header ? preheader : *target;
+        }
+    }
+
+    for (int i = 0; i < vector_count (header->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        struct vector* inside = vector_create (sizeof (struct ir_phi_value));
+        struct vector* outside = vector_create (sizeof (struct ir_phi_value));
+        for (int j = 0; j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            vector_push (loop->body[value->block->id] ? inside : outside, value);
+        }
+
+        struct ir_phi_value entry = {.block=preheader};
+        if (vector_count (outside) == 1)
+        {
+            entry.vreg = ((struct ir_phi_value*) vector_at (outside, 0))->vreg;
+            vector_free (outside);
+        }
+        else
+        {
+            struct ir_instruction* merge = ir_instruction_new (IR_OP_PHI);
+            merge->dst = ir_vreg_new (function, ir_vreg_type (function, phi->dst));
+            merge->phi_values = outside;
+            ir_block_append (preheader, merge);
+            entry.vreg = merge->dst;
+        }
+
+        vector_push (inside, &entry);
+        vector_free (phi->phi_values);
+        phi->phi_values = inside;
+    }
+
+    struct ir_instruction* jump = ir_instruction_new (IR_OP_JUMP);
+    jump->targets[0] = header;
+    ir_block_append (preheader, jump);
+}
+
+/* Defined before the loop, so the same on every iteration.  */
+static bool
+ir_loops_is_invariant (struct ir_loops* state, struct ir_loop* loop, int vreg)
+{
+    return vreg < state->total_vregs && state->blocks[vreg] && \
+           !loop->body[state->blocks[vreg]->id];
+}
+
+static void
+ir_loops_move_to_preheader (struct ir_loops* state, struct ir_loop* loop,
+                            struct ir_instruction* instruction)
+{
+    struct ir_block* preheader = loop->preheader;
+    ir_block_insert (preheader, vector_count (preheader->instructions) - 1, instruction);
+    ir_loops_define (state, instruction, preheader);
+}
+
+/* Instructions computing their value from their operands alone,
+   which do not trap.  A compare stays by the branch it feeds.  */
+static bool
+ir_loops_is_movable (struct ir_instruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_OP_CONST:
+        case IR_OP_ADDRESS:
+        case IR_OP_SLOT_ADDRESS:
+        case IR_OP_COPY:
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_AND:
+        case IR_OP_OR:
+        case IR_OP_XOR:
+        case IR_OP_SHL:
+        case IR_OP_SHR:
+        case IR_OP_SAR:
+        case IR_OP_NEG:
+        case IR_OP_NOT:
+        case IR_OP_EXTEND:
+            return true;
+    }
+
+    return false;
+}
+
+/* Moves the instructions of `loop` whose operands are invariant to
+   its preheader.  The blocks are in reverse postorder, a definition
+   is seen before its uses and a value depending on hoisted ones goes
+   in the same walk.  */
+static void
+ir_loops_hoist (struct ir_loops* state, struct ir_loop* loop)
+{
+    struct vector* blocks = state->function->blocks;
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        if (!loop->body[block->id])
+        {
+            continue;
+        }
+
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction** at = vector_at (block->instructions, j);
+            struct ir_instruction* instruction = *at;
+            if (!ir_loops_is_movable (instruction) || \
+                (instruction->args[0] && \
+                 !ir_loops_is_invariant (state, loop, instruction->args[0])) || \
+                (instruction->args[1] && \
+                 !ir_loops_is_invariant (state, loop, instruction->args[1])))
+            {
+                continue;
+            }
+
+            *at = ir_instruction_new (IR_OP_NOP);
+            ir_loops_move_to_preheader (state, loop, instruction);
+            state->hoisted++;
+        }
+    }
+}
+
+/* The basic induction variables of `loop`, the phis of its header
+   whose value from the latch adds an invariant to them.  */
+static struct vector*
+ir_loops_find_ivs (struct ir_loops* state, struct ir_loop* loop)
+{
+    struct vector* ivs = vector_create (sizeof (struct ir_loop_iv));
+    struct vector* instructions = loop->header->instructions;
+    for (int i = 0; i < vector_count (instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        struct ir_loop_iv iv = {.vreg=phi->dst};
+        int next = 0;
+        for (int j = 0; j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            if (value->block == loop->preheader)
+            {
+                iv.init = value->vreg;
+            }
+            else
+            {
+                next = value->vreg;
+            }
+        }
+
+        iv.next = next < state->total_vregs ? state->definitions[next] : NULL;
+        if (!iv.init || !iv.next || !loop->body[state->blocks[next]->id])
+        {
+            continue;
+        }
+
+        int* args = iv.next->args;
+        if (iv.next->op == IR_OP_ADD && args[1] == iv.vreg)
+        {
+            iv.step = args[0];
+        }
+        else if ((iv.next->op == IR_OP_ADD || iv.next->op == IR_OP_SUB) && \
+                 args[0] == iv.vreg)
+        {
+            iv.step = args[1];
+        }
+
+        if (iv.step && ir_loops_is_invariant (state, loop, iv.step))
+        {
+            iv.op = iv.next->op;
+            vector_push (ivs, &iv);
+        }
+    }
+
+    return ivs;
+}
+
+static struct ir_loop_iv*
+ir_loops_iv (struct vector* ivs, int vreg)
+{
+    for (int i = 0; vreg && i < vector_count (ivs); i++)
+    {
+        struct ir_loop_iv* iv = vector_at (ivs, i);
+        if (iv->vreg == vreg)
+        {
+            return iv;
+        }
+    }
+
+    return NULL;
+}
+
+/* Which operand of `instruction` is the induction variable it may
+   be turned into one from, -1 when it may not.  Multiplications and
+   shifts of any of them are, so is the sign extension of one on
+   x86-64, signed overflow being undefined.  Sums of a derived one
+   are too, the derived one is then no longer needed.  */
+static int
+ir_loops_reducible_operand (struct ir_loops* state, struct ir_loop* loop,
+                            struct vector* ivs, struct ir_instruction* instruction)
+{
+    int* args = instruction->args;
+    struct ir_loop_iv* first = ir_loops_iv (ivs, args[0]);
+    struct ir_loop_iv* second = ir_loops_iv (ivs, args[1]);
+    switch (instruction->op)
+    {
+        case IR_OP_MUL:
+            if (second && ir_loops_is_invariant (state, loop, args[0]))
+            {
+                return 1;
+            }
+            /* Fall through.  */
+        case IR_OP_SHL:
+            return first && ir_loops_is_invariant (state, loop, args[1]) ? 0 : -1;
+
+        case IR_OP_EXTEND:
+            return first && instruction->is_signed && \
+                   instruction->size == DATA_SIZE_DWORD && \
+                   ir_type_size (ir_vreg_type (state->function, args[0])) == \
+                   DATA_SIZE_DWORD && \
+                   ir_type_size (ir_vreg_type (state->function, instruction->dst)) == \
+                   DATA_SIZE_DDWORD ? 0 : -1;
+
+        case IR_OP_ADD:
+            if (second && second->is_derived && \
+                ir_loops_is_invariant (state, loop, args[0]))
+            {
+                return 1;
+            }
+            /* Fall through.  */
+        case IR_OP_SUB:
+            return first && first->is_derived && \
+                   ir_loops_is_invariant (state, loop, args[1]) ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/* The operand of `instruction` it equals, adding zero or multiplying
+   by one, 0 when there is none.  */
+static int
+ir_loops_identity (struct ir_loops* state, struct ir_instruction* instruction,
+                   struct ir_instruction* a, struct ir_instruction* b)
+{
+    int op = instruction->op;
+    long long neutral = op == IR_OP_MUL ? 1 : 0;
+    int kept = 0;
+    if (op != IR_OP_ADD && op != IR_OP_SUB && op != IR_OP_MUL && op != IR_OP_SHL)
+    {
+        return 0;
+    }
+
+    if (b && b->op == IR_OP_CONST && b->imm == neutral)
+    {
+        kept = instruction->args[0];
+    }
+    else if ((op == IR_OP_ADD || op == IR_OP_MUL) && a && a->op == IR_OP_CONST && \
+             a->imm == neutral)
+    {
+        kept = instruction->args[1];
+    }
+
+    int type = ir_vreg_type (state->function, instruction->dst);
+    return kept && ir_type_size (ir_vreg_type (state->function, kept)) == \
+                   ir_type_size (type) ? kept : 0;
+}
+
+/* `model` with operand `index` replaced by `value`, computed in the
+   preheader.  Constants are folded, and so are offsets added to the
+   address of a symbol, to leave an operand the lowering writes out
+   where it is used.  */
+static int
+ir_loops_compute (struct ir_loops* state, struct ir_loop* loop,
+                  struct ir_instruction* model, int index, int value)
+{
+    struct ir_instruction* instruction = ir_instruction_new (model->op);
+    instruction->args[0] = model->args[0];
+    instruction->args[1] = model->args[1];
+    instruction->args[index] = value;
+    instruction->size = model->size;
+    instruction->is_signed = model->is_signed;
+    instruction->dst = model->dst;
+    int type = ir_vreg_type (state->function, model->dst);
+
+    struct ir_instruction* a = state->definitions[instruction->args[0]];
+    struct ir_instruction* b = instruction->args[1] ? \
+                    state->definitions[instruction->args[1]] : NULL;
+    int identity = ir_loops_identity (state, instruction, a, b);
+    if (identity)
+    {
+        ir_instruction_free (instruction);
+        return identity;
+    }
+
+    instruction->dst = ir_vreg_new (state->function, type);
+    bool is_constant = a && a->op == IR_OP_CONST && (!b || b->op == IR_OP_CONST);
+    unsigned long long x = a ? (unsigned long long) a->imm : 0;
+    unsigned long long y = b ? (unsigned long long) b->imm : 0;
+    if (model->op == IR_OP_MUL && a && b && \
+        ((a->op == IR_OP_CONST && !x) || (b->op == IR_OP_CONST && !y)))
+    {
+        /* Induction variables mostly start at zero.  */
+        is_constant = true;
+        x = y = 0;
+    }
+    if (is_constant)
+    {
+        unsigned long long result = 0;
+        switch (model->op)
+        {
+            case IR_OP_ADD:
+                result = x + y;
+                break;
+            case IR_OP_SUB:
+                result = x - y;
+                break;
+            case IR_OP_MUL:
+                result = x * y;
+                break;
+            case IR_OP_SHL:
+                result = x << (y & 63);
+                break;
+            case IR_OP_EXTEND:
+                result = (long long) (int) x;
+                break;
+        }
+
+        instruction->op = IR_OP_CONST;
+        instruction->imm = ir_type_size (type) == DATA_SIZE_DWORD ? \
+                           (long long) (int) result : (long long) result;
+        instruction->args[0] = instruction->args[1] = 0;
+    }
+    else if (model->op == IR_OP_ADD && a && b && \
+             ((a->op == IR_OP_ADDRESS && b->op == IR_OP_CONST) || \
+              (a->op == IR_OP_CONST && b->op == IR_OP_ADDRESS)))
+    {
+        struct ir_instruction* address = a->op == IR_OP_ADDRESS ? a : b;
+        instruction->op = IR_OP_ADDRESS;
+        instruction->label = address->label;
+        instruction->imm = (long long) (x + y);
+        instruction->args[0] = instruction->args[1] = 0;
+    }
+
+    ir_loops_move_to_preheader (state, loop, instruction);
+    return instruction->dst;
+}
+
+static void
+ir_loops_replace (struct ir_function* function, int vreg, int replacement)
+{
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                int* use = ir_instruction_use_at (instruction, k);
+                *use = *use == vreg ? replacement : *use;
+            }
+        }
+    }
+}
+
+/* Makes `instruction`, of the induction variable at operand `index`,
+   an induction variable of its own starting at the same expression
+   of the initial value and stepping by the same expression of the
+   step, multiplied or shifted, its next value computed right after
+   the one of `iv`.  */
+static void
+ir_loops_reduce_instruction (struct ir_loops* state, struct ir_loop* loop,
+                             struct vector* ivs, struct ir_instruction* instruction,
+                             int index)
+{
+    struct ir_function* function = state->function;
+    struct ir_loop_iv iv = *ir_loops_iv (ivs, instruction->args[index]);
+    int type = ir_vreg_type (function, instruction->dst);
+    struct ir_loop_iv derived = {.op=iv.op, .is_derived=true};
+    derived.init = ir_loops_compute (state, loop, instruction, index, iv.init);
+    derived.step = instruction->op == IR_OP_ADD || instruction->op == IR_OP_SUB ? \
+                   iv.step : ir_loops_compute (state, loop, instruction, index, iv.step);
+
+    struct ir_instruction* phi = ir_instruction_new (IR_OP_PHI);
+    phi->dst = ir_vreg_new (function, type);
+    derived.vreg = phi->dst;
+    derived.next = ir_instruction_new (iv.op);
+    derived.next->dst = ir_vreg_new (function, type);
+    derived.next->args[0] = phi->dst;
+    derived.next->args[1] = derived.step;
+
+    phi->phi_values = vector_create (sizeof (struct ir_phi_value));
+    struct ir_phi_value value = {.block=loop->preheader, .vreg=derived.init};
+    vector_push (phi->phi_values, &value);
+    value = (struct ir_phi_value) {.block=loop->latch, .vreg=derived.next->dst};
+    vector_push (phi->phi_values, &value);
+    ir_block_insert (loop->header, 0, phi);
+    ir_loops_define (state, phi, loop->header);
+
+    struct ir_block* block = state->blocks[iv.next->dst];
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        if (vector_peek_ptr_at (block->instructions, i) == iv.next)
+        {
+            ir_block_insert (block, i + 1, derived.next);
+            break;
+        }
+    }
+    ir_loops_define (state, derived.next, block);
+
+    ir_loops_replace (function, instruction->dst, phi->dst);
+    state->definitions[instruction->dst] = NULL;
+    state->blocks[instruction->dst] = NULL;
+    instruction->op = IR_OP_NOP;
+    vector_push (ivs, &derived);
+    state->reduced++;
+}
+
+static bool
+ir_loops_is_next (struct vector* ivs, struct ir_instruction* instruction)
+{
+    for (int i = 0; i < vector_count (ivs); i++)
+    {
+        if (((struct ir_loop_iv*) vector_at (ivs, i))->next == instruction)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Strength reduction, until no instruction of the loop is an
+   expression of an induction variable to replace.  Inserting moves
+   instructions around so every replacement starts the walk over.  */
+static void
+ir_loops_reduce (struct ir_loops* state, struct ir_loop* loop)
+{
+    if (!loop->latch)
+    {
+        return;
+    }
+
+    struct vector* ivs = ir_loops_find_ivs (state, loop);
+    struct vector* blocks = state->function->blocks;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count (blocks) && !changed; i++)
+        {
+            struct ir_block* block = vector_peek_ptr_at (blocks, i);
+            for (int j = 0; loop->body[block->id] && \
+                            j < vector_count (block->instructions); j++)
+            {
+                struct ir_instruction* instruction = \
+                                vector_peek_ptr_at (block->instructions, j);
+                int index = ir_loops_reducible_operand (state, loop, ivs, instruction);
+                if (index >= 0 && !ir_loops_is_next (ivs, instruction))
+                {
+                    ir_loops_reduce_instruction (state, loop, ivs, instruction, index);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    vector_free (ivs);
+}
+
+/* The blocks of `loop` in reverse postorder, the header first.  */
+static struct vector*
+ir_loops_blocks (struct ir_function* function, struct ir_loop* loop)
+{
+    struct vector* blocks = vector_create (sizeof (struct ir_block*));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        if (loop->body[block->id])
+        {
+            vector_push (blocks, &block);
+        }
+    }
+
+    return blocks;
+}
+
+/* The target of the header branch staying in `loop`.  */
+static struct ir_block*
+ir_loops_inside_target (struct ir_loop* loop)
+{
+    struct ir_instruction* branch = ir_block_terminator (loop->header);
+    return loop->body[branch->targets[0]->id] ? branch->targets[0] : branch->targets[1];
+}
+
+/* Why `loop` may not be unrolled, NULL when it may.  Only innermost
+   loops leaving from their header alone are, their header phis
+   taking a value from the preheader and one from the latch.  */
+static const char*
+ir_loops_unroll_refusal (struct vector* loops, struct ir_loop* loop,
+                         struct vector* blocks)
+{
+    if (!loop->preheader || !loop->latch || \
+        ir_block_terminator (loop->latch)->op != IR_OP_JUMP)
+    {
+        return "not a simple loop";
+    }
+
+    for (int i = 0; i < vector_count (loops); i++)
+    {
+        struct ir_loop* other = vector_at (loops, i);
+        if (other != loop && loop->body[other->header->id])
+        {
+            return "not innermost";
+        }
+    }
+
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        struct ir_instruction* terminator = ir_block_terminator (block);
+        int total_outside = 0;
+        for (int j = 0; j < ir_instruction_total_targets (terminator); j++)
+        {
+            struct ir_block* target = *ir_instruction_target_at (terminator, j);
+            total_outside += target && !loop->body[target->id];
+        }
+
+        if (block == loop->header ? terminator->op != IR_OP_BRANCH || total_outside != 1 : \
+                                    total_outside != 0)
+        {
+            return "leaves from its body";
+        }
+    }
+
+    for (int i = 0; i < vector_count (loop->header->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (loop->header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        if (vector_count (phi->phi_values) != 2)
+        {
+            return "not a simple loop";
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+ir_loops_constant (struct ir_loops* state, int vreg, long long* value)
+{
+    struct ir_instruction* definition = vreg < state->total_vregs ? \
+                                        state->definitions[vreg] : NULL;
+    if (!definition || definition->op != IR_OP_CONST)
+    {
+        return false;
+    }
+
+    *value = definition->imm;
+    return true;
+}
+
+/* `value` read at `size` bytes as signed or unsigned, false when it
+   is a 64 bit value too big to count iterations with.  */
+static bool
+ir_loops_count_value (size_t size, bool is_unsigned, long long* value)
+{
+    if (size == DATA_SIZE_DWORD)
+    {
+        *value = is_unsigned ? (long long) (unsigned int) *value : \
+                               (long long) (int) *value;
+        return true;
+    }
+
+    return *value > -(1ll << 62) && *value < (1ll << 62);
+}
+
+/* Times `loop` runs its body, -1 when that is not known here.  Its
+   header must test an induction variable starting and stepping by
+   constants against a constant, which is then `counter`.  */
+static long long
+ir_loops_trip_count (struct ir_loops* state, struct ir_loop* loop,
+                     struct ir_loop_iv* counter)
+{
+    struct ir_instruction* branch = ir_block_terminator (loop->header);
+    int compare_vreg = branch->args[0];
+    struct ir_instruction* compare = compare_vreg < state->total_vregs ? \
+                                     state->definitions[compare_vreg] : NULL;
+    if (!compare || compare->op != IR_OP_COMPARE || \
+        state->blocks[compare_vreg] != loop->header)
+    {
+        return -1;
+    }
+
+    struct vector* ivs = ir_loops_find_ivs (state, loop);
+    int condition = compare->condition;
+    int bound_vreg = compare->args[1];
+    struct ir_loop_iv* iv = ir_loops_iv (ivs, compare->args[0]);
+    if (!iv)
+    {
+        /* `10 > i` is `i < 10`.  */
+        static const int swapped[] = {
+            [IR_CONDITION_EQ] = IR_CONDITION_EQ,
+            [IR_CONDITION_NE] = IR_CONDITION_NE,
+            [IR_CONDITION_LT] = IR_CONDITION_GT,
+            [IR_CONDITION_LE] = IR_CONDITION_GE,
+            [IR_CONDITION_GT] = IR_CONDITION_LT,
+            [IR_CONDITION_GE] = IR_CONDITION_LE,
+            [IR_CONDITION_ULT] = IR_CONDITION_UGT,
+            [IR_CONDITION_ULE] = IR_CONDITION_UGE,
+            [IR_CONDITION_UGT] = IR_CONDITION_ULT,
+            [IR_CONDITION_UGE] = IR_CONDITION_ULE
+        };
+        iv = ir_loops_iv (ivs, compare->args[1]);
+        condition = swapped[condition];
+        bound_vreg = compare->args[0];
+    }
+
+    if (iv)
+    {
+        *counter = *iv;
+    }
+    vector_free (ivs);
+
+    long long first, step, bound;
+    if (!iv || !ir_loops_constant (state, counter->init, &first) || \
+        !ir_loops_constant (state, counter->step, &step) || \
+        !ir_loops_constant (state, bound_vreg, &bound) || \
+        ir_type_size (ir_vreg_type (state->function, counter->vreg)) != compare->size)
+    {
+        return -1;
+    }
+
+    if (branch->targets[0] != ir_loops_inside_target (loop))
+    {
+        condition = ir_condition_inverse (condition);
+    }
+
+    bool is_unsigned = condition >= IR_CONDITION_ULT;
+    size_t size = compare->size;
+    long long lowest = is_unsigned ? 0 : size == DATA_SIZE_DWORD ? INT_MIN : -(1ll << 62);
+    long long highest = size != DATA_SIZE_DWORD ? (1ll << 62) : \
+                        is_unsigned ? UINT_MAX : INT_MAX;
+    step = size == DATA_SIZE_DWORD ? (long long) (int) step : step;
+    step = counter->op == IR_OP_SUB ? -step : step;
+    if (!ir_loops_count_value (size, is_unsigned, &first) || \
+        !ir_loops_count_value (size, is_unsigned, &bound) || \
+        !step || step >= (1ll << 32) || step <= -(1ll << 32))
+    {
+        return -1;
+    }
+
+    /* Inclusive bounds are exclusive ones a step further.  */
+    switch (condition)
+    {
+        case IR_CONDITION_LE:
+        case IR_CONDITION_ULE:
+            if (bound == highest)
+            {
+                return -1;
+            }
+            bound++;
+            condition = IR_CONDITION_LT;
+            break;
+
+        case IR_CONDITION_GE:
+        case IR_CONDITION_UGE:
+            if (bound == lowest)
+            {
+                return -1;
+            }
+            bound--;
+            condition = IR_CONDITION_GT;
+            break;
+
+        case IR_CONDITION_ULT:
+            condition = IR_CONDITION_LT;
+            break;
+
+        case IR_CONDITION_UGT:
+            condition = IR_CONDITION_GT;
+            break;
+    }
+
+    long long iterations = -1;
+    switch (condition)
+    {
+        case IR_CONDITION_LT:
+            if (step > 0)
+            {
+                iterations = first < bound ? (bound - first + step - 1) / step : 0;
+            }
+            break;
+
+        case IR_CONDITION_GT:
+            if (step < 0)
+            {
+                iterations = first > bound ? (first - bound - step - 1) / -step : 0;
+            }
+            break;
+
+        case IR_CONDITION_NE:
+            if ((bound - first) % step == 0 && (bound - first) / step >= 0)
+            {
+                iterations = (bound - first) / step;
+            }
+            break;
+    }
+
+    /* The variable must not wrap around before the loop ends.  */
+    long long last = first + iterations * step;
+    return iterations >= 0 && last >= lowest && last <= highest ? iterations : -1;
+}
+
+/* Instructions of `blocks` doing some work, whether one is a call.  */
+static int
+ir_loops_body_size (struct vector* blocks, bool* has_call)
+{
+    int size = 0;
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            size += instruction->op != IR_OP_PHI && instruction->op != IR_OP_JUMP;
+            *has_call |= instruction->op == IR_OP_CALL;
+        }
+    }
+
+    return size;
+}
+
+/* Copies the `blocks` of `loop` to new blocks with new registers.
+   With `incoming`, by header phi the value it takes in the copy, the
+   phis are left out and the header goes on to the body without
+   testing anything, the number of iterations being known.  */
+static void
+ir_loops_copy (struct ir_loops* state, struct ir_loop* loop, struct vector* blocks,
+               int* incoming, struct ir_loop_copy* copy)
+{
+    struct ir_function* function = state->function;
+    int total_vregs = ir_total_vregs (function);
+    copy->blocks = calloc (function->next_block_id, sizeof (struct ir_block*));
+    copy->vregs = malloc (total_vregs * sizeof (int));
+    for (int i = 0; i < total_vregs; i++)
+    {
+        copy->vregs[i] = i;
+    }
+
+    /* Phis may read values defined further down, all get their
+       register before any is copied.  */
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        copy->blocks[block->id] = ir_block_new (function);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (!instruction->dst)
+            {
+                continue;
+            }
+
+            bool is_header_phi = block == loop->header && instruction->op == IR_OP_PHI;
+            copy->vregs[instruction->dst] = incoming && is_header_phi ? incoming[j] : \
+                    ir_vreg_new (function, ir_vreg_type (function, instruction->dst));
+        }
+    }
+
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        struct ir_block* block_copy = copy->blocks[block->id];
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (incoming && block == loop->header && instruction->op == IR_OP_PHI)
+            {
+                continue;
+            }
+
+            struct ir_instruction* instruction_copy = ir_instruction_copy (instruction);
+            instruction_copy->dst = copy->vregs[instruction->dst];
+            for (int k = 0; k < ir_instruction_total_uses (instruction_copy); k++)
+            {
+                int* use = ir_instruction_use_at (instruction_copy, k);
+                *use = copy->vregs[*use];
+            }
+
+            for (int k = 0; k < ir_instruction_total_targets (instruction_copy); k++)
+            {
+                struct ir_block** target = ir_instruction_target_at (instruction_copy, k);
+                *target = *target && loop->body[(*target)->id] ? \
+                          copy->blocks[(*target)->id] : *target;
+            }
+
+            for (int k = 0; instruction_copy->phi_values && \
+                            k < vector_count (instruction_copy->phi_values); k++)
+            {
+                struct ir_phi_value* value = vector_at (instruction_copy->phi_values, k);
+                value->block = loop->body[value->block->id] ? \
+                               copy->blocks[value->block->id] : value->block;
+            }
+
+            ir_block_append (block_copy, instruction_copy);
+            if (instruction_copy->dst)
+            {
+                ir_loops_define (state, instruction_copy, block_copy);
+            }
+        }
+    }
+
+    if (incoming)
+    {
+        struct ir_instruction* branch = \
+                        ir_block_terminator (copy->blocks[loop->header->id]);
+        branch->op = IR_OP_JUMP;
+        branch->args[0] = 0;
+        branch->size = 0;
+        branch->targets[0] = copy->blocks[ir_loops_inside_target (loop)->id];
+        branch->targets[1] = NULL;
+    }
+}
+
+static void
+ir_loops_copy_free (struct ir_loop_copy* copy)
+{
+    free (copy->blocks);
+    free (copy->vregs);
+}
+
+/* Sets `incoming`, by header phi, to the value it takes after the
+   iteration `copy` made.  */
+static void
+ir_loops_next_incoming (struct ir_loop* loop, struct ir_loop_copy* copy, int* incoming)
+{
+    struct vector* instructions = loop->header->instructions;
+    for (int i = 0; i < vector_count (instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        for (int j = 0; j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            if (value->block == loop->latch)
+            {
+                incoming[i] = copy->vregs[value->vreg];
+            }
+        }
+    }
+}
+
+/* Makes `loop` run `copies` iterations one after the other, starting
+   with the values of `incoming`.  The preheader goes to the first,
+   the last goes back to the header, which then gets the values
+   `incoming` is left with.  `first` is the copy that may keep its
+   phis and its test, when given, the last then goes back to it.
+   Returns the block going back.  */
+static struct ir_block*
+ir_loops_unroll_copies (struct ir_loops* state, struct ir_loop* loop,
+                        struct vector* blocks, int copies, int* incoming,
+                        struct ir_loop_copy* first)
+{
+    struct ir_block* last = loop->preheader;
+    struct ir_block** next = &ir_block_terminator (last)->targets[0];
+    if (first)
+    {
+        ir_loops_copy (state, loop, blocks, NULL, first);
+        ir_loops_next_incoming (loop, first, incoming);
+        *next = first->blocks[loop->header->id];
+        last = first->blocks[loop->latch->id];
+        next = &ir_block_terminator (last)->targets[0];
+        copies--;
+    }
+
+    for (int i = 0; i < copies; i++)
+    {
+        struct ir_loop_copy copy;
+        ir_loops_copy (state, loop, blocks, incoming, &copy);
+        ir_loops_next_incoming (loop, &copy, incoming);
+        *next = copy.blocks[loop->header->id];
+        last = copy.blocks[loop->latch->id];
+        next = &ir_block_terminator (last)->targets[0];
+        ir_loops_copy_free (&copy);
+    }
+
+    *next = first ? first->blocks[loop->header->id] : loop->header;
+    return last;
+}
+
+/* Replaces `loop` by one copy of its body per iteration.  The header
+   stays to compute what the code after the loop reads, from the
+   values of the last iteration, and goes there.  */
+static void
+ir_loops_unroll_fully (struct ir_loops* state, struct ir_loop* loop,
+                       struct vector* blocks, int iterations)
+{
+    struct ir_block* header = loop->header;
+    int* incoming = calloc (vector_count (header->instructions), sizeof (int));
+    for (int i = 0; i < vector_count (header->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (header->instructions, i);
+        for (int j = 0; phi->op == IR_OP_PHI && j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            incoming[i] = value->block == loop->preheader ? value->vreg : incoming[i];
+        }
+    }
+
+    ir_loops_unroll_copies (state, loop, blocks, iterations, incoming, NULL);
+    for (int i = 0; i < vector_count (header->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        ir_loops_replace (state->function, phi->dst, incoming[i]);
+        phi->op = IR_OP_NOP;
+    }
+    ir_block_compact (header);
+
+    struct ir_instruction* branch = ir_block_terminator (header);
+    struct ir_block* inside = ir_loops_inside_target (loop);
+    branch->op = IR_OP_JUMP;
+    branch->args[0] = 0;
+    branch->size = 0;
+    branch->targets[0] = branch->targets[0] == inside ? branch->targets[1] : \
+                                                        branch->targets[0];
+    branch->targets[1] = NULL;
+    free (incoming);
+}
+
+/* Puts ahead of `loop` a loop running `copies` iterations per test
+   until fewer than that are left, which `loop` then runs.  Its
+   counter is compared to the value it has then.  */
+static void
+ir_loops_unroll_partially (struct ir_loops* state, struct ir_loop* loop,
+                           struct vector* blocks, struct ir_loop_iv* counter,
+                           long long iterations, int copies)
+{
+    struct ir_function* function = state->function;
+    struct ir_block* header = loop->header;
+    int* incoming = calloc (vector_count (header->instructions), sizeof (int));
+    struct ir_loop_copy first;
+    struct ir_block* last_latch = ir_loops_unroll_copies (state, loop, blocks, copies,
+                                                          incoming, &first);
+    struct ir_block* first_header = first.blocks[header->id];
+    struct ir_block* first_latch = first.blocks[loop->latch->id];
+    for (int i = 0; i < vector_count (header->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        /* The last copy goes back to the first.  */
+        struct ir_instruction* phi_copy = vector_peek_ptr_at (first_header->instructions, i);
+        for (int j = 0; j < vector_count (phi_copy->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi_copy->phi_values, j);
+            if (value->block == first_latch)
+            {
+                value->block = last_latch;
+                value->vreg = incoming[i];
+            }
+        }
+
+        /* The loop left for the rest starts where the unrolled one
+           stops.  */
+        for (int j = 0; j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            if (value->block == loop->preheader)
+            {
+                value->block = first_header;
+                value->vreg = first.vregs[phi->dst];
+            }
+        }
+    }
+
+    long long first_value = 0, step = 0;
+    ir_loops_constant (state, counter->init, &first_value);
+    ir_loops_constant (state, counter->step, &step);
+    step = counter->op == IR_OP_SUB ? -step : step;
+    int type = ir_vreg_type (function, counter->vreg);
+    unsigned long long end = (unsigned long long) first_value + \
+                             (unsigned long long) (iterations - iterations % copies) * \
+                             (unsigned long long) step;
+    struct ir_instruction* end_const = ir_instruction_new (IR_OP_CONST);
+    end_const->dst = ir_vreg_new (function, type);
+    end_const->imm = ir_type_size (type) == DATA_SIZE_DWORD ? (long long) (int) end : \
+                                                              (long long) end;
+    ir_loops_move_to_preheader (state, loop, end_const);
+
+    struct ir_instruction* compare = ir_instruction_new (IR_OP_COMPARE);
+    compare->dst = ir_vreg_new (function, IR_TYPE_I32);
+    compare->args[0] = first.vregs[counter->vreg];
+    compare->args[1] = end_const->dst;
+    compare->condition = IR_CONDITION_NE;
+    compare->size = ir_type_size (type);
+    ir_block_insert (first_header, vector_count (first_header->instructions) - 1, compare);
+
+    struct ir_instruction* branch = ir_block_terminator (first_header);
+    branch->args[0] = compare->dst;
+    branch->size = DATA_SIZE_DWORD;
+    branch->targets[0] = first.blocks[ir_loops_inside_target (loop)->id];
+    branch->targets[1] = header;
+    branch->is_unlikely[0] = false;
+    branch->is_unlikely[1] = false;
+
+    /* Neither is unrolled again.  */
+    first_header->unroll = 1;
+    header->unroll = 1;
+    ir_loops_copy_free (&first);
+    free (incoming);
+}
+
+/* Unrolls `loop` as much as its `#pragma unroll` asks or its size
+   allows, returns whether it did.  */
+static bool
+ir_loops_unroll_loop (struct ir_loops* state, struct vector* loops,
+                      struct ir_loop* loop)
+{
+    struct ir_function* function = state->function;
+    int asked = loop->header->unroll;
+    if (asked == 1 || \
+        (!asked && (function->process->flags & COMPILE_PROCESS_FLAG_NO_UNROLL_LOOPS)))
+    {
+        return false;
+    }
+
+    struct vector* blocks = ir_loops_blocks (function, loop);
+    struct ir_loop_iv counter = {};
+    const char* refusal = ir_loops_unroll_refusal (loops, loop, blocks);
+    long long iterations = refusal ? -1 : ir_loops_trip_count (state, loop, &counter);
+    bool has_call = false;
+    int size = ir_loops_body_size (blocks, &has_call);
+    long long copies = 0;
+    if (iterations < 0)
+    {
+        refusal = refusal ? refusal : "unknown number of iterations";
+    }
+    else if (asked)
+    {
+        copies = asked < 0 ? iterations : asked;
+    }
+    else if (!has_call && iterations * size <= IR_LOOP_UNROLL_MAX_INSTRUCTIONS)
+    {
+        copies = iterations;
+    }
+    else
+    {
+        for (int i = 0; !has_call && !copies && \
+                        i < (int) (sizeof (ir_loop_unroll_factors) / sizeof (int)); i++)
+        {
+            int factor = ir_loop_unroll_factors[i];
+            copies = factor * size <= IR_LOOP_UNROLL_MAX_INSTRUCTIONS && \
+                     factor < iterations ? factor : 0;
+        }
+    }
+
+    /* Past the most copies, the rest of the iterations is left to the
+       loop running several per test.  */
+    copies = copies < iterations ? copies : iterations;
+    copies = copies < IR_LOOP_UNROLL_MAX_COPIES ? copies : IR_LOOP_UNROLL_MAX_COPIES;
+
+    if (refusal || (copies < 2 && copies != iterations))
+    {
+        if (refusal && asked)
+        {
+            compiler_report (function->process, "unroll: kept loop in %s, %s",
+                             function->node->func.name, refusal);
+        }
+        vector_free (blocks);
+        return false;
+    }
+
+    if (copies == iterations)
+    {
+        ir_loops_unroll_fully (state, loop, blocks, (int) iterations);
+        compiler_report (function->process, "unroll: %s: loop of %lli iterations "
+                         "unrolled fully", function->node->func.name, iterations);
+    }
+    else
+    {
+        ir_loops_unroll_partially (state, loop, blocks, &counter, iterations, (int) copies);
+        compiler_report (function->process, "unroll: %s: loop of %lli iterations "
+                         "unrolled %lli times", function->node->func.name, iterations,
+                         copies);
+    }
+    state->unrolled++;
+    vector_free (blocks);
+    return true;
+}
+
+/* Whether `vreg` adds a constant to another register, `base` and
+   `offset` are set to them then.  */
+static bool
+ir_loops_offset (struct ir_loops* state, int vreg, int* base, long long* offset)
+{
+    struct ir_instruction* definition = vreg < state->total_vregs ? \
+                                        state->definitions[vreg] : NULL;
+    if (!definition || (definition->op != IR_OP_ADD && definition->op != IR_OP_SUB))
+    {
+        return false;
+    }
+
+    int index = ir_loops_constant (state, definition->args[1], offset) ? 0 : \
+                definition->op == IR_OP_ADD && \
+                ir_loops_constant (state, definition->args[0], offset) ? 1 : -1;
+    if (index < 0 || \
+        ir_vreg_type (state->function, definition->args[index]) != \
+        ir_vreg_type (state->function, vreg))
+    {
+        return false;
+    }
+
+    *base = definition->args[index];
+    *offset = definition->op == IR_OP_SUB ? -*offset : *offset;
+    return true;
+}
+
+/* The copies of a body step their induction variables one after the
+   other.  Offsets added to offsets are summed, and the ones added to
+   the addresses of loads and stores go in the instruction, so the
+   copies read their value at the start of the iteration and the
+   steps in between are left unused.  */
+static void
+ir_loops_fold_offsets (struct ir_loops* state, int first_block_id)
+{
+    struct ir_function* function = state->function;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; block->id >= first_block_id && \
+                        j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            int base, inner_base;
+            long long offset, inner_offset;
+            if ((instruction->op == IR_OP_LOAD || instruction->op == IR_OP_STORE) && \
+                ir_loops_offset (state, instruction->args[0], &base, &offset) && \
+                instruction->imm + offset == (int) (instruction->imm + offset))
+            {
+                instruction->args[0] = base;
+                instruction->imm += offset;
+                continue;
+            }
+
+            if (!instruction->dst || \
+                !ir_loops_offset (state, instruction->dst, &base, &offset) || \
+                !ir_loops_offset (state, base, &inner_base, &inner_offset))
+            {
+                continue;
+            }
+
+            int type = ir_vreg_type (function, instruction->dst);
+            long long sum = (long long) ((unsigned long long) offset + \
+                                         (unsigned long long) inner_offset);
+            struct ir_instruction* constant = ir_instruction_new (IR_OP_CONST);
+            constant->dst = ir_vreg_new (function, type);
+            constant->imm = ir_type_size (type) == DATA_SIZE_DWORD ? (long long) (int) sum : sum;
+            ir_block_insert (block, j++, constant);
+            ir_loops_define (state, constant, block);
+
+            instruction->op = IR_OP_ADD;
+            instruction->args[0] = inner_base;
+            instruction->args[1] = constant->dst;
+        }
+    }
+}
+
+/* Unrolls the loops of the function one at a time, finding them
+   again after each.  */
+static void
+ir_loops_unroll (struct ir_loops* state)
+{
+    int first_block_id = state->function->next_block_id;
+    bool is_changed = true;
+    while (is_changed)
+    {
+        is_changed = false;
+        struct vector* loops = ir_loops_find (state->function);
+        for (int i = 0; i < vector_count (loops) && !is_changed; i++)
+        {
+            is_changed = ir_loops_unroll_loop (state, loops, vector_at (loops, i));
+        }
+        ir_loops_free (loops);
+
+        if (is_changed)
+        {
+            ir_compute_cfg (state->function);
+            ir_loops_define_all (state);
+        }
+    }
+
+    if (state->unrolled)
+    {
+        ir_loops_fold_offsets (state, first_block_id);
+    }
+}
+
+void
+ir_optimize_loops (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_LOOP_OPTIMIZATION)
+    {
+        return;
+    }
+
+    struct vector* loops = ir_loops_find (function);
+    bool has_new_blocks = false;
+    for (int i = 0; i < vector_count (loops); i++)
+    {
+        struct ir_loop* loop = vector_at (loops, i);
+        if (!loop->preheader && loop->header != ir_entry_block (function))
+        {
+            ir_loops_add_preheader (function, loop);
+            has_new_blocks = true;
+        }
+    }
+
+    if (has_new_blocks)
+    {
+        ir_loops_free (loops);
+        ir_compute_cfg (function);
+        loops = ir_loops_find (function);
+    }
+
+    struct ir_loops state = {.function=function};
+    ir_loops_define_all (&state);
+
+    for (int i = 0; i < vector_count (loops); i++)
+    {
+        struct ir_loop* loop = vector_at (loops, i);
+        if (loop->preheader)
+        {
+            ir_loops_hoist (&state, loop);
+            ir_loops_reduce (&state, loop);
+        }
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        ir_block_compact (vector_peek_ptr_at (function->blocks, i));
+    }
+
+    if (state.hoisted || state.reduced)
+    {
+        compiler_report (function->process, "loops: %s: %i loops, %i instructions "
+                         "hoisted, %i induction variables added", function->node->func.name,
+                         vector_count (loops), state.hoisted, state.reduced);
+    }
+    ir_loops_free (loops);
+
+    ir_loops_unroll (&state);
+    if (state.hoisted || state.reduced || state.unrolled)
+    {
+        ir_remove_dead_code (function);
+    }
+
+    free (state.definitions);
+    free (state.blocks);
+}
@@ -0,0 +1,2530 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Emits the x86 or x86-64 of a function that left SSA.  Every virtual
+   register gets one live interval, the hull of the positions where it
+   is live, and the linear scan allocator gives it a callee saved
+   register or a stack slot.  eax, ecx and edx stay free for the
+   instructions, so do the argument registers on x86-64.
+
+   On x86 the functions of this object call each other with their
+   first arguments in registers, at `name.regparm`.  `name` itself is
+   a cdecl entry that loads them from the stack, for the callers from
+   elsewhere and for calls through pointers.  Small structures come
+   back from `name.regparm` in eax and edx, the cdecl entry returns
+   them through the hidden pointer of the i386 ABI.
+
+   A value is held in a register as wide as its IR type, the
+   operations on it are that wide.  An i32 in a 64-bit register only
+   has meaningful low bits, extending it is an explicit IR_OP_EXTEND.  */
+
+/* Where the arguments of a call go, the first `total_registers` in
+   `registers` and the rest on the stack.  */
+struct ir_lower_convention
+{
+    const char** registers;
+    int total_registers;
+};
+
+struct ir_lower
+{
+    struct ir_function* function;
+    struct node* node;
+    struct ir_lower_convention convention;
+    struct regalloc* regalloc;
+    /* Definitions recomputed at every use instead of held in a
+       register, constants and addresses.  By virtual register.  */
+    struct ir_instruction** rematerialized;
+    /* By virtual register, the compare only read by the select right
+       after it, which then compares the operands itself.  */
+    struct ir_instruction** select_compares;
+    /* Register of every virtual register, NULL when it lives in
+       the stack slot at `spill_offsets`.  */
+    const char** registers;
+    int* spill_offsets;
+    size_t frame_size;
+    /* The frame is addressed from the stack pointer, below it are
+       the locals and then `saved_size` bytes of saved registers.  */
+    bool omits_frame_pointer;
+    size_t saved_size;
+    /* Nothing of the frame is addressed, so no pointer into it can
+       outlive a sibling call.  */
+    bool allows_sibling_calls;
+    /* The structure the function returns goes through the hidden
+       pointer above the return address, which `ret` pops.  */
+    bool returns_through_pointer;
+    int exit_id;
+};
+
+static const char* ir_condition_codes[] = {
+    [IR_CONDITION_EQ] = "e",
+    [IR_CONDITION_NE] = "ne",
+    [IR_CONDITION_LT] = "l",
+    [IR_CONDITION_LE] = "le",
+    [IR_CONDITION_GT] = "g",
+    [IR_CONDITION_GE] = "ge",
+    [IR_CONDITION_ULT] = "b",
+    [IR_CONDITION_ULE] = "be",
+    [IR_CONDITION_UGT] = "a",
+    [IR_CONDITION_UGE] = "ae"
+};
+
+/* Names of every register the lowering uses by width, 8, 4, 2 and
+   1 bytes.  */
+static const char* ir_lower_register_names[][4] = {
+    {"rax", "eax", "ax", "al"},
+    {"rcx", "ecx", "cx", "cl"},
+    {"rdx", "edx", "dx", "dl"},
+    {"rbx", "ebx", "bx", "bl"},
+    {"rsi", "esi", "si", "sil"},
+    {"rdi", "edi", "di", "dil"},
+    {"rbp", "ebp", "bp", "bpl"},
+    {"r8", "r8d", "r8w", "r8b"},
+    {"r9", "r9d", "r9w", "r9b"},
+    {"r11", "r11d", "r11w", "r11b"},
+    {"r12", "r12d", "r12w", "r12b"},
+    {"r13", "r13d", "r13w", "r13b"},
+    {"r14", "r14d", "r14w", "r14b"},
+    {"r15", "r15d", "r15w", "r15b"}
+};
+
+/* Where the System V ABI passes the first integer arguments.  */
+static const char* ir_lower_argument_registers[] = {
+    "rdi", "rsi", "rdx", "rcx", "r8", "r9"
+};
+
+/* The internal calls of x86, like regparm (3) of GCC.  */
+static const char* ir_lower_regparm_registers[] = {
+    "eax", "edx", "ecx"
+};
+
+#define IR_LOWER_TOTAL(array) ((int) (sizeof (array) / sizeof (array[0])))
+
+/* Loops start on a boundary of this many bytes, where the processor
+   fetches instructions from.  */
+#define IR_LOWER_LOOP_ALIGNMENT 16
+
+static bool
+ir_lower_is_rematerialized (int op)
+{
+    return op == IR_OP_CONST || op == IR_OP_ADDRESS || op == IR_OP_SLOT_ADDRESS;
+}
+
+/* A compare only read by the branch right after it becomes part
+   of the branch, which then tests the flags directly.  */
+static void
+ir_lower_fuse_compares (struct ir_function* function, int* use_counts)
+{
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        struct ir_instruction* branch = ir_block_terminator (block);
+        if (branch->op != IR_OP_BRANCH || branch->args[1] || \
+            use_counts[branch->args[0]] != 1)
+        {
+            continue;
+        }
+
+        int total = vector_count (block->instructions);
+        struct ir_instruction* compare = NULL;
+        int j = total - 2;
+        for (; j >= 0; j--)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->dst == branch->args[0])
+            {
+                compare = instruction;
+                break;
+            }
+        }
+
+        if (!compare || compare->op != IR_OP_COMPARE)
+        {
+            continue;
+        }
+
+        /* Copies out of SSA may overwrite what the compare read.  */
+        bool overwritten = false;
+        for (int k = j + 1; k < total - 1; k++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, k);
+            if (instruction->dst && (instruction->dst == compare->args[0] || \
+                                     instruction->dst == compare->args[1]))
+            {
+                overwritten = true;
+            }
+        }
+
+        if (overwritten)
+        {
+            continue;
+        }
+
+        branch->args[0] = compare->args[0];
+        branch->args[1] = compare->args[1];
+        branch->condition = compare->condition;
+        branch->size = compare->size;
+        compare->op = IR_OP_NOP;
+        ir_block_compact (block);
+    }
+}
+
+/* A compare only read by the select right after it sets the flags
+   the select's cmov tests instead of a value.  With nothing between
+   them the operands of the compare are still where they were.  */
+static void
+ir_lower_fuse_selects (struct ir_lower* lower, int* use_counts)
+{
+    struct ir_function* function = lower->function;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 1; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* select = vector_peek_ptr_at (block->instructions, j);
+            struct ir_instruction* compare = \
+                            vector_peek_ptr_at (block->instructions, j - 1);
+            if (select->op == IR_OP_SELECT && compare->op == IR_OP_COMPARE && \
+                select->args[2] == compare->dst && use_counts[compare->dst] == 1)
+            {
+                lower->select_compares[compare->dst] = compare;
+            }
+        }
+    }
+}
+
+/* Numbers the instructions in layout order, a use of instruction `i`
+   is at 2i and its definition at 2i + 1, so a value may take the
+   register of an operand read for the last time.  */
+static void
+ir_lower_intervals (struct ir_lower* lower, int* starts, int* ends)
+{
+    struct ir_function* function = lower->function;
+    int total_vregs = ir_total_vregs (function);
+    int total_blocks = vector_count (function->blocks);
+    bool* uses = calloc ((size_t) total_blocks * total_vregs, sizeof (bool));
+    bool* defs = calloc ((size_t) total_blocks * total_vregs, sizeof (bool));
+    bool* live_in = calloc ((size_t) total_blocks * total_vregs, sizeof (bool));
+    bool* live_out = calloc ((size_t) total_blocks * total_vregs, sizeof (bool));
+    int* block_starts = calloc (total_blocks, sizeof (int));
+    int* block_ends = calloc (total_blocks, sizeof (int));
+    for (int i = 0; i < total_vregs; i++)
+    {
+        starts[i] = INT_MAX;
+        ends[i] = -1;
+    }
+
+    int position = 0;
+    for (int i = 0; i < total_blocks; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        bool* block_uses = &uses[(size_t) i * total_vregs];
+        bool* block_defs = &defs[(size_t) i * total_vregs];
+        block_starts[i] = position * 2;
+        for (int j = 0; j < vector_count (block->instructions); j++, position++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                int vreg = *ir_instruction_use_at (instruction, k);
+                if (!vreg || lower->rematerialized[vreg])
+                {
+                    continue;
+                }
+
+                if (!block_defs[vreg])
+                {
+                    block_uses[vreg] = true;
+                }
+                starts[vreg] = position * 2 < starts[vreg] ? position * 2 : starts[vreg];
+                ends[vreg] = position * 2 > ends[vreg] ? position * 2 : ends[vreg];
+            }
+
+            int dst = instruction->dst;
+            if (dst && !lower->rematerialized[dst])
+            {
+                block_defs[dst] = true;
+                starts[dst] = position * 2 + 1 < starts[dst] ? position * 2 + 1 : starts[dst];
+                ends[dst] = position * 2 + 1 > ends[dst] ? position * 2 + 1 : ends[dst];
+            }
+        }
+        block_ends[i] = position * 2 - 1;
+    }
+
+    /* live_in = uses + (live_out - defs), backwards until stable.  */
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = total_blocks - 1; i >= 0; i--)
+        {
+            struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+            bool* out = &live_out[(size_t) i * total_vregs];
+            bool* in = &live_in[(size_t) i * total_vregs];
+            for (int j = 0; j < vector_count (block->successors); j++)
+            {
+                struct ir_block* successor = vector_peek_ptr_at (block->successors, j);
+                bool* successor_in = &live_in[(size_t) successor->order * total_vregs];
+                for (int vreg = 1; vreg < total_vregs; vreg++)
+                {
+                    out[vreg] |= successor_in[vreg];
+                }
+            }
+
+            for (int vreg = 1; vreg < total_vregs; vreg++)
+            {
+                bool value = uses[(size_t) i * total_vregs + vreg] || \
+                             (out[vreg] && !defs[(size_t) i * total_vregs + vreg]);
+                if (value && !in[vreg])
+                {
+                    in[vreg] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < total_blocks; i++)
+    {
+        for (int vreg = 1; vreg < total_vregs; vreg++)
+        {
+            if (live_in[(size_t) i * total_vregs + vreg] && block_starts[i] < starts[vreg])
+            {
+                starts[vreg] = block_starts[i];
+            }
+
+            if (live_out[(size_t) i * total_vregs + vreg] && block_ends[i] > ends[vreg])
+            {
+                ends[vreg] = block_ends[i];
+            }
+        }
+    }
+
+    free (uses);
+    free (defs);
+    free (live_in);
+    free (live_out);
+    free (block_starts);
+    free (block_ends);
+}
+
+
+/* `reg` as wide as `size`, ecx of 8 bytes is rcx.  */
+static const char*
+ir_lower_sized (const char* reg, size_t size)
+{
+    int column = size == DATA_SIZE_DDWORD ? 0 : size == DATA_SIZE_DWORD ? 1 : \
+                 size == DATA_SIZE_WORD ? 2 : 3;
+    int total = sizeof (ir_lower_register_names) / sizeof (ir_lower_register_names[0]);
+    for (int i = 0; i < total; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            if (S_EQ (ir_lower_register_names[i][j], reg))
+            {
+                return ir_lower_register_names[i][column];
+            }
+        }
+    }
+
+    return reg;
+}
+
+static bool
+ir_lower_same_register (const char* a, const char* b)
+{
+    return S_EQ (ir_lower_sized (a, DATA_SIZE_DDWORD),
+                 ir_lower_sized (b, DATA_SIZE_DDWORD));
+}
+
+static const char*
+ir_lower_frame_register ()
+{
+    return compiler_target_is_x86_64 () ? "rbp" : "ebp";
+}
+
+static const char*
+ir_lower_stack_register ()
+{
+    return compiler_target_is_x86_64 () ? "rsp" : "esp";
+}
+
+/* Memory operand at `offset` from the frame pointer, from the stack
+   pointer when the function has no frame.  There the locals start
+   right below the return address and the arguments are one push
+   closer, the stack pointer is below everything the frame holds.  */
+static void
+ir_lower_frame_address (struct ir_lower* lower, long long offset, char* out)
+{
+    if (!lower->omits_frame_pointer)
+    {
+        sprintf (out, "[%s%+lld]", ir_lower_frame_register (), offset);
+        return;
+    }
+
+    if (offset > 0)
+    {
+        offset -= STACK_PUSH_SIZE;
+    }
+    else
+    {
+        struct stack_frame_element* element = stack_frame_find (lower->node, (int) offset);
+        if (!element || element->type != STACK_FRAME_ELEMENT_TYPE_LOCAL_VARIABLE)
+        {
+            compiler_error (lower->function->process, "No frame slot at %lld "
+                            "in `%s` without a frame pointer", offset,
+                            lower->node->func.name);
+        }
+    }
+    sprintf (out, "[%s%+lld]", ir_lower_stack_register (),
+             offset + (long long) lower->node->func.frame.size);
+}
+
+/* Width of the register holding `vreg`.  */
+static size_t
+ir_lower_size (struct ir_lower* lower, int vreg)
+{
+    return ir_type_size (ir_vreg_type (lower->function, vreg));
+}
+
+/* Width of a compare or a branch, set by the builder.  */
+static size_t
+ir_lower_instruction_size (struct ir_instruction* instruction)
+{
+    return instruction->size ? instruction->size : DATA_SIZE_DWORD;
+}
+
+/* Instructions take at most a sign extended 32-bit immediate.  */
+static bool
+ir_lower_fits_immediate (long long value)
+{
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+/* x86-64 always has the System V registers, x86 only between the
+   functions of this object, which `is_internal` tells.  */
+static struct ir_lower_convention
+ir_lower_convention_for (bool is_internal)
+{
+    if (compiler_target_is_x86_64 ())
+    {
+        return (struct ir_lower_convention) {
+            ir_lower_argument_registers,
+            IR_LOWER_TOTAL (ir_lower_argument_registers)
+        };
+    }
+
+    if (is_internal)
+    {
+        return (struct ir_lower_convention) {
+            ir_lower_regparm_registers,
+            IR_LOWER_TOTAL (ir_lower_regparm_registers)
+        };
+    }
+
+    return (struct ir_lower_convention) {NULL, 0};
+}
+
+/* Functions taking `...` keep every argument on the stack.  */
+static bool
+ir_lower_is_regparm (struct node* function_node)
+{
+    return !compiler_target_is_x86_64 () && \
+           !(function_node->func.flags & FUNCTION_NODE_FLAG_IS_VARIADIC);
+}
+
+/* A direct call to a function defined in this object.  */
+static bool
+ir_lower_call_is_regparm (struct ir_instruction* instruction)
+{
+    return !compiler_target_is_x86_64 () && instruction->label && \
+           !instruction->is_variadic && \
+           codegen_function_is_defined (instruction->label);
+}
+
+/* Whether the small structure `instruction` returns comes back in
+   eax and edx.  Cdecl on x86 returns every structure through a
+   hidden pointer, only the calls between our own functions use the
+   registers.  System V on x86-64 always does.  */
+static bool
+ir_lower_call_returns_in_registers (struct ir_instruction* instruction)
+{
+    return compiler_target_is_x86_64 () || ir_lower_call_is_regparm (instruction);
+}
+
+/* Same for the functions we define, for their callers from
+   elsewhere.  */
+static bool
+ir_lower_returns_in_registers (struct node* function_node)
+{
+    return compiler_target_is_x86_64 () || ir_lower_is_regparm (function_node);
+}
+
+/* Gives every spilled virtual register a slot below the locals.
+   Values whose intervals do not overlap share a slot, the intervals
+   are taken by start and a slot is free again once the instruction
+   of its last use is behind.  Returns the number of values spilled.  */
+static int
+ir_lower_assign_spill_slots (struct ir_lower* lower, int* starts, int* ends)
+{
+    int total_vregs = ir_total_vregs (lower->function);
+    int* spilled = calloc (total_vregs, sizeof (int));
+    int* slot_ends = calloc (total_vregs, sizeof (int));
+    int* slot_offsets = calloc (total_vregs, sizeof (int));
+    int total_spilled = 0;
+    int total_slots = 0;
+    for (int vreg = 1; vreg < total_vregs; vreg++)
+    {
+        if (ends[vreg] < 0 || lower->registers[vreg])
+        {
+            continue;
+        }
+
+        int i = total_spilled++;
+        for (; i > 0 && starts[spilled[i - 1]] > starts[vreg]; i--)
+        {
+            spilled[i] = spilled[i - 1];
+        }
+        spilled[i] = vreg;
+    }
+
+    for (int i = 0; i < total_spilled; i++)
+    {
+        int vreg = spilled[i];
+        int slot = 0;
+        /* Not the instruction that reads the last value, it may
+           write its result before it is done reading.  */
+        while (slot < total_slots && slot_ends[slot] / 2 >= starts[vreg] / 2)
+        {
+            slot++;
+        }
+
+        if (slot == total_slots)
+        {
+            lower->frame_size += STACK_PUSH_SIZE;
+            slot_offsets[total_slots++] = -(int) lower->frame_size;
+        }
+        slot_ends[slot] = ends[vreg];
+        lower->spill_offsets[vreg] = slot_offsets[slot];
+    }
+
+    free (spilled);
+    free (slot_ends);
+    free (slot_offsets);
+    return total_spilled;
+}
+
+/* Marks in `derived` the virtual registers holding an address within
+   `slot`.  Returns whether one of them escapes, stored somewhere,
+   passed to a call or returned, so the slot may be read at any time.  */
+static bool
+ir_lower_slot_addresses (struct ir_function* function, struct ir_slot* slot,
+                         bool* derived)
+{
+    bool escapes = false;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count (function->blocks); i++)
+        {
+            struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+            for (int j = 0; j < vector_count (block->instructions); j++)
+            {
+                struct ir_instruction* instruction = \
+                                vector_peek_ptr_at (block->instructions, j);
+                int op = instruction->op;
+                bool is_arithmetic = op == IR_OP_COPY || op == IR_OP_ADD || \
+                                     op == IR_OP_SUB || op == IR_OP_PHI || \
+                                     op == IR_OP_SELECT;
+                bool reads = false;
+                for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+                {
+                    int vreg = *ir_instruction_use_at (instruction, k);
+                    if (!vreg || !derived[vreg])
+                    {
+                        continue;
+                    }
+
+                    reads = true;
+                    /* The address of a store is fine, its value is not.  */
+                    if (!is_arithmetic && op != IR_OP_LOAD && op != IR_OP_COMPARE && \
+                        op != IR_OP_BRANCH && (op != IR_OP_STORE || k != 0))
+                    {
+                        escapes = true;
+                    }
+                }
+
+                bool is_address = (op == IR_OP_SLOT_ADDRESS && instruction->slot == slot) || \
+                                  (reads && is_arithmetic);
+                if (is_address && !derived[instruction->dst])
+                {
+                    derived[instruction->dst] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return escapes;
+}
+
+/* The hull of the positions where the memory of `slot` is in use, in
+   the units of ir_lower_intervals.  That is where an instruction names
+   the slot or reads an address within it and where such an address is
+   live, stretched over every loop it is in use around.  `slot_end`
+   is -1 when the slot is never used.  */
+static void
+ir_lower_slot_interval (struct ir_lower* lower, struct ir_slot* slot,
+                        int* starts, int* ends, int* slot_start, int* slot_end)
+{
+    struct ir_function* function = lower->function;
+    int total_vregs = ir_total_vregs (function);
+    int total_blocks = vector_count (function->blocks);
+    int* block_starts = calloc (total_blocks, sizeof (int));
+    int* block_ends = calloc (total_blocks, sizeof (int));
+    bool* derived = calloc (total_vregs, sizeof (bool));
+    bool escapes = ir_lower_slot_addresses (function, slot, derived);
+    *slot_start = INT_MAX;
+    *slot_end = -1;
+    int position = 0;
+    for (int i = 0; i < total_blocks; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        block_starts[i] = position * 2;
+        for (int j = 0; j < vector_count (block->instructions); j++, position++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            bool uses = instruction->slot == slot;
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                uses |= derived[*ir_instruction_use_at (instruction, k)];
+            }
+
+            if (uses)
+            {
+                *slot_start = position * 2 < *slot_start ? position * 2 : *slot_start;
+                *slot_end = position * 2 + 1;
+            }
+        }
+        block_ends[i] = position * 2 - 1;
+    }
+
+    if (escapes && *slot_end >= 0)
+    {
+        *slot_start = 0;
+        *slot_end = position * 2;
+    }
+
+    for (int vreg = 1; vreg < total_vregs; vreg++)
+    {
+        if (derived[vreg] && ends[vreg] >= 0)
+        {
+            *slot_start = starts[vreg] < *slot_start ? starts[vreg] : *slot_start;
+            *slot_end = ends[vreg] > *slot_end ? ends[vreg] : *slot_end;
+        }
+    }
+
+    /* What one iteration leaves in the slot the next may read.  */
+    bool changed = *slot_end >= 0;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < total_blocks; i++)
+        {
+            struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+            for (int j = 0; j < vector_count (block->successors); j++)
+            {
+                struct ir_block* successor = vector_peek_ptr_at (block->successors, j);
+                int start = block_starts[successor->order];
+                int end = block_ends[i];
+                if (successor->order > i || *slot_end < start || *slot_start > end || \
+                    (*slot_start <= start && *slot_end >= end))
+                {
+                    continue;
+                }
+
+                *slot_start = start < *slot_start ? start : *slot_start;
+                *slot_end = end > *slot_end ? end : *slot_end;
+                changed = true;
+            }
+        }
+    }
+
+    free (derived);
+    free (block_starts);
+    free (block_ends);
+}
+
+/* Whether `a` and `b` are locals of scopes that never are open at
+   the same time, which the parser gave overlapping bytes.  Their
+   addresses may escape, the objects still end with their scope.  */
+static bool
+ir_lower_in_sibling_scopes (struct ir_slot* a, struct ir_slot* b)
+{
+    if (!a->var_node || !b->var_node)
+    {
+        return false;
+    }
+
+    int a_offset = a->var_node->var.aoffset;
+    int b_offset = b->var_node->var.aoffset;
+    return a_offset < b_offset + (int) b->size && b_offset < a_offset + (int) a->size;
+}
+
+/* Places the slots of the locals and of the temporaries below the
+   frame laid out so far.  Slots in use at the same time get disjoint
+   bytes, the others may share them: every slot, taken by the start of
+   its interval, goes to the first offset no slot it overlaps with
+   covers.  */
+static void
+ir_lower_place_slots (struct ir_lower* lower, int* starts, int* ends)
+{
+    struct ir_function* function = lower->function;
+    int total_slots = vector_count (function->slots);
+    struct ir_slot** placed = calloc (total_slots, sizeof (struct ir_slot*));
+    int* slot_starts = calloc (total_slots, sizeof (int));
+    int* slot_ends = calloc (total_slots, sizeof (int));
+    int total_placed = 0;
+    for (int i = 0; i < total_slots; i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        int start = 0;
+        int end = 0;
+        if (slot->promoted || slot->argument >= 0)
+        {
+            continue;
+        }
+
+        ir_lower_slot_interval (lower, slot, starts, ends, &start, &end);
+        if (end < 0)
+        {
+            continue;
+        }
+
+        int j = total_placed++;
+        for (; j > 0 && slot_starts[j - 1] > start; j--)
+        {
+            placed[j] = placed[j - 1];
+            slot_starts[j] = slot_starts[j - 1];
+            slot_ends[j] = slot_ends[j - 1];
+        }
+        placed[j] = slot;
+        slot_starts[j] = start;
+        slot_ends[j] = end;
+    }
+
+    int base = (int) lower->frame_size;
+    for (int i = 0; i < total_placed; i++)
+    {
+        struct ir_slot* slot = placed[i];
+        int size = (int) slot->size;
+        int alignment = 1;
+        while (alignment < size && alignment < STACK_PUSH_SIZE)
+        {
+            alignment *= 2;
+        }
+
+        /* The slot covers the `size` bytes from `-distance` on.  */
+        int distance = align_value (base + size, alignment);
+        for (int j = 0; j < i; j++)
+        {
+            struct ir_slot* other = placed[j];
+            if (slot_ends[j] < slot_starts[i] || slot_starts[j] > slot_ends[i] || \
+                ir_lower_in_sibling_scopes (slot, other) || \
+                -distance + size <= other->offset || \
+                other->offset + (int) other->size <= -distance)
+            {
+                continue;
+            }
+
+            distance = align_value (-other->offset + size, alignment);
+            j = -1;
+        }
+
+        slot->offset = -distance;
+        if ((size_t) distance > lower->frame_size)
+        {
+            lower->frame_size = distance;
+        }
+    }
+
+    free (placed);
+    free (slot_starts);
+    free (slot_ends);
+}
+
+/* Decides where every value lives and how big the frame gets.  */
+static void
+ir_lower_allocate (struct ir_lower* lower)
+{
+    struct ir_function* function = lower->function;
+    int total_vregs = ir_total_vregs (function);
+    int* use_counts = calloc (total_vregs, sizeof (int));
+    lower->rematerialized = calloc (total_vregs, sizeof (struct ir_instruction*));
+    lower->select_compares = calloc (total_vregs, sizeof (struct ir_instruction*));
+    lower->registers = calloc (total_vregs, sizeof (const char*));
+    lower->spill_offsets = calloc (total_vregs, sizeof (int));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        block->label_id = codegen_label_count ();
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (ir_lower_is_rematerialized (instruction->op))
+            {
+                lower->rematerialized[instruction->dst] = instruction;
+            }
+
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                use_counts[*ir_instruction_use_at (instruction, k)]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->op == IR_OP_CALL && !use_counts[instruction->dst])
+            {
+                instruction->dst = 0;
+            }
+        }
+    }
+    ir_lower_fuse_compares (function, use_counts);
+    ir_lower_fuse_selects (lower, use_counts);
+
+    lower->frame_size = 0;
+    for (int i = 0; i < vector_count (function->slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        int total_registers = lower->convention.total_registers;
+        if (!total_registers || slot->argument < 0)
+        {
+            continue;
+        }
+
+        /* Past the saved frame pointer and the return address, or a
+           home in the frame for the ones passed in registers.  */
+        if (slot->argument >= total_registers)
+        {
+            slot->offset = (2 + slot->argument - total_registers) * STACK_PUSH_SIZE;
+        }
+        else if (!slot->promoted)
+        {
+            lower->frame_size = align_value (lower->frame_size, STACK_PUSH_SIZE) + \
+                                STACK_PUSH_SIZE;
+            slot->offset = -(int) lower->frame_size;
+        }
+    }
+
+    int* starts = calloc (total_vregs, sizeof (int));
+    int* ends = calloc (total_vregs, sizeof (int));
+    ir_lower_intervals (lower, starts, ends);
+    ir_lower_place_slots (lower, starts, ends);
+    struct vector* intervals = vector_create (sizeof (struct regalloc_interval*));
+    if (!(function->process->flags & COMPILE_PROCESS_FLAG_NO_REGISTER_ALLOCATION))
+    {
+        lower->regalloc = regalloc_new (lower->node);
+        if (lower->omits_frame_pointer)
+        {
+            regalloc_free_frame_register (lower->regalloc);
+        }
+        for (int vreg = 1; vreg < total_vregs; vreg++)
+        {
+            if (ends[vreg] < 0)
+            {
+                continue;
+            }
+
+            struct regalloc_interval* interval = \
+                    regalloc_add_interval (lower->regalloc, vreg,
+                                           starts[vreg], ends[vreg]);
+            vector_push (intervals, &interval);
+        }
+        regalloc_allocate (lower->regalloc);
+    }
+
+    for (int i = 0; i < vector_count (intervals); i++)
+    {
+        struct regalloc_interval* interval = vector_peek_ptr_at (intervals, i);
+        lower->registers[interval->vreg] = interval->reg;
+    }
+
+    size_t locals_size = lower->frame_size;
+    lower->frame_size = align_value (lower->frame_size, STACK_PUSH_SIZE);
+    size_t spills_start = lower->frame_size;
+    int total_spilled = ir_lower_assign_spill_slots (lower, starts, ends);
+    size_t total_slots = (lower->frame_size - spills_start) / STACK_PUSH_SIZE;
+
+    for (int i = 0; lower->regalloc && i < lower->regalloc->total_registers; i++)
+    {
+        if (lower->regalloc->used_registers & (1 << i))
+        {
+            lower->saved_size += STACK_PUSH_SIZE;
+        }
+    }
+
+    if (compiler_target_is_x86_64 () && !lower->omits_frame_pointer)
+    {
+        /* rsp is 16 byte aligned at every call, the return address
+           and the saved rbp take 16 already.  */
+        lower->frame_size = align_value (lower->frame_size + lower->saved_size, 16) - \
+                            lower->saved_size;
+    }
+
+    compiler_report (function->process, "stack: %s: %lu bytes, %lu of locals, "
+                     "%i values spilled to %lu slots", lower->node->func.name,
+                     (unsigned long) lower->frame_size, (unsigned long) locals_size,
+                     total_spilled, (unsigned long) total_slots);
+
+    vector_free (intervals);
+    free (starts);
+    free (ends);
+    free (use_counts);
+}
+
+/* Writes the operand of `vreg` to `out` as `size` bytes, its register,
+   its stack slot or the constant.  Addresses and constants too big
+   for an immediate are computed in `scratch`.  */
+static void
+ir_lower_operand (struct ir_lower* lower, int vreg, const char* scratch,
+                  size_t size, char* out)
+{
+    char address[64];
+    struct ir_instruction* definition = lower->rematerialized[vreg];
+    if (definition)
+    {
+        switch (definition->op)
+        {
+            case IR_OP_CONST:
+                if (ir_lower_fits_immediate (definition->imm))
+                {
+                    sprintf (out, "%lld", definition->imm);
+                    return;
+                }
+                asm_push ("mov %s, %lld", ir_lower_sized (scratch, DATA_SIZE_DDWORD),
+                          definition->imm);
+                sprintf (out, "%s", ir_lower_sized (scratch, size));
+                return;
+
+            case IR_OP_ADDRESS:
+                if (compiler_target_is_x86_64 ())
+                {
+                    /* Relative to rip, there are no 64-bit immediates
+                       in most instructions.  */
+                    asm_push ("lea %s, [$%s%+lld]", ir_lower_sized (scratch, DATA_SIZE_DDWORD),
+                              definition->label, definition->imm);
+                    sprintf (out, "%s", ir_lower_sized (scratch, size));
+                    return;
+                }
+
+                if (definition->imm)
+                {
+                    sprintf (out, "$%s%+lld", definition->label, definition->imm);
+                    return;
+                }
+                sprintf (out, "$%s", definition->label);
+                return;
+
+            case IR_OP_SLOT_ADDRESS:
+                ir_lower_frame_address (lower, definition->slot->offset, address);
+                asm_push ("lea %s, %s", ir_lower_sized (scratch, DATA_SIZE_POINTER),
+                          address);
+                sprintf (out, "%s", ir_lower_sized (scratch, size));
+                return;
+        }
+    }
+
+    if (lower->registers[vreg])
+    {
+        sprintf (out, "%s", ir_lower_sized (lower->registers[vreg], size));
+        return;
+    }
+
+    ir_lower_frame_address (lower, lower->spill_offsets[vreg], address);
+    sprintf (out, "%s %s", codegen_size_keyword (size), address);
+}
+
+/* Register of `vreg`, NULL if it is in memory or rematerialized.  */
+static const char*
+ir_lower_register (struct ir_lower* lower, int vreg)
+{
+    return lower->rematerialized[vreg] ? NULL : lower->registers[vreg];
+}
+
+/* `vreg` can be an immediate operand.  */
+static bool
+ir_lower_is_constant (struct ir_lower* lower, int vreg)
+{
+    struct ir_instruction* definition = lower->rematerialized[vreg];
+    if (!definition || definition->op == IR_OP_SLOT_ADDRESS)
+    {
+        return false;
+    }
+
+    if (definition->op == IR_OP_ADDRESS)
+    {
+        return !compiler_target_is_x86_64 ();
+    }
+
+    return ir_lower_fits_immediate (definition->imm);
+}
+
+/* Loads `size` bytes of `vreg` into `reg`.  */
+static void
+ir_lower_move (struct ir_lower* lower, const char* reg, int vreg, size_t size)
+{
+    char operand[64];
+    struct ir_instruction* definition = lower->rematerialized[vreg];
+    if (size == DATA_SIZE_DDWORD && definition && definition->op == IR_OP_CONST && \
+        definition->imm >= 0 && definition->imm <= UINT_MAX)
+    {
+        /* Writing the low half clears the high one, the shorter
+           encoding.  */
+        size = DATA_SIZE_DWORD;
+    }
+
+    reg = ir_lower_sized (reg, size);
+    ir_lower_operand (lower, vreg, reg, size, operand);
+    if (!S_EQ (operand, reg))
+    {
+        asm_push ("mov %s, %s", reg, operand);
+    }
+}
+
+/* Register to compute the value of `dst` in.  */
+static const char*
+ir_lower_work_register (struct ir_lower* lower, int dst)
+{
+    const char* reg = ir_lower_register (lower, dst);
+    return ir_lower_sized (reg ? reg : "eax", ir_lower_size (lower, dst));
+}
+
+/* Stores `reg` into `dst` unless the value was computed in place.  */
+static void
+ir_lower_write (struct ir_lower* lower, int dst, const char* reg)
+{
+    char operand[64];
+    ir_lower_operand (lower, dst, NULL, ir_lower_size (lower, dst), operand);
+    if (!S_EQ (operand, reg))
+    {
+        asm_push ("mov %s, %s", operand, reg);
+    }
+}
+
+static const char*
+ir_lower_arithmetic_instruction (int op)
+{
+    switch (op)
+    {
+        case IR_OP_ADD:
+            return "add";
+        case IR_OP_SUB:
+            return "sub";
+        case IR_OP_MUL:
+            return "imul";
+        case IR_OP_AND:
+            return "and";
+        case IR_OP_OR:
+            return "or";
+        case IR_OP_XOR:
+            return "xor";
+        case IR_OP_SHL:
+            return "shl";
+        case IR_OP_SHR:
+            return "shr";
+        case IR_OP_SAR:
+            return "sar";
+    }
+
+    return NULL;
+}
+
+/* Shift of the power of two `value`, -1 if it is none.  */
+static int
+ir_lower_log2 (unsigned long long value)
+{
+    if (!value || (value & (value - 1)))
+    {
+        return -1;
+    }
+
+    int shift = 0;
+    while (value >>= 1)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+/* Multiplies by a constant with shifts and lea where they do, false
+   if imul is as good.  Factors of 3, 5 and 9 are an lea of the value
+   and its index scaled by 2, 4 or 8.  */
+static bool
+ir_lower_multiply_constant (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    int a = instruction->args[0];
+    int b = instruction->args[1];
+    if (!lower->rematerialized[b] || lower->rematerialized[b]->op != IR_OP_CONST)
+    {
+        a = instruction->args[1];
+        b = instruction->args[0];
+    }
+
+    struct ir_instruction* definition = lower->rematerialized[b];
+    if (!definition || definition->op != IR_OP_CONST)
+    {
+        return false;
+    }
+
+    size_t size = ir_lower_size (lower, instruction->dst);
+    long long value = size == DATA_SIZE_DDWORD ? definition->imm : (int) definition->imm;
+    int factor = value % 9 == 0 ? 9 : value % 5 == 0 ? 5 : value % 3 == 0 ? 3 : 1;
+    int shift = ir_lower_log2 (value / factor);
+    if ((value != -1 && (value <= 0 || shift < 0)) || (size != DATA_SIZE_DWORD && \
+                                                      size != DATA_SIZE_DDWORD))
+    {
+        return false;
+    }
+
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    const char* source = ir_lower_register (lower, a);
+    if (factor == 1 || !source)
+    {
+        ir_lower_move (lower, work, a, size);
+        source = work;
+    }
+
+    if (value == -1)
+    {
+        asm_push ("neg %s", work);
+    }
+    else if (factor != 1)
+    {
+        const char* address = ir_lower_sized (source, DATA_SIZE_POINTER);
+        asm_push ("lea %s, [%s+%s*%i]", work, address, address, factor - 1);
+    }
+
+    if (shift > 0)
+    {
+        asm_push ("shl %s, %i", work, shift);
+    }
+    ir_lower_write (lower, instruction->dst, work);
+    return true;
+}
+
+static void
+ir_lower_arithmetic (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    if (instruction->op == IR_OP_MUL && ir_lower_multiply_constant (lower, instruction))
+    {
+        return;
+    }
+
+    char operand[64];
+    int a = instruction->args[0];
+    int b = instruction->args[1];
+    size_t size = ir_lower_size (lower, instruction->dst);
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    const char* b_reg = ir_lower_register (lower, b);
+    bool is_commutative = instruction->op != IR_OP_SUB && \
+                          instruction->op != IR_OP_SHL && \
+                          instruction->op != IR_OP_SHR && \
+                          instruction->op != IR_OP_SAR;
+    if (b_reg && ir_lower_same_register (b_reg, work) && a != b)
+    {
+        if (is_commutative)
+        {
+            b = instruction->args[0];
+            a = instruction->args[1];
+        }
+        else
+        {
+            work = ir_lower_sized ("eax", size);
+        }
+    }
+
+    ir_lower_move (lower, work, a, size);
+    const char* name = ir_lower_arithmetic_instruction (instruction->op);
+    if (instruction->op == IR_OP_SHL || instruction->op == IR_OP_SHR || \
+        instruction->op == IR_OP_SAR)
+    {
+        if (lower->rematerialized[b] && lower->rematerialized[b]->op == IR_OP_CONST)
+        {
+            asm_push ("%s %s, %lld", name, work,
+                      lower->rematerialized[b]->imm & (long long) (size * 8 - 1));
+        }
+        else
+        {
+            ir_lower_move (lower, "ecx", b, DATA_SIZE_DWORD);
+            asm_push ("%s %s, cl", name, work);
+        }
+    }
+    else
+    {
+        ir_lower_operand (lower, b, "ecx", size, operand);
+        asm_push ("%s %s, %s", name, work, operand);
+    }
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+/* Multiplier and shift dividing a `bits` wide integer by a constant,
+   from Hacker's Delight.  The arithmetic is that of `bits` wide
+   unsigned integers, each step wraps around as they would.  An
+   unsigned multiplier that would need one bit more sets `is_wide`
+   and has its top bit added back in afterwards.  */
+struct ir_lower_magic
+{
+    unsigned long long multiplier;
+    int shift;
+    bool is_wide;
+};
+
+/* `divisor` is not 0, 1 or -1.  */
+static struct ir_lower_magic
+ir_lower_signed_magic (long long divisor, int bits)
+{
+    const unsigned long long mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    const unsigned long long two = 1ULL << (bits - 1);
+    unsigned long long absolute = (divisor < 0 ? -(unsigned long long) divisor : \
+                                                 (unsigned long long) divisor) & mask;
+    unsigned long long t = two + (((unsigned long long) divisor & mask) >> (bits - 1));
+    unsigned long long anc = t - 1 - t % absolute;
+    unsigned long long q1 = two / anc;
+    unsigned long long r1 = two - q1 * anc;
+    unsigned long long q2 = two / absolute;
+    unsigned long long r2 = two - q2 * absolute;
+    unsigned long long delta;
+    int p = bits - 1;
+    do
+    {
+        p++;
+        q1 = q1 * 2 & mask;
+        r1 = r1 * 2 & mask;
+        if (r1 >= anc)
+        {
+            q1 = (q1 + 1) & mask;
+            r1 -= anc;
+        }
+
+        q2 = q2 * 2 & mask;
+        r2 = r2 * 2 & mask;
+        if (r2 >= absolute)
+        {
+            q2 = (q2 + 1) & mask;
+            r2 -= absolute;
+        }
+        delta = absolute - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    struct ir_lower_magic magic = {.multiplier=(q2 + 1) & mask, .shift=p - bits};
+    if (divisor < 0)
+    {
+        magic.multiplier = -magic.multiplier & mask;
+    }
+    return magic;
+}
+
+/* `divisor` is neither 0 nor a power of two.  */
+static struct ir_lower_magic
+ir_lower_unsigned_magic (unsigned long long divisor, int bits)
+{
+    const unsigned long long mask = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+    const unsigned long long two = 1ULL << (bits - 1);
+    struct ir_lower_magic magic = {0};
+    unsigned long long nc = mask - (-divisor & mask) % divisor;
+    unsigned long long q1 = two / nc;
+    unsigned long long r1 = two - q1 * nc;
+    unsigned long long q2 = (two - 1) / divisor;
+    unsigned long long r2 = (two - 1) - q2 * divisor;
+    unsigned long long delta;
+    int p = bits - 1;
+    do
+    {
+        p++;
+        if (r1 >= nc - r1)
+        {
+            q1 = (2 * q1 + 1) & mask;
+            r1 = (2 * r1 - nc) & mask;
+        }
+        else
+        {
+            q1 = 2 * q1 & mask;
+            r1 = 2 * r1 & mask;
+        }
+
+        if (r2 + 1 >= divisor - r2)
+        {
+            magic.is_wide |= q2 >= two - 1;
+            q2 = (2 * q2 + 1) & mask;
+            r2 = (2 * r2 + 1 - divisor) & mask;
+        }
+        else
+        {
+            magic.is_wide |= q2 >= two;
+            q2 = 2 * q2 & mask;
+            r2 = (2 * r2 + 1) & mask;
+        }
+        delta = divisor - 1 - r2;
+    } while (p < 2 * bits && (q1 < delta || (q1 == delta && r1 == 0)));
+
+    magic.multiplier = (q2 + 1) & mask;
+    magic.shift = p - bits;
+    return magic;
+}
+
+/* Divides by a power of two, `divisor` is 1 << shift or its
+   negation if signed.  Signed quotients round towards zero, so
+   negative dividends get the divisor less one added first.  */
+static void
+ir_lower_division_by_power (struct ir_lower* lower, struct ir_instruction* instruction,
+                            long long divisor, int shift, bool is_signed,
+                            bool is_remainder)
+{
+    size_t size = ir_lower_size (lower, instruction->dst);
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    long long mask = ((long long) 1 << shift) - 1;
+    if (is_remainder && !shift)
+    {
+        asm_push ("xor %s, %s", ir_lower_sized (work, DATA_SIZE_DWORD),
+                  ir_lower_sized (work, DATA_SIZE_DWORD));
+    }
+    else if (!is_signed)
+    {
+        ir_lower_move (lower, work, instruction->args[0], size);
+        if (is_remainder)
+        {
+            asm_push ("and %s, %lld", work, mask);
+        }
+        else if (shift)
+        {
+            asm_push ("shr %s, %i", work, shift);
+        }
+    }
+    else if (!shift)
+    {
+        ir_lower_move (lower, work, instruction->args[0], size);
+    }
+    else
+    {
+        const char* eax = ir_lower_sized ("eax", size);
+        const char* edx = ir_lower_sized ("edx", size);
+        work = eax;
+        ir_lower_move (lower, eax, instruction->args[0], size);
+        asm_push (size == DATA_SIZE_DDWORD ? "cqo" : "cdq");
+        asm_push ("and %s, %lld", edx, mask);
+        asm_push ("add %s, %s", eax, edx);
+        if (is_remainder)
+        {
+            asm_push ("and %s, %lld", eax, mask);
+            asm_push ("sub %s, %s", eax, edx);
+        }
+        else
+        {
+            asm_push ("sar %s, %i", eax, shift);
+        }
+    }
+
+    if (is_signed && divisor < 0 && !is_remainder)
+    {
+        asm_push ("neg %s", work);
+    }
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+/* Divides a dword or a qword by a constant with the high half of a
+   multiply, the remainder is what the quotient times the divisor
+   falls short of the dividend.  */
+static void
+ir_lower_division_by_magic (struct ir_lower* lower, struct ir_instruction* instruction,
+                            long long divisor, bool is_signed, bool is_remainder)
+{
+    size_t size = ir_lower_size (lower, instruction->dst);
+    int bits = (int) size * 8;
+    struct ir_lower_magic magic = is_signed ? ir_lower_signed_magic (divisor, bits) : \
+                                              ir_lower_unsigned_magic (divisor, bits);
+    /* The multiplier as the immediate of a `bits` wide mov.  */
+    long long multiplier = bits == 64 ? (long long) magic.multiplier : \
+                                        (int) magic.multiplier;
+    const char* eax = ir_lower_sized ("eax", size);
+    const char* ecx = ir_lower_sized ("ecx", size);
+    const char* edx = ir_lower_sized ("edx", size);
+    const char* quotient = edx;
+    ir_lower_move (lower, ecx, instruction->args[0], size);
+    asm_push ("mov %s, %lld", eax, multiplier);
+    asm_push (is_signed ? "imul %s" : "mul %s", ecx);
+    if (is_signed)
+    {
+        if (divisor > 0 && multiplier < 0)
+        {
+            asm_push ("add %s, %s", edx, ecx);
+        }
+        else if (divisor < 0 && multiplier > 0)
+        {
+            asm_push ("sub %s, %s", edx, ecx);
+        }
+
+        if (magic.shift)
+        {
+            asm_push ("sar %s, %i", edx, magic.shift);
+        }
+        /* Negative quotients are one short.  */
+        asm_push ("mov %s, %s", eax, edx);
+        asm_push ("shr %s, %i", eax, bits - 1);
+        asm_push ("add %s, %s", eax, edx);
+        quotient = eax;
+    }
+    else if (magic.is_wide)
+    {
+        asm_push ("mov %s, %s", eax, ecx);
+        asm_push ("sub %s, %s", eax, edx);
+        asm_push ("shr %s, 1", eax);
+        asm_push ("add %s, %s", eax, edx);
+        if (magic.shift > 1)
+        {
+            asm_push ("shr %s, %i", eax, magic.shift - 1);
+        }
+        quotient = eax;
+    }
+    else if (magic.shift)
+    {
+        asm_push ("shr %s, %i", edx, magic.shift);
+    }
+
+    if (is_remainder)
+    {
+        asm_push ("imul %s, %s, %lld", quotient, quotient, divisor);
+        asm_push ("sub %s, %s", ecx, quotient);
+        quotient = ecx;
+    }
+    ir_lower_write (lower, instruction->dst, quotient);
+}
+
+/* Divides by a constant without div where it can, false if it
+   can't.  The divisor has to fit the immediate of the multiply that
+   gives back the remainder.  */
+static bool
+ir_lower_division_by_constant (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    struct ir_instruction* definition = lower->rematerialized[instruction->args[1]];
+    size_t size = ir_lower_size (lower, instruction->dst);
+    if (!definition || definition->op != IR_OP_CONST || \
+        (size != DATA_SIZE_DWORD && size != DATA_SIZE_DDWORD))
+    {
+        return false;
+    }
+
+    bool is_signed = instruction->op == IR_OP_DIV || instruction->op == IR_OP_MOD;
+    bool is_remainder = instruction->op == IR_OP_MOD || \
+                        instruction->op == IR_OP_UMOD;
+    long long divisor = definition->imm;
+    if (size == DATA_SIZE_DWORD && is_signed)
+    {
+        divisor = (int) divisor;
+    }
+    else if (size == DATA_SIZE_DWORD)
+    {
+        divisor = (unsigned int) divisor;
+    }
+
+    unsigned long long absolute = is_signed && divisor < 0 ? -(unsigned long long) divisor : \
+                                                             (unsigned long long) divisor;
+    int shift = ir_lower_log2 (absolute);
+    if (shift >= 0 && shift < 32)
+    {
+        ir_lower_division_by_power (lower, instruction, divisor, shift, is_signed,
+                                    is_remainder);
+        return true;
+    }
+
+    /* Unsigned divisors past the sign bit have no immediate for the
+       remainder, their quotients are 0 or 1 anyway.  */
+    if (!divisor || divisor > INT_MAX || divisor < INT_MIN)
+    {
+        return false;
+    }
+
+    ir_lower_division_by_magic (lower, instruction, divisor, is_signed,
+                                is_remainder);
+    return true;
+}
+
+static void
+ir_lower_division (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    if (ir_lower_division_by_constant (lower, instruction))
+    {
+        return;
+    }
+
+    char divisor[64];
+    size_t size = ir_lower_size (lower, instruction->dst);
+    bool is_signed = instruction->op == IR_OP_DIV || instruction->op == IR_OP_MOD;
+    ir_lower_move (lower, "eax", instruction->args[0], size);
+    if (ir_lower_register (lower, instruction->args[1]))
+    {
+        sprintf (divisor, "%s", ir_lower_sized (ir_lower_register (lower, instruction->args[1]),
+                                                size));
+    }
+    else
+    {
+        ir_lower_move (lower, "ecx", instruction->args[1], size);
+        sprintf (divisor, "%s", ir_lower_sized ("ecx", size));
+    }
+
+    if (is_signed)
+    {
+        asm_push (size == DATA_SIZE_DDWORD ? "cqo" : "cdq");
+        asm_push ("idiv %s", divisor);
+    }
+    else
+    {
+        asm_push ("xor edx, edx");
+        asm_push ("div %s", divisor);
+    }
+
+    bool is_remainder = instruction->op == IR_OP_MOD || \
+                        instruction->op == IR_OP_UMOD;
+    ir_lower_write (lower, instruction->dst,
+                    ir_lower_sized (is_remainder ? "edx" : "eax", size));
+}
+
+/* Sets the flags for the low `size` bytes of `a` compared to `b`.  */
+static void
+ir_lower_compare_flags (struct ir_lower* lower, int a, int b, size_t size)
+{
+    char left[64];
+    char right[64];
+    const char* a_reg = ir_lower_register (lower, a);
+    bool b_is_immediate = ir_lower_register (lower, b) || \
+                          ir_lower_is_constant (lower, b);
+    if (a_reg)
+    {
+        sprintf (left, "%s", ir_lower_sized (a_reg, size));
+    }
+    else if (!lower->rematerialized[a] && b_is_immediate)
+    {
+        /* Spilled, compared in memory.  */
+        ir_lower_operand (lower, a, NULL, size, left);
+    }
+    else
+    {
+        ir_lower_move (lower, "eax", a, size);
+        sprintf (left, "%s", ir_lower_sized ("eax", size));
+    }
+
+    ir_lower_operand (lower, b, "ecx", size, right);
+    asm_push ("cmp %s, %s", left, right);
+}
+
+static void
+ir_lower_compare (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    if (lower->select_compares[instruction->dst] == instruction)
+    {
+        return;
+    }
+
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    ir_lower_compare_flags (lower, instruction->args[0], instruction->args[1],
+                            ir_lower_instruction_size (instruction));
+    asm_push ("set%s al", ir_condition_codes[instruction->condition]);
+    asm_push ("movzx %s, al", work);
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+static void
+ir_lower_unary (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    ir_lower_move (lower, work, instruction->args[0],
+                   ir_lower_size (lower, instruction->dst));
+    asm_push ("%s %s", instruction->op == IR_OP_NEG ? "neg" : "not", work);
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+/* An int made a long, the high half is filled even when the value
+   stays in its register.  */
+static void
+ir_lower_extend_dword (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    char operand[64];
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    struct ir_instruction* definition = lower->rematerialized[instruction->args[0]];
+    if (definition && definition->op == IR_OP_CONST)
+    {
+        asm_push ("mov %s, %lld", work, instruction->is_signed ? \
+                  (long long) (int) definition->imm : \
+                  (long long) (unsigned int) definition->imm);
+    }
+    else if (instruction->is_signed)
+    {
+        ir_lower_operand (lower, instruction->args[0], "eax", DATA_SIZE_DWORD, operand);
+        asm_push ("movsxd %s, %s", work, operand);
+    }
+    else
+    {
+        ir_lower_operand (lower, instruction->args[0], "eax", DATA_SIZE_DWORD, operand);
+        asm_push ("mov %s, %s", ir_lower_sized (work, DATA_SIZE_DWORD), operand);
+    }
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+static void
+ir_lower_extend (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    if (instruction->size == DATA_SIZE_DWORD)
+    {
+        ir_lower_extend_dword (lower, instruction);
+        return;
+    }
+
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    ir_lower_move (lower, "eax", instruction->args[0], DATA_SIZE_DWORD);
+    asm_push ("%s %s, %s", instruction->is_signed ? "movsx" : "movzx", work,
+              instruction->size == DATA_SIZE_BYTE ? "al" : "ax");
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+/* Memory operand of `base` + `offset`, `base` is loaded into ecx
+   when it is not in a register.  */
+static void
+ir_lower_address (struct ir_lower* lower, int base, long long offset, char* out)
+{
+    struct ir_instruction* definition = lower->rematerialized[base];
+    if (definition && definition->op == IR_OP_ADDRESS)
+    {
+        sprintf (out, "[$%s%+lld]", definition->label, definition->imm + offset);
+        return;
+    }
+
+    if (definition && definition->op == IR_OP_SLOT_ADDRESS)
+    {
+        ir_lower_frame_address (lower, definition->slot->offset + offset, out);
+        return;
+    }
+
+    const char* reg = ir_lower_register (lower, base);
+    if (!reg)
+    {
+        ir_lower_move (lower, "ecx", base, DATA_SIZE_POINTER);
+        reg = "ecx";
+    }
+    sprintf (out, "[%s%+lld]", ir_lower_sized (reg, DATA_SIZE_POINTER), offset);
+}
+
+static void
+ir_lower_load_from (struct ir_lower* lower, int dst, const char* address,
+                    size_t size, bool is_signed)
+{
+    const char* work = ir_lower_work_register (lower, dst);
+    if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
+    {
+        asm_push ("%s %s, %s %s", is_signed ? "movsx" : "movzx",
+                  ir_lower_sized (work, DATA_SIZE_DWORD), codegen_size_keyword (size),
+                  address);
+    }
+    else
+    {
+        work = ir_lower_sized (work, size);
+        asm_push ("mov %s, %s %s", work, codegen_size_keyword (size), address);
+    }
+    ir_lower_write (lower, dst, ir_lower_sized (work, ir_lower_size (lower, dst)));
+}
+
+static void
+ir_lower_store_to (struct ir_lower* lower, const char* address, size_t size,
+                   int value)
+{
+    char operand[64];
+    if (size != DATA_SIZE_BYTE && size != DATA_SIZE_WORD && \
+        (ir_lower_register (lower, value) || ir_lower_is_constant (lower, value)))
+    {
+        ir_lower_operand (lower, value, NULL, size, operand);
+        asm_push ("mov %s %s, %s", codegen_size_keyword (size), address, operand);
+        return;
+    }
+
+    ir_lower_move (lower, "eax", value, size < DATA_SIZE_DWORD ? DATA_SIZE_DWORD : size);
+    asm_push ("mov %s %s, %s", codegen_size_keyword (size), address,
+              ir_lower_sized ("eax", size));
+}
+
+/* The arguments past the registers of `convention` are pushed, right
+   to left, the others are moved to their register.  On x86-64 the
+   pushes keep rsp 16 byte aligned, unless they are `is_sibling` and
+   only go through the stack on their way to our own arguments.
+   Returns how much to give back after the call.  */
+static size_t
+ir_lower_arguments (struct ir_lower* lower, struct ir_instruction* instruction,
+                    struct ir_lower_convention* convention, bool is_sibling)
+{
+    char operand[64];
+    int total = vector_count (instruction->call_args);
+    int total_registers = convention->total_registers;
+    size_t pushed = 0;
+    if (compiler_target_is_x86_64 () && !is_sibling && total > total_registers && \
+        (total - total_registers) % 2)
+    {
+        asm_push ("sub rsp, %i", STACK_PUSH_SIZE);
+        stack_frame_sub (lower->node, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                         "call_argument_padding", STACK_PUSH_SIZE);
+        pushed += STACK_PUSH_SIZE;
+    }
+
+    for (int i = total - 1; i >= total_registers; i--)
+    {
+        ir_lower_operand (lower, *(int*) vector_at (instruction->call_args, i),
+                          "eax", STACK_PUSH_SIZE, operand);
+        asm_push_ins_push (operand, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                           "call_argument");
+        pushed += STACK_PUSH_SIZE;
+    }
+
+    /* Values live in callee saved registers or in memory, never in
+       an argument register.  */
+    for (int i = 0; i < total && i < total_registers; i++)
+    {
+        int vreg = *(int*) vector_at (instruction->call_args, i);
+        ir_lower_move (lower, convention->registers[i], vreg,
+                       ir_lower_size (lower, vreg));
+    }
+
+    return pushed;
+}
+
+/* Moves `size` bytes between `reg` and `address`, `size` is one of
+   the sizes of a register.  */
+static void
+ir_lower_load_part (const char* reg, const char* address, size_t size)
+{
+    if (size == DATA_SIZE_BYTE || size == DATA_SIZE_WORD)
+    {
+        asm_push ("movzx %s, %s %s", ir_lower_sized (reg, DATA_SIZE_DWORD),
+                  codegen_size_keyword (size), address);
+        return;
+    }
+
+    asm_push ("mov %s, %s %s", ir_lower_sized (reg, size), codegen_size_keyword (size),
+              address);
+}
+
+/* A small structure is in eax and edx, the low word first.  */
+static size_t
+ir_lower_struct_part (size_t size, int part)
+{
+    size_t word = STACK_PUSH_SIZE;
+    if (!part)
+    {
+        return size < word ? size : word;
+    }
+    return size > word ? size - word : 0;
+}
+
+/* Stores the small structure of `size` bytes in eax and edx to where
+   `pointer` points and returns that pointer in eax, as a function
+   returning it through a hidden pointer does.  */
+static void
+ir_lower_store_struct (const char* pointer, size_t size)
+{
+    for (int part = 0; part < 2; part++)
+    {
+        size_t part_size = ir_lower_struct_part (size, part);
+        if (part_size)
+        {
+            asm_push ("mov %s [%s+%i], %s", codegen_size_keyword (part_size),
+                      pointer, part * STACK_PUSH_SIZE,
+                      ir_lower_sized (part ? "edx" : "eax", part_size));
+        }
+    }
+    asm_push ("mov eax, %s", pointer);
+}
+
+static void
+ir_lower_call (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    char address[64];
+    bool is_regparm = ir_lower_call_is_regparm (instruction);
+    struct ir_lower_convention convention = ir_lower_convention_for (is_regparm);
+    size_t pushed = ir_lower_arguments (lower, instruction, &convention, false);
+    bool through_pointer = instruction->is_struct && \
+                           !ir_lower_call_returns_in_registers (instruction);
+    if (through_pointer)
+    {
+        /* The hidden pointer to the result goes last, the callee
+           pops it and stores the structure there itself.  */
+        ir_lower_frame_address (lower, instruction->slot->offset, address);
+        asm_push ("lea eax, %s", address);
+        asm_push_ins_push ("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                           "call_struct_pointer");
+    }
+
+    if (compiler_target_is_x86_64 () && instruction->is_variadic)
+    {
+        /* al holds how many vector registers carry arguments.  */
+        asm_push ("xor eax, eax");
+    }
+
+    struct ir_instruction* target = lower->rematerialized[instruction->args[0]];
+    if (is_regparm)
+    {
+        asm_push ("call $%s.regparm", instruction->label);
+    }
+    else if (instruction->label)
+    {
+        asm_push ("call $%s", instruction->label);
+    }
+    else if (target && target->op == IR_OP_ADDRESS && !target->imm)
+    {
+        asm_push ("call $%s", target->label);
+    }
+    else if (compiler_target_is_x86_64 ())
+    {
+        ir_lower_move (lower, "r11", instruction->args[0], DATA_SIZE_DDWORD);
+        asm_push ("call r11");
+    }
+    else
+    {
+        ir_lower_move (lower, "eax", instruction->args[0], DATA_SIZE_DWORD);
+        asm_push ("call eax");
+    }
+
+    if (pushed)
+    {
+        asm_push ("add %s, %lu", ir_lower_stack_register (), (unsigned long) pushed);
+        stack_frame_add (lower->node, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                         "call_argument", pushed);
+    }
+
+    if (through_pointer)
+    {
+        stack_frame_add (lower->node, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                         "call_struct_pointer", STACK_PUSH_SIZE);
+    }
+
+    for (int part = 0; instruction->is_struct && !through_pointer && part < 2; part++)
+    {
+        size_t size = ir_lower_struct_part (instruction->size, part);
+        if (size)
+        {
+            ir_lower_frame_address (lower, instruction->slot->offset + \
+                                    part * STACK_PUSH_SIZE, address);
+            asm_push ("mov %s %s, %s", codegen_size_keyword (size), address,
+                      ir_lower_sized (part ? "edx" : "eax", size));
+        }
+    }
+
+    if (instruction->dst)
+    {
+        ir_lower_write (lower, instruction->dst,
+                        ir_lower_sized ("eax", ir_lower_size (lower, instruction->dst)));
+    }
+}
+
+/* How many of `total` arguments `convention` passes on the stack.  */
+static int
+ir_lower_stack_arguments (struct ir_lower_convention* convention, int total)
+{
+    return total > convention->total_registers ? \
+           total - convention->total_registers : 0;
+}
+
+/* Whether `call`, followed by `ret`, may jump to its callee once our
+   frame is taken down, the callee then returns to our caller.  The
+   callee's stack arguments go where ours are, so they must fit.  */
+static bool
+ir_lower_is_sibling_call (struct ir_lower* lower, struct ir_instruction* call,
+                          struct ir_instruction* ret)
+{
+    if (!lower->allows_sibling_calls || call->op != IR_OP_CALL || \
+        !call->label || call->is_struct || ret->op != IR_OP_RETURN || ret->is_struct)
+    {
+        return false;
+    }
+
+    if (ret->args[0] && (ret->args[0] != call->dst || \
+                         ret->size != ir_lower_size (lower, call->dst)))
+    {
+        return false;
+    }
+
+    struct ir_lower_convention convention = \
+                    ir_lower_convention_for (ir_lower_call_is_regparm (call));
+    struct vector* arguments = lower->node->func.args.vector;
+    return ir_lower_stack_arguments (&convention, vector_count (call->call_args)) <= \
+           ir_lower_stack_arguments (&lower->convention,
+                                     arguments ? vector_count (arguments) : 0);
+}
+
+/* The call of a `return f (...)`.  Its stack arguments are pushed
+   before any of ours is overwritten, then popped over them, and the
+   saved registers and the frame are given back as the epilogue does
+   before jumping.  The frame model is left to the epilogue.  */
+static void
+ir_lower_sibling_call (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    char address[64];
+    char operand[80];
+    bool is_regparm = ir_lower_call_is_regparm (instruction);
+    struct ir_lower_convention convention = ir_lower_convention_for (is_regparm);
+    size_t pushed = ir_lower_arguments (lower, instruction, &convention, true);
+    for (size_t offset = 0; offset < pushed; offset += STACK_PUSH_SIZE)
+    {
+        ir_lower_frame_address (lower, 2 * STACK_PUSH_SIZE + offset, address);
+        sprintf (operand, "%s %s", codegen_size_keyword (STACK_PUSH_SIZE), address);
+        asm_push_ins_pop (operand, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE,
+                          "call_argument");
+    }
+
+    if (compiler_target_is_x86_64 () && instruction->is_variadic)
+    {
+        asm_push ("xor eax, eax");
+    }
+
+    for (int i = lower->regalloc ? lower->regalloc->total_registers - 1 : -1; i >= 0; i--)
+    {
+        if (lower->regalloc->used_registers & (1 << i))
+        {
+            asm_push ("pop %s", regalloc_register_name (i));
+        }
+    }
+    asm_push ("mov %s, %s", ir_lower_stack_register (), ir_lower_frame_register ());
+    asm_push ("pop %s", ir_lower_frame_register ());
+    asm_push ("jmp $%s%s", instruction->label, is_regparm ? ".regparm" : "");
+    compiler_report (lower->function->process, "sibling call: %s from %s",
+                     instruction->label, lower->node->func.name);
+}
+
+/* An argument the caller passed in a register.  Without a register
+   of its own it is extended in place, the other argument registers
+   still hold theirs.  */
+static void
+ir_lower_register_argument (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    struct ir_slot* slot = instruction->slot;
+    const char* reg = lower->convention.registers[slot->argument];
+    const char* work = ir_lower_register (lower, instruction->dst);
+    work = ir_lower_sized (work ? work : reg, ir_lower_size (lower, instruction->dst));
+    if (slot->size == DATA_SIZE_BYTE || slot->size == DATA_SIZE_WORD)
+    {
+        asm_push ("%s %s, %s", slot->is_signed ? "movsx" : "movzx",
+                  ir_lower_sized (work, DATA_SIZE_DWORD), ir_lower_sized (reg, slot->size));
+    }
+    else if (!ir_lower_same_register (work, reg))
+    {
+        work = ir_lower_sized (work, slot->size);
+        asm_push ("mov %s, %s", work, ir_lower_sized (reg, slot->size));
+    }
+    ir_lower_write (lower, instruction->dst,
+                    ir_lower_sized (work, ir_lower_size (lower, instruction->dst)));
+}
+
+static void
+ir_lower_copy (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    char operand[64];
+    size_t size = ir_lower_size (lower, instruction->dst);
+    const char* reg = ir_lower_register (lower, instruction->dst);
+    if (reg)
+    {
+        ir_lower_move (lower, reg, instruction->args[0], size);
+        return;
+    }
+
+    if (ir_lower_register (lower, instruction->args[0]) || \
+        ir_lower_is_constant (lower, instruction->args[0]))
+    {
+        ir_lower_operand (lower, instruction->args[0], NULL, size, operand);
+        ir_lower_write (lower, instruction->dst, operand);
+        return;
+    }
+
+    ir_lower_move (lower, "eax", instruction->args[0], size);
+    ir_lower_write (lower, instruction->dst, ir_lower_sized ("eax", size));
+}
+
+/* Where jumping to `block` ends up, past blocks that only jump.  */
+static struct ir_block*
+ir_lower_jump_target (struct ir_block* block)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        struct ir_instruction* terminator = ir_block_terminator (block);
+        if (vector_count (block->instructions) != 1 || \
+            terminator->op != IR_OP_JUMP)
+        {
+            break;
+        }
+        block = terminator->targets[0];
+    }
+
+    return block;
+}
+
+static void
+ir_lower_jump (struct ir_block* target, struct ir_block* next)
+{
+    target = ir_lower_jump_target (target);
+    if (target != next)
+    {
+        asm_push ("jmp .block_%i", target->label_id);
+    }
+}
+
+/* Sets the flags for the low `size` bytes of `vreg` compared to 0.  */
+static void
+ir_lower_test_flags (struct ir_lower* lower, int vreg, size_t size)
+{
+    char operand[64];
+    if (ir_lower_register (lower, vreg))
+    {
+        const char* reg = ir_lower_sized (ir_lower_register (lower, vreg), size);
+        asm_push ("test %s, %s", reg, reg);
+    }
+    else if (!lower->rematerialized[vreg])
+    {
+        ir_lower_operand (lower, vreg, NULL, size, operand);
+        asm_push ("cmp %s, 0", operand);
+    }
+    else
+    {
+        const char* reg = ir_lower_sized ("eax", size);
+        ir_lower_move (lower, reg, vreg, size);
+        asm_push ("test %s, %s", reg, reg);
+    }
+}
+
+/* Picks one of two values with a cmov, over the flags of the compare
+   fused into it or of its condition tested against 0.  */
+static void
+ir_lower_select (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    char operand[64];
+    int condition = IR_CONDITION_NE;
+    struct ir_instruction* compare = lower->select_compares[instruction->args[2]];
+    if (compare)
+    {
+        ir_lower_compare_flags (lower, compare->args[0], compare->args[1],
+                                ir_lower_instruction_size (compare));
+        condition = compare->condition;
+    }
+    else
+    {
+        ir_lower_test_flags (lower, instruction->args[2],
+                             ir_lower_instruction_size (instruction));
+    }
+
+    /* Nothing from here on may touch the flags.  */
+    size_t size = ir_lower_size (lower, instruction->dst);
+    const char* work = ir_lower_work_register (lower, instruction->dst);
+    const char* reg = ir_lower_register (lower, instruction->args[0]);
+    int taken = instruction->args[0];
+    if (reg && ir_lower_same_register (reg, work))
+    {
+        /* The first value is in place, the second is taken when the
+           condition does not hold.  */
+        taken = instruction->args[1];
+        condition = ir_condition_inverse (condition);
+    }
+    else
+    {
+        ir_lower_move (lower, work, instruction->args[1], size);
+    }
+
+    /* cmov takes no immediate.  */
+    if (lower->rematerialized[taken])
+    {
+        ir_lower_move (lower, "edx", taken, size);
+        sprintf (operand, "%s", ir_lower_sized ("edx", size));
+    }
+    else
+    {
+        ir_lower_operand (lower, taken, NULL, size, operand);
+    }
+    asm_push ("cmov%s %s, %s", ir_condition_codes[condition], work, operand);
+    ir_lower_write (lower, instruction->dst, work);
+}
+
+static void
+ir_lower_branch (struct ir_lower* lower, struct ir_instruction* instruction,
+                 struct ir_block* next)
+{
+    size_t size = ir_lower_instruction_size (instruction);
+    int condition = IR_CONDITION_NE;
+    if (instruction->args[1])
+    {
+        ir_lower_compare_flags (lower, instruction->args[0], instruction->args[1],
+                                size);
+        condition = instruction->condition;
+    }
+    else
+    {
+        ir_lower_test_flags (lower, instruction->args[0], size);
+    }
+
+    struct ir_block* if_true = ir_lower_jump_target (instruction->targets[0]);
+    struct ir_block* if_false = ir_lower_jump_target (instruction->targets[1]);
+    if (if_true == next)
+    {
+        asm_push ("j%s .block_%i", ir_condition_codes[ir_condition_inverse (condition)],
+                  if_false->label_id);
+        return;
+    }
+
+    asm_push ("j%s .block_%i", ir_condition_codes[condition], if_true->label_id);
+    ir_lower_jump (if_false, next);
+}
+
+/* Jumps through a table in .rodata, the builder already checked the
+   index is within it.  The table sits between the instructions, in
+   its own section, so its label belongs to the function.  On x86-64
+   the entries are distances from the table, which need no relocation
+   when the code is linked at any address.  */
+static void
+ir_lower_switch (struct ir_lower* lower, struct ir_instruction* instruction)
+{
+    int table_id = codegen_label_count ();
+    /* The index is small, writing eax clears the rest of rax.  */
+    ir_lower_move (lower, "eax", instruction->args[0], DATA_SIZE_DWORD);
+    if (compiler_target_is_x86_64 ())
+    {
+        asm_push ("lea rcx, [.switch_%i]", table_id);
+        asm_push ("movsxd rax, dword [rcx+rax*4]");
+        asm_push ("add rax, rcx");
+        asm_push ("jmp rax");
+    }
+    else
+    {
+        asm_push ("jmp dword [.switch_%i+eax*4]", table_id);
+    }
+
+    asm_push ("section .rodata");
+    asm_push ("align %i", DATA_SIZE_DWORD);
+    asm_push (".switch_%i:", table_id);
+    for (int i = 0; i < vector_count (instruction->switch_targets); i++)
+    {
+        struct ir_block* target = \
+                        vector_peek_ptr_at (instruction->switch_targets, i);
+        if (compiler_target_is_x86_64 ())
+        {
+            asm_push ("dd .block_%i - .switch_%i",
+                      ir_lower_jump_target (target)->label_id, table_id);
+        }
+        else
+        {
+            asm_push ("dd .block_%i", ir_lower_jump_target (target)->label_id);
+        }
+    }
+    asm_push ("section .text");
+}
+
+static void
+ir_lower_instruction (struct ir_lower* lower, struct ir_instruction* instruction,
+                      struct ir_block* next)
+{
+    char address[64];
+    switch (instruction->op)
+    {
+        case IR_OP_CONST:
+        case IR_OP_ADDRESS:
+        case IR_OP_SLOT_ADDRESS:
+            /* Rematerialized where used.  */
+            break;
+
+        case IR_OP_COPY:
+            ir_lower_copy (lower, instruction);
+            break;
+
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_AND:
+        case IR_OP_OR:
+        case IR_OP_XOR:
+        case IR_OP_SHL:
+        case IR_OP_SHR:
+        case IR_OP_SAR:
+            ir_lower_arithmetic (lower, instruction);
+            break;
+
+        case IR_OP_DIV:
+        case IR_OP_UDIV:
+        case IR_OP_MOD:
+        case IR_OP_UMOD:
+            ir_lower_division (lower, instruction);
+            break;
+
+        case IR_OP_NEG:
+        case IR_OP_NOT:
+            ir_lower_unary (lower, instruction);
+            break;
+
+        case IR_OP_COMPARE:
+            ir_lower_compare (lower, instruction);
+            break;
+
+        case IR_OP_SELECT:
+            ir_lower_select (lower, instruction);
+            break;
+
+        case IR_OP_EXTEND:
+            ir_lower_extend (lower, instruction);
+            break;
+
+        case IR_OP_ARGUMENT:
+            if (instruction->slot->argument < lower->convention.total_registers)
+            {
+                ir_lower_register_argument (lower, instruction);
+                break;
+            }
+            /* Fall through, the caller pushed it.  */
+
+        case IR_OP_SLOT_LOAD:
+            ir_lower_frame_address (lower, instruction->slot->offset, address);
+            ir_lower_load_from (lower, instruction->dst, address,
+                                instruction->slot->size, instruction->slot->is_signed);
+            break;
+
+        case IR_OP_SLOT_STORE:
+            ir_lower_frame_address (lower, instruction->slot->offset, address);
+            ir_lower_store_to (lower, address, instruction->slot->size,
+                               instruction->args[0]);
+            break;
+
+        case IR_OP_LOAD:
+            ir_lower_address (lower, instruction->args[0], instruction->imm, address);
+            ir_lower_load_from (lower, instruction->dst, address,
+                                instruction->size, instruction->is_signed);
+            break;
+
+        case IR_OP_STORE:
+            ir_lower_address (lower, instruction->args[0], instruction->imm, address);
+            ir_lower_store_to (lower, address, instruction->size, instruction->args[1]);
+            break;
+
+        case IR_OP_CALL:
+            ir_lower_call (lower, instruction);
+            break;
+
+        case IR_OP_JUMP:
+            ir_lower_jump (instruction->targets[0], next);
+            break;
+
+        case IR_OP_BRANCH:
+            ir_lower_branch (lower, instruction, next);
+            break;
+
+        case IR_OP_SWITCH:
+            ir_lower_switch (lower, instruction);
+            break;
+
+        case IR_OP_RETURN:
+            for (int part = 0; instruction->is_struct && part < 2; part++)
+            {
+                size_t size = ir_lower_struct_part (instruction->size, part);
+                if (size)
+                {
+                    ir_lower_address (lower, instruction->args[0],
+                                      part * STACK_PUSH_SIZE, address);
+                    ir_lower_load_part (part ? "edx" : "eax", address, size);
+                }
+            }
+
+            if (instruction->is_struct && lower->returns_through_pointer)
+            {
+                ir_lower_frame_address (lower, 2 * STACK_PUSH_SIZE, address);
+                asm_push ("mov ecx, dword %s", address);
+                ir_lower_store_struct ("ecx", instruction->size);
+            }
+
+            if (instruction->args[0] && !instruction->is_struct)
+            {
+                ir_lower_move (lower, "eax", instruction->args[0],
+                               instruction->size ? instruction->size : \
+                               ir_lower_size (lower, instruction->args[0]));
+            }
+
+            if (next)
+            {
+                asm_push ("jmp .function_exit_%i", lower->exit_id);
+            }
+            break;
+
+        default:
+            compiler_error (lower->function->process,
+                            "Cannot lower IR instruction %i", instruction->op);
+    }
+}
+
+/* Arguments passed in registers whose address is taken are kept in
+   their home in the frame.  */
+static void
+ir_lower_store_register_arguments (struct ir_lower* lower)
+{
+    char address[64];
+    struct vector* slots = lower->function->slots;
+    for (int i = 0; i < vector_count (slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (slots, i);
+        if (slot->promoted || slot->argument < 0 || \
+            slot->argument >= lower->convention.total_registers)
+        {
+            continue;
+        }
+
+        ir_lower_frame_address (lower, slot->offset, address);
+        asm_push ("mov %s %s, %s", codegen_size_keyword (slot->size), address,
+                  ir_lower_sized (lower->convention.registers[slot->argument],
+                                  slot->size));
+    }
+}
+
+static void
+ir_lower_prologue (struct ir_lower* lower)
+{
+    if (!lower->omits_frame_pointer)
+    {
+        asm_push_ins_push (ir_lower_frame_register (), STACK_FRAME_ELEMENT_TYPE_SAVED_BP,
+                           "function_entry_saved_ebp");
+        asm_push ("mov %s, %s", ir_lower_frame_register (), ir_lower_stack_register ());
+    }
+
+    if (lower->frame_size)
+    {
+        asm_push ("sub %s, %lu", ir_lower_stack_register (),
+                  (unsigned long) lower->frame_size);
+        stack_frame_sub (lower->node, STACK_FRAME_ELEMENT_TYPE_LOCAL_VARIABLE,
+                         "local_variables", lower->frame_size);
+    }
+
+    for (int i = 0; lower->regalloc && i < lower->regalloc->total_registers; i++)
+    {
+        if (lower->regalloc->used_registers & (1 << i))
+        {
+            asm_push_ins_push (regalloc_register_name (i),
+                               STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER,
+                               "function_saved_register");
+        }
+    }
+
+    if (lower->convention.total_registers)
+    {
+        ir_lower_store_register_arguments (lower);
+    }
+}
+
+/* The cdecl entry of a function taking its arguments in registers,
+   it loads them from the stack and goes on at `name.regparm`.  The
+   ones past the registers are pushed again for the callee to find
+   them above its own return address.  */
+static void
+ir_lower_regparm_entry (struct ir_lower* lower)
+{
+    struct vector* arguments = lower->node->func.args.vector;
+    int total = arguments ? vector_count (arguments) : 0;
+    int total_registers = lower->convention.total_registers;
+    int pushed = total > total_registers ? total - total_registers : 0;
+    /* A structure is returned through a pointer the caller pushed
+       below the arguments.  */
+    bool is_struct = datatype_is_returned_in_registers (&lower->node->func.rtype);
+    int first = is_struct ? 2 : 1;
+    for (int i = 0; i < pushed; i++)
+    {
+        asm_push ("push dword [esp+%i]", (total + first - 1) * STACK_PUSH_SIZE);
+    }
+
+    for (int i = 0; i < total && i < total_registers; i++)
+    {
+        asm_push ("mov %s, dword [esp+%i]", lower->convention.registers[i],
+                  (first + i + pushed) * STACK_PUSH_SIZE);
+    }
+
+    if (pushed || is_struct)
+    {
+        asm_push ("call $%s.regparm", lower->node->func.name);
+        if (pushed)
+        {
+            asm_push ("add esp, %i", pushed * STACK_PUSH_SIZE);
+        }
+        if (is_struct)
+        {
+            asm_push ("mov ecx, dword [esp+%i]", STACK_PUSH_SIZE);
+            ir_lower_store_struct ("ecx", datatype_size (&lower->node->func.rtype));
+            asm_push ("ret %i", STACK_PUSH_SIZE);
+        }
+        else
+        {
+            asm_push ("ret");
+        }
+    }
+    asm_push ("$%s.regparm:", lower->node->func.name);
+}
+
+static void
+ir_lower_epilogue (struct ir_lower* lower)
+{
+    asm_push (".function_exit_%i:", lower->exit_id);
+    for (int i = lower->regalloc ? lower->regalloc->total_registers - 1 : -1; i >= 0; i--)
+    {
+        if (lower->regalloc->used_registers & (1 << i))
+        {
+            asm_push_ins_pop (regalloc_register_name (i),
+                              STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER,
+                              "function_saved_register");
+        }
+    }
+
+    if (lower->frame_size)
+    {
+        if (lower->omits_frame_pointer)
+        {
+            asm_push ("add %s, %lu", ir_lower_stack_register (),
+                      (unsigned long) lower->frame_size);
+        }
+        stack_frame_add (lower->node, STACK_FRAME_ELEMENT_TYPE_LOCAL_VARIABLE,
+                         "local_variables", lower->frame_size);
+    }
+
+    if (!lower->omits_frame_pointer)
+    {
+        asm_push ("mov %s, %s", ir_lower_stack_register (), ir_lower_frame_register ());
+        asm_push_ins_pop (ir_lower_frame_register (), STACK_FRAME_ELEMENT_TYPE_SAVED_BP,
+                          "function_entry_saved_ebp");
+    }
+    if (lower->returns_through_pointer)
+    {
+        asm_push ("ret %i", STACK_PUSH_SIZE);
+    }
+    else
+    {
+        asm_push ("ret");
+    }
+    stack_frame_assert_empty (lower->node);
+}
+
+/* Only when asked for and only in leaf functions, a call would need
+   the stack pointer to move while the frame is in use.  */
+static bool
+ir_lower_can_omit_frame_pointer (struct ir_function* function)
+{
+    if (!(function->process->flags & COMPILE_PROCESS_FLAG_OMIT_FRAME_POINTER))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->op == IR_OP_CALL)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Unless told not to, when every slot is in a register.  */
+static bool
+ir_lower_can_make_sibling_calls (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_SIBLING_CALLS)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < vector_count (function->slots); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        if (!slot->promoted)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Emits `function`, which must be out of SSA, from its prologue to
+   its `ret`.  The label of the function is already out.  */
+void
+ir_lower (struct ir_function* function)
+{
+    struct ir_lower lower = {.function=function, .node=function->node};
+    bool is_regparm = ir_lower_is_regparm (function->node);
+    lower.convention = ir_lower_convention_for (is_regparm);
+    lower.omits_frame_pointer = ir_lower_can_omit_frame_pointer (function);
+    lower.allows_sibling_calls = ir_lower_can_make_sibling_calls (function);
+    lower.returns_through_pointer = \
+                    datatype_is_returned_in_registers (&function->node->func.rtype) && \
+                    !ir_lower_returns_in_registers (function->node);
+    ir_lower_allocate (&lower);
+    lower.exit_id = codegen_label_count ();
+
+    if (is_regparm)
+    {
+        ir_lower_regparm_entry (&lower);
+    }
+    ir_lower_prologue (&lower);
+    int total = vector_count (function->blocks);
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        struct ir_block* next = i + 1 < total ? \
+                                vector_peek_ptr_at (function->blocks, i + 1) : NULL;
+        if (vector_count (block->predecessors))
+        {
+            if (block->is_aligned)
+            {
+                asm_push ("align %i", IR_LOWER_LOOP_ALIGNMENT);
+            }
+            asm_push (".block_%i:", block->label_id);
+        }
+
+        int count = vector_count (block->instructions);
+        for (int j = 0; j < count; j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (j + 1 < count && ir_lower_is_sibling_call (
+                        &lower, instruction, vector_peek_ptr_at (block->instructions,
+                                                                 j + 1)))
+            {
+                /* The callee returns for us.  */
+                ir_lower_sibling_call (&lower, instruction);
+                break;
+            }
+            ir_lower_instruction (&lower, instruction, next);
+        }
+    }
+    ir_lower_epilogue (&lower);
+
+    if (lower.regalloc)
+    {
+        regalloc_free (lower.regalloc);
+    }
+    free (lower.rematerialized);
+    free (lower.select_compares);
+    free (lower.registers);
+    free (lower.spill_offsets);
+}
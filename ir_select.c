@@ -0,0 +1,331 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/* If-conversion on the SSA form.  A branch around one or two short
+   arms that only compute values, `c ? a : b` or `if (x < lo) x =
+   lo;`, has the arms moved before it and every phi where they meet
+   replaced by an IR_OP_SELECT of the branch condition, which the
+   lowering turns into a cmov.  Both arms then always run, which is
+   cheaper than a branch mispredicted half the time as long as they
+   are short and cannot trap.  Nested conditionals are converted from
+   the inside out, the block where an inner one met being merged into
+   the one that branched.  */
+
+/* Instructions an arm may have besides its jump and its constants.  */
+#define IR_SELECT_MAX_INSTRUCTIONS 4
+/* Phis the arms may meet at.  */
+#define IR_SELECT_MAX_PHIS 2
+
+/* Whether `instruction`, moved before the branch of `block`, computes
+   the same and cannot trap.  Loads only read what `block` already
+   read or wrote.  */
+static bool
+ir_select_is_speculable (struct ir_block* block, struct ir_instruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_OP_CONST:
+        case IR_OP_ADDRESS:
+        case IR_OP_SLOT_ADDRESS:
+        case IR_OP_COPY:
+        case IR_OP_ADD:
+        case IR_OP_SUB:
+        case IR_OP_MUL:
+        case IR_OP_AND:
+        case IR_OP_OR:
+        case IR_OP_XOR:
+        case IR_OP_SHL:
+        case IR_OP_SHR:
+        case IR_OP_SAR:
+        case IR_OP_NEG:
+        case IR_OP_NOT:
+        case IR_OP_COMPARE:
+        case IR_OP_SELECT:
+        case IR_OP_EXTEND:
+            return true;
+
+        case IR_OP_LOAD:
+            break;
+
+        default:
+            return false;
+    }
+
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* access = vector_peek_ptr_at (block->instructions, i);
+        if ((access->op == IR_OP_LOAD || access->op == IR_OP_STORE) && \
+            access->args[0] == instruction->args[0] && \
+            access->imm == instruction->imm && access->size >= instruction->size)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Whether `arm`, a successor of `block`, is entered from `block` only
+   and goes on to `join` after a few instructions worth running on
+   either side of the branch.  */
+static bool
+ir_select_is_arm (struct ir_block* block, struct ir_block* arm, struct ir_block* join)
+{
+    struct ir_instruction* terminator = ir_block_terminator (arm);
+    if (arm == block || vector_count (arm->predecessors) != 1 || \
+        terminator->op != IR_OP_JUMP || terminator->targets[0] != join)
+    {
+        return false;
+    }
+
+    int size = 0;
+    for (int i = 0; i < vector_count (arm->instructions) - 1; i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (arm->instructions, i);
+        if (!ir_select_is_speculable (block, instruction))
+        {
+            return false;
+        }
+        size += instruction->op != IR_OP_CONST;
+    }
+
+    return size <= IR_SELECT_MAX_INSTRUCTIONS;
+}
+
+/* Moves the instructions of `arm` but its jump to the end of `block`,
+   before its terminator.  */
+static void
+ir_select_hoist (struct ir_block* block, struct ir_block* arm)
+{
+    int total = vector_count (arm->instructions);
+    for (int i = 0; i < total - 1; i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (arm->instructions, i);
+        ir_block_insert (block, vector_count (block->instructions) - 1, instruction);
+    }
+
+    struct ir_instruction* jump = vector_peek_ptr_at (arm->instructions, total - 1);
+    vector_clear (arm->instructions);
+    vector_push (arm->instructions, &jump);
+}
+
+/* Appends `join`, now only entered from `block`, to `block`.  `join`
+   is left unreachable, going to itself.  */
+static void
+ir_select_merge (struct ir_block* block, struct ir_block* join)
+{
+    struct ir_instruction* jump = ir_block_terminator (block);
+    vector_pop (block->instructions);
+    ir_instruction_free (jump);
+    for (int i = 0; i < vector_count (join->instructions); i++)
+    {
+        ir_block_append (block, vector_peek_ptr_at (join->instructions, i));
+    }
+
+    for (int i = 0; i < vector_count (join->successors); i++)
+    {
+        struct ir_block* successor = vector_peek_ptr_at (join->successors, i);
+        for (int j = 0; j < vector_count (successor->instructions); j++)
+        {
+            struct ir_instruction* phi = \
+                            vector_peek_ptr_at (successor->instructions, j);
+            if (phi->op != IR_OP_PHI)
+            {
+                break;
+            }
+
+            for (int k = 0; k < vector_count (phi->phi_values); k++)
+            {
+                struct ir_phi_value* value = vector_at (phi->phi_values, k);
+                if (value->block == join)
+                {
+                    value->block = block;
+                }
+            }
+        }
+    }
+
+    vector_clear (join->instructions);
+    jump = ir_instruction_new (IR_OP_JUMP);
+    jump->targets[0] = join;
+    ir_block_append (join, jump);
+}
+
+/* Whether an instruction of `block` from `index` up to its
+   terminator reads `vreg`.  */
+static bool
+ir_select_is_read (struct ir_block* block, int index, int vreg)
+{
+    for (int i = index; i < vector_count (block->instructions) - 1; i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (block->instructions, i);
+        for (int j = 0; j < ir_instruction_total_uses (instruction); j++)
+        {
+            if (*ir_instruction_use_at (instruction, j) == vreg)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Moves the compare of `block` computing `vreg` down to just before
+   the terminator, next to the select reading it, which then tests
+   its flags.  Nothing it passes may read it.  */
+static void
+ir_select_sink (struct ir_block* block, int vreg)
+{
+    int total = vector_count (block->instructions);
+    for (int i = 0; i < total - 1; i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (block->instructions, i);
+        if (instruction->dst != vreg)
+        {
+            continue;
+        }
+
+        if (instruction->op != IR_OP_COMPARE || ir_select_is_read (block, i + 1, vreg))
+        {
+            return;
+        }
+
+        for (int j = i; j < total - 2; j++)
+        {
+            *(struct ir_instruction**) vector_at (block->instructions, j) = \
+                            vector_peek_ptr_at (block->instructions, j + 1);
+        }
+        *(struct ir_instruction**) vector_at (block->instructions, total - 2) = instruction;
+        return;
+    }
+}
+
+/* Converts the branch ending `block` if it leads to arms meeting
+   again right away.  Either arm may be missing, the branch then
+   going straight to where the other one ends.  */
+static bool
+ir_select_convert (struct ir_block* block)
+{
+    /* A branch `__builtin_expect` says goes one way is predicted
+       better than a select.  */
+    struct ir_instruction* branch = ir_block_terminator (block);
+    if (branch->op != IR_OP_BRANCH || branch->args[1] || \
+        branch->targets[0] == branch->targets[1] || \
+        branch->is_unlikely[0] || branch->is_unlikely[1])
+    {
+        return false;
+    }
+
+    struct ir_block* arms[2] = {branch->targets[0], branch->targets[1]};
+    struct ir_block* join = NULL;
+    if (ir_block_terminator (arms[0])->op == IR_OP_JUMP && \
+        ir_block_terminator (arms[0])->targets[0] == arms[1])
+    {
+        join = arms[1];
+        arms[1] = NULL;
+    }
+    else if (ir_block_terminator (arms[1])->op == IR_OP_JUMP && \
+             ir_block_terminator (arms[1])->targets[0] == arms[0])
+    {
+        join = arms[0];
+        arms[0] = NULL;
+    }
+    else if (ir_block_terminator (arms[0])->op == IR_OP_JUMP)
+    {
+        join = ir_block_terminator (arms[0])->targets[0];
+    }
+
+    if (!join || join == block || vector_count (join->predecessors) != 2 || \
+        (arms[0] && !ir_select_is_arm (block, arms[0], join)) || \
+        (arms[1] && !ir_select_is_arm (block, arms[1], join)))
+    {
+        return false;
+    }
+
+    int total_phis = 0;
+    while (total_phis < vector_count (join->instructions) && \
+           ((struct ir_instruction*) vector_peek_ptr_at (join->instructions,
+                                                         total_phis))->op == IR_OP_PHI)
+    {
+        total_phis++;
+    }
+
+    if (total_phis > IR_SELECT_MAX_PHIS)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (arms[i])
+        {
+            ir_select_hoist (block, arms[i]);
+        }
+    }
+    ir_select_sink (block, branch->args[0]);
+
+    /* The phis become selects in place, keeping their register.  */
+    for (int i = 0; i < total_phis; i++)
+    {
+        struct ir_instruction* select = vector_peek_ptr_at (join->instructions, i);
+        for (int j = 0; j < vector_count (select->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (select->phi_values, j);
+            select->args[value->block == (arms[0] ? arms[0] : block) ? 0 : 1] = value->vreg;
+        }
+
+        vector_free (select->phi_values);
+        select->phi_values = NULL;
+        select->op = IR_OP_SELECT;
+        select->args[2] = branch->args[0];
+        select->size = branch->size;
+        ir_block_insert (block, vector_count (block->instructions) - 1, select);
+    }
+
+    struct vector* rest = vector_create (sizeof (struct ir_instruction*));
+    for (int i = total_phis; i < vector_count (join->instructions); i++)
+    {
+        struct ir_instruction* instruction = vector_peek_ptr_at (join->instructions, i);
+        vector_push (rest, &instruction);
+    }
+    vector_free (join->instructions);
+    join->instructions = rest;
+
+    branch->op = IR_OP_JUMP;
+    branch->args[0] = 0;
+    branch->size = 0;
+    branch->targets[0] = join;
+    branch->targets[1] = NULL;
+    ir_select_merge (block, join);
+    return true;
+}
+
+void
+ir_select (struct ir_function* function)
+{
+    if (function->process->flags & COMPILE_PROCESS_FLAG_NO_IF_CONVERSION)
+    {
+        return;
+    }
+
+    /* The blocks change with every conversion, the walk starts over
+       once they are known again.  */
+    int converted = 0;
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        if (ir_select_convert (vector_peek_ptr_at (function->blocks, i)))
+        {
+            converted++;
+            ir_compute_cfg (function);
+            i = -1;
+        }
+    }
+
+    if (converted)
+    {
+        compiler_report (function->process, "select: %s: %i branches made selects",
+                         function->node->func.name, converted);
+    }
+}
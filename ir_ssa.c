@@ -0,0 +1,711 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <limits.h>
+#include <stdlib.h>
+
+/* Moves the scalar slots whose address is never taken into virtual
+   registers, the classic SSA construction of Cytron et al.  Phis go
+   on the iterated dominance frontier of the blocks storing to a slot,
+   then a walk over the dominator tree renames loads to the value
+   stored last.  */
+
+struct ir_mem2reg
+{
+    struct ir_function* function;
+    int total_slots;
+    /* Vector of int per slot, the values stored so far on the
+       path from the entry.  */
+    struct vector** stacks;
+    /* What each loaded virtual register turned into.  */
+    int* replacements;
+    int total_replacements;
+    /* Value of a slot before any store, by slot.  */
+    int* initial_values;
+    /* Instructions computing the initial values, placed at the
+       start of the entry block once renaming is done.  */
+    struct vector* initial_instructions;
+    int undefined_value;
+    /* Vectors of struct ir_block* by block id.  */
+    struct vector** children;
+    struct vector** frontiers;
+};
+
+static bool
+ir_slot_is_promotable (struct ir_slot* slot)
+{
+    return slot->is_scalar && !slot->address_taken;
+}
+
+static struct ir_slot*
+ir_mem2reg_slot (struct ir_instruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_OP_SLOT_LOAD:
+        case IR_OP_SLOT_STORE:
+        case IR_OP_PHI:
+            if (instruction->slot && ir_slot_is_promotable (instruction->slot))
+            {
+                return instruction->slot;
+            }
+    }
+
+    return NULL;
+}
+
+static void
+ir_mem2reg_add_unique (struct vector* blocks, struct ir_block* block)
+{
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        if (vector_peek_ptr_at (blocks, i) == block)
+        {
+            return;
+        }
+    }
+    vector_push (blocks, &block);
+}
+
+/* Dominance frontiers, Cooper, Harvey and Kennedy.  */
+static void
+ir_mem2reg_frontiers (struct ir_mem2reg* state)
+{
+    struct vector* blocks = state->function->blocks;
+    for (int i = 0; i < vector_count (blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (blocks, i);
+        if (block->idom)
+        {
+            vector_push (state->children[block->idom->id], &block);
+        }
+
+        if (vector_count (block->predecessors) < 2)
+        {
+            continue;
+        }
+
+        for (int j = 0; j < vector_count (block->predecessors); j++)
+        {
+            struct ir_block* runner = vector_peek_ptr_at (block->predecessors, j);
+            while (runner != block->idom)
+            {
+                ir_mem2reg_add_unique (state->frontiers[runner->id], block);
+                runner = runner->idom;
+            }
+        }
+    }
+}
+
+static void
+ir_mem2reg_place_phis (struct ir_mem2reg* state, struct ir_slot* slot)
+{
+    struct ir_function* function = state->function;
+    bool* has_phi = calloc (function->next_block_id, sizeof (bool));
+    bool* queued = calloc (function->next_block_id, sizeof (bool));
+    struct vector* work = vector_create (sizeof (struct ir_block*));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->op == IR_OP_SLOT_STORE && instruction->slot == slot)
+            {
+                queued[block->id] = true;
+                vector_push (work, &block);
+                break;
+            }
+        }
+    }
+
+    while (!vector_empty (work))
+    {
+        struct ir_block* block = vector_back_ptr (work);
+        vector_pop (work);
+        struct vector* frontier = state->frontiers[block->id];
+        for (int i = 0; i < vector_count (frontier); i++)
+        {
+            struct ir_block* join = vector_peek_ptr_at (frontier, i);
+            if (has_phi[join->id])
+            {
+                continue;
+            }
+
+            struct ir_instruction* phi = ir_instruction_new (IR_OP_PHI);
+            phi->dst = ir_vreg_new (function, slot->type);
+            phi->slot = slot;
+            phi->phi_values = vector_create (sizeof (struct ir_phi_value));
+            ir_block_insert (join, 0, phi);
+            has_phi[join->id] = true;
+            if (!queued[join->id])
+            {
+                queued[join->id] = true;
+                vector_push (work, &join);
+            }
+        }
+    }
+
+    vector_free (work);
+    free (has_phi);
+    free (queued);
+}
+
+static int
+ir_mem2reg_resolve (struct ir_mem2reg* state, int vreg)
+{
+    while (vreg && vreg < state->total_replacements && state->replacements[vreg])
+    {
+        vreg = state->replacements[vreg];
+    }
+
+    return vreg;
+}
+
+/* Value of `slot` before any store, the argument the caller passed
+   or zero for locals read before they are set.  */
+static int
+ir_mem2reg_initial_value (struct ir_mem2reg* state, struct ir_slot* slot)
+{
+    if (state->initial_values[slot->id])
+    {
+        return state->initial_values[slot->id];
+    }
+
+    struct ir_instruction* instruction = NULL;
+    if (slot->argument >= 0)
+    {
+        instruction = ir_instruction_new (IR_OP_ARGUMENT);
+        instruction->slot = slot;
+    }
+    else if (state->undefined_value)
+    {
+        state->initial_values[slot->id] = state->undefined_value;
+        return state->undefined_value;
+    }
+    else
+    {
+        instruction = ir_instruction_new (IR_OP_CONST);
+        state->undefined_value = ir_vreg_new (state->function, IR_TYPE_I32);
+        instruction->dst = state->undefined_value;
+    }
+
+    if (!instruction->dst)
+    {
+        instruction->dst = ir_vreg_new (state->function, slot->type);
+    }
+    vector_push (state->initial_instructions, &instruction);
+    state->initial_values[slot->id] = instruction->dst;
+    return instruction->dst;
+}
+
+static int
+ir_mem2reg_current (struct ir_mem2reg* state, struct ir_slot* slot)
+{
+    struct vector* stack = state->stacks[slot->id];
+    if (vector_empty (stack))
+    {
+        return ir_mem2reg_initial_value (state, slot);
+    }
+
+    return *(int*) vector_back (stack);
+}
+
+static void
+ir_mem2reg_push (struct ir_mem2reg* state, struct vector* pushed,
+                 struct ir_slot* slot, int vreg)
+{
+    vector_push (state->stacks[slot->id], &vreg);
+    vector_push (pushed, &slot);
+}
+
+/* Stores to a slot narrower than a register keep the value
+   truncated, as the load from memory would have returned it.  */
+static int
+ir_mem2reg_store (struct ir_mem2reg* state, struct ir_instruction* instruction)
+{
+    struct ir_slot* slot = instruction->slot;
+    int value = instruction->args[0];
+    if (slot->size >= DATA_SIZE_DWORD)
+    {
+        instruction->op = IR_OP_NOP;
+        return value;
+    }
+
+    instruction->op = IR_OP_EXTEND;
+    instruction->dst = ir_vreg_new (state->function, IR_TYPE_I32);
+    instruction->size = slot->size;
+    instruction->is_signed = slot->is_signed;
+    instruction->slot = NULL;
+    return instruction->dst;
+}
+
+static void
+ir_mem2reg_rename (struct ir_mem2reg* state, struct ir_block* block)
+{
+    struct vector* pushed = vector_create (sizeof (struct ir_slot*));
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* instruction = \
+                        vector_peek_ptr_at (block->instructions, i);
+        if (instruction->op != IR_OP_PHI)
+        {
+            for (int j = 0; j < ir_instruction_total_uses (instruction); j++)
+            {
+                int* use = ir_instruction_use_at (instruction, j);
+                *use = ir_mem2reg_resolve (state, *use);
+            }
+        }
+
+        struct ir_slot* slot = ir_mem2reg_slot (instruction);
+        if (!slot)
+        {
+            continue;
+        }
+
+        switch (instruction->op)
+        {
+            case IR_OP_PHI:
+                ir_mem2reg_push (state, pushed, slot, instruction->dst);
+                break;
+
+            case IR_OP_SLOT_LOAD:
+                state->replacements[instruction->dst] = \
+                                ir_mem2reg_current (state, slot);
+                instruction->op = IR_OP_NOP;
+                break;
+
+            case IR_OP_SLOT_STORE:
+                ir_mem2reg_push (state, pushed, slot,
+                                 ir_mem2reg_store (state, instruction));
+                break;
+        }
+    }
+
+    for (int i = 0; i < vector_count (block->successors); i++)
+    {
+        struct ir_block* successor = vector_peek_ptr_at (block->successors, i);
+        for (int j = 0; j < vector_count (successor->instructions); j++)
+        {
+            struct ir_instruction* phi = \
+                            vector_peek_ptr_at (successor->instructions, j);
+            if (phi->op != IR_OP_PHI)
+            {
+                break;
+            }
+
+            struct ir_phi_value value = {
+                .block=block,
+                .vreg=ir_mem2reg_current (state, phi->slot)
+            };
+            vector_push (phi->phi_values, &value);
+        }
+    }
+
+    struct vector* children = state->children[block->id];
+    for (int i = 0; i < vector_count (children); i++)
+    {
+        ir_mem2reg_rename (state, vector_peek_ptr_at (children, i));
+    }
+
+    for (int i = 0; i < vector_count (pushed); i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (pushed, i);
+        vector_pop (state->stacks[slot->id]);
+    }
+    vector_free (pushed);
+}
+
+/* Arguments by their position, before the other initial values.  */
+static int
+ir_mem2reg_compare_initial (const void* a, const void* b)
+{
+    struct ir_instruction* first = *(struct ir_instruction**) a;
+    struct ir_instruction* second = *(struct ir_instruction**) b;
+    int first_key = first->op == IR_OP_ARGUMENT ? first->slot->argument : INT_MAX;
+    int second_key = second->op == IR_OP_ARGUMENT ? second->slot->argument : INT_MAX;
+    return (first_key > second_key) - (first_key < second_key);
+}
+
+void
+ir_mem2reg (struct ir_function* function)
+{
+    struct ir_mem2reg state = {.function=function};
+    state.total_slots = vector_count (function->slots);
+    state.stacks = calloc (state.total_slots + 1, sizeof (struct vector*));
+    state.initial_values = calloc (state.total_slots + 1, sizeof (int));
+    state.initial_instructions = vector_create (sizeof (struct ir_instruction*));
+    state.children = calloc (function->next_block_id, sizeof (struct vector*));
+    state.frontiers = calloc (function->next_block_id, sizeof (struct vector*));
+    for (int i = 0; i < function->next_block_id; i++)
+    {
+        state.children[i] = vector_create (sizeof (struct ir_block*));
+        state.frontiers[i] = vector_create (sizeof (struct ir_block*));
+    }
+
+    ir_mem2reg_frontiers (&state);
+    for (int i = 0; i < state.total_slots; i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        state.stacks[i] = vector_create (sizeof (int));
+        if (ir_slot_is_promotable (slot))
+        {
+            ir_mem2reg_place_phis (&state, slot);
+        }
+    }
+
+    state.total_replacements = ir_total_vregs (function);
+    state.replacements = calloc (state.total_replacements, sizeof (int));
+    struct ir_block* entry = ir_entry_block (function);
+    ir_mem2reg_rename (&state, entry);
+
+    /* The arguments passed in registers are then read before loading
+       one passed on the stack may need a register.  */
+    qsort (vector_data_ptr (state.initial_instructions),
+           vector_count (state.initial_instructions), sizeof (struct ir_instruction*),
+           ir_mem2reg_compare_initial);
+    for (int i = vector_count (state.initial_instructions) - 1; i >= 0; i--)
+    {
+        ir_block_insert (entry, 0, vector_peek_ptr_at (state.initial_instructions, i));
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        ir_block_compact (vector_peek_ptr_at (function->blocks, i));
+    }
+
+    for (int i = 0; i < state.total_slots; i++)
+    {
+        struct ir_slot* slot = vector_peek_ptr_at (function->slots, i);
+        slot->promoted = ir_slot_is_promotable (slot);
+        vector_free (state.stacks[i]);
+    }
+
+    for (int i = 0; i < function->next_block_id; i++)
+    {
+        vector_free (state.children[i]);
+        vector_free (state.frontiers[i]);
+    }
+    free (state.children);
+    free (state.frontiers);
+    free (state.stacks);
+    free (state.initial_values);
+    free (state.replacements);
+    vector_free (state.initial_instructions);
+    ir_remove_dead_code (function);
+}
+
+/* Mark and sweep, starting from the instructions with side effects.
+   Phis that only feed each other are dropped too.  */
+void
+ir_remove_dead_code (struct ir_function* function)
+{
+    int total_vregs = ir_total_vregs (function);
+    struct ir_instruction** definitions = \
+                    calloc (total_vregs, sizeof (struct ir_instruction*));
+    bool* live = calloc (total_vregs, sizeof (bool));
+    struct vector* work = vector_create (sizeof (struct ir_instruction*));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->dst)
+            {
+                definitions[instruction->dst] = instruction;
+            }
+
+            if (ir_instruction_has_side_effects (instruction))
+            {
+                if (instruction->dst)
+                {
+                    live[instruction->dst] = true;
+                }
+                vector_push (work, &instruction);
+            }
+        }
+    }
+
+    while (!vector_empty (work))
+    {
+        struct ir_instruction* instruction = vector_back_ptr (work);
+        vector_pop (work);
+        for (int i = 0; i < ir_instruction_total_uses (instruction); i++)
+        {
+            int vreg = *ir_instruction_use_at (instruction, i);
+            if (!vreg || live[vreg] || !definitions[vreg])
+            {
+                continue;
+            }
+
+            live[vreg] = true;
+            vector_push (work, &definitions[vreg]);
+        }
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            if (instruction->dst && !live[instruction->dst])
+            {
+                instruction->op = IR_OP_NOP;
+            }
+        }
+        ir_block_compact (block);
+    }
+
+    vector_free (work);
+    free (definitions);
+    free (live);
+}
+
+static bool
+ir_block_has_phis (struct ir_block* block)
+{
+    struct ir_instruction* first = vector_count (block->instructions) ? \
+                                   vector_peek_ptr_at (block->instructions, 0) : NULL;
+    return first && first->op == IR_OP_PHI;
+}
+
+/* An edge from a block with two successors to a block with two
+   predecessors gets a block of its own to hold the phi copies.  The
+   entries of a switch table that share a target share the block.  */
+static void
+ir_split_critical_edges (struct ir_function* function)
+{
+    int total = vector_count (function->blocks);
+    for (int i = 0; i < total; i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        struct ir_instruction* terminator = ir_block_terminator (block);
+        if (terminator->op != IR_OP_BRANCH && terminator->op != IR_OP_SWITCH)
+        {
+            continue;
+        }
+
+        int total_targets = ir_instruction_total_targets (terminator);
+        for (int j = 0; j < total_targets; j++)
+        {
+            struct ir_block* target = *ir_instruction_target_at (terminator, j);
+            if (!ir_block_has_phis (target) || \
+                vector_count (target->predecessors) < 2)
+            {
+                continue;
+            }
+
+            struct ir_block* edge = ir_block_new (function);
+            struct ir_instruction* jump = ir_instruction_new (IR_OP_JUMP);
+            jump->targets[0] = target;
+            ir_block_append (edge, jump);
+            for (int k = j; k < total_targets; k++)
+            {
+                struct ir_block** other = ir_instruction_target_at (terminator, k);
+                if (*other == target)
+                {
+                    *other = edge;
+                }
+            }
+
+            for (int k = 0; k < vector_count (target->instructions); k++)
+            {
+                struct ir_instruction* phi = \
+                                vector_peek_ptr_at (target->instructions, k);
+                if (phi->op != IR_OP_PHI)
+                {
+                    break;
+                }
+
+                for (int l = 0; l < vector_count (phi->phi_values); l++)
+                {
+                    struct ir_phi_value* value = vector_at (phi->phi_values, l);
+                    if (value->block == block)
+                    {
+                        value->block = edge;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    ir_compute_cfg (function);
+}
+
+static void
+ir_insert_copy (struct ir_block* block, int dst, int src)
+{
+    struct ir_instruction* copy = ir_instruction_new (IR_OP_COPY);
+    copy->dst = dst;
+    copy->args[0] = src;
+    ir_block_insert (block, vector_count (block->instructions) - 1, copy);
+}
+
+/* Computes `src` straight into `dst` instead of copying it, when
+   the phi is all that reads `src` and nothing after its definition
+   in `predecessor` reads or writes `dst`.  */
+static bool
+ir_leave_ssa_coalesce (struct ir_block* predecessor, int dst, int src,
+                       int* use_counts)
+{
+    if (use_counts[src] != 1)
+    {
+        return false;
+    }
+
+    for (int i = vector_count (predecessor->instructions) - 1; i >= 0; i--)
+    {
+        struct ir_instruction* instruction = \
+                        vector_peek_ptr_at (predecessor->instructions, i);
+        if (instruction->dst == src)
+        {
+            switch (instruction->op)
+            {
+                /* Lowering recomputes these where they are used.  */
+                case IR_OP_CONST:
+                case IR_OP_ADDRESS:
+                case IR_OP_SLOT_ADDRESS:
+                case IR_OP_PHI:
+                    return false;
+            }
+
+            instruction->dst = dst;
+            return true;
+        }
+
+        if (instruction->dst == dst)
+        {
+            return false;
+        }
+
+        for (int j = 0; j < ir_instruction_total_uses (instruction); j++)
+        {
+            if (*ir_instruction_use_at (instruction, j) == dst)
+            {
+                return false;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* The copies of one predecessor happen at once.  When a phi reads
+   what another phi of the block writes they go through temporaries.  */
+static void
+ir_leave_ssa_edge (struct ir_function* function, struct ir_block* block,
+                   struct ir_block* predecessor, int* use_counts)
+{
+    struct vector* dsts = vector_create (sizeof (int));
+    struct vector* srcs = vector_create (sizeof (int));
+    for (int i = 0; i < vector_count (block->instructions); i++)
+    {
+        struct ir_instruction* phi = vector_peek_ptr_at (block->instructions, i);
+        if (phi->op != IR_OP_PHI)
+        {
+            break;
+        }
+
+        for (int j = 0; j < vector_count (phi->phi_values); j++)
+        {
+            struct ir_phi_value* value = vector_at (phi->phi_values, j);
+            if (value->block == predecessor && value->vreg != phi->dst)
+            {
+                vector_push (dsts, &phi->dst);
+                vector_push (srcs, &value->vreg);
+                break;
+            }
+        }
+    }
+
+    bool overlaps = false;
+    for (int i = 0; i < vector_count (srcs); i++)
+    {
+        for (int j = 0; j < vector_count (dsts); j++)
+        {
+            if (*(int*) vector_at (srcs, i) == *(int*) vector_at (dsts, j))
+            {
+                overlaps = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < vector_count (srcs); i++)
+    {
+        int* src = vector_at (srcs, i);
+        if (overlaps)
+        {
+            int temporary = ir_vreg_new (function, ir_vreg_type (function, *src));
+            ir_insert_copy (predecessor, temporary, *src);
+            *src = temporary;
+        }
+    }
+
+    for (int i = 0; i < vector_count (srcs); i++)
+    {
+        int dst = *(int*) vector_at (dsts, i);
+        int src = *(int*) vector_at (srcs, i);
+        if (overlaps || !ir_leave_ssa_coalesce (predecessor, dst, src, use_counts))
+        {
+            ir_insert_copy (predecessor, dst, src);
+        }
+    }
+
+    vector_free (dsts);
+    vector_free (srcs);
+}
+
+/* Replaces the phis by copies at the end of the predecessors.  The
+   function is no longer in SSA form afterwards, a phi destination is
+   written once per incoming edge.  */
+void
+ir_leave_ssa (struct ir_function* function)
+{
+    ir_split_critical_edges (function);
+    int* use_counts = calloc (ir_total_vregs (function), sizeof (int));
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* instruction = \
+                            vector_peek_ptr_at (block->instructions, j);
+            for (int k = 0; k < ir_instruction_total_uses (instruction); k++)
+            {
+                use_counts[*ir_instruction_use_at (instruction, k)]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < vector_count (function->blocks); i++)
+    {
+        struct ir_block* block = vector_peek_ptr_at (function->blocks, i);
+        if (!ir_block_has_phis (block))
+        {
+            continue;
+        }
+
+        for (int j = 0; j < vector_count (block->predecessors); j++)
+        {
+            ir_leave_ssa_edge (function, block,
+                               vector_peek_ptr_at (block->predecessors, j),
+                               use_counts);
+        }
+
+        for (int j = 0; j < vector_count (block->instructions); j++)
+        {
+            struct ir_instruction* phi = vector_peek_ptr_at (block->instructions, j);
+            if (phi->op == IR_OP_PHI)
+            {
+                phi->op = IR_OP_NOP;
+            }
+        }
+        ir_block_compact (block);
+    }
+    free (use_counts);
+}
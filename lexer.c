@@ -14,6 +14,8 @@
 
 struct token *read_next_token ();
 bool lex_is_in_expression ();
+char lex_get_escaped_char (char c);
+bool is_hex_char (char c);
 
 static struct lex_process *lex_process;
 static struct token tmp_token;
@@ -182,11 +184,8 @@ struct token
     {
         if (c == '\\')
         {
-            /*
-             * TODO: Handle backslash character
-             * "Hello World\n" <- "\"
-             */
-            continue;
+            /* "Hello World\n" <- "\n" becomes a single newline.  */
+            c = lex_get_escaped_char (nextc ());
         }
 
         buffer_write(buf, c);
@@ -242,6 +241,12 @@ op_valid (const char *op)
         S_EQ (op, "-=")   ||
         S_EQ (op, "*=")   ||
         S_EQ (op, "/=")   ||
+        S_EQ (op, "%=")   ||
+        S_EQ (op, "&=")   ||
+        S_EQ (op, "|=")   ||
+        S_EQ (op, "^=")   ||
+        S_EQ (op, "<<=")  ||
+        S_EQ (op, ">>=")  ||
         S_EQ (op, ">>")   ||
         S_EQ (op, "<<")   ||
         S_EQ (op, ">=")   ||
@@ -296,7 +301,12 @@ const char
     struct buffer *buffer = buffer_create();
     buffer_write(buffer, op);
 
-    if (!op_treadted_as_on(op))
+    if (op == '*' && peekc () == '=')
+    {
+        /* `*` is kept on its own for pointers, except in `*=`.  */
+        buffer_write (buffer, nextc ());
+    }
+    else if (!op_treadted_as_on(op))
     {
         op = peekc();
         if (is_single_operator(op))
@@ -304,6 +314,13 @@ const char
             buffer_write(buffer, op);
             nextc();
             single_operator = false;
+
+            /* `<<=` and `>>=` are the only three character operators.  */
+            if ((op == '<' || op == '>') && op == ((char*) buffer_ptr (buffer))[0] && \
+                peekc () == '=')
+            {
+                buffer_write (buffer, nextc ());
+            }
         }
     }
 
@@ -312,7 +329,8 @@ const char
     char *ptr = buffer_ptr(buffer);
     if (!single_operator)
     {
-        if (!op_valid)
+        /* e.g `a=-1` reads `=-`, which must be split again.  */
+        if (!op_valid (ptr))
         {
             read_op_flush_back_keep_first(buffer);
             /* Write NULL terminator to the string (0xx0) */
@@ -400,7 +418,9 @@ is_keyword (const char* str)
             S_EQ(str, "typedef")            ||
             S_EQ(str, "const")              ||
             S_EQ(str, "extern")             ||
-            S_EQ(str, "restrict");
+            S_EQ(str, "restrict")           ||
+            S_EQ(str, "inline")             ||
+            S_EQ(str, "__attribute__");
 }
 
 static struct token
@@ -542,6 +562,9 @@ struct token
     return token_create(&(struct token){.type=TOKEN_TYPE_NEWLINE});
 }
 
+/* Translates the escape sequence whose first character after the
+   backslash is `c`.  Octal and \x sequences read the rest of their
+   digits from the input.  */
 char
 lex_get_escaped_char(char c)
 {
@@ -564,6 +587,59 @@ lex_get_escaped_char(char c)
         case '\'':
             co = '\'';
             break;
+
+        case '"':
+            co = '"';
+            break;
+
+        case '?':
+            co = '?';
+            break;
+
+        case 'r':
+            co = '\r';
+            break;
+
+        case 'a':
+            co = '\a';
+            break;
+
+        case 'b':
+            co = '\b';
+            break;
+
+        case 'f':
+            co = '\f';
+            break;
+
+        case 'v':
+            co = '\v';
+            break;
+
+        case 'x':
+            if (!is_hex_char(peekc()))
+            {
+                compiler_error(lex_process->compiler, "\\x used with no following hex digits\n");
+            }
+
+            while (is_hex_char(peekc()))
+            {
+                char digit = tolower(nextc());
+                co = co * 16 + (isdigit(digit) ? digit - '0' : digit - 'a' + 10);
+            }
+            break;
+
+        case '0': case '1': case '2': case '3':
+        case '4': case '5': case '6': case '7':
+            co = c - '0';
+            for (int i = 0; i < 2 && peekc() >= '0' && peekc() <= '7'; i++)
+            {
+                co = co * 8 + nextc() - '0';
+            }
+            break;
+
+        default:
+            compiler_error(lex_process->compiler, "Unknown escape sequence \\%c\n", c);
     }
     return co;
 }
@@ -0,0 +1,51 @@
+/* exit: 0 */
+int data[100];
+
+int
+dot (int* a, int* b, int n)
+{
+    int i;
+    int s = 0;
+    for (i = 0; i < n; i++)
+        s += a[i] * b[i];
+    return s;
+}
+
+int
+main ()
+{
+    int i;
+    int j;
+    for (i = 0; i < 100; i++)
+        data[i] = i - 50;
+    if (dot (data, data, 100) != 83350) return 1;
+    if (dot (data, data, 7) != 15491) return 2;
+
+    int s = 0;
+    for (i = 0; i < 8; i++)
+        s += i * 3;
+    if (s != 84) return 3;
+
+    s = 0;
+    int k = 5;
+    for (i = 0; i < 20; i++)
+        for (j = 0; j < 10; j++)
+            s += k * 7 + i * j;
+    if (s != 15550) return 4;
+
+    s = 0;
+#pragma unroll 4
+    for (i = 0; i < 10; i++)
+        s = s * 2 + i;
+    if (s != 1013) return 5;
+
+    s = 0;
+    i = 100;
+    while (i > 0)
+    {
+        s += i;
+        i -= 7;
+    }
+    if (s != 765) return 6;
+    return 0;
+}
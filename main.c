@@ -1,10 +1,53 @@
 #include <stdio.h>
+#include <string.h>
 #include "compiler.h"
 
 int
-main (void)
+main (int argc, char** argv)
 {
-	int res = compile_file("./test.c", "./test", 0);
+	const char* input_file = "./test.c";
+	const char* output_file = "./test";
+	int flags = 0;
+	int total_files = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-fno-regalloc") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_REGISTER_ALLOCATION;
+		else if (strcmp(argv[i], "-freport") == 0)
+			flags |= COMPILE_PROCESS_FLAG_REPORT;
+		else if (strcmp(argv[i], "-fno-ir") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_IR;
+		else if (strcmp(argv[i], "-fdump-ir") == 0)
+			flags |= COMPILE_PROCESS_FLAG_DUMP_IR;
+		else if (strcmp(argv[i], "-fno-peephole") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_PEEPHOLE;
+		else if (strcmp(argv[i], "-S") == 0)
+			flags |= COMPILE_PROCESS_FLAG_ASSEMBLY_OUTPUT;
+		else if (strcmp(argv[i], "-fno-inline") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_INLINE;
+		else if (strcmp(argv[i], "-fno-optimize-sibling-calls") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_SIBLING_CALLS;
+		else if (strcmp(argv[i], "-fno-loop-optimize") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_LOOP_OPTIMIZATION;
+		else if (strcmp(argv[i], "-fno-unroll-loops") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_UNROLL_LOOPS;
+		else if (strcmp(argv[i], "-fno-if-conversion") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_IF_CONVERSION;
+		else if (strcmp(argv[i], "-fno-reorder-blocks") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_REORDER_BLOCKS;
+		else if (strcmp(argv[i], "-fno-cse") == 0)
+			flags |= COMPILE_PROCESS_FLAG_NO_CSE;
+		else if (strcmp(argv[i], "-fomit-frame-pointer") == 0)
+			flags |= COMPILE_PROCESS_FLAG_OMIT_FRAME_POINTER;
+		else if (strcmp(argv[i], "-m64") == 0)
+			flags |= COMPILE_PROCESS_FLAG_X86_64;
+		else if (total_files++ == 0)
+			input_file = argv[i];
+		else
+			output_file = argv[i];
+	}
+
+	int res = compile_file(input_file, output_file, flags);
 	if (res == COMPILER_FILE_COMPILED_OK)
 		printf("Everthing looks good.\n");
 	else if (res == COMPILER_FAILED_WITH_ERRORS)
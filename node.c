@@ -1,6 +1,7 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include <assert.h>
+#include <limits.h>
 
 struct vector *node_vector = NULL;
 struct vector *node_vector_root = NULL;
@@ -63,7 +64,19 @@ node_is_expressionable (struct node* node)
            node->type == NODE_TYPE_EXPRESSION_PARENTHESES   ||
            node->type == NODE_TYPE_UNARY                    ||
            node->type == NODE_TYPE_IDENTIFIER               ||
-           node->type == NODE_TYPE_NUMBER;
+           node->type == NODE_TYPE_NUMBER                   ||
+           node->type == NODE_TYPE_STRING                   ||
+           node->type == NODE_TYPE_CAST;
+}
+
+/* A number too big for an int is a long, which only x86-64 has, so
+   is a number folded from long operands.  */
+bool
+number_node_is_long (struct node* node)
+{
+    long long value = (long long) node->llnum;
+    return compiler_target_is_x86_64 () && \
+           (node->flags & NODE_FLAG_IS_LONG || value < INT_MIN || value > INT_MAX);
 }
 
 /*
@@ -76,7 +89,7 @@ struct node*
 node_peek_expressionable_or_null ()
 {
     struct node* last_node = node_peek_or_null();
-    return node_is_expressionable(last_node) ? last_node : NULL;
+    return last_node && node_is_expressionable(last_node) ? last_node : NULL;
 }
 
 void
@@ -90,6 +103,16 @@ make_cast_node (struct datatype* dtype, struct node* operand_node)
     });
 }
 
+void
+make_initializer_node (struct vector* values)
+{
+    node_create (& (struct node)
+    {
+        .type=NODE_TYPE_INITIALIZER,
+        .initializer.values=values
+    });
+}
+
 void
 make_tenary_node (struct node* true_node, struct node* false_node)
 {
@@ -111,6 +134,27 @@ make_case_node (struct node* exp_node)
     });
 }
 
+void
+make_default_node ()
+{
+    node_create (& (struct node)
+    {
+        .type=NODE_TYPE_STATEMENT_DEFAULT
+    });
+}
+
+void
+make_unary_node (const char* op, struct node* operand_node, int flags)
+{
+    node_create (& (struct node)
+    {
+        .type=NODE_TYPE_UNARY,
+        .unary.op=op,
+        .unary.operand=operand_node,
+        .unary.flags=flags
+    });
+}
+
 void
 make_goto_node (struct node* name_node)
 {
@@ -227,7 +271,7 @@ make_function_node (struct datatype* ret_type, const char* name,
         .func.args.vector=arguments,
         .func.body_n=body_node,
         .func.rtype=*ret_type,
-        .func.args.stack_addition=DATA_SIZE_DDWORD
+        .func.args.stack_addition=2 * STACK_PUSH_SIZE
     });
 
     function_node->func.frame.elements = \
@@ -1,10 +1,14 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include <assert.h>
+#include <limits.h>
 
 static struct compile_process *current_process;
 static struct fixup_system* parser_fixup_sys;
 static struct token *parser_last_token;
+/* Parsing a value of an initializer list, a comma ends the value
+   instead of being the comma operator.  */
+static bool parser_inside_initializer = false;
 
 extern struct node* parser_current_body;
 extern struct node* parser_current_function;
@@ -58,6 +62,7 @@ enum
     HISTORY_FLAG_INSIDE_FUNCTION_BODY   = 0b00010000,
     HISTORY_FLAG_IN_SWITCH_STATEMENT    = 0b00100000,
     HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL = 0b01000000,
+    HISTORY_FLAG_INSIDE_EXPRESSION      = 0b10000000,
 };
 
 struct history_cases
@@ -98,7 +103,7 @@ history_down (struct history* history, int flags)
 struct parser_history_switch
 parser_new_switch_statement (struct history* history)
 {
-    memset (&history->_switch, 0, sizeof (&history->_switch));
+    memset (&history->_switch, 0, sizeof (history->_switch));
     history->_switch.case_data.cases = \
                         vector_create (sizeof (struct parsed_switch_case));
     history->flags |= HISTORY_FLAG_IN_SWITCH_STATEMENT;
@@ -116,7 +121,7 @@ parser_register_case (struct history* history, struct node* case_node)
 {
     assert (history->flags & HISTORY_FLAG_IN_SWITCH_STATEMENT);
     struct parsed_switch_case s_case;
-    s_case.index = case_node->stmt._case.exp_node->llnum;
+    s_case.value = case_node->stmt._case.exp_node->llnum;
     /* In C all cases are numerical.  */
     vector_push (history->_switch.case_data.cases, &s_case);
 }
@@ -128,6 +133,7 @@ void parse_keyword (struct history* history);
 struct vector* parse_function_arguments (struct history* history);
 void parse_expressionable_root (struct history* history);
 void parse_label (struct history* history);
+void parse_pragma (struct history* history);
 void parse_for_tenary (struct history* history);
 void parse_datatype (struct datatype* dtype);
 void parse_for_cast ();
@@ -216,7 +222,7 @@ token_next_is_keyword (const char* keyword)
 }
 
 static bool
-token_next_is_symbol (const char* c)
+token_next_is_symbol (char c)
 {
     struct token* token = token_peek_next();
     return token_is_symbol(token, c);
@@ -308,20 +314,16 @@ parser_left_op_has_priority (const char* op_left , const char* op_right)
     struct expressionable_op_precedence_group* group_left = NULL;
     struct expressionable_op_precedence_group* group_right = NULL;
 
-    if (S_EQ(op_left, op_right))
-    {
-        return false;
-    }
-
     int precedence_left = parser_get_precedence_for_operator(op_left, &group_left);
     int precedence_right = parser_get_precedence_for_operator(op_right, &group_right);
 
-    if (group_left->associtivity == ASSOCIATIVITY_RIGHT_TO_LEFT)
+    /* e.g `a - b - c` is `(a - b) - c` but `a = b = c` is `a = (b = c)`.  */
+    if (precedence_left == precedence_right)
     {
-        return false;
+        return group_left->associtivity == ASSOCIATIVITY_LEFT_TO_RIGHT;
     }
 
-    return precedence_left <= precedence_right;
+    return precedence_left < precedence_right;
 }
 
 void
@@ -345,19 +347,6 @@ parser_node_shift_children_left (struct node* node)
     node->exp.op = right_op;
 }
 
-void
-parser_node_move_right_left_to_left (struct node* node)
-{
-    make_exp_node (node->exp.left, node->exp.right->exp.left, node->exp.op);
-    struct node* completed_node = node_pop ();
-
-    /* Still need to deal with the right node.  */
-    const char* new_op = node->exp.right->exp.op;
-    node->exp.left = completed_node;
-    node->exp.right = node->exp.right->exp.right;
-    node->exp.op = new_op;
-}
-
 void
 parser_reorder_expression (struct node** node_out)
 {
@@ -367,21 +356,15 @@ parser_reorder_expression (struct node** node_out)
         return;
     }
 
-    /* No expressions, nothing to do... */
-    if (node->exp.left->type != NODE_TYPE_EXPRESSION &&
-        node->exp.right && node->exp.right->type != NODE_TYPE_EXPRESSION)
-    {
-        return;
-    }
-
     /*
      * e.i 50*E(30+20)
      *     50*EXPRESSION
      *     EXPRESSION(50*EXPRESSION(30+20))
      *     (50*30) + 20
+     * The left node is always a complete operand, so this also
+     * holds when it is an expression itself.
      */
-    if (node->exp.left->type != NODE_TYPE_EXPRESSION &&
-        node->exp.right && node->exp.right->type == NODE_TYPE_EXPRESSION)
+    if (node->exp.right && node->exp.right->type == NODE_TYPE_EXPRESSION)
     {
         const char* right_op = node->exp.right->exp.op;
         if (parser_left_op_has_priority(node->exp.op, right_op))
@@ -401,14 +384,59 @@ parser_reorder_expression (struct node** node_out)
 
         }
     }
+}
 
-    if ((is_array_node (node->exp.left) ||
-         is_node_assignment (node->exp.right)) ||
-       ((node_is_expression (node->exp.left, "()")) &&
-         node_is_expression (node->exp.right, ",")))
+static bool
+parser_is_unary_operator (const char* op)
+{
+    return S_EQ (op, "-")  ||
+           S_EQ (op, "!")  ||
+           S_EQ (op, "~")  ||
+           S_EQ (op, "*")  ||
+           S_EQ (op, "&")  ||
+           S_EQ (op, "++") ||
+           S_EQ (op, "--");
+}
+
+/* Operators that bind tighter than any unary operator.  */
+static bool
+parser_is_postfix_operator (const char* op)
+{
+    return S_EQ (op, "[]") ||
+           S_EQ (op, "()") ||
+           S_EQ (op, ".")  ||
+           S_EQ (op, "->");
+}
+
+/* Unary operators and casts parse their operand as a full expression,
+   e.g `-a + b` gives them `a + b`.  They bind tighter than every binary
+   operator except the postfix ones, so the prefix belongs to the
+   leftmost operand: `(-a) + b`.  Returns where that operand lives.  */
+static struct node**
+parser_prefix_operand (struct node** node_ptr)
+{
+    struct node* node = *node_ptr;
+    while (node->type == NODE_TYPE_EXPRESSION &&
+           !parser_is_postfix_operator (node->exp.op))
     {
-        parser_node_move_right_left_to_left (node);
+        node_ptr = &node->exp.left;
+        node = *node_ptr;
     }
+
+    return node_ptr;
+}
+
+void
+parse_for_unary (struct history* history)
+{
+    const char* unary_op = token_next ()->sval;
+    parse_expressionable (history_begin (0));
+    struct node* exp_node = node_pop ();
+
+    struct node** operand = parser_prefix_operand (&exp_node);
+    make_unary_node (unary_op, *operand, 0);
+    *operand = node_pop ();
+    node_push (exp_node);
 }
 
 void
@@ -417,9 +445,25 @@ parse_exp_normal (struct history* history)
     struct token* op_token = token_peek_next();
     const char* op = op_token->sval;
     struct node* node_left = node_peek_expressionable_or_null();
-    /* If the last node is not compatible to an expression, return. */
+    /* Nothing on the left, e.g `-a` or `*ptr`. */
     if (!node_left)
     {
+        if (!parser_is_unary_operator (op))
+        {
+            compiler_error (current_process,
+                            "The operator %s has no left operand\n", op);
+        }
+
+        parse_for_unary (history);
+        return;
+    }
+
+    /* `i++` or `i--`.  */
+    if (S_EQ (op, "++") || S_EQ (op, "--"))
+    {
+        token_next ();
+        node_pop ();
+        make_unary_node (op, node_left, UNARY_FLAG_IS_POSTFIX);
         return;
     }
 
@@ -481,7 +525,10 @@ parse_for_parentheses (struct history* history)
     struct node* exp_node = parser_blank_node;
     if (!token_next_is_symbol (')'))
     {
+        bool was_inside_initializer = parser_inside_initializer;
+        parser_inside_initializer = false;
         parse_expressionable_root (history_begin (0));
+        parser_inside_initializer = was_inside_initializer;
         exp_node = node_pop ();
     }
 
@@ -518,7 +565,7 @@ parse_for_comma (struct history* history)
 void
 parse_for_array (struct history* history)
 {
-    struct node* left_node = node_peek_or_null ();
+    struct node* left_node = node_peek_expressionable_or_null ();
     if (left_node)
     {
         node_pop ();
@@ -551,8 +598,12 @@ parse_for_cast (void)
 
     parse_expressionable (history_begin (0));
 
-    struct node* operand_node = node_pop ();
-    make_cast_node (&dtype, operand_node);
+    /* Casts bind like unary operators.  */
+    struct node* exp_node = node_pop ();
+    struct node** operand = parser_prefix_operand (&exp_node);
+    make_cast_node (&dtype, *operand);
+    *operand = node_pop ();
+    node_push (exp_node);
 }
 
 /*
@@ -597,12 +648,65 @@ static bool is_keyword_variable_modifier(const char* val)
 {
     return S_EQ(val, "unsigned")    ||
            S_EQ(val, "signed")      ||
-           S_EQ(val, "statis" )     ||
+           S_EQ(val, "static")      ||
            S_EQ(val, "const")       ||
            S_EQ(val, "extern")      ||
+           S_EQ(val, "restrict")    ||
+           S_EQ(val, "inline")      ||
+           S_EQ(val, "__attribute__") ||
            S_EQ(val, "__ignore_typecheck__");
 }
 
+/* `__attribute__ ((a, b (c), ...))`, the `__attribute__` is already
+   taken.  Only the ones about inlining mean something, the others
+   are skipped with their arguments.  */
+static void
+parse_attributes (struct datatype* dtype)
+{
+    expect_op ("(");
+    expect_op ("(");
+    while (!token_next_is_symbol (')'))
+    {
+        struct token* token = token_next ();
+        if (token->type == TOKEN_TYPE_IDENTIFIER && \
+            (S_EQ (token->sval, "always_inline") || \
+             S_EQ (token->sval, "__always_inline__")))
+        {
+            dtype->flags |= DATATYPE_FLAG_ALWAYS_INLINE;
+        }
+        else if (token->type == TOKEN_TYPE_IDENTIFIER && \
+                 (S_EQ (token->sval, "noinline") || \
+                  S_EQ (token->sval, "__noinline__")))
+        {
+            dtype->flags |= DATATYPE_FLAG_NO_INLINE;
+        }
+
+        if (token_next_is_operator ("("))
+        {
+            int depth = 0;
+            do
+            {
+                token = token_next ();
+                if (token_is_operator (token, "("))
+                {
+                    depth++;
+                }
+                else if (token_is_symbol (token, ')'))
+                {
+                    depth--;
+                }
+            } while (depth);
+        }
+
+        if (token_next_is_operator (","))
+        {
+            token_next ();
+        }
+    }
+    expect_sym (')');
+    expect_sym (')');
+}
+
 void
 parse_datatype_modifiers (struct datatype* dtype)
 {
@@ -642,6 +746,17 @@ parse_datatype_modifiers (struct datatype* dtype)
         {
             dtype->flags |= DATATYPE_FLAG_IS_IGNORE_TYPE_CHECKING;
         }
+        else if (S_EQ(token->sval, "inline"))
+        {
+            dtype->flags |= DATATYPE_FLAG_IS_INLINE;
+        }
+        else if (S_EQ(token->sval, "__attribute__"))
+        {
+            token_next();
+            parse_attributes(dtype);
+            token = token_peek_next();
+            continue;
+        }
 
         token_next();
         token = token_peek_next();
@@ -692,7 +807,8 @@ void parser_datatype_init_type_and_size_for_primitive (struct token* datatype_to
 void
 parser_datatype_adjust_size_for_secondary (struct datatype* datatype, struct token* datatype_secondary_token)
 {
-    if (!datatype_secondary_token)
+    /* `long int` and `short int` are just `long` and `short`.  */
+    if (!datatype_secondary_token || S_EQ (datatype_secondary_token->sval, "int"))
     {
         return;
     }
@@ -717,7 +833,7 @@ parser_datatype_is_secondary_allowed_for_type (const char* type)
 void
 parser_datatype_init_type_and_size_for_primitive (struct token* datatype_token, struct token* datatype_secondary_token, struct datatype* datatype_out)
 {
-    if (parser_datatype_is_secondary_allowed_for_type(datatype_token->sval), datatype_secondary_token)
+    if (!parser_datatype_is_secondary_allowed_for_type(datatype_token->sval) && datatype_secondary_token)
     {
         compiler_error(current_process, "You are not allowed a secondary datatype here for the given datatype.");
     }
@@ -745,8 +861,7 @@ parser_datatype_init_type_and_size_for_primitive (struct token* datatype_token,
     else if (S_EQ(datatype_token->sval, "long"))
     {
         datatype_out->type = DATA_TYPE_LONG;
-        /* This is to be cahnged later. For now, keep as DWORD. */
-        datatype_out->size = DATA_SIZE_DWORD;
+        datatype_out->size = DATA_SIZE_POINTER;
     }
     else if (S_EQ(datatype_token->sval, "float"))
     {
@@ -823,6 +938,13 @@ parser_datatype_init_type_and_size (struct token* datatype_token,
         compiler_error(current_process, "You provided an invalid secondary datatype.\n");
     }
 
+    /* e.g `int**` has a pointer depth of 2.  */
+    if (pointer_depth > 0)
+    {
+        datatype_out->flags |= DATATYPE_FLAG_IS_POINTER;
+        datatype_out->pointer_depth = pointer_depth;
+    }
+
     switch (expected_type)
     {
         case DATA_TYPE_EXPECT_PRIMITIVE:
@@ -855,8 +977,12 @@ parser_datatype_init (struct token* datatype_token,
 
     if (S_EQ(datatype_token->sval, "long") && datatype_secondary_token && S_EQ(datatype_secondary_token->sval, "long"))
     {
-        compiler_warning(current_process, "Our compiler does not support 64 bit longs, therefore your `long long` is defaulting to 32 bits.\n");
-        datatype_out->size = DATA_SIZE_DWORD;
+        /* Only x86-64 has registers wide enough for 64 bits.  */
+        if (!compiler_target_is_x86_64())
+        {
+            compiler_warning(current_process, "Our compiler does not support 64 bit longs on x86, therefore your `long long` is defaulting to 32 bits.\n");
+        }
+        datatype_out->size = DATA_SIZE_POINTER;
     }
 }
 
@@ -982,7 +1108,7 @@ datatype_struct_node_fix (struct fixup* fixup)
     struct datatype_struct_node_fix_private* private = fixup_private (fixup);
     struct datatype* dtype = &private->node->var.type;
     dtype->type = DATA_TYPE_STRUCT;
-    dtype->type = size_of_struct (dtype->type_str);
+    dtype->size = size_of_struct (dtype->type_str);
     dtype->struct_node = struct_node_for_name (current_process, \
                                                dtype->type_str);
     if (!dtype->struct_node)
@@ -1050,8 +1176,10 @@ parser_scope_offset_for_stack (struct node* node, struct history* history)
         offset = stack_addition;
         if (last_entity)
         {
-            offset = datatype_size (&variable_node (
-                                        last_entity->node)->var.type);
+            /* Every argument is pushed as at least one stack slot.  */
+            offset = align_value (datatype_size (&variable_node (
+                                  last_entity->node)->var.type),
+                                  STACK_PUSH_SIZE);
         }
     }
 
@@ -1064,9 +1192,13 @@ parser_scope_offset_for_stack (struct node* node, struct history* history)
         offset += variable_node(last_entity->node)->var.aoffset;
         if (variable_node_is_primitive(node))
         {
-            variable_node(node)->var.padding = padding(upwards_stack ? offset : -offset, node->var.type.size);
+            variable_node(node)->var.padding = padding(upwards_stack ? offset : -offset, datatype_element_size (&node->var.type));
         }
     }
+
+    variable_node (node)->var.aoffset = offset + (upwards_stack ? \
+                                        variable_node (node)->var.padding : \
+                                        -variable_node (node)->var.padding);
 }
 
 /* Global variables dont have offsets. They have an address in memory. */
@@ -1084,13 +1216,16 @@ void
 parser_scope_offset_for_structure (struct node* node, struct history* history)
 {
     int offset = 0;
-    struct parser_scope_entity* last_entity = parser_scope_last_entity();
+    /* Only members of this structure body count.  */
+    struct parser_scope_entity* last_entity = \
+                        scope_last_entity_at_scope (scope_current (current_process));
     if (last_entity)
     {
-        offset += last_entity->stack_offset + last_entity->node->var.type.size;
+        offset += last_entity->stack_offset + \
+                  datatype_size (&last_entity->node->var.type);
         if (variable_node_is_primitive(node))
         {
-            node->var.padding = padding(offset, node->var.type.size);
+            node->var.padding = padding(offset, datatype_element_size (&node->var.type));
         }
 
         node->var.aoffset = offset + node->var.padding;
@@ -1111,6 +1246,13 @@ parser_scope_offset (struct node* node, struct history* history)
         parser_scope_offset_for_structure(node, history);
         return;
     }
+
+    /* All members of an union share the same memory.  */
+    if (history->flags & HISTORY_FLAG_INSIDE_UNION)
+    {
+        node->var.aoffset = 0;
+        return;
+    }
     parser_scope_offset_for_stack(node, history);
 }
 
@@ -1163,6 +1305,75 @@ parse_array_brackets (struct history* history)
     return brackets;
 }
 
+/* `{1, 2, {3, 4}}`, values are separated by commas and a trailing
+   comma is allowed.  */
+void
+parse_initializer (struct history* history)
+{
+    struct vector* values = vector_create (sizeof (struct node*));
+    expect_sym ('{');
+    while (!token_next_is_symbol ('}'))
+    {
+        if (token_next_is_symbol ('{'))
+        {
+            parse_initializer (history);
+        }
+        else
+        {
+            bool was_inside_initializer = parser_inside_initializer;
+            parser_inside_initializer = true;
+            parse_expressionable_root (history);
+            parser_inside_initializer = was_inside_initializer;
+        }
+
+        struct node* value_node = node_pop ();
+        vector_push (values, &value_node);
+        if (!token_next_is_operator (","))
+        {
+            break;
+        }
+        token_next ();
+    }
+    expect_sym ('}');
+
+    make_initializer_node (values);
+}
+
+/* `int a[] = {1, 2, 3};` and `char s[] = "abc";` take their
+   size from the initializer.  */
+void
+parser_array_size_from_value (struct datatype* dtype, struct node* value_node)
+{
+    struct array_brackets* brackets = dtype->array.brackets;
+    if (!value_node || vector_count (array_brackets_node_vector (brackets)))
+    {
+        return;
+    }
+
+    long long total = 0;
+    if (value_node->type == NODE_TYPE_INITIALIZER)
+    {
+        total = vector_count (value_node->initializer.values);
+    }
+    else if (value_node->type == NODE_TYPE_STRING)
+    {
+        total = strlen (value_node->sval) + 1;
+    }
+    else
+    {
+        compiler_error (current_process, "Invalid initializer for an array");
+    }
+
+    node_create (&(struct node)
+    {
+        .type=NODE_TYPE_NUMBER,
+        .llnum=total
+    });
+    make_bracket_node (node_pop ());
+    array_brackets_add (brackets, node_pop ());
+    dtype->array.size = array_brackets_calculate_size (dtype, brackets);
+}
+
 void
 parse_variable (struct datatype* dtype, struct token* name_token, struct history* history)
 {
@@ -1186,10 +1397,22 @@ parse_variable (struct datatype* dtype, struct token* name_token, struct history
     {
         /* Ignore the `=` operator. */
         token_next();
-        parse_expressionable_root(history);
+        if (token_next_is_symbol ('{'))
+        {
+            parse_initializer (history);
+        }
+        else
+        {
+            parse_expressionable_root(history);
+        }
         value_node = node_pop();
     }
 
+    if (brackets)
+    {
+        parser_array_size_from_value (dtype, value_node);
+    }
+
     make_variable_node_and_register(history, dtype, name_token, value_node);
 }
 
@@ -1212,20 +1435,33 @@ parse_function (struct datatype* ret_type, struct token* name_token,
     struct node* function_node = node_peek ();
     parser_current_function = function_node;
 
-    /* If we are returning a struct or union.  */
-    if (datatype_is_struct_or_union (ret_type))
+    /* A struct or union is returned through a hidden pointer, on
+       x86-64 only when it is too big for registers.  Functions
+       taking their arguments in registers find the others without
+       it, but their cdecl entry has it.  */
+    if (datatype_is_struct_or_union (ret_type) && \
+        !(ret_type->flags & DATATYPE_FLAG_IS_POINTER) && \
+        (!compiler_target_is_x86_64 () || \
+         !datatype_is_returned_in_registers (ret_type)))
     {
-        function_node->func.args.stack_addition += DATA_SIZE_DWORD;
+        function_node->func.args.stack_addition += DATA_SIZE_POINTER;
     }
 
     expect_op ("(");
     arguments_vector = parse_function_arguments (history_begin (0));
     expect_sym (')');
 
+    /* `int f (int) __attribute__ ((noinline));`  */
+    while (token_next_is_keyword ("__attribute__"))
+    {
+        token_next ();
+        parse_attributes (&function_node->func.rtype);
+    }
+
     function_node->func.args.vector = arguments_vector;
     /* e.g. for prototype.  */
     if (symbol_resolver_get_symbol_for_native_function (current_process,
-                                                        name_token->sval));
+                                                        name_token->sval))
     {
         function_node->func.flags |= FUNCTION_NODE_FLAG_IS_NATIVE;
     }
@@ -1253,11 +1489,13 @@ parse_symbol ()
     if (token_next_is_symbol('{'))
     {
         size_t variable_size = 0;
-        struct history* history = history_begin(HISTORY_FLAG_IS_GLOBAL_SCOPE);
+        /* A nested block lives on the stack of the enclosing function.  */
+        struct history* history = history_begin(HISTORY_FLAG_INSIDE_FUNCTION_BODY);
         parse_body(&variable_size, history);
         struct node* body_node = node_pop();
 
         node_push(body_node);
+        return;
     }
     else if (token_next_is_symbol (':'))
     {
@@ -1271,6 +1509,21 @@ parse_symbol ()
 void
 parse_statement (struct history* history)
 {
+    /* e.g `#pragma unroll 4` before a for loop.  */
+    if (token_next_is_symbol ('#'))
+    {
+        parse_pragma (history);
+        return;
+    }
+
+    /* Empty statement, e.g `for (;;) ;` */
+    if (token_next_is_symbol (';'))
+    {
+        expect_sym (';');
+        node_push (parser_blank_node);
+        return;
+    }
+
     /* e.g `return 50;` */
     if (token_peek_next()->type == TOKEN_TYPE_KEYWORD)
     {
@@ -1664,6 +1917,7 @@ parse_function_arguments (struct history* history)
         if (token_next_is_operator ("."))
         {
             token_read_dots (3);
+            parser_current_function->func.flags |= FUNCTION_NODE_FLAG_IS_VARIADIC;
             parser_scope_finish ();
             return arguments_vec;
         }
@@ -1826,7 +2080,7 @@ parse_return (struct history* history)
 {
     expect_keyword ("return");
     /* For returns with no expressions: `return;`  */
-    if (token_next_is_symbol (";"))
+    if (token_next_is_symbol (';'))
     {
         expect_sym (';');
         make_return_node (NULL);
@@ -1859,6 +2113,16 @@ parse_case (struct history* history)
     struct node* case_exp_node = node_pop ();
     expect_sym (':');
 
+    /* `case -1:`  */
+    if (case_exp_node->type == NODE_TYPE_UNARY &&
+        S_EQ (case_exp_node->unary.op, "-") &&
+        case_exp_node->unary.operand->type == NODE_TYPE_NUMBER)
+    {
+        case_exp_node->unary.operand->llnum = \
+                            -case_exp_node->unary.operand->llnum;
+        case_exp_node = case_exp_node->unary.operand;
+    }
+
     make_case_node (case_exp_node);
 
     if (case_exp_node->type != NODE_TYPE_NUMBER)
@@ -1869,6 +2133,35 @@ parse_case (struct history* history)
 
     struct node* case_node = node_pop ();
     parser_register_case (history, case_node);
+    node_push (case_node);
+}
+
+void
+parse_default (struct history* history)
+{
+    expect_keyword ("default");
+    expect_sym (':');
+    make_default_node ();
+}
+
+/* The history is copied for every statement of the body, so the
+   `default` is found by looking at the body afterwards.  */
+bool
+parser_switch_body_has_default (struct node* body_node)
+{
+    struct vector* statements = body_node->body.statements;
+    vector_set_peek_pointer (statements, 0);
+    struct node* statement = vector_peek_ptr (statements);
+    while (statement)
+    {
+        if (statement->type == NODE_TYPE_STATEMENT_DEFAULT)
+        {
+            return true;
+        }
+        statement = vector_peek_ptr (statements);
+    }
+
+    return false;
 }
 
 void
@@ -1880,6 +2173,8 @@ parse_switch (struct history* history)
     size_t variable_size = 0;
     parse_body (&variable_size, history);
     struct node* body_node = node_pop ();
+    _switch.case_data.has_default_case = \
+                        parser_switch_body_has_default (body_node);
 
     /* Make the switch node.  */
     make_switch_node (switch_exp_node, body_node, _switch.case_data.cases,
@@ -2018,6 +2313,63 @@ parse_label (struct history* history)
     make_label_node (label_name_node);
 }
 
+/* The next token when it is on the current line, NULL otherwise.  */
+static struct token*
+token_next_on_line ()
+{
+    struct token* token = vector_peek_no_increment (current_process->token_vec);
+    if (!token || token->type == TOKEN_TYPE_NEWLINE)
+    {
+        return NULL;
+    }
+
+    return vector_peek (current_process->token_vec);
+}
+
+/* `#pragma unroll`, `#pragma unroll N` or `#pragma GCC unroll N`
+   applies to the for loop after it, the statement then parsed with
+   it.  Other pragmas are ignored.  */
+void
+parse_pragma (struct history* history)
+{
+    expect_sym ('#');
+    struct token* token = token_next_on_line ();
+    if (!token || token->type != TOKEN_TYPE_IDENTIFIER || !S_EQ (token->sval, "pragma"))
+    {
+        compiler_error (current_process, "Expecting a pragma after #\n");
+    }
+
+    int unroll = 0;
+    token = token_next_on_line ();
+    if (token && token->type == TOKEN_TYPE_IDENTIFIER && S_EQ (token->sval, "GCC"))
+    {
+        token = token_next_on_line ();
+    }
+
+    if (token && token->type == TOKEN_TYPE_IDENTIFIER && S_EQ (token->sval, "unroll"))
+    {
+        unroll = -1;
+        token = token_next_on_line ();
+        if (token && token->type == TOKEN_TYPE_NUMBER)
+        {
+            /* Unrolling zero times keeps the loop as it is, like once.  */
+            unroll = token->llnum ? (int) (token->llnum < INT_MAX ? token->llnum : INT_MAX) : 1;
+        }
+    }
+
+    while (token)
+    {
+        token = token_next_on_line ();
+    }
+
+    parse_statement (history);
+    struct node* node = node_peek ();
+    if (node->type == NODE_TYPE_STATEMENT_FOR)
+    {
+        node->stmt.for_stmt.unroll = unroll;
+    }
+}
+
 void
 parse_for_tenary (struct history* history)
 {
@@ -2029,9 +2381,100 @@ parse_for_tenary (struct history* history)
     parse_expressionable_root (history_down (history, HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
     struct node* false_result_node = node_pop ();
 
+    /* `a ? b : c, d` is `(a ? b : c), d`, the comma expression
+       does not belong to the false result.  */
+    struct node* comma_root = NULL;
+    struct node* comma_node = NULL;
+    if (node_is_expression (false_result_node, ","))
+    {
+        comma_root = false_result_node;
+        comma_node = comma_root;
+        while (node_is_expression (comma_node->exp.left, ","))
+        {
+            comma_node = comma_node->exp.left;
+        }
+        false_result_node = comma_node->exp.left;
+    }
+
     make_tenary_node (true_result_node, false_result_node);
     struct node* tenary_node = node_pop ();
     make_exp_node (condition_node, tenary_node, "?");
+    if (comma_root)
+    {
+        comma_node->exp.left = node_pop ();
+        node_push (comma_root);
+    }
+}
+
+struct node*
+parser_scope_variable_for_name (const char* name)
+{
+    struct scope* scope = scope_current (current_process);
+    while (scope)
+    {
+        for (int i = vector_count (scope->entities) - 1; i >= 0; i--)
+        {
+            struct parser_scope_entity* entity = \
+                        *(struct parser_scope_entity**) vector_at (scope->entities, i);
+            struct node* var_node = variable_node (entity->node);
+            if (var_node && S_EQ (var_node->var.name, name))
+            {
+                return var_node;
+            }
+        }
+        scope = scope->parent;
+    }
+
+    return NULL;
+}
+
+/* `sizeof (int)`, `sizeof (struct abc*)` or `sizeof (x)`.
+   The size is known while parsing, so a number node is made.  */
+void
+parse_sizeof (struct history* history)
+{
+    expect_keyword ("sizeof");
+    bool has_parentheses = token_next_is_operator ("(");
+    if (has_parentheses)
+    {
+        expect_op ("(");
+    }
+
+    size_t size = 0;
+    struct token* token = token_peek_next ();
+    if (token->type == TOKEN_TYPE_KEYWORD)
+    {
+        struct datatype dtype;
+        parse_datatype (&dtype);
+        size = datatype_size (&dtype);
+    }
+    else if (token->type == TOKEN_TYPE_IDENTIFIER)
+    {
+        token_next ();
+        struct node* var_node = parser_scope_variable_for_name (token->sval);
+        if (!var_node)
+        {
+            compiler_error (current_process,
+                            "sizeof of unknown variable %s\n", token->sval);
+        }
+        size = variable_size (var_node);
+    }
+    else
+    {
+        compiler_error (current_process,
+            "sizeof only supports datatypes and variable names\n");
+    }
+
+    if (has_parentheses)
+    {
+        expect_sym (')');
+    }
+
+    node_create (&(struct node)
+    {
+        .type=NODE_TYPE_NUMBER,
+        .llnum=size
+    });
 }
 
 /* Responsible for parsing all keyword tokens. */
@@ -2096,6 +2539,16 @@ parse_keyword (struct history* history)
         parse_case (history);
         return;
     }
+    else if (S_EQ (token->sval, "default"))
+    {
+        parse_default (history);
+        return;
+    }
+    else if (S_EQ (token->sval, "sizeof"))
+    {
+        parse_sizeof (history);
+        return;
+    }
     compiler_error (current_process, "Invalid keyword.\n");
 }
 
@@ -2114,8 +2567,14 @@ parse_expressionable_single (struct history* history)
         return -1;
     }
 
+    if (parser_inside_initializer && token->type == TOKEN_TYPE_OPERATOR && \
+        S_EQ (token->sval, ","))
+    {
+        return -1;
+    }
+
     /* When this flag is set, it means that we are inside an expression */
-    history->flags |= NODE_FLAG_INSIDE_EXPRESSION;
+    history->flags |= HISTORY_FLAG_INSIDE_EXPRESSION;
     int res = -1;
     switch (token->type)
     {
@@ -2161,7 +2620,7 @@ parse_expressionable (struct history* history)
 void
 parse_keyword_for_global()
 {
-    parse_keyword(history_begin(0));
+    parse_keyword(history_begin(HISTORY_FLAG_IS_GLOBAL_SCOPE));
     struct node* node = node_pop();
 
     node_push(node);
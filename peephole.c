@@ -0,0 +1,605 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Peephole optimisation over the instructions of a function, run
+   before they are printed.  Every rule looks at a short window of
+   instructions that control flow cannot enter in the middle of,
+   labels end a window.  */
+
+struct asm_instruction*
+asm_instruction_new (const char* text)
+{
+    struct asm_instruction* instruction = \
+                    calloc (1, sizeof (struct asm_instruction));
+    instruction->text = strdup (text);
+    size_t len = strlen (text);
+    if (len && text[len - 1] == ':' && !strchr (text, ' '))
+    {
+        instruction->label = strndup (text, len - 1);
+        return instruction;
+    }
+
+    if (text[0] == ';' || !len)
+    {
+        return instruction;
+    }
+
+    const char* space = strchr (text, ' ');
+    if (!space)
+    {
+        instruction->mnemonic = strdup (text);
+        return instruction;
+    }
+
+    instruction->mnemonic = strndup (text, space - text);
+    const char* operand = space + 1;
+    while (operand && instruction->total_operands < 2)
+    {
+        const char* comma = strchr (operand, ',');
+        size_t operand_len = comma ? (size_t) (comma - operand) : strlen (operand);
+        instruction->operands[instruction->total_operands++] = \
+                        strndup (operand, operand_len);
+        operand = comma ? comma + 1 : NULL;
+        while (operand && *operand == ' ')
+        {
+            operand++;
+        }
+    }
+    return instruction;
+}
+
+void
+asm_instruction_free (struct asm_instruction* instruction)
+{
+    free (instruction->text);
+    free (instruction->mnemonic);
+    free (instruction->operands[0]);
+    free (instruction->operands[1]);
+    free (instruction->label);
+    free (instruction);
+}
+
+/* Replaces the instruction by `mnemonic op0, op1`.  */
+static void
+peephole_rewrite (struct asm_instruction* instruction, const char* mnemonic,
+                  const char* op0, const char* op1)
+{
+    char text[256];
+    if (op1)
+    {
+        snprintf (text, sizeof (text), "%s %s, %s", mnemonic, op0, op1);
+    }
+    else
+    {
+        snprintf (text, sizeof (text), "%s %s", mnemonic, op0);
+    }
+
+    char* mnemonic_copy = strdup (mnemonic);
+    char* op0_copy = strdup (op0);
+    char* op1_copy = op1 ? strdup (op1) : NULL;
+    free (instruction->text);
+    free (instruction->mnemonic);
+    free (instruction->operands[0]);
+    free (instruction->operands[1]);
+    instruction->text = strdup (text);
+    instruction->mnemonic = mnemonic_copy;
+    instruction->operands[0] = op0_copy;
+    instruction->operands[1] = op1_copy;
+    instruction->total_operands = op1 ? 2 : 1;
+}
+
+static struct asm_instruction*
+peephole_at (struct vector* instructions, int index)
+{
+    return vector_peek_ptr_at (instructions, index);
+}
+
+/* Index of the first instruction after `index` still there, -1 at
+   the end.  */
+static int
+peephole_next (struct vector* instructions, int index)
+{
+    for (int i = index + 1; i < vector_count (instructions); i++)
+    {
+        if (!peephole_at (instructions, i)->deleted)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool
+peephole_is (struct asm_instruction* instruction, const char* mnemonic)
+{
+    return instruction->mnemonic && S_EQ (instruction->mnemonic, mnemonic);
+}
+
+static bool
+peephole_is_register (const char* operand)
+{
+    static const char* registers[] = {
+        "eax", "ebx", "ecx", "edx", "esi", "edi", NULL
+    };
+
+    for (int i = 0; registers[i]; i++)
+    {
+        if (S_EQ (operand, registers[i]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+peephole_is_number (const char* operand, long* value)
+{
+    char* end = NULL;
+    *value = strtol (operand, &end, 10);
+    return end != operand && *end == '\0';
+}
+
+/* Names `reg` goes by in part or in full, the qword names on
+   x86-64 included.  */
+static bool
+peephole_is_alias (const char* name, const char* reg)
+{
+    static const char* aliases[][6] = {
+        {"eax", "rax", "ax", "al", "ah", NULL},
+        {"ebx", "rbx", "bx", "bl", "bh", NULL},
+        {"ecx", "rcx", "cx", "cl", "ch", NULL},
+        {"edx", "rdx", "dx", "dl", "dh", NULL},
+        {"esi", "rsi", "si", "sil", NULL},
+        {"edi", "rdi", "di", "dil", NULL},
+        {"esp", "rsp", "sp", "spl", NULL},
+        {"ebp", "rbp", "bp", "bpl", NULL}
+    };
+
+    for (int i = 0; i < sizeof (aliases) / sizeof (aliases[0]); i++)
+    {
+        bool is_group = false;
+        for (int j = 0; aliases[i][j]; j++)
+        {
+            is_group |= S_EQ (aliases[i][j], reg);
+        }
+
+        if (!is_group)
+        {
+            continue;
+        }
+
+        for (int j = 0; aliases[i][j]; j++)
+        {
+            if (S_EQ (aliases[i][j], name))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* Whether `operand` names `reg`, also through its other widths or
+   inside a memory operand.  */
+static bool
+peephole_operand_mentions (const char* operand, const char* reg)
+{
+    const char* ptr = operand;
+    while (*ptr)
+    {
+        if (!isalpha (*ptr))
+        {
+            ptr++;
+            continue;
+        }
+
+        char name[64];
+        int len = 0;
+        while ((isalnum (*ptr) || *ptr == '_' || *ptr == '.') && len < 63)
+        {
+            name[len++] = *ptr++;
+        }
+        name[len] = '\0';
+        if (peephole_is_alias (name, reg))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Whether an operand of the instruction names `reg`.  */
+static bool
+peephole_mentions (struct asm_instruction* instruction, const char* reg)
+{
+    for (int i = 0; i < instruction->total_operands; i++)
+    {
+        if (peephole_operand_mentions (instruction->operands[i], reg))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Instructions that only touch the registers they name and leave
+   the stack pointer alone.  */
+static bool
+peephole_is_simple (struct asm_instruction* instruction)
+{
+    static const char* simple[] = {
+        "mov", "movzx", "movsx", "lea", "add", "sub", "and", "or", "xor",
+        "shl", "shr", "sar", "neg", "not", "cmp", "test", NULL
+    };
+
+    if (!instruction->mnemonic || peephole_mentions (instruction, "esp"))
+    {
+        return false;
+    }
+
+    if (peephole_is (instruction, "imul") && instruction->total_operands == 2)
+    {
+        return true;
+    }
+
+    if (!strncmp (instruction->mnemonic, "set", 3))
+    {
+        return true;
+    }
+
+    for (int i = 0; simple[i]; i++)
+    {
+        if (S_EQ (instruction->mnemonic, simple[i]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+peephole_is_jump (struct asm_instruction* instruction)
+{
+    return instruction->mnemonic && instruction->mnemonic[0] == 'j';
+}
+
+/* `push x` ... `pop y` becomes `mov y, x` when what lies between
+   neither uses y nor the stack.  */
+static bool
+peephole_push_pop (struct vector* instructions, int index)
+{
+    struct asm_instruction* push = peephole_at (instructions, index);
+    if (!peephole_is (push, "push"))
+    {
+        return false;
+    }
+
+    int i = peephole_next (instructions, index);
+    while (i != -1 && peephole_is_simple (peephole_at (instructions, i)))
+    {
+        i = peephole_next (instructions, i);
+    }
+
+    if (i == -1)
+    {
+        return false;
+    }
+
+    struct asm_instruction* pop = peephole_at (instructions, i);
+    if (!peephole_is (pop, "pop") || !peephole_is_register (pop->operands[0]))
+    {
+        return false;
+    }
+
+    const char* reg = pop->operands[0];
+    for (int j = peephole_next (instructions, index); j != i;
+         j = peephole_next (instructions, j))
+    {
+        if (peephole_mentions (peephole_at (instructions, j), reg))
+        {
+            return false;
+        }
+    }
+
+    pop->deleted = true;
+    if (S_EQ (push->operands[0], reg))
+    {
+        push->deleted = true;
+        return true;
+    }
+
+    char source[128];
+    snprintf (source, sizeof (source), "%s", push->operands[0]);
+    peephole_rewrite (push, "mov", reg, source);
+    return true;
+}
+
+/* Memory operand without its size keyword.  */
+static const char*
+peephole_memory (const char* operand)
+{
+    if (!strncmp (operand, "dword ", 6))
+    {
+        operand += 6;
+    }
+
+    return operand[0] == '[' ? operand : NULL;
+}
+
+/* A load right after a store or a load of the same dword reads
+   what is already in a register.  */
+static bool
+peephole_forward (struct vector* instructions, int index)
+{
+    struct asm_instruction* first = peephole_at (instructions, index);
+    int next_index = peephole_next (instructions, index);
+    if (next_index == -1 || !peephole_is (first, "mov") || \
+        first->total_operands != 2)
+    {
+        return false;
+    }
+
+    struct asm_instruction* second = peephole_at (instructions, next_index);
+    if (!peephole_is (second, "mov") || second->total_operands != 2 || \
+        !peephole_is_register (second->operands[0]))
+    {
+        return false;
+    }
+
+    const char* memory = peephole_memory (second->operands[1]);
+    const char* reg = NULL;
+    const char* first_memory = NULL;
+    if (peephole_is_register (first->operands[1]))
+    {
+        /* mov [x], reg  */
+        reg = first->operands[1];
+        first_memory = peephole_memory (first->operands[0]);
+    }
+    else if (peephole_is_register (first->operands[0]))
+    {
+        /* mov reg, [x]  */
+        reg = first->operands[0];
+        first_memory = peephole_memory (first->operands[1]);
+        if (first_memory && peephole_operand_mentions (first_memory, reg))
+        {
+            return false;
+        }
+    }
+
+    if (!memory || !first_memory || !S_EQ (memory, first_memory) || \
+        strncmp (second->operands[1], "byte", 4) == 0 || \
+        strncmp (second->operands[1], "word", 4) == 0)
+    {
+        return false;
+    }
+
+    if (S_EQ (second->operands[0], reg))
+    {
+        second->deleted = true;
+        return true;
+    }
+
+    if (peephole_operand_mentions (memory, second->operands[0]))
+    {
+        return false;
+    }
+
+    char target[16];
+    char source[16];
+    snprintf (target, sizeof (target), "%s", second->operands[0]);
+    snprintf (source, sizeof (source), "%s", reg);
+    peephole_rewrite (second, "mov", target, source);
+    return true;
+}
+
+static bool
+peephole_labels_ahead (struct vector* instructions, int index, const char* label)
+{
+    for (int i = peephole_next (instructions, index); i != -1;
+         i = peephole_next (instructions, i))
+    {
+        struct asm_instruction* instruction = peephole_at (instructions, i);
+        if (peephole_is (instruction, "align"))
+        {
+            continue;
+        }
+
+        if (!instruction->label)
+        {
+            return false;
+        }
+
+        if (S_EQ (instruction->label, label))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const char*
+peephole_inverse_condition (const char* condition)
+{
+    static const char* pairs[][2] = {
+        {"e", "ne"}, {"z", "nz"}, {"l", "ge"}, {"le", "g"}, {"b", "ae"},
+        {"be", "a"}, {"s", "ns"}
+    };
+
+    for (int i = 0; i < sizeof (pairs) / sizeof (pairs[0]); i++)
+    {
+        if (S_EQ (condition, pairs[i][0]))
+        {
+            return pairs[i][1];
+        }
+
+        if (S_EQ (condition, pairs[i][1]))
+        {
+            return pairs[i][0];
+        }
+    }
+
+    return NULL;
+}
+
+/* Jumps to the next line go, so does the code after a jump that no
+   label makes reachable, and `jcc a; jmp b; a:` becomes `jncc b`.
+   A jump table in another section is not code after the jump, the
+   padding aligning a label is not in the way of one.  */
+static bool
+peephole_jump (struct vector* instructions, int index)
+{
+    struct asm_instruction* jump = peephole_at (instructions, index);
+    if (!peephole_is_jump (jump) && !peephole_is (jump, "ret"))
+    {
+        return false;
+    }
+
+    if (peephole_is_jump (jump) && \
+        peephole_labels_ahead (instructions, index, jump->operands[0]))
+    {
+        jump->deleted = true;
+        return true;
+    }
+
+    int next_index = peephole_next (instructions, index);
+    if (next_index == -1)
+    {
+        return false;
+    }
+
+    struct asm_instruction* next = peephole_at (instructions, next_index);
+    if (peephole_is (jump, "jmp") || peephole_is (jump, "ret"))
+    {
+        if (next->label || !next->mnemonic || peephole_is (next, "section") || \
+            peephole_is (next, "align"))
+        {
+            return false;
+        }
+
+        next->deleted = true;
+        return true;
+    }
+
+    const char* inverse = peephole_inverse_condition (jump->mnemonic + 1);
+    if (!inverse || !peephole_is (next, "jmp") || \
+        !peephole_labels_ahead (instructions, next_index, jump->operands[0]))
+    {
+        return false;
+    }
+
+    char mnemonic[16];
+    char target[128];
+    snprintf (mnemonic, sizeof (mnemonic), "j%s", inverse);
+    snprintf (target, sizeof (target), "%s", next->operands[0]);
+    peephole_rewrite (jump, mnemonic, target, NULL);
+    next->deleted = true;
+    return true;
+}
+
+/* Arguments are popped with `add esp, n` after each call.  Two
+   adjustments with only register and memory moves between them
+   become one, and the adjustment goes away when the frame is dropped
+   with `mov esp, ebp`.  A push in between would land elsewhere, the
+   arguments of an enclosing call must stay next to each other.  */
+static bool
+peephole_stack_adjustment (struct vector* instructions, int index)
+{
+    struct asm_instruction* add = peephole_at (instructions, index);
+    long amount = 0;
+    if (!peephole_is (add, "add") || !S_EQ (add->operands[0], "esp") || \
+        !peephole_is_number (add->operands[1], &amount))
+    {
+        return false;
+    }
+
+    for (int i = peephole_next (instructions, index); i != -1;
+         i = peephole_next (instructions, i))
+    {
+        struct asm_instruction* instruction = peephole_at (instructions, i);
+        long other = 0;
+        if (peephole_is (instruction, "add") && \
+            S_EQ (instruction->operands[0], "esp") && \
+            peephole_is_number (instruction->operands[1], &other))
+        {
+            char total[32];
+            snprintf (total, sizeof (total), "%li", amount + other);
+            peephole_rewrite (instruction, "add", "esp", total);
+            add->deleted = true;
+            return true;
+        }
+
+        if (peephole_is (instruction, "mov") && \
+            S_EQ (instruction->operands[0], "esp") && \
+            S_EQ (instruction->operands[1], "ebp"))
+        {
+            add->deleted = true;
+            return true;
+        }
+
+        if (!peephole_is_simple (instruction))
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/* Runs every rule at every instruction until none applies.  */
+void
+peephole_optimize (struct compile_process* process, struct vector* instructions)
+{
+    int hits[PEEPHOLE_TOTAL_RULES] = {0};
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count (instructions); i++)
+        {
+            if (peephole_at (instructions, i)->deleted)
+            {
+                continue;
+            }
+
+            int rule = -1;
+            if (peephole_push_pop (instructions, i))
+            {
+                rule = PEEPHOLE_RULE_PUSH_POP;
+            }
+            else if (peephole_forward (instructions, i))
+            {
+                rule = PEEPHOLE_RULE_FORWARD;
+            }
+            else if (peephole_jump (instructions, i))
+            {
+                rule = PEEPHOLE_RULE_JUMP;
+            }
+            else if (peephole_stack_adjustment (instructions, i))
+            {
+                rule = PEEPHOLE_RULE_STACK_ADJUSTMENT;
+            }
+
+            if (rule != -1)
+            {
+                hits[rule]++;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < PEEPHOLE_TOTAL_RULES; i++)
+    {
+        process->generator->peephole_hits[i] += hits[i];
+    }
+}
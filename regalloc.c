@@ -0,0 +1,424 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/* Linear scan register allocation, Poletto and Sarkar.
+   Intervals are sorted by start, at each start the intervals that
+   ended give their register back.  When no register is free the
+   interval that ends last is spilled and keeps its stack slot.  */
+
+/* The callee saved registers of each target, esi and edi carry
+   arguments on x86-64.  The frame pointer is last, only functions
+   without a frame get it.  */
+static const char* regalloc_registers[] = {
+    "ebx", "esi", "edi", "ebp"
+};
+
+static const char* regalloc_registers_x86_64[] = {
+    "rbx", "r12", "r13", "r14", "r15", "rbp"
+};
+
+int
+regalloc_total_registers ()
+{
+    return compiler_target_is_x86_64 () ? 5 : 3;
+}
+
+const char*
+regalloc_register_name (int index)
+{
+    assert (index >= 0 && index <= regalloc_total_registers ());
+    return compiler_target_is_x86_64 () ? regalloc_registers_x86_64[index] : \
+                                          regalloc_registers[index];
+}
+
+static int
+regalloc_register_index (const char* reg)
+{
+    for (int i = 0; i <= regalloc_total_registers (); i++)
+    {
+        if (S_EQ (regalloc_register_name (i), reg))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+struct regalloc*
+regalloc_new (struct node* function_node)
+{
+    struct regalloc* regalloc = calloc (1, sizeof (struct regalloc));
+    regalloc->function = function_node;
+    regalloc->intervals = vector_create (sizeof (struct regalloc_interval*));
+    regalloc->loops = vector_create (sizeof (struct regalloc_loop));
+    regalloc->total_registers = regalloc_total_registers ();
+    return regalloc;
+}
+
+void
+regalloc_free (struct regalloc* regalloc)
+{
+    for (int i = 0; i < vector_count (regalloc->intervals); i++)
+    {
+        free (vector_peek_ptr_at (regalloc->intervals, i));
+    }
+    vector_free (regalloc->intervals);
+    vector_free (regalloc->loops);
+    free (regalloc);
+}
+
+/* The function addresses its frame from the stack pointer, the
+   frame pointer is one more register to give out.  */
+void
+regalloc_free_frame_register (struct regalloc* regalloc)
+{
+    regalloc->total_registers = regalloc_total_registers () + 1;
+}
+
+/* Starts a walk over the function, positions restart from zero
+   so every walk numbers the statements the same way.  */
+void
+regalloc_begin (struct regalloc* regalloc, int state)
+{
+    regalloc->state = state;
+    regalloc->position = 0;
+    regalloc->temporaries_in_use = 0;
+}
+
+void
+regalloc_next_position (struct regalloc* regalloc)
+{
+    regalloc->position++;
+}
+
+/* Only scalars of this function whose address is never needed
+   can live in a register.  */
+bool
+regalloc_variable_is_eligible (struct regalloc* regalloc, struct node* var_node)
+{
+    struct datatype* dtype = &var_node->var.type;
+    if (var_node->binded.function != regalloc->function || !var_node->var.name)
+    {
+        return false;
+    }
+
+    if (dtype->flags & (DATATYPE_FLAG_IS_ARRAY | DATATYPE_FLAG_IS_STATIC | \
+                        DATATYPE_FLAG_IS_EXTERN))
+    {
+        return false;
+    }
+
+    if (datatype_is_struct_or_union (dtype) && \
+        !(dtype->flags & DATATYPE_FLAG_IS_POINTER))
+    {
+        return false;
+    }
+
+    return datatype_size (dtype) <= DATA_SIZE_DWORD;
+}
+
+static bool
+regalloc_variable_is_argument (struct regalloc* regalloc, struct node* var_node)
+{
+    struct vector* arguments = regalloc->function->func.args.vector;
+    for (int i = 0; arguments && i < vector_count (arguments); i++)
+    {
+        if (vector_peek_ptr_at (arguments, i) == var_node)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct regalloc_interval*
+regalloc_interval_for_variable (struct regalloc* regalloc, struct node* var_node)
+{
+    for (int i = 0; i < vector_count (regalloc->intervals); i++)
+    {
+        struct regalloc_interval* interval = \
+                        vector_peek_ptr_at (regalloc->intervals, i);
+        if (interval->var_node == var_node)
+        {
+            return interval;
+        }
+    }
+
+    return NULL;
+}
+
+void
+regalloc_record_use (struct regalloc* regalloc, struct node* var_node)
+{
+    if (regalloc->state != REGALLOC_STATE_COLLECT || \
+        !regalloc_variable_is_eligible (regalloc, var_node))
+    {
+        return;
+    }
+
+    struct regalloc_interval* interval = \
+                        regalloc_interval_for_variable (regalloc, var_node);
+    if (!interval)
+    {
+        interval = calloc (1, sizeof (struct regalloc_interval));
+        interval->var_node = var_node;
+        interval->start = regalloc->position;
+        interval->end = regalloc->position;
+        vector_push (regalloc->intervals, &interval);
+        return;
+    }
+
+    if (regalloc->position < interval->start)
+    {
+        interval->start = regalloc->position;
+    }
+
+    if (regalloc->position > interval->end)
+    {
+        interval->end = regalloc->position;
+    }
+}
+
+/* Interval of a virtual register of the IR, whose live range the
+   lowering computed from the control flow graph.  */
+struct regalloc_interval*
+regalloc_add_interval (struct regalloc* regalloc, int vreg, int start, int end)
+{
+    struct regalloc_interval* interval = calloc (1, sizeof (struct regalloc_interval));
+    interval->vreg = vreg;
+    interval->start = start;
+    interval->end = end;
+    vector_push (regalloc->intervals, &interval);
+    return interval;
+}
+
+void
+regalloc_record_address_taken (struct regalloc* regalloc, struct node* var_node)
+{
+    if (regalloc->state != REGALLOC_STATE_COLLECT)
+    {
+        return;
+    }
+
+    regalloc_record_use (regalloc, var_node);
+    struct regalloc_interval* interval = \
+                        regalloc_interval_for_variable (regalloc, var_node);
+    if (interval)
+    {
+        interval->address_taken = true;
+    }
+}
+
+void
+regalloc_record_loop (struct regalloc* regalloc, int start, int end)
+{
+    if (regalloc->state != REGALLOC_STATE_COLLECT)
+    {
+        return;
+    }
+
+    struct regalloc_loop loop = {.start=start, .end=end};
+    vector_push (regalloc->loops, &loop);
+}
+
+void
+regalloc_record_label (struct regalloc* regalloc)
+{
+    regalloc->has_labels = true;
+}
+
+/* A value used inside a loop may be needed again on the next
+   iteration, so it has to survive the whole loop.  */
+static void
+regalloc_extend_for_loops (struct regalloc* regalloc,
+                           struct regalloc_interval* interval)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count (regalloc->loops); i++)
+        {
+            struct regalloc_loop* loop = vector_at (regalloc->loops, i);
+            if (interval->start > loop->end || interval->end < loop->start)
+            {
+                continue;
+            }
+
+            if (loop->start < interval->start)
+            {
+                interval->start = loop->start;
+                changed = true;
+            }
+
+            if (loop->end > interval->end)
+            {
+                interval->end = loop->end;
+                changed = true;
+            }
+        }
+    }
+}
+
+static int
+regalloc_compare_start (const void* a, const void* b)
+{
+    const struct regalloc_interval* interval_a = \
+                        *(const struct regalloc_interval**) a;
+    const struct regalloc_interval* interval_b = \
+                        *(const struct regalloc_interval**) b;
+    return interval_a->start - interval_b->start;
+}
+
+void
+regalloc_allocate (struct regalloc* regalloc)
+{
+    int total = vector_count (regalloc->intervals);
+    struct regalloc_interval** sorted = \
+                        calloc (total + 1, sizeof (struct regalloc_interval*));
+    int total_sorted = 0;
+    for (int i = 0; i < total; i++)
+    {
+        struct regalloc_interval* interval = \
+                        vector_peek_ptr_at (regalloc->intervals, i);
+        if (interval->address_taken)
+        {
+            continue;
+        }
+
+        /* Arguments are loaded into their register by the prologue.  */
+        if (regalloc_variable_is_argument (regalloc, interval->var_node))
+        {
+            interval->start = 0;
+        }
+
+        if (regalloc->has_labels)
+        {
+            interval->start = 0;
+            interval->end = regalloc->position;
+        }
+        regalloc_extend_for_loops (regalloc, interval);
+        sorted[total_sorted++] = interval;
+    }
+
+    qsort (sorted, total_sorted, sizeof (struct regalloc_interval*),
+           regalloc_compare_start);
+
+    /* Active intervals, ordered by increasing end.  */
+    struct regalloc_interval* active[REGALLOC_MAX_REGISTERS];
+    int total_active = 0;
+    int free_registers = (1 << regalloc->total_registers) - 1;
+    for (int i = 0; i < total_sorted; i++)
+    {
+        struct regalloc_interval* interval = sorted[i];
+
+        /* Expire the intervals that ended before this one starts.  */
+        int kept = 0;
+        for (int j = 0; j < total_active; j++)
+        {
+            if (active[j]->end < interval->start)
+            {
+                free_registers |= 1 << regalloc_register_index (active[j]->reg);
+                continue;
+            }
+            active[kept++] = active[j];
+        }
+        total_active = kept;
+
+        if (total_active == regalloc->total_registers)
+        {
+            /* Spill whichever lives the longest.  */
+            struct regalloc_interval* spill = active[total_active - 1];
+            if (spill->end <= interval->end)
+            {
+                continue;
+            }
+
+            interval->reg = spill->reg;
+            spill->reg = NULL;
+            total_active--;
+        }
+        else
+        {
+            int index = 0;
+            while (!(free_registers & (1 << index)))
+            {
+                index++;
+            }
+            free_registers &= ~(1 << index);
+            interval->reg = regalloc_register_name (index);
+        }
+
+        int insert_at = total_active;
+        while (insert_at > 0 && active[insert_at - 1]->end > interval->end)
+        {
+            active[insert_at] = active[insert_at - 1];
+            insert_at--;
+        }
+        active[insert_at] = interval;
+        total_active++;
+        regalloc->used_registers |= 1 << regalloc_register_index (interval->reg);
+    }
+
+    free (sorted);
+}
+
+const char*
+regalloc_register_for_variable (struct regalloc* regalloc, struct node* var_node)
+{
+    if (regalloc->state == REGALLOC_STATE_COLLECT)
+    {
+        return NULL;
+    }
+
+    struct regalloc_interval* interval = \
+                        regalloc_interval_for_variable (regalloc, var_node);
+    return interval && !interval->address_taken ? interval->reg : NULL;
+}
+
+/* A register for a temporary, free of variables at the current
+   position.  Returns NULL if the temporary must go on the stack.  */
+const char*
+regalloc_temporary_acquire (struct regalloc* regalloc)
+{
+    if (regalloc->state == REGALLOC_STATE_COLLECT)
+    {
+        return NULL;
+    }
+
+    int taken = regalloc->temporaries_in_use;
+    for (int i = 0; i < vector_count (regalloc->intervals); i++)
+    {
+        struct regalloc_interval* interval = \
+                        vector_peek_ptr_at (regalloc->intervals, i);
+        if (interval->reg && interval->start <= regalloc->position && \
+            interval->end >= regalloc->position)
+        {
+            taken |= 1 << regalloc_register_index (interval->reg);
+        }
+    }
+
+    for (int i = 0; i < regalloc->total_registers; i++)
+    {
+        if (!(taken & (1 << i)))
+        {
+            regalloc->temporaries_in_use |= 1 << i;
+            regalloc->used_registers |= 1 << i;
+            return regalloc_register_name (i);
+        }
+    }
+
+    return NULL;
+}
+
+void
+regalloc_temporary_release (struct regalloc* regalloc, const char* reg)
+{
+    int index = regalloc_register_index (reg);
+    assert (regalloc->temporaries_in_use & (1 << index));
+    regalloc->temporaries_in_use &= ~(1 << index);
+}
@@ -140,6 +140,7 @@ scope_finish (struct compile_process* process)
 {
     struct scope* new_current_scope = process->scope.current->parent;
     scope_dealloc(process->scope.current);
+    process->scope.current = new_current_scope;
     if (process->scope.root && !process->scope.current)
     {
         process->scope.root = NULL;
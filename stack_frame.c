@@ -2,10 +2,15 @@
 #include "helpers/vector.h"
 #include <assert.h>
 
+/* The frame is a stack of ranges, every push or subtraction of the
+   stack pointer is one element however many bytes it takes.  */
+
 void
 stack_frame_pop (struct node* func_node)
 {
     struct stack_frame* frame = &func_node->func.frame;
+    struct stack_frame_element* element = vector_back (frame->elements);
+    frame->size -= element->size;
     vector_pop (frame->elements);
 }
 
@@ -21,7 +26,7 @@ stack_frame_back_expect (struct node* func_node, int expecting_type,
                          const char* expecting_name)
 {
     struct stack_frame_element* element = stack_frame_back (func_node);
-    if (element && element->type != expecting_type || \
+    if (!element || element->type != expecting_type || \
         !S_EQ (element->name, expecting_name))
     {
         return NULL;
@@ -40,6 +45,8 @@ stack_frame_pop_expecting (struct node* func_node, int expecting_type,
     assert (last_element);
     assert (last_element->type == expecting_type && \
             S_EQ (last_element->name, expecting_name));
+    frame->size -= last_element->size;
+    vector_pop (frame->elements);
 }
 
 void
@@ -62,10 +69,14 @@ stack_frame_push (struct node* func_node,
                        struct stack_frame_element* element)
 {
     struct stack_frame* frame = &func_node->func.frame;
+    if (!element->size)
+    {
+        element->size = STACK_PUSH_SIZE;
+    }
 
     /* The stack grows downwards.  */
-    element->offset_from_bp = \
-                -(vector_count (frame->elements) * STACK_PUSH_SIZE);
+    element->offset_from_bp = -(int) frame->size;
+    frame->size += element->size;
     vector_push (frame->elements, element);
 }
 
@@ -75,28 +86,40 @@ stack_frame_sub (struct node* func_node, int type,
 {
     /* Check alignment.  */
     assert ((amount % STACK_PUSH_SIZE) == 0);
-    /* How many pushes we need to do, to achieve this "amount" of
-       stack subtraction.  E.g., 4 = 16 / 4  */
-    size_t total_pushes = amount / STACK_PUSH_SIZE;
-    for (size_t i = 0; i < total_pushes; i++)
+    if (!amount)
     {
-        stack_frame_push (func_node, &(struct stack_frame_element)
-        {
-            .type=type,
-            .name=name
-        });
+        return;
     }
+
+    stack_frame_push (func_node, &(struct stack_frame_element)
+    {
+        .type=type,
+        .name=name,
+        .size=amount
+    });
 }
 
+/* Gives back `amount` bytes from the top, the last range shrinks
+   when only part of it goes.  */
 void
 stack_frame_add (struct node* func_node, int type,
                 const char* name, size_t amount)
 {
     /* Check alignment.  */
     assert ((amount % STACK_PUSH_SIZE) == 0);
-    size_t total_pushes = amount / STACK_PUSH_SIZE;
-    for (size_t i = 0; i < total_pushes; i++)
+    struct stack_frame* frame = &func_node->func.frame;
+    while (amount)
     {
+        struct stack_frame_element* element = stack_frame_back (func_node);
+        assert (element);
+        if (element->size > amount)
+        {
+            element->size -= amount;
+            frame->size -= amount;
+            return;
+        }
+
+        amount -= element->size;
         stack_frame_pop (func_node);
     }
 }
@@ -106,4 +129,33 @@ stack_frame_assert_empty (struct node* func_node)
 {
     struct stack_frame* frame = &func_node->func.frame;
     assert (vector_count (frame->elements) == 0);
+}
+
+/* The element covering `offset`, NULL when it is outside the frame.
+   Offsets go down as elements are pushed, so it is a binary search.  */
+struct stack_frame_element*
+stack_frame_find (struct node* func_node, int offset)
+{
+    struct vector* elements = func_node->func.frame.elements;
+    int low = 0;
+    int high = vector_count (elements) - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        struct stack_frame_element* element = vector_at (elements, middle);
+        if (offset >= element->offset_from_bp)
+        {
+            high = middle - 1;
+        }
+        else if (offset < element->offset_from_bp - (int) element->size)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return element;
+        }
+    }
+
+    return NULL;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+/* exit: 0 */
+int
+main ()
+{
+    int a = 7;
+    int b = -3;
+    unsigned int u = 4000000000;
+    unsigned char uc = 250;
+    char c = 'A';
+    if (a + b != 4 || a - b != 10 || a * b != -21) return 1;
+    if (a / b != -2 || a % b != 1 || b / 2 != -1 || b % 2 != -1) return 2;
+    if (u / 3 != 1333333333 || u % 7 != 3 || u >> 30 != 3) return 3;
+    if ((b >> 1) != -2 || (a << 3) != 56) return 4;
+    if ((a & 3) != 3 || (a | 8) != 15 || (a ^ 5) != 2 || ~a != -8) return 5;
+    if (!(b < a) || b > a || a <= b || !(a >= 7) || a == b || !(a != b)) return 6;
+    if (!(u > 5) || (b < u) != 0) return 7;
+    uc = uc + 10;
+    if (uc != 4) return 8;
+    c += 2;
+    if (c != 'C' || 'z' - 1 != 'y') return 9;
+    int x = 100;
+    x += 5; x -= 3; x *= 4; x /= 3; x %= 100; x <<= 2; x >>= 1; x |= 1; x &= ~2; x ^= 64;
+    if (x != 9) return 10;
+    int i = 5;
+    int pre = ++i;
+    int post = i++;
+    if (pre != 6 || post != 6 || i != 7 || --i != 6 || i-- != 6 || i != 5) return 11;
+    if (-(-a) != 7 || !a != 0 || !0 != 1) return 12;
+    int neg = -2147483647 - 1;
+    if (neg >= 0 || neg + 2147483647 != -1) return 13;
+    short sh = -300;
+    if ((int) sh != -300 || (unsigned char) sh != 212 || (char) 200 != -56) return 14;
+    if (sizeof (int) != 4 || sizeof (char) != 1 || sizeof (short) != 2) return 15;
+    int d = -16;
+    unsigned int n = 2;
+    unsigned char k = 200;
+    long l = 1;
+    if ((d >> n) != -4 || (d << n) != -64 || (d >> l) != -8) return 16;
+    if ((k << 1) - 500 >= 0 || (k >> n) - 100 >= 0) return 17;
+    d >>= n;
+    if (d != -4) return 18;
+    return 0;
+}
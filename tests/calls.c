@@ -0,0 +1,93 @@
+/* exit: 0 */
+/* report: inline: big into main */
+/* report: inline: kept call to kept in main, noinline */
+int
+sum6 (int a, int b, int c, int d, int e, int f)
+{
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f;
+}
+
+int
+fact (int n)
+{
+    return n <= 1 ? 1 : n * fact (n - 1);
+}
+
+int
+gcd (int a, int b)
+{
+    if (b == 0)
+        return a;
+    return gcd (b, a % b);
+}
+
+int
+accumulate (int n, int total)
+{
+    if (n == 0)
+        return total;
+    return accumulate (n - 1, total + 1);
+}
+
+static int
+square (int x)
+{
+    return x * x;
+}
+
+__attribute__((noinline)) int
+noinline_sub (int a, int b)
+{
+    return a - b;
+}
+
+/* The attributes of the prototypes hold for the definitions.  */
+int big (int n) __attribute__((always_inline));
+int kept (int a) __attribute__((noinline));
+
+int
+big (int n)
+{
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if (i % 3 == 0)
+            total = total + i * 7;
+        else if (i % 3 == 1)
+            total = total - i;
+        else
+            total = total ^ (i << 2);
+    }
+    return total * 3 + n / 5 - (n % 7) * 11;
+}
+
+int
+kept (int a)
+{
+    return a + 1;
+}
+
+void
+store (int* p, int v)
+{
+    *p = v;
+}
+
+int
+main ()
+{
+    if (sum6 (1, 2, 3, 4, 5, 6) != 91) return 1;
+    if (fact (10) != 3628800) return 2;
+    if (gcd (1071, 462) != 21) return 3;
+    if (accumulate (100000, 0) != 100000) return 4;
+    if (square (9) + square (-3) != 90) return 5;
+    if (noinline_sub (3, 10) != -7) return 6;
+    int v = 0;
+    store (&v, 17);
+    if (v != 17) return 7;
+    if (sum6 (fact (3), gcd (8, 12), square (2), 0, 1, noinline_sub (1, 1)) != 31) return 8;
+    if (big (10) != 251) return 9;
+    if (kept (41) != 42) return 10;
+    return 0;
+}
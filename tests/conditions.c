@@ -0,0 +1,69 @@
+/* exit: 0 */
+/* Every operand of && and || that runs leaves its digit in `trace`,
+   in the order it ran.  */
+int trace;
+
+int
+step (int digit, int result)
+{
+    trace = trace * 10 + digit;
+    return result;
+}
+
+int
+check (int expected)
+{
+    int same = trace == expected;
+    trace = 0;
+    return same;
+}
+
+int
+main ()
+{
+    int i;
+    int n;
+    unsigned int u = 3;
+    int* p = 0;
+
+    if (step (1, 0) && step (2, 1)) return 1;
+    if (!check (1)) return 2;
+    if (!(step (1, 1) || step (2, 1))) return 3;
+    if (!check (1)) return 4;
+    if (!((step (1, 1) && step (2, 0)) || step (3, 1))) return 5;
+    if (!check (123)) return 6;
+    if ((step (1, 0) || step (2, 0)) && step (3, 1)) return 7;
+    if (!check (12)) return 8;
+    if (!(!step (1, 0) && !(step (2, 0) || step (3, 0)))) return 9;
+    if (!check (123)) return 10;
+
+    /* Unsigned and pointer compares, and operands that are constant.  */
+    if (u > -1 || u - 4 < u) return 11;
+    if (p && *p) return 12;
+    if (!(p == 0 || *p)) return 13;
+    if (0 && step (1, 1)) return 14;
+    if (1 || step (1, 1)) trace += 0;
+    if (!check (0)) return 15;
+
+    /* Loops test the whole chain on every iteration.  */
+    n = 0;
+    for (i = 0; i < 10 && step (i % 10, 1); i++)
+        n++;
+    if (n != 10 || !check (123456789)) return 16;
+    i = 0;
+    while (i < 3 || step (9, 0))
+        i++;
+    if (i != 3 || !check (9)) return 17;
+    i = 0;
+    do
+        i++;
+    while (!(i >= 4) && (i != 2 || step (2, 1)));
+    if (i != 4 || !check (2)) return 18;
+
+    /* As values they are 0 or 1.  */
+    n = (step (1, 5) && step (2, 7)) + (step (3, 0) || step (4, -2)) * 10;
+    if (n != 11 || !check (1234)) return 19;
+    n = step (1, 0) || step (2, 0) ? 3 : step (3, 4);
+    if (n != 4 || !check (123)) return 20;
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* exit: 55 */
+int
+fib (int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return fib (n - 1) + fib (n - 2);
+}
+
+int
+main ()
+{
+    int i = 0;
+    int s = 0;
+    do
+    {
+        s += i;
+        i++;
+    } while (i < 10);
+    if (s != 45) return 1;
+
+    s = 0;
+    for (i = 0; i < 10; i++)
+    {
+        if (i % 2)
+            continue;
+        if (i > 6)
+            break;
+        s = s * 10 + i;
+    }
+    if (s != 246) return 2;
+
+    i = 0;
+again:
+    i++;
+    if (i < 5)
+        goto again;
+    if (i != 5) return 3;
+
+    int n = 0;
+    while (n < 3)
+    {
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            if (k == 1)
+                continue;
+            n++;
+        }
+    }
+    if (n != 4) return 4;
+
+    int j;
+    for (i = 0, j = 10; i < j; i++, j--)
+        ;
+    if (i != 5 || j != 5) return 5;
+    if (fib (15) != 610) return 6;
+    return fib (10);
+}
@@ -0,0 +1,45 @@
+/* exit: 0 */
+struct pair
+{
+    int a;
+    int b;
+};
+
+int g;
+
+void
+bump ()
+{
+    g++;
+}
+
+int
+work (int x, int y, int* p, struct pair* s)
+{
+    int r = (x + y) * (x + y) + (y + x);
+    r += *p + *p;
+    *p = 3;
+    r += *p;
+    s->a = 5;
+    s->b = 7;
+    r += s->a * s->b;
+    g = 1;
+    bump ();
+    r += g;
+    return r;
+}
+
+int
+main ()
+{
+    int v = 10;
+    struct pair s;
+    int r = work (2, 3, &v, &s);
+    if (r != 25 + 5 + 20 + 3 + 35 + 2) return 1;
+    if (v != 3 || g != 2) return 2;
+    int* alias = &v;
+    v = 1;
+    *alias = 2;
+    if (v != 2) return 3;
+    return 0;
+}
@@ -0,0 +1,24 @@
+/* exit: 0 */
+int
+main ()
+{
+    int i;
+    int s = 0;
+    unsigned int u = 0;
+    for (i = -1000; i < 1000; i += 7)
+    {
+        s += i / 3 + i % 3 + i / 7 - i % 10 + i / 16 + i % 16 + i / -5;
+    }
+    if (s != -139) return 1;
+    unsigned int x;
+    for (x = 4294967295; x > 4000000000; x -= 12345677)
+    {
+        u += x / 3 + x % 7 + x / 10 + x % 1021 + x / 16 + x % 32;
+    }
+    if (u != 2175976772) return 2;
+    int big = 2147483647;
+    int small = -2147483647 - 1;
+    if (big / 7 != 306783378 || small / 7 != -306783378 || small % 7 != -2) return 3;
+    if (big / 1 != big || small / 2 != -1073741824) return 4;
+    return 0;
+}
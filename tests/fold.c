@@ -0,0 +1,32 @@
+/* exit: 0 */
+/* report: fold: 122 nodes eliminated, 5 constants propagated */
+int big = 4 * 1024;
+short negative = -3;
+char truncated = (char) 300;
+int table[5] = {1 << 4, 100 / 7, 100 % 7, -(~5), !0 + !7};
+
+int
+divide (int a, int b)
+{
+    return a / b;
+}
+
+int
+main ()
+{
+    const int width = 6;
+    const int height = width * 2 - 1;
+    const int kept = 3;
+    const int* p = &kept;
+    if (big != 4096 || negative != -3 || truncated != 44) return 1;
+    if (table[0] != 16 || table[1] != 14 || table[2] != 2) return 2;
+    if (table[3] != 6 || table[4] != 1) return 3;
+    if (width * height != 66 || height - width != 5) return 4;
+    if (2147483647 + 1 != -2147483647 - 1 || -2147483647 - 1 >> 4 != -134217728) return 5;
+    if ((short) 70000 != 4464 || (unsigned char) -1 != 255) return 6;
+    if ((1 ? 10 : divide (1, 0)) != 10 || (0 && divide (1, 0)) || !(1 || divide (1, 0))) return 7;
+    if ((divide (1, 1), 5) != 5 || (7 < 3) + (3 <= 3) * 2 + (5 == 5) * 4 != 6) return 8;
+    if ((0 ? 1 : 2) * (((3))) != 6) return 9;
+    if (*p + kept != 6) return 10;
+    return 0;
+}
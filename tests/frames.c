@@ -0,0 +1,137 @@
+/* exit: 0 */
+/* frame: mix 0 */
+
+int fill (int* p, int n, int v)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        p[i] = v + i;
+    }
+    return p[n - 1];
+}
+
+int sum (int* p, int n)
+{
+    int s;
+    int i;
+    s = 0;
+    for (i = 0; i < n; i++)
+    {
+        s = s + p[i];
+    }
+    return s;
+}
+
+/* Two arrays in sibling scopes may share their bytes.  */
+int siblings (int which)
+{
+    int r;
+    r = 0;
+    if (which)
+    {
+        int a[16];
+        fill (a, 16, 1);
+        r = sum (a, 16);
+    }
+    else
+    {
+        int b[16];
+        fill (b, 16, 2);
+        r = sum (b, 16);
+    }
+    return r;
+}
+
+/* `carried` keeps its contents from one iteration to the next while
+   `scratch` is written and read within each.  */
+int carried (int n)
+{
+    int keep[4];
+    int i;
+    keep[0] = 0;
+    for (i = 0; i < n; i++)
+    {
+        int scratch[4];
+        scratch[0] = i;
+        scratch[1] = keep[0];
+        keep[0] = scratch[0] + scratch[1];
+    }
+    return keep[0];
+}
+
+int* saved;
+
+int remember (int* p)
+{
+    saved = p;
+    return 0;
+}
+
+/* The address of `kept` escapes, it must not share with `other`.  */
+int escaped ()
+{
+    int kept[2];
+    int other[2];
+    kept[0] = 7;
+    remember (kept);
+    other[0] = 9;
+    other[1] = 9;
+    sum (other, 2);
+    return saved[0];
+}
+
+/* A leaf whose locals all live in registers needs no frame.  */
+int mix (int a, int b)
+{
+    int x;
+    int y;
+    x = a * 31 + b;
+    y = x ^ (x >> 7);
+    return y + x;
+}
+
+/* Past the register arguments of both targets, read from the
+   caller's frame by a leaf without one of its own.  */
+__attribute__((noinline)) int
+stacked (int a, int b, int c, int d, int e, int f, int g, int h)
+{
+    int* p;
+    p = &h;
+    return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * *p;
+}
+
+int main ()
+{
+    if (siblings (1) != 136)
+    {
+        return 1;
+    }
+
+    if (siblings (0) != 152)
+    {
+        return 2;
+    }
+
+    if (carried (5) != 10)
+    {
+        return 3;
+    }
+
+    if (escaped () != 7)
+    {
+        return 4;
+    }
+
+    if (mix (3, 4) != 194)
+    {
+        return 5;
+    }
+
+    if (stacked (1, 2, 3, 4, 5, 6, 7, 8) != 204)
+    {
+        return 6;
+    }
+
+    return 0;
+}
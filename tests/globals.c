@@ -0,0 +1,51 @@
+/* exit: 55 */
+struct pt
+{
+    char tag;
+    int x;
+    short y;
+};
+
+int counter;
+int table[8] = {1, 2, 4, 8, 16, 32, 64 * 2, (1 << 12) - 1};
+const short squares[] = {0, 1, 4, 9, 16, 25, -36};
+char name[8] = "hello";
+int grid[2][3] = {{1, 2, 3}, {4, 5}};
+struct pt origin = {'o', -5, 7};
+struct pt pts[3] = {{'p', 1, 1}, {'q', 2, 2}};
+int value = 42;
+int* pvalue = &value;
+int* pend = table + 7;
+const char* names[] = {"zero", "one", "two"};
+const int limit = 6;
+
+/* Named like registers and assembler keywords.  */
+char ch = 'c';
+short ax;
+long rax = 7;
+int* dword = &value;
+
+__attribute__((noinline)) int
+cl (int x)
+{
+    return x + ch;
+}
+
+int
+main ()
+{
+    int i;
+    for (i = 0; i < limit; i++)
+        counter += table[i];
+    if (counter != 63 || table[7] != 4095) return 1;
+    if (squares[6] != -36 || sizeof (squares) != 14) return 2;
+    if (name[1] != 'e' || name[5] != 0 || name[7] != 0) return 3;
+    if (grid[1][1] != 5 || grid[1][2] != 0) return 4;
+    if (origin.tag != 'o' || origin.x != -5 || origin.y != 7) return 5;
+    if (pts[1].tag != 'q' || pts[2].x != 0) return 6;
+    if (*pvalue != 42 || *pend != 4095) return 7;
+    if (names[2][1] != 'w') return 8;
+    ax = rax + *dword;
+    if (cl (1) != 'd' || ax != 49 || cl (0) != 'c') return 9;
+    return 55;
+}
@@ -0,0 +1,58 @@
+/* exit: 0 */
+/* frame: leaf 65536 */
+
+/* A leaf with a large frame, addressed from the stack pointer when
+   the frame pointer is omitted.  */
+int
+leaf (int n)
+{
+    char buf[65536];
+    int i;
+    for (i = 0; i < 65536; i++)
+        buf[i] = n;
+    return buf[65535] + buf[4096];
+}
+
+int
+sum (char* p, int n)
+{
+    int s = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        s += p[i];
+    return s;
+}
+
+/* Blocks give back part of the frame when they end.  */
+int
+blocks (int which)
+{
+    int r = 1;
+    char small[3];
+    small[0] = 1;
+    small[1] = 2;
+    small[2] = 3;
+    if (which)
+    {
+        char big[100000];
+        big[0] = 5;
+        big[99999] = 6;
+        r = sum (big, 1) + big[99999] + sum (small, 3);
+    }
+    else
+    {
+        int words[5000];
+        words[4999] = 7;
+        r = words[4999] + sum (small, 2);
+    }
+    return r + small[2];
+}
+
+int
+main ()
+{
+    if (leaf (3) != 6) return 1;
+    if (blocks (1) != 20) return 2;
+    if (blocks (0) != 13) return 3;
+    return 0;
+}
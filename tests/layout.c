@@ -0,0 +1,55 @@
+/* exit: 0 */
+/* report: layout: scan: 1 loops rotated, 1 unlikely blocks moved */
+char text[] = "rotate, then lay out; unlikely: last";
+
+/* The length of `s` up to the first `stop`, or -1 when a character
+   less than a space comes first.  */
+int
+scan (char* s, char stop)
+{
+    int n = 0;
+    while (s[n] != stop)
+    {
+        if (__builtin_expect (s[n] < ' ', 0))
+            return -1;
+        n++;
+    }
+    return n;
+}
+
+int
+main ()
+{
+    int i;
+    int s = 0;
+    int n = 0;
+    if (scan (text, ',') != 6 || scan (text, ';') != 20) return 1;
+    text[3] = '\n';
+    if (scan (text, ',') != -1) return 2;
+
+    /* Loops that never run, stop early and skip some iterations.  */
+    for (i = 10; i < 10; i++)
+        s++;
+    if (s != 0) return 3;
+    for (i = 0; i < 100; i++)
+    {
+        if (i % 3 == 0)
+            continue;
+        if (i > 20)
+            break;
+        s += i;
+    }
+    if (s != 147 || i != 22) return 4;
+    while (n < s)
+        n += 7;
+    if (n != 147) return 5;
+
+    /* The hint is a value, not just 0 or 1, and it may be wrong.  */
+    if (__builtin_expect (n, 140) != 147) return 6;
+    if (__builtin_expect (n == 147, 0))
+        s = 1;
+    else
+        return 7;
+    if (!__builtin_expect (s, 1)) return 8;
+    return 0;
+}
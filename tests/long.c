@@ -0,0 +1,73 @@
+/* exit: 20 */
+/* requires: x86-64 */
+long g = 5000000000;
+long arr[4] = {1, -2, 3000000000, 4};
+long shifted = (long) 3 << 40;
+long product = 100000 * (long) 100000;
+long wide = 3000000000 * 3;
+int narrowed = (int) ((long) 1 << 33 | 5);
+
+long
+fact (long n)
+{
+    return n <= 1 ? 1 : n * fact (n - 1);
+}
+
+int
+compare (long a, long b)
+{
+    return (a < b) + 2 * (a == b) + 4 * (a > b);
+}
+
+/* Divisions by constants, done with the high half of a multiply.  */
+__attribute__((noinline)) unsigned long
+unsigned_divide (unsigned long x)
+{
+    return x / 1021;
+}
+
+__attribute__((noinline)) unsigned long
+unsigned_modulo (unsigned long x)
+{
+    return x % 1021;
+}
+
+__attribute__((noinline)) long
+signed_divide (long x)
+{
+    return x / 7 + x / 1000003 * 1000;
+}
+
+__attribute__((noinline)) long
+signed_modulo (long x)
+{
+    return x % 7 + x % -1000003 * 10;
+}
+
+int
+main ()
+{
+    long a = 123456789012;
+    long b = -a;
+    unsigned int u = 4000000000;
+    if (a / 1000 % 97 != 39) return 1;
+    if (fact (20) != 2432902008176640000) return 2;
+    if (g * 3 != 15000000000) return 3;
+    if (compare (a, b) != 4 || compare (b, a) != 1 || compare (a, a) != 2) return 4;
+    if ((long) u != 4000000000 || (long) -7 + u != 3999999993) return 5;
+    if (arr[2] != 3000000000 || &arr[3] - &arr[0] != 3) return 6;
+    if (sizeof (long) != 8 || sizeof (long*) != 8) return 7;
+    if (shifted != 3298534883328 || product != 10000000000) return 9;
+    if (wide != 9000000000 || narrowed != 5) return 10;
+    if (a + ((long) 1 << 35) != 157816527380) return 11;
+    if (unsigned_divide ((unsigned long) -59) != 18067330140753723 || \
+        unsigned_modulo ((unsigned long) -59) != 374) return 12;
+    if (signed_divide (b) != -17636684144 - 123456000 || \
+        signed_modulo (b) != -4 - 4186440) return 13;
+    long sum = 0;
+    int k;
+    for (k = 0; k < 100000; k++)
+        sum += k * (long) k;
+    if (sum != 333328333350000) return 8;
+    return (int) (a % 256);
+}
@@ -0,0 +1,16 @@
+/* exit: 0 */
+
+/* Compiled by gcc, see narrow_gcc.c.  */
+char narrow_char (int x);
+unsigned short narrow_short (int x);
+
+int
+main ()
+{
+    int c = narrow_char (511);
+    int s = narrow_short (-1);
+    if (c != -1) return 1;
+    if (s != 65535) return 2;
+    if (narrow_char (384) >= 0 || narrow_short (196607) != 65535) return 3;
+    return 0;
+}
@@ -0,0 +1,13 @@
+/* Built with gcc and linked with narrow.c.  gcc leaves the bits of a
+   char or short result above its width as they are.  */
+char
+narrow_char (int x)
+{
+    return x;
+}
+
+unsigned short
+narrow_short (int x)
+{
+    return x;
+}
@@ -0,0 +1,19 @@
+/* error: Passing structures by value is not supported */
+/* requires: ir */
+
+struct pair
+{
+    int first;
+    int second;
+    char tag;
+};
+
+int sum (struct pair p)
+{
+    return p.first + p.second + p.tag;
+}
+
+int main ()
+{
+    return 0;
+}
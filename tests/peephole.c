@@ -0,0 +1,91 @@
+/* exit: 0 */
+union word
+{
+    int i;
+    char c;
+};
+
+int cells[4];
+
+int
+add3 (int a, int b, int c)
+{
+    return a + b * 2 + c * 3;
+}
+
+/* A byte store between does not let the dword load reuse a register.  */
+int
+partial (union word* w)
+{
+    w->i = 0x01020304;
+    w->c = 9;
+    return w->i;
+}
+
+/* The same operand names different memory once its base changed.  */
+int
+chase (int*** p)
+{
+    return ***p;
+}
+
+int
+aliased (int* a, int* b)
+{
+    *a = 1;
+    *b = 2;
+    return *a;
+}
+
+/* Stored and read back at once while its address is out.  */
+int
+forward (int a)
+{
+    int t;
+    int* q = &t;
+    t = a;
+    t = t + 1;
+    *q = *q * 2;
+    return t;
+}
+
+int
+nested (int a, int b)
+{
+    return (a + b) * (a - b) + (a * (b + (a - (b * 2))));
+}
+
+int
+branches (int x)
+{
+    int r = 0;
+    if (x > 3)
+        r = 1;
+    else if (x < -3)
+        r = 2;
+    while (x > 0)
+    {
+        if (x == 5)
+            break;
+        x--;
+    }
+    return r * 10 + x;
+}
+
+int
+main ()
+{
+    union word w;
+    int v = 7;
+    int* pv = &v;
+    int** ppv = &pv;
+    if (add3 (1, 2, 3) + add3 (4, 5, 6) != 46) return 1;
+    if (add3 (add3 (1, 1, 1), 2, add3 (0, 0, 1)) != 19) return 2;
+    if (partial (&w) != 0x01020309) return 3;
+    if (chase (&ppv) != 7) return 4;
+    if (aliased (&cells[1], &cells[1]) != 2 || aliased (cells, cells + 1) != 1) return 5;
+    if (forward (4) != 10) return 8;
+    if (nested (7, 3) != 40 + 7 * (3 + (7 - 6))) return 6;
+    if (branches (9) != 15 || branches (-5) != 15 || branches (2) != 0) return 7;
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* exit: 6 */
+int table[8];
+
+void
+reverse (char* s)
+{
+    char* e = s;
+    while (*e)
+        e++;
+    e--;
+    while (s < e)
+    {
+        char t = *s;
+        *s = *e;
+        *e = t;
+        s++;
+        e--;
+    }
+}
+
+void
+swap (int* a, int* b)
+{
+    int t = *a;
+    *a = *b;
+    *b = t;
+}
+
+int
+main ()
+{
+    int v[5];
+    int* p = v;
+    int i;
+    for (i = 0; i < 5; i++)
+        v[i] = i * i;
+    if (*(p + 3) != 9 || p[4] != 16 || &v[4] - p != 4) return 1;
+    p += 2;
+    if (*p++ != 4 || *p != 9 || *--p != 4) return 2;
+
+    int a = 1;
+    int b = 2;
+    swap (&a, &b);
+    if (a != 2 || b != 1) return 3;
+
+    int m[3][4];
+    int j;
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 4; j++)
+            m[i][j] = i * 10 + j;
+    if (m[2][3] != 23 || m[1][0] != 10) return 4;
+
+    char buf[8];
+    char* src = "abcde";
+    for (i = 0; src[i]; i++)
+        buf[i] = src[i];
+    buf[i] = 0;
+    reverse (buf);
+    if (buf[0] != 'e' || buf[4] != 'a' || buf[5] != 0) return 5;
+
+    int* q = table;
+    int** pq = &q;
+    (*pq)[6] = 6;
+    return table[6];
+}
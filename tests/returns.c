@@ -0,0 +1,73 @@
+/* exit: 17 */
+/* requires: ir */
+struct pair
+{
+    int a;
+    short b;
+};
+
+struct tag
+{
+    char c;
+};
+
+struct pair global_pair;
+
+/* Compiled by gcc, see returns_gcc.c.  */
+struct pair theirs (int a, int b);
+int call_ours ();
+
+struct pair
+make (int a, int b)
+{
+    struct pair p;
+    p.a = a;
+    p.b = b;
+    return p;
+}
+
+struct pair
+copy ()
+{
+    global_pair.a = 8;
+    global_pair.b = 9;
+    return global_pair;
+}
+
+struct pair
+make_many (int a, int b, int c, int d, int e)
+{
+    struct pair p;
+    p.a = a + b + c;
+    p.b = d + e;
+    return p;
+}
+
+struct pair
+make_variadic (int n, ...)
+{
+    struct pair p;
+    p.a = n * 3;
+    p.b = n + 1;
+    return p;
+}
+
+struct tag
+make_tag (char c)
+{
+    struct tag t;
+    t.c = c;
+    return t;
+}
+
+int
+main ()
+{
+    if (make (4, -5).a != 4 || make (4, -5).b != -5) return 1;
+    if (copy ().a != 8 || copy ().b != 9) return 2;
+    if (make_many (1, 2, 3, 4, 5).a != 6 || make_many (1, 2, 3, 4, 5).b != 9) return 3;
+    if (make_variadic (4, 1, 2).a != 12 || make_variadic (4).b != 5) return 4;
+    if (theirs (4, 5).a != 8 || theirs (4, 5).b != 15) return 5;
+    if (call_ours () != 3121) return 6;
+    return make_tag (17).c;
+}
@@ -0,0 +1,36 @@
+/* Built with gcc and linked with returns.c, to check that structures
+   are returned the way the ABI of the target says.  */
+struct pair
+{
+    int a;
+    short b;
+};
+
+struct tag
+{
+    char c;
+};
+
+struct pair make (int a, int b);
+struct pair make_many (int a, int b, int c, int d, int e);
+struct pair make_variadic (int n, ...);
+struct tag make_tag (char c);
+
+struct pair
+theirs (int a, int b)
+{
+    struct pair p;
+    p.a = a * 2;
+    p.b = b * 3;
+    return p;
+}
+
+int
+call_ours (void)
+{
+    struct pair p = make (1, 2);
+    struct pair q = make_many (1, 0, 0, 1, 2);
+    struct pair r = make_variadic (0, 5);
+    return p.a + p.b * 10 + q.a * 100 + q.b * 1000 + r.a + r.b - 1 + \
+           make_tag (0).c;
+}
@@ -0,0 +1,127 @@
+#!/bin/sh
+# Compiles each program in this directory with ../main, links it with
+# start.c and checks its exit code against the `exit:` line at its top.
+# Every program is built once per set of flags below, for both
+# targets.  Those marked `requires: x86-64` are only built with -m64,
+# those marked `requires: ir` never with -fno-ir.  The tree code
+# generator -fno-ir selects only targets x86.  A program `name.c` may
+# come with a `name_gcc.c`, built with gcc and linked with it, to
+# check that both agree on the ABI.  A line `frame: function bytes`
+# gives the frame -freport has to show for a leaf function built with
+# -fomit-frame-pointer, a line `report: text` a line -freport has to
+# start with when built without flags.  A program with a line
+# `error: text` has to be rejected with that message instead.
+
+cd "$(dirname "$0")"
+out=../build/tests
+mkdir -p $out
+
+total=0
+failed=0
+
+check ()
+{
+    name=$1
+    target=$2
+    flags=$3
+    expected=$4
+    binary=$out/$name$target
+    total=$((total + 1))
+    if [ "$target" = "64" ]; then
+        flags="-m64 $flags"
+        linker="ld -m elf_x86_64"
+    else
+        linker="ld -m elf_i386"
+    fi
+
+    error=$(sed -n 's/^\/\* error: \(.*\) \*\/$/\1/p' $name.c)
+    if [ -n "$error" ]; then
+        if ../main $flags $name.c $binary.o > $binary.log 2>&1 || \
+           ! grep -q "^$error" $binary.log; then
+            echo "FAIL $name ($target $flags): not rejected with \"$error\""
+            failed=$((failed + 1))
+        fi
+        return
+    fi
+
+    if ! ../main -freport $flags $name.c $binary.o > $binary.log 2>&1 || \
+       ! grep -q "Everthing looks good" $binary.log; then
+        echo "FAIL $name ($target $flags): does not compile"
+        failed=$((failed + 1))
+        return
+    fi
+
+    if [ -z "$3" ]; then
+        sed -n 's/^\/\* report: \(.*\) \*\/$/\1/p' $name.c | \
+        while read text; do
+            if ! grep -q "^$text" $binary.log; then
+                echo "FAIL $name ($target $flags): no report \"$text\""
+                exit 1
+            fi
+        done || failed=$((failed + 1))
+    fi
+
+    if [ "$3" = "-fomit-frame-pointer" ]; then
+        sed -n 's/^\/\* frame: \([^ ]*\) \([0-9]*\) \*\/$/\1 \2/p' $name.c | \
+        while read function bytes; do
+            if ! grep -q "^stack: $function: $bytes bytes" $binary.log; then
+                echo "FAIL $name ($target $flags): frame of $function is not $bytes bytes"
+                exit 1
+            fi
+        done || failed=$((failed + 1))
+    fi
+
+    objects="$binary.o $out/start$target.o"
+    if [ -f ${name}_gcc.c ]; then
+        objects="$objects $binary.gcc.o"
+        gcc -m$target -O2 -fno-pie -fno-stack-protector -c ${name}_gcc.c \
+            -o $binary.gcc.o
+    fi
+
+    if ! $linker -e _start $objects -o $binary; then
+        echo "FAIL $name ($target $flags): does not link"
+        failed=$((failed + 1))
+        return
+    fi
+
+    ./$binary
+    code=$?
+    if [ $code -ne $expected ]; then
+        echo "FAIL $name ($target $flags): exit code $code, expected $expected"
+        failed=$((failed + 1))
+    fi
+}
+
+requires ()
+{
+    grep -q "^/\* requires: $1 \*/$" $source
+}
+
+gcc -m32 -O1 -ffreestanding -fno-pie -fno-stack-protector -c start.c -o $out/start32.o || exit 1
+gcc -m64 -O1 -ffreestanding -fno-pie -fno-stack-protector -c start.c -o $out/start64.o || exit 1
+
+for source in *.c; do
+    name=${source%.c}
+    case $name in
+        start|*_gcc)
+            continue
+            ;;
+    esac
+
+    expected=$(sed -n 's/^\/\* exit: \([0-9]*\) \*\/$/\1/p' $source)
+    for flags in "" "-fno-ir" "-fno-regalloc" "-fomit-frame-pointer" \
+                 "-fno-inline -fno-loop-optimize -fno-cse -fno-peephole"; do
+        if [ "$flags" = "-fno-ir" ] && requires ir; then
+            continue
+        fi
+        if ! requires x86-64; then
+            check $name 32 "$flags" $expected
+        fi
+        if [ "$flags" != "-fno-ir" ]; then
+            check $name 64 "$flags" $expected
+        fi
+    done
+done
+
+echo "$((total - failed)) of $total passed"
+[ $failed -eq 0 ]
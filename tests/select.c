@@ -0,0 +1,47 @@
+/* exit: 0 */
+int calls;
+
+int
+touch (int v)
+{
+    calls++;
+    return v;
+}
+
+int
+maximum (int a, int b)
+{
+    return a > b ? a : b;
+}
+
+int
+clamp (int v, int lo, int hi)
+{
+    if (v < lo)
+        v = lo;
+    if (v > hi)
+        v = hi;
+    return v;
+}
+
+int
+in_range (int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+int
+main ()
+{
+    if (maximum (3, 9) != 9 || maximum (-3, -9) != -3) return 1;
+    if (clamp (-5, 0, 10) != 0 || clamp (50, 0, 10) != 10 || clamp (5, 0, 10) != 5) return 2;
+    if (!in_range ('q') || !in_range ('7') || !in_range ('_') || in_range ('Q')) return 3;
+    if (touch (0) && touch (1)) return 4;
+    if (calls != 1) return 5;
+    if (touch (1) || touch (1)) calls += 10;
+    if (calls != 12) return 6;
+    int a = 4;
+    int b = (a > 3 && a < 10) + (a == 2 || a == 4) * 2;
+    if (b != 3) return 7;
+    return 0;
+}
@@ -0,0 +1,17 @@
+/* Entry point of the programs `make check` runs.  They are linked
+   without a C library, the exit code of `main` is their result.  */
+int main ();
+
+void
+_start (void)
+{
+    int code = main ();
+#ifdef __x86_64__
+    __asm__ volatile ("syscall" : : "a" (60), "D" (code));
+#else
+    __asm__ volatile ("int $0x80" : : "a" (1), "b" (code));
+#endif
+    for (;;)
+    {
+    }
+}
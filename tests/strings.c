@@ -0,0 +1,35 @@
+/* exit: 3 */
+int
+length (char* s)
+{
+    int n = 0;
+    while (s[n])
+        n++;
+    return n;
+}
+
+int
+count (char* s, char c)
+{
+    int n = 0;
+    for (; *s; s++)
+        if (*s == c)
+            n++;
+    return n;
+}
+
+int
+main ()
+{
+    char* tab = "a\tb\n";
+    char* quoted = "it's \"quoted\"";
+    if (length (tab) != 4 || tab[1] != 9 || tab[3] != 10) return 1;
+    if (length (quoted) != 13 || quoted[2] != '\'' || quoted[5] != '"') return 2;
+    if (length ("") != 0 || "xyz"[2] != 'z') return 4;
+    if ('\\' != 92 || '\0' != 0) return 5;
+    if ('\a' != 7 || '\b' != 8 || '\f' != 12 || '\v' != 11 || '\?' != 63) return 6;
+    char* escaped = "\x41\x7a\101\0012\7";
+    if (length (escaped) != 6 || escaped[0] != 'A' || escaped[1] != 'z') return 7;
+    if (escaped[2] != 'A' || escaped[3] != 1 || escaped[4] != '2' || escaped[5] != 7) return 8;
+    return count ("banana", 'a');
+}
@@ -0,0 +1,53 @@
+/* exit: 0 */
+struct point
+{
+    int x;
+    char c;
+    int y;
+};
+
+union word
+{
+    int i;
+    char b;
+};
+
+struct point gp;
+
+int
+sum (struct point* p)
+{
+    return p->x + p->y + p->c;
+}
+
+int
+main ()
+{
+    struct point p;
+    struct point* pp = &p;
+    p.x = 1;
+    p.c = 2;
+    p.y = 3;
+    pp->x = pp->x + 10;
+    if (sum (&p) != 16) return 1;
+    gp.y = 7;
+    gp.x = 1;
+    if (sum (&gp) != 8) return 2;
+
+    union word w;
+    w.i = 258;
+    if (w.b != 2) return 3;
+
+    struct point arr[3];
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        arr[i].x = i;
+        arr[i].y = i * 10;
+        arr[i].c = 0;
+    }
+    if (arr[2].y != 20 || sum (&arr[1]) != 11) return 4;
+
+    if (sizeof (struct point) != 12) return 5;
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* exit: 0 */
+int
+dense (int x)
+{
+    switch (x)
+    {
+        case 0: return 10;
+        case 1: return 11;
+        case 2: return 12;
+        case 3: return 13;
+        case 5: return 15;
+        case 6: return 16;
+        default: return -1;
+    }
+}
+
+int
+sparse (int x)
+{
+    switch (x)
+    {
+        case -1000: return 1;
+        case 7: return 2;
+        case 100: return 3;
+        case 5000: return 4;
+        case 77777: return 5;
+        case -5: return 6;
+        case 123456: return 7;
+    }
+    return 0;
+}
+
+int
+fallthrough (int x)
+{
+    int r = 0;
+    switch (x)
+    {
+        case -3: r = r + 1;
+        case -2: r = r + 2;
+        case -1: r = r + 4;
+        case 0: r = r + 8;
+            break;
+        case 1000: r = 100; break;
+        case 2000: r = 200; break;
+        default: r = 999;
+    }
+    return r;
+}
+
+int
+wide (unsigned int x)
+{
+    switch (x)
+    {
+        case 4294967295: return 1;
+        case 2147483648: return 2;
+        case 0: return 3;
+    }
+    return 0;
+}
+
+int
+main ()
+{
+    int i;
+    int s = 0;
+    for (i = -2; i < 9; i++)
+        s = s * 3 + dense (i);
+    if (s != 23306) return 1;
+    if (sparse (-1000) != 1 || sparse (77777) != 5 || sparse (123456) != 7) return 2;
+    if (sparse (-5) != 6 || sparse (8) != 0 || sparse (5001) != 0) return 3;
+    if (fallthrough (-3) != 15 || fallthrough (-1) != 12 || fallthrough (0) != 8) return 4;
+    if (fallthrough (2000) != 200 || fallthrough (1) != 999) return 5;
+    if (wide (-1) != 1 || wide (2147483648) != 2 || wide (0) != 3 || wide (5) != 0) return 6;
+    return 0;
+}
@@ -0,0 +1,76 @@
+/* exit: 0 */
+/* requires: ir */
+/* report: sibling call: odd from even */
+/* report: sibling call: count from count */
+/* Deep enough to run out of stack unless every `return f (...)`
+   reuses the frame of its caller.  */
+int odd (int n);
+
+int
+even (int n)
+{
+    if (n == 0)
+        return 1;
+    return odd (n - 1);
+}
+
+int
+odd (int n)
+{
+    if (n == 0)
+        return 0;
+    return even (n - 1);
+}
+
+int
+count (int n, int total)
+{
+    if (n == 0)
+        return total;
+    return count (n - 1, total + n % 2);
+}
+
+/* A pointer into the frame may outlive the call, so it is kept.  */
+int
+pointed (int* p, int n)
+{
+    int local = *p + n;
+    if (n == 0)
+        return local;
+    return pointed (&local, n - 1);
+}
+
+/* Fewer arguments than the callee: it may not take our frame.  */
+int
+widen (int a, int b, int c, int d, int e, int f, int g, int h)
+{
+    return a + b + c + d + e + f + g + h;
+}
+
+int
+narrow (int a)
+{
+    return widen (a, a, a, a, a, a, a, a);
+}
+
+/* Not a tail call, the result is used after it returns.  */
+int
+depth (int n)
+{
+    if (n == 0)
+        return 0;
+    return 1 + depth (n - 1);
+}
+
+int
+main ()
+{
+    int s;
+    if (even (10000000) != 1 || odd (10000001) != 1) return 1;
+    if (count (5000000, 0) != 2500000) return 2;
+    if (narrow (3) != 24) return 3;
+    if (depth (1000) != 1000) return 4;
+    s = 1;
+    if (pointed (&s, 100) != 5051) return 5;
+    return 0;
+}